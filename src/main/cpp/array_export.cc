@@ -0,0 +1,325 @@
+/**
+ * @file array_export.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Streaming export of ImageDS arrays to Zarr v2 and NPY stores
+ */
+
+
+#include "array_export.h"
+#include "json.h"
+#include "tile_layout.h"
+
+#include "tiledb_utils.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_HEADER_ALIGNMENT 64
+
+static bool host_is_little_endian() {
+  uint16_t value = 1;
+  return *reinterpret_cast<char *>(&value) == 1;
+}
+
+std::string imageds_numpy_dtype(attr_type_t type) {
+  std::string order = host_is_little_endian() ? "<" : ">";
+  switch (type) {
+    case CHAR:
+      return "|S1";
+    case INT8:
+      return "|i1";
+    case UINT8:
+      return "|u1";
+    case INT16:
+      return order + "i2";
+    case UINT16:
+      return order + "u2";
+    case INT32:
+      return order + "i4";
+    case UINT32:
+      return order + "u4";
+    case INT64:
+      return order + "i8";
+    case UINT64:
+      return order + "u8";
+    case FLOAT32:
+      return order + "f4";
+    case FLOAT64:
+      return order + "f8";
+  }
+  throw std::runtime_error("Not yet implemented!");
+}
+
+// Schema of the array and a read array holding only the selected attribute
+static int select_attribute(ImageDS& imageds, const std::string& array_path, const std::string& attribute,
+                            ImageDSArray& schema, ImageDSArray& array) {
+  RETURN_EINVAL_IF_ERROR(imageds.array_info(array_path, schema));
+  for (auto& schema_attribute : schema.m_attributes) {
+    if (attribute.empty() ? schema.m_attributes.size() == 1 : schema_attribute->m_name == attribute) {
+      array = ImageDSArray(array_path);
+      array.add_attribute(schema_attribute->m_name, schema_attribute->m_type);
+      return IMAGEDS_OK;
+    }
+  }
+  errno = EINVAL;
+  return IMAGEDS_ERR;
+}
+
+// Runs task for 0..n-1 in parallel, every thread with its own ImageDS instance as instances cannot be shared
+static int parallel_for(ImageDS& imageds, uint64_t n, const std::function<int(ImageDS&, uint64_t)>& task) {
+  std::atomic<int> status(IMAGEDS_OK);
+  std::atomic<int> saved_errno(0);
+  #pragma omp parallel
+  {
+    std::unique_ptr<ImageDS> thread_imageds;
+    try {
+      thread_imageds = std::unique_ptr<ImageDS>(new ImageDS(imageds.workspace(), false, false, true));
+    } catch (const ImageDSException& e) {
+      status = IMAGEDS_ERR;
+      saved_errno = EIO;
+    }
+    #pragma omp for schedule(dynamic)
+    for (uint64_t i=0; i<n; i++) {
+      if (status == IMAGEDS_OK) {
+        errno = 0;
+        if (task(*thread_imageds, i)) {
+          status = IMAGEDS_ERR;
+          saved_errno = errno ? errno : EIO;
+        }
+      }
+    }
+  }
+  if (status) {
+    errno = saved_errno;
+  }
+  return status;
+}
+
+int imageds_zarr_export(ImageDS& imageds, const std::string& array_path, const std::string& directory,
+                        const std::string& attribute, const std::vector<uint64_t>& chunk_shape, int zlib_level) {
+  ImageDSArray schema, array;
+  RETURN_EINVAL_IF_ERROR(select_attribute(imageds, array_path, attribute, schema, array));
+  size_t dim_num = schema.m_dimensions.size();
+  if ((!chunk_shape.empty() && chunk_shape.size() != dim_num) || zlib_level < 0 || zlib_level > 9) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<uint64_t> domain, shape, chunks, grid;
+  uint64_t chunk_num = 1;
+  for (auto i=0ul; i<dim_num; i++) {
+    ImageDSDimension *dimension = schema.m_dimensions[i].get();
+    domain.push_back(dimension->m_start);
+    domain.push_back(dimension->m_end);
+    shape.push_back(dimension->m_end - dimension->m_start + 1);
+    uint64_t chunk = chunk_shape.empty() ? dimension->m_tile_extent : chunk_shape[i];
+    if (!chunk) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    chunks.push_back(std::min(chunk, shape[i]));
+    grid.push_back((shape[i] + chunks[i] - 1)/chunks[i]);
+    chunk_num *= grid[i];
+  }
+
+  std::map<std::string, std::string> metadata;
+  RETURN_EIO_IF_ERROR(imageds.read_metadata(array_path, metadata));
+  attr_type_t type = array.m_attributes[0]->m_type;
+  auto json_list = [](const std::vector<uint64_t>& values) {
+    std::ostringstream json;
+    for (auto i=0ul; i<values.size(); i++) {
+      json << (i ? ", " : "") << values[i];
+    }
+    return "[" + json.str() + "]";
+  };
+  std::ostringstream zarray, zattrs;
+  zarray << "{\n"
+         << "    \"chunks\": " << json_list(chunks) << ",\n"
+         << "    \"compressor\": ";
+  if (zlib_level) {
+    zarray << "{\"id\": \"zlib\", \"level\": " << zlib_level << "},\n";
+  } else {
+    zarray << "null,\n";
+  }
+  zarray << "    \"dtype\": " << json_string(imageds_numpy_dtype(type)) << ",\n"
+         << "    \"fill_value\": " << (type == CHAR ? "null" : "0") << ",\n"
+         << "    \"filters\": null,\n"
+         << "    \"order\": \"C\",\n"
+         << "    \"shape\": " << json_list(shape) << ",\n"
+         << "    \"zarr_format\": 2\n"
+         << "}\n";
+  zattrs << "{\n    \"_ARRAY_DIMENSIONS\": [";
+  for (auto i=0ul; i<dim_num; i++) {
+    zattrs << (i ? ", " : "") << json_string(schema.m_dimensions[i]->m_name);
+  }
+  zattrs << "]";
+  for (auto& entry : metadata) {
+    zattrs << ",\n    " << json_string(entry.first) << ": " << json_string(entry.second);
+  }
+  zattrs << "\n}\n";
+
+  if (!TileDBUtils::is_dir(directory) && TileDBUtils::create_dir(directory)) {
+    if (!errno) errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  std::string zarray_json = zarray.str(), zattrs_json = zattrs.str();
+  RETURN_EIO_IF_ERROR(TileDBUtils::write_file(append_paths(directory, ".zarray"), zarray_json.data(),
+                                              zarray_json.size(), true));
+  RETURN_EIO_IF_ERROR(TileDBUtils::write_file(append_paths(directory, ".zattrs"), zattrs_json.data(),
+                                              zattrs_json.size(), true));
+
+  size_t cell_size = attr_type_size(type);
+  uint64_t chunk_cells = 1;
+  for (auto chunk : chunks) {
+    chunk_cells *= chunk;
+  }
+  return parallel_for(imageds, chunk_num, [&](ImageDS& thread_imageds, uint64_t chunk_id) {
+      // Chunk keys are the chunk coordinates in row-major order joined by "."
+      std::vector<uint64_t> box(dim_num*2), clipped(dim_num*2);
+      std::string key;
+      for (auto i=dim_num; i-- > 0; ) {
+        uint64_t coord = chunk_id % grid[i];
+        chunk_id /= grid[i];
+        box[i*2] = domain[i*2] + coord*chunks[i];
+        box[i*2+1] = box[i*2] + chunks[i] - 1;
+        clipped[i*2] = box[i*2];
+        clipped[i*2+1] = std::min(box[i*2+1], domain[i*2+1]);
+        key = std::to_string(coord) + (key.empty() ? "" : "." + key);
+      }
+
+      // Edge chunks are padded to the full chunk shape with the fill value
+      std::vector<char> cells(ImageDSTileLayout::cell_num(clipped)*cell_size);
+      ImageDSArray thread_array(array_path);
+      thread_array.add_attribute(array.m_attributes[0]->m_name, type);
+      RETURN_EIO_IF_ERROR(thread_imageds.from_array(thread_array, clipped, {cells.data()}, {cells.size()}));
+      if (clipped != box) {
+        std::vector<char> padded(chunk_cells*cell_size, 0);
+        copy_region(cells.data(), clipped, padded.data(), box, clipped, cell_size);
+        cells.swap(padded);
+      }
+
+      if (zlib_level) {
+        uLongf length = compressBound(cells.size());
+        std::vector<char> compressed(length);
+        if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &length,
+                      reinterpret_cast<const Bytef *>(cells.data()), cells.size(), zlib_level) != Z_OK) {
+          errno = ENOMEM;
+          return IMAGEDS_ERR;
+        }
+        compressed.resize(length);
+        cells.swap(compressed);
+      }
+      return TileDBUtils::write_file(append_paths(directory, key), cells.data(), cells.size(), true);
+    });
+}
+
+int imageds_npy_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                       const std::string& attribute) {
+  ImageDSArray schema, array;
+  RETURN_EINVAL_IF_ERROR(select_attribute(imageds, array_path, attribute, schema, array));
+  attr_type_t type = array.m_attributes[0]->m_type;
+
+  std::vector<uint64_t> subarray;
+  std::ostringstream shape;
+  for (auto i=0ul; i<schema.m_dimensions.size(); i++) {
+    ImageDSDimension *dimension = schema.m_dimensions[i].get();
+    subarray.push_back(dimension->m_start);
+    subarray.push_back(dimension->m_end);
+    shape << (i ? ", " : "") << dimension->m_end - dimension->m_start + 1;
+  }
+  if (schema.m_dimensions.size() == 1) {
+    shape << ",";
+  }
+
+  // Version 1.0 header padded with spaces so that the data is aligned
+  std::string dictionary = "{'descr': '" + imageds_numpy_dtype(type) + "', 'fortran_order': False, 'shape': ("
+      + shape.str() + "), }";
+  size_t header_length = strlen(NPY_MAGIC) + 4 + dictionary.size() + 1;
+  header_length = (header_length + NPY_HEADER_ALIGNMENT - 1)/NPY_HEADER_ALIGNMENT*NPY_HEADER_ALIGNMENT;
+  if (header_length > 65535) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  std::string header = std::string(NPY_MAGIC) + '\x01' + '\x00';
+  uint16_t dictionary_length = header_length - header.size() - 2;
+  header.push_back(dictionary_length & 0xFF);
+  header.push_back(dictionary_length >> 8);
+  header += dictionary;
+  header.resize(header_length-1, ' ');
+  header.push_back('\n');
+
+  size_t cell_size = attr_type_size(type);
+  uint64_t row_cells = ImageDSTileLayout::cell_num(subarray)/(subarray[1]-subarray[0]+1);
+  size_t data_size = ImageDSTileLayout::cell_num(subarray)*cell_size;
+  int fd = open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0) {
+    return IMAGEDS_ERR;
+  }
+  size_t length = header_length + data_size;
+  if (ftruncate(fd, length)) {
+    close(fd);
+    return IMAGEDS_ERR;
+  }
+  void *mapped = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return IMAGEDS_ERR;
+  }
+  memcpy(mapped, header.data(), header.size());
+  char *data = reinterpret_cast<char *>(mapped) + header_length;
+
+  // Tile-aligned slabs of the slowest dimension are contiguous in C order
+  uint64_t slab_extent = schema.m_dimensions[0]->m_tile_extent;
+  uint64_t slab_num = (subarray[1] - subarray[0] + slab_extent)/slab_extent;
+  std::string attribute_name = array.m_attributes[0]->m_name;
+  int rc = parallel_for(imageds, slab_num, [&](ImageDS& thread_imageds, uint64_t slab) {
+      std::vector<uint64_t> slab_subarray(subarray);
+      slab_subarray[0] = subarray[0] + slab*slab_extent;
+      slab_subarray[1] = std::min(subarray[1], slab_subarray[0]+slab_extent-1);
+      char *slab_data = data + (slab_subarray[0]-subarray[0])*row_cells*cell_size;
+      size_t slab_size = (slab_subarray[1]-slab_subarray[0]+1)*row_cells*cell_size;
+      ImageDSArray thread_array(array_path);
+      thread_array.add_attribute(attribute_name, type);
+      return thread_imageds.from_array(thread_array, slab_subarray, {slab_data}, {slab_size});
+    });
+  int saved_errno = errno;
+  if (msync(mapped, length, MS_SYNC) && !rc) {
+    saved_errno = errno;
+    rc = IMAGEDS_ERR;
+  }
+  munmap(mapped, length);
+  errno = saved_errno;
+  return rc;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file array_export.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Streaming export of ImageDS arrays to Zarr v2 and NPY stores
+ */
+
+
+#ifndef __ARRAY_EXPORT_H__
+#define __ARRAY_EXPORT_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** NumPy array-protocol type string, e.g. <u2, for the attribute type in host byte order */
+IMAGEDS_PUBLIC std::string imageds_numpy_dtype(attr_type_t type);
+
+/**
+ * Exports one attribute of an array to a Zarr v2 directory store. chunk_shape defaults to the tile extents of the
+ * array. Chunks are read and written in parallel by one ImageDS instance per thread, so memory is bounded by a few
+ * chunks per thread. Chunks are zlib compressed for zlib_level 1-9 and stored uncompressed for zlib_level 0. Array
+ * metadata and dimension names are stored in .zattrs. attribute can be empty for single attribute arrays.
+ */
+IMAGEDS_PUBLIC int imageds_zarr_export(ImageDS& imageds, const std::string& array_path, const std::string& directory,
+                                       const std::string& attribute="",
+                                       const std::vector<uint64_t>& chunk_shape=std::vector<uint64_t>(),
+                                       int zlib_level=0);
+
+/**
+ * Exports one attribute of an array to a .npy file. The file is memory mapped and tile-aligned slabs of the slowest
+ * dimension, which are contiguous in the file, are read in parallel straight into the mapping.
+ */
+IMAGEDS_PUBLIC int imageds_npy_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                                      const std::string& attribute="");
+
+#endif //__ARRAY_EXPORT_H__
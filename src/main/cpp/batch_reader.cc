@@ -0,0 +1,402 @@
+/**
+ * @file batch_reader.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Batched whole file reads through io_uring with a pread fallback
+ */
+
+
+#include "batch_reader.h"
+#include "error.h"
+#include "page_cache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef IMAGEDS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Offsets, lengths and buffers of O_DIRECT reads are aligned to the logical block size, pages cover all devices
+#define IMAGEDS_DIRECT_IO_ALIGNMENT 4096
+
+// Opens path and reads its size, returns -1 with errno set on failure
+static int open_file(const std::string& path, size_t& size, int flags=0) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st)) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  size = st.st_size;
+  return fd;
+}
+
+// Reads length bytes from offset, retrying short reads. Every read asks for the rest of capacity, so that direct
+// reads keep aligned lengths and stop at the end of the file.
+static int pread_fully(int fd, char *data, size_t length, size_t offset, size_t capacity) {
+  size_t done = 0;
+  while (done < length) {
+    ssize_t read_length = pread(fd, data+done, capacity-done, offset+done);
+    if (read_length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read_length <= 0) {
+      if (!read_length) errno = EIO;
+      return IMAGEDS_ERR;
+    }
+    done += read_length;
+  }
+  return IMAGEDS_OK;
+}
+
+// File being read, m_data points into m_buffer or to an aligned buffer of the pool for direct reads
+struct ImageDSBatchReader::File {
+  int m_fd = -1;
+  size_t m_size = 0;
+  size_t m_capacity = 0;
+  char *m_data = NULL;
+  std::vector<char> m_buffer;
+  std::unique_ptr<ImageDSPageCacheGuard> m_guard;
+  iovec m_iov;
+};
+
+#ifdef IMAGEDS_IO_URING
+
+// Submission and completion rings shared with the kernel, see io_uring(7)
+struct ImageDSBatchReader::Ring {
+  int m_fd = -1;
+  unsigned m_entries = 0;
+  void *m_sq_ptr = MAP_FAILED;
+  void *m_cq_ptr = MAP_FAILED;
+  size_t m_sq_size = 0;
+  size_t m_cq_size = 0;
+  io_uring_sqe *m_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  size_t m_sqes_size = 0;
+  unsigned *m_sq_tail, *m_sq_mask, *m_sq_array;
+  unsigned *m_cq_head, *m_cq_tail, *m_cq_mask;
+  io_uring_cqe *m_cqes;
+
+  int setup(unsigned queue_depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (m_fd < 0) {
+      return IMAGEDS_ERR;
+    }
+    m_entries = params.sq_entries;
+    m_sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+      return IMAGEDS_ERR;
+    }
+    m_cq_ptr = single_mmap ? m_sq_ptr : mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             m_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ptr == MAP_FAILED) {
+      return IMAGEDS_ERR;
+    }
+    m_sqes_size = params.sq_entries*sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe *>(mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                              m_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED) {
+      return IMAGEDS_ERR;
+    }
+    char *sq = static_cast<char *>(m_sq_ptr);
+    m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(m_cq_ptr);
+    m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return IMAGEDS_OK;
+  }
+
+  ~Ring() {
+    if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr, m_sq_size);
+    if (m_fd >= 0) close(m_fd);
+  }
+
+  // Queues a vectored read, the caller keeps at most m_entries submissions unconsumed by the kernel
+  void queue_read(int fd, const iovec *iov, uint64_t offset, uint64_t user_data) {
+    unsigned tail = *m_sq_tail;
+    unsigned index = tail & *m_sq_mask;
+    io_uring_sqe *sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail+1, __ATOMIC_RELEASE);
+  }
+
+  // Submits to_submit entries and waits for min_complete completions, returns the entries submitted
+  int enter(unsigned to_submit, unsigned min_complete) {
+    int submitted;
+    do {
+      submitted = syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete,
+                          min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    return submitted;
+  }
+
+  // Calls on_completion for every available completion
+  template<typename F>
+  void reap(F on_completion) {
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+      on_completion(cqe->user_data, cqe->res);
+      head++;
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+  }
+};
+
+bool ImageDSBatchReader::uring_available() {
+  // Kernels without io_uring return ENOSYS, seccomp profiles of containers often return EPERM
+  static bool available = []() {
+    Ring ring;
+    return ring.setup(1) == IMAGEDS_OK;
+  }();
+  return available;
+}
+
+ImageDSBatchReader::ImageDSBatchReader(unsigned queue_depth, bool direct) : m_ring(NULL), m_direct(direct) {
+  if (queue_depth && uring_available()) {
+    m_ring = new Ring();
+    if (m_ring->setup(queue_depth)) {
+      delete m_ring;
+      m_ring = NULL;
+    }
+  }
+}
+
+int ImageDSBatchReader::read_uring(const std::vector<std::string>& paths, const read_callback_t& on_read) {
+  std::vector<File> files(paths.size());
+  int status = IMAGEDS_OK;
+  int first_errno = 0;
+  auto fail = [&](int error) {
+    if (!status) first_errno = error;
+    status = IMAGEDS_ERR;
+  };
+
+  size_t next = 0;
+  unsigned queued = 0;   // Queued but not consumed by the kernel
+  unsigned inflight = 0; // Queued and not completed
+  while (next < paths.size() || inflight) {
+    while (next < paths.size() && inflight < m_ring->m_entries) {
+      File& file = files[next];
+      if (prepare(paths[next], file)) {
+        fail(errno);
+        next++;
+        continue;
+      }
+      if (!file.m_size) {
+        finish(next++, file, &on_read);
+        continue;
+      }
+      file.m_iov.iov_base = file.m_data;
+      file.m_iov.iov_len = file.m_capacity;
+      m_ring->queue_read(file.m_fd, &file.m_iov, 0, next++);
+      queued++;
+      inflight++;
+    }
+    if (!inflight) {
+      break;
+    }
+    int submitted = m_ring->enter(queued, 1);
+    if (submitted < 0) {
+      if (errno != EAGAIN && errno != EBUSY) {
+        // The kernel may still write into the buffers of the reads in flight, they are leaked rather than freed
+        fail(errno);
+        new std::vector<File>(std::move(files));
+        break;
+      }
+      submitted = 0; // Completions have to be reaped before more entries are accepted
+    }
+    queued -= submitted;
+    m_ring->reap([&](uint64_t index, int res) {
+        File& file = files[index];
+        inflight--;
+        if (res >= 0 && static_cast<size_t>(res) < file.m_size) {
+          // Short reads are completed synchronously, they are not expected for regular files
+          if (pread_fully(file.m_fd, file.m_data+res, file.m_size-res, res, file.m_capacity-res)) res = -errno;
+        }
+        if (res < 0) {
+          fail(-res);
+        }
+        finish(index, file, res < 0 ? NULL : &on_read);
+      });
+  }
+  if (status) {
+    errno = first_errno;
+  }
+  return status;
+}
+
+#else
+
+struct ImageDSBatchReader::Ring {};
+
+bool ImageDSBatchReader::uring_available() {
+  return false;
+}
+
+ImageDSBatchReader::ImageDSBatchReader(unsigned, bool direct) : m_ring(NULL), m_direct(direct) {}
+
+int ImageDSBatchReader::read_uring(const std::vector<std::string>& paths, const read_callback_t& on_read) {
+  return read_pread(paths, on_read);
+}
+
+#endif
+
+ImageDSBatchReader::~ImageDSBatchReader() {
+  delete m_ring;
+  for (auto& buffer : m_buffer_pool) {
+    free(buffer.first);
+  }
+}
+
+int ImageDSBatchReader::read(const std::vector<std::string>& paths, const read_callback_t& on_read) {
+  return m_ring ? read_uring(paths, on_read) : read_pread(paths, on_read);
+}
+
+int ImageDSBatchReader::read_pread(const std::vector<std::string>& paths, const read_callback_t& on_read) {
+  int status = IMAGEDS_OK;
+  int first_errno = 0;
+  for (auto i=0ul; i<paths.size(); i++) {
+    File file;
+    if (prepare(paths[i], file) || pread_fully(file.m_fd, file.m_data, file.m_size, 0, file.m_capacity)) {
+      if (!status) first_errno = errno;
+      status = IMAGEDS_ERR;
+      finish(i, file, NULL);
+    } else {
+      finish(i, file, &on_read);
+    }
+  }
+  if (status) {
+    errno = first_errno;
+  }
+  return status;
+}
+
+// Opens path and sets up the buffer the file is read into
+int ImageDSBatchReader::prepare(const std::string& path, File& file) {
+  if (m_direct) {
+    file.m_fd = open_file(path, file.m_size, O_DIRECT);
+    if (file.m_fd < 0 && errno != EINVAL) {
+      return IMAGEDS_ERR;
+    }
+  }
+  if (file.m_fd >= 0) {
+    file.m_capacity = (file.m_size + IMAGEDS_DIRECT_IO_ALIGNMENT - 1)/IMAGEDS_DIRECT_IO_ALIGNMENT
+        *IMAGEDS_DIRECT_IO_ALIGNMENT;
+    for (auto i=0ul; i<m_buffer_pool.size(); i++) {
+      if (m_buffer_pool[i].second >= file.m_capacity) {
+        file.m_data = m_buffer_pool[i].first;
+        file.m_capacity = m_buffer_pool[i].second;
+        m_buffer_pool.erase(m_buffer_pool.begin()+i);
+        break;
+      }
+    }
+    void *buffer;
+    if (!file.m_data && file.m_capacity) {
+      if (posix_memalign(&buffer, IMAGEDS_DIRECT_IO_ALIGNMENT, file.m_capacity)) {
+        close(file.m_fd);
+        file.m_fd = -1;
+        errno = ENOMEM;
+        return IMAGEDS_ERR;
+      }
+      file.m_data = static_cast<char *>(buffer);
+    }
+    return IMAGEDS_OK;
+  }
+
+  // Filesystems such as tmpfs do not support O_DIRECT
+  if (m_direct) {
+    file.m_guard = std::unique_ptr<ImageDSPageCacheGuard>(new ImageDSPageCacheGuard(path));
+  }
+  file.m_fd = open_file(path, file.m_size);
+  if (file.m_fd < 0) {
+    file.m_guard.reset();
+    return IMAGEDS_ERR;
+  }
+  file.m_buffer.resize(file.m_size);
+  file.m_data = file.m_buffer.data();
+  file.m_capacity = file.m_size;
+  return IMAGEDS_OK;
+}
+
+// Passes the contents of the file to on_read, if given, and releases the file and its buffer
+void ImageDSBatchReader::finish(size_t index, File& file, const read_callback_t *on_read) {
+  if (file.m_fd >= 0) {
+    close(file.m_fd);
+    file.m_fd = -1;
+  }
+  bool pooled = file.m_data && file.m_data != file.m_buffer.data();
+  if (on_read) {
+    if (pooled) {
+      std::vector<char> data(file.m_data, file.m_data + file.m_size);
+      (*on_read)(index, data);
+    } else {
+      file.m_buffer.resize(file.m_size);
+      (*on_read)(index, file.m_buffer);
+    }
+  }
+  // Buffers of the reads in flight are never pooled, so the pool stays within the queue depth
+  if (pooled) {
+    m_buffer_pool.push_back(std::make_pair(file.m_data, file.m_capacity));
+  }
+  file.m_data = NULL;
+  std::vector<char>().swap(file.m_buffer);
+  file.m_guard.reset();
+}
@@ -0,0 +1,91 @@
+/**
+ * @file batch_reader.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Batched whole file reads through io_uring with a pread fallback
+ */
+
+#ifndef __BATCH_READER_H__
+#define __BATCH_READER_H__
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Reads batches of whole files, keeping up to queue_depth reads in flight through io_uring when the library is
+ * built with IMAGEDS_IO_URING and the kernel allows it, or reading the files one by one with pread otherwise.
+ * Direct readers bypass the page cache with O_DIRECT reads into pooled aligned buffers. On filesystems without
+ * O_DIRECT support, they read through the page cache and drop the pages they brought in afterwards.
+ * Instances are not thread-safe.
+ */
+class ImageDSBatchReader {
+ public:
+  /** Called on the reading thread in completion order, data can be moved from */
+  typedef std::function<void(size_t index, std::vector<char>& data)> read_callback_t;
+
+  /** A queue_depth of 0 always reads with pread */
+  ImageDSBatchReader(unsigned queue_depth=64, bool direct=false);
+
+  // Delete copy constructor
+  ImageDSBatchReader(const ImageDSBatchReader& other) = delete;
+
+  ~ImageDSBatchReader();
+
+  /** Whether io_uring can be used by this process */
+  static bool uring_available();
+
+  bool uses_uring() const {
+    return m_ring != NULL;
+  }
+
+  bool direct() const {
+    return m_direct;
+  }
+
+  /**
+   * Reads every file in paths in full and passes its contents to on_read. Files that cannot be read are skipped
+   * and reported with IMAGEDS_ERR and the errno of the first failure.
+   */
+  int read(const std::vector<std::string>& paths, const read_callback_t& on_read);
+
+ private:
+  struct Ring;
+  struct File;
+
+  int read_uring(const std::vector<std::string>& paths, const read_callback_t& on_read);
+  int read_pread(const std::vector<std::string>& paths, const read_callback_t& on_read);
+  int prepare(const std::string& path, File& file);
+  void finish(size_t index, File& file, const read_callback_t *on_read);
+
+  Ring *m_ring;
+  bool m_direct;
+  // Aligned buffers of direct reads with their capacities, reused across files
+  std::vector<std::pair<char *, size_t>> m_buffer_pool;
+};
+
+#endif //__BATCH_READER_H__
@@ -0,0 +1,72 @@
+/**
+ * @file context_pool.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION TileDB contexts of a workspace reused by the threads decoding tiles
+ */
+
+
+#include "context_pool.h"
+
+#include "tiledb.h"
+#include "tiledb_utils.h"
+
+#include <iostream>
+
+ImageDSContextPool::~ImageDSContextPool() {
+  for (auto context : m_contexts) {
+    if (tiledb_ctx_finalize(reinterpret_cast<TileDB_CTX *>(context))) {
+      std::cerr << "Could not finalize TileDB:" << tiledb_errmsg << std::endl;
+    }
+  }
+}
+
+void *ImageDSContextPool::acquire() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_idle.empty()) {
+      void *context = m_idle.back();
+      m_idle.pop_back();
+      return context;
+    }
+  }
+  // Initialized outside of the lock, initialize_workspace returns 1 as the workspace already exists
+  TileDB_CTX *tiledb_ctx = NULL;
+  int rc = TileDBUtils::initialize_workspace(&tiledb_ctx, m_workspace, false, false);
+  if ((rc && rc != 1) || !tiledb_ctx) {
+    return NULL;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_contexts.push_back(tiledb_ctx);
+  return tiledb_ctx;
+}
+
+void ImageDSContextPool::release(void *tiledb_ctx) {
+  if (tiledb_ctx) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idle.push_back(tiledb_ctx);
+  }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file context_pool.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION TileDB contexts of a workspace reused by the threads decoding tiles
+ */
+
+#ifndef __CONTEXT_POOL_H__
+#define __CONTEXT_POOL_H__
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * TileDB contexts cannot be shared between threads. Threads reading tiles concurrently take a context of the
+ * workspace from the pool and give it back when done, so that contexts are only initialized when more threads
+ * than before read at once. Contexts are finalized with the pool.
+ */
+class ImageDSContextPool {
+ public:
+  ImageDSContextPool(const std::string& workspace) : m_workspace(workspace) {}
+
+  // Delete copy constructor
+  ImageDSContextPool(const ImageDSContextPool& other) = delete;
+
+  ~ImageDSContextPool();
+
+  /** TileDB_CTX of the workspace not used by any other thread, NULL if it could not be initialized */
+  void *acquire();
+
+  void release(void *tiledb_ctx);
+
+ private:
+  std::string m_workspace;
+  std::mutex m_mutex;
+  std::vector<void *> m_contexts;
+  std::vector<void *> m_idle;
+};
+
+#endif //__CONTEXT_POOL_H__
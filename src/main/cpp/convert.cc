@@ -0,0 +1,293 @@
+/**
+ * @file convert.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Kernels converting cells between attribute types as they are read
+ */
+
+
+#include "convert.h"
+#include "typed_view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// Float arithmetic when both types fit in its mantissa, as for the 8 and 16 bit types most images are stored as, so
+// that twice as many cells fit in a vector register
+template<typename T>
+struct fits_float : std::integral_constant<bool, std::numeric_limits<T>::digits <= std::numeric_limits<float>::digits> {};
+
+template<typename S, typename D>
+struct arithmetic_type {
+  typedef typename std::conditional<fits_float<S>::value && fits_float<D>::value, float, double>::type type;
+};
+
+// Every value of S is exactly representable as D
+template<typename S, typename D>
+struct lossless : std::integral_constant<bool, std::numeric_limits<S>::digits <= std::numeric_limits<D>::digits
+                                         && (std::is_floating_point<D>::value
+                                             || (std::is_integral<S>::value
+                                                 && (std::is_signed<D>::value || !std::is_signed<S>::value)))> {};
+
+// Cells of 8 and 16 bit integer types index tables of results, starting from the lowest value
+template<typename S>
+struct table_size : std::integral_constant<int64_t, std::is_integral<S>::value && sizeof(S) <= 2
+                                           ? int64_t(1) << (8*sizeof(S)) : 0> {};
+
+template<typename S>
+static int64_t table_lowest() {
+  return std::is_signed<S>::value ? -table_size<S>::value/2 : 0;
+}
+
+// Largest value of A converting to the integer type D without overflow, the maximum of 32 and 64 bit types rounds up
+// to the next power of two in float and double
+template<typename D, typename A>
+static A upper_limit() {
+  A max = static_cast<A>(std::numeric_limits<D>::max());
+  return max < std::ldexp(A(1), std::numeric_limits<D>::digits) ? max : std::nextafter(max, A(0));
+}
+
+// Bounds results are clipped to before they are stored as D
+template<typename D, typename A>
+static void limits(const ImageDSConversion& conversion, A& low, A& high) {
+  low = -std::numeric_limits<A>::infinity();
+  high = std::numeric_limits<A>::infinity();
+  if (std::is_integral<D>::value) {
+    low = static_cast<A>(std::numeric_limits<D>::lowest());
+    high = upper_limit<D, A>();
+  }
+  if (conversion.m_clip) {
+    low = std::max(low, static_cast<A>(conversion.m_min));
+    high = std::min(high, static_cast<A>(conversion.m_max));
+  }
+}
+
+// Range windows map onto, all of an integer type and [0, 1] for floating point types
+template<typename D>
+struct OutputRange {
+  static int run(double& min, double& max) {
+    min = std::is_integral<D>::value ? static_cast<double>(std::numeric_limits<D>::lowest()) : 0;
+    max = std::is_integral<D>::value ? static_cast<double>(std::numeric_limits<D>::max()) : 1;
+    return IMAGEDS_OK;
+  }
+};
+
+// Result of the window or lookup table of a rescaled cell, see DICOM PS3.3 C.11.2.1.2 for the windows
+static double map_value(const ImageDSConversion& conversion, double out_min, double out_max, double value) {
+  if (!conversion.m_lut.empty()) {
+    double index = std::round(value) - conversion.m_lut_first;
+    index = index >= 0 ? index : 0; // NaN takes the first entry
+    index = std::min(index, static_cast<double>(conversion.m_lut.size()-1));
+    return conversion.m_lut[static_cast<size_t>(index)];
+  }
+  if (!conversion.m_window) {
+    return value;
+  }
+  double center = conversion.m_center;
+  double width = conversion.m_width;
+  double range = out_max - out_min;
+  switch (conversion.m_function) {
+    case VOI_SIGMOID:
+      return range/(1 + std::exp(-4*(value - center)/width)) + out_min;
+    case VOI_LINEAR_EXACT:
+      return std::min(std::max(((value - center)/width + 0.5)*range + out_min, out_min), out_max);
+    case VOI_LINEAR:
+      break;
+  }
+  if (value <= center - 0.5 - (width-1)/2) {
+    return out_min;
+  } else if (value > center - 0.5 + (width-1)/2) {
+    return out_max;
+  }
+  return ((value - (center-0.5))/(width-1) + 0.5)*range + out_min;
+}
+
+// Rounds and saturates value for integer D, NaN saturates to low
+template<typename D>
+static D store(double value, double low, double high) {
+  if (std::is_integral<D>::value) {
+    value = value >= low ? value : low;
+    value = value <= high ? value : high;
+    return static_cast<D>(value + std::copysign(0.5, value));
+  }
+  value = value < low ? low : value;
+  value = value > high ? high : value;
+  return static_cast<D>(value);
+}
+
+template<typename S, typename D>
+struct BuildTable {
+  static int run(const ImageDSConversion& conversion, std::vector<char>& table) {
+    if (!table_size<S>::value || (!conversion.m_window && conversion.m_lut.empty())) {
+      return IMAGEDS_OK;
+    }
+    double out_min, out_max, low, high;
+    OutputRange<D>::run(out_min, out_max);
+    limits<D>(conversion, low, high);
+    table.resize(table_size<S>::value*sizeof(D));
+    D *results = reinterpret_cast<D *>(table.data());
+    for (int64_t i=0; i<table_size<S>::value; i++) {
+      double value = static_cast<double>(table_lowest<S>() + i)*conversion.m_slope + conversion.m_intercept;
+      results[i] = store<D>(map_value(conversion, out_min, out_max, value), low, high);
+    }
+    return IMAGEDS_OK;
+  }
+};
+
+template<typename S, typename D>
+struct Convert {
+  static int run(const ImageDSConversion& conversion, const std::vector<char>& table, const void *src_cells,
+                 void *dst_cells, uint64_t cell_num) {
+    const S *src = static_cast<const S *>(src_cells);
+    D *dst = static_cast<D *>(dst_cells);
+    if (!table.empty()) {
+      const D *results = reinterpret_cast<const D *>(table.data());
+      for (auto i=0ul; i<cell_num; i++) {
+        dst[i] = results[static_cast<int64_t>(src[i]) - table_lowest<S>()];
+      }
+      return IMAGEDS_OK;
+    }
+
+    if (conversion.m_window || !conversion.m_lut.empty()) {
+      double out_min, out_max, low, high;
+      OutputRange<D>::run(out_min, out_max);
+      limits<D>(conversion, low, high);
+      for (auto i=0ul; i<cell_num; i++) {
+        double value = static_cast<double>(src[i])*conversion.m_slope + conversion.m_intercept;
+        dst[i] = store<D>(map_value(conversion, out_min, out_max, value), low, high);
+      }
+      return IMAGEDS_OK;
+    }
+
+    if (!conversion.m_clip && conversion.m_slope == 1 && conversion.m_intercept == 0 && lossless<S, D>::value) {
+      for (auto i=0ul; i<cell_num; i++) {
+        dst[i] = static_cast<D>(src[i]);
+      }
+      return IMAGEDS_OK;
+    }
+
+    typedef typename arithmetic_type<S, D>::type A;
+    A slope = static_cast<A>(conversion.m_slope);
+    A intercept = static_cast<A>(conversion.m_intercept);
+    A low, high;
+    limits<D>(conversion, low, high);
+    // Branch free loops, the comparisons compile to vector min/max
+    if (std::is_integral<D>::value) {
+      for (auto i=0ul; i<cell_num; i++) {
+        A value = static_cast<A>(src[i])*slope + intercept;
+        value = value >= low ? value : low; // NaN saturates to low
+        value = value <= high ? value : high;
+        dst[i] = static_cast<D>(value + std::copysign(A(0.5), value)); // Half away from zero
+      }
+    } else if (conversion.m_clip) {
+      for (auto i=0ul; i<cell_num; i++) {
+        A value = static_cast<A>(src[i])*slope + intercept;
+        value = value >= low ? value : low;
+        value = value <= high ? value : high;
+        dst[i] = static_cast<D>(value);
+      }
+    } else {
+      for (auto i=0ul; i<cell_num; i++) {
+        dst[i] = static_cast<D>(static_cast<A>(src[i])*slope + intercept);
+      }
+    }
+    return IMAGEDS_OK;
+  }
+};
+
+// Runs Kernel<S, D>::run(args...) with S and D the C++ types of source and target
+template<template<typename, typename> class Kernel>
+struct PairDispatch {
+  template<typename S>
+  struct From {
+    template<typename D>
+    struct To {
+      template<typename... Args>
+      static int run(Args&&... args) {
+        return Kernel<S, D>::run(std::forward<Args>(args)...);
+      }
+    };
+
+    template<typename... Args>
+    static int run(attr_type_t target, Args&&... args) {
+      return imageds_dispatch<To>(target, std::forward<Args>(args)...);
+    }
+  };
+};
+
+template<template<typename, typename> class Kernel, typename... Args>
+static int dispatch_pair(attr_type_t source, attr_type_t target, Args&&... args) {
+  return imageds_dispatch<PairDispatch<Kernel>::template From>(source, target, std::forward<Args>(args)...);
+}
+
+ImageDSConverter::ImageDSConverter(attr_type_t source, const ImageDSConversion& conversion)
+    : m_source(source), m_conversion(conversion) {
+  double out_min, out_max;
+  if (imageds_dispatch<OutputRange>(conversion.m_type, out_min, out_max)) {
+    return;
+  }
+  if (conversion.m_window) {
+    double width = conversion.m_width;
+    if (!(conversion.m_function == VOI_LINEAR ? width >= 1 : width > 0)
+        || (conversion.m_function != VOI_LINEAR && conversion.m_function != VOI_LINEAR_EXACT
+            && conversion.m_function != VOI_SIGMOID)) {
+      return;
+    }
+    // Linear windows are a rescale followed by a clip to the output range
+    double scale = 0, offset = 0;
+    double range = out_max - out_min;
+    if (conversion.m_function == VOI_LINEAR && width > 1) {
+      scale = range/(width-1);
+      offset = (0.5 - (conversion.m_center-0.5)/(width-1))*range + out_min;
+    } else if (conversion.m_function == VOI_LINEAR_EXACT) {
+      scale = range/width;
+      offset = (0.5 - conversion.m_center/width)*range + out_min;
+    }
+    if (scale) {
+      m_conversion.m_window = false;
+      m_conversion.m_slope = conversion.m_slope*scale;
+      m_conversion.m_intercept = conversion.m_intercept*scale + offset;
+      m_conversion.clip(conversion.m_clip ? std::max(conversion.m_min, out_min) : out_min,
+                        conversion.m_clip ? std::min(conversion.m_max, out_max) : out_max);
+    }
+  }
+  m_valid = !dispatch_pair<BuildTable>(source, conversion.m_type, m_conversion, m_table);
+}
+
+int ImageDSConverter::convert(const void *src, void *dst, uint64_t cell_num) const {
+  if (!m_valid) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return dispatch_pair<Convert>(m_source, m_conversion.m_type, m_conversion, m_table, src, dst, cell_num);
+}
+
+int imageds_convert(const void *src, attr_type_t source, void *dst, const ImageDSConversion& conversion,
+                    uint64_t cell_num) {
+  return ImageDSConverter(source, conversion).convert(src, dst, cell_num);
+}
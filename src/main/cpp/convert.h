@@ -0,0 +1,67 @@
+/**
+ * @file convert.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Kernels converting cells between attribute types as they are read
+ */
+
+#ifndef __CONVERT_H__
+#define __CONVERT_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Conversion of cells of one type prepared once per read and applied to many runs of cells from any thread. Linear
+ * windows are folded into the rescale and clip, so that the loops over cells vectorize. Other windows and lookup
+ * tables of 8 and 16 bit integer cells are evaluated once for every possible cell into a table.
+ */
+class ImageDSConverter {
+ public:
+  ImageDSConverter(attr_type_t source, const ImageDSConversion& conversion);
+
+  /** Whether the types are known and the window, if any, is wide enough */
+  bool valid() const {
+    return m_valid;
+  }
+
+  /** Converts cell_num cells from src into dst, fails with EINVAL unless valid */
+  int convert(const void *src, void *dst, uint64_t cell_num) const;
+
+ private:
+  attr_type_t m_source;
+  ImageDSConversion m_conversion;
+  bool m_valid = false;
+  std::vector<char> m_table; // Results in order of the cell values from the lowest
+};
+
+/** Converts cell_num cells of type source from src into dst as described by conversion, see ImageDSConverter */
+int imageds_convert(const void *src, attr_type_t source, void *dst, const ImageDSConversion& conversion,
+                    uint64_t cell_num);
+
+#endif //__CONVERT_H__
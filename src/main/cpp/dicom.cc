@@ -0,0 +1,532 @@
+/**
+ * @file dicom.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Native ingestion of DICOM series into 3D ImageDS arrays
+ */
+
+#include "dicom.h"
+#include "tile_layout.h"
+
+#include "tiledb_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <map>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#define DICOM_PREAMBLE_LENGTH 128
+#define DICOM_HEADER_READ_LENGTH 64*1024
+#define DICOM_UNDEFINED_LENGTH 0xFFFFFFFF
+
+#define TAG(group, element) ((static_cast<uint32_t>(group) << 16) | (element))
+
+#define TAG_TRANSFER_SYNTAX      TAG(0x0002, 0x0010)
+#define TAG_MODALITY             TAG(0x0008, 0x0060)
+#define TAG_SLICE_THICKNESS      TAG(0x0018, 0x0050)
+#define TAG_SERIES_UID           TAG(0x0020, 0x000E)
+#define TAG_INSTANCE_NUMBER      TAG(0x0020, 0x0013)
+#define TAG_POSITION             TAG(0x0020, 0x0032)
+#define TAG_ORIENTATION          TAG(0x0020, 0x0037)
+#define TAG_SAMPLES_PER_PIXEL    TAG(0x0028, 0x0002)
+#define TAG_ROWS                 TAG(0x0028, 0x0010)
+#define TAG_COLUMNS              TAG(0x0028, 0x0011)
+#define TAG_PIXEL_SPACING        TAG(0x0028, 0x0030)
+#define TAG_BITS_ALLOCATED       TAG(0x0028, 0x0100)
+#define TAG_PIXEL_REPRESENTATION TAG(0x0028, 0x0103)
+#define TAG_WINDOW_CENTER        TAG(0x0028, 0x1050)
+#define TAG_WINDOW_WIDTH         TAG(0x0028, 0x1051)
+#define TAG_RESCALE_INTERCEPT    TAG(0x0028, 0x1052)
+#define TAG_RESCALE_SLOPE        TAG(0x0028, 0x1053)
+#define TAG_VOI_LUT_FUNCTION     TAG(0x0028, 0x1056)
+#define TAG_PIXEL_DATA           TAG(0x7FE0, 0x0010)
+#define TAG_ITEM                 TAG(0xFFFE, 0xE000)
+#define TAG_ITEM_DELIMITATION    TAG(0xFFFE, 0xE00D)
+#define TAG_SEQUENCE_DELIMITATION TAG(0xFFFE, 0xE0DD)
+
+// Parser results
+#define PARSE_OK        0
+#define PARSE_NEED_MORE 1
+#define PARSE_ERR      -1
+
+static inline uint16_t read_u16(const unsigned char *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t read_u32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static bool has_long_length(const char *vr) {
+  static const char *long_vrs[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+  for (auto long_vr : long_vrs) {
+    if (vr[0] == long_vr[0] && vr[1] == long_vr[1]) return true;
+  }
+  return false;
+}
+
+static std::string trim(const unsigned char *value, size_t length) {
+  std::string str(reinterpret_cast<const char *>(value), length);
+  size_t end = str.find_last_not_of(std::string(" \0", 2));
+  size_t start = str.find_first_not_of(' ');
+  if (end == std::string::npos || start == std::string::npos) return "";
+  return str.substr(start, end-start+1);
+}
+
+static std::vector<double> decimals(const std::string& str) {
+  std::vector<double> values;
+  std::istringstream in(str);
+  std::string value;
+  while (std::getline(in, value, '\\')) {
+    values.push_back(strtod(value.c_str(), NULL));
+  }
+  return values;
+}
+
+class DicomParser {
+ public:
+  DicomParser(const unsigned char *data, size_t length, ImageDSDicomSlice& slice)
+      : m_data(data), m_length(length), m_slice(slice) {}
+
+  int parse() {
+    size_t pos = 0;
+    if (m_length >= DICOM_PREAMBLE_LENGTH+4 && !memcmp(m_data+DICOM_PREAMBLE_LENGTH, "DICM", 4)) {
+      pos = DICOM_PREAMBLE_LENGTH+4;
+    } else if (m_length < 8 || (read_u16(m_data) != 0x0002 && read_u16(m_data) != 0x0008)) {
+      // Files without preamble have to start with the meta or identifying group
+      return PARSE_ERR;
+    }
+
+    while (pos < m_length) {
+      int rc = element(pos, true);
+      if (rc != PARSE_OK || m_done) return rc;
+    }
+    // Files without pixel data cannot be ingested
+    return PARSE_ERR;
+  }
+
+ private:
+  bool is_explicit(uint16_t group) {
+    return group == 0x0002 || m_slice.m_transfer_syntax != DICOM_IMPLICIT_VR_LITTLE_ENDIAN;
+  }
+
+  // Parses the element at pos and advances pos past it, top level elements are interpreted
+  int element(size_t& pos, bool top_level) {
+    if (pos + 8 > m_length) return PARSE_NEED_MORE;
+    uint16_t group = read_u16(m_data+pos);
+    uint32_t tag = TAG(group, read_u16(m_data+pos+2));
+    uint32_t length;
+    size_t header_length;
+    if (group == 0xFFFE) {
+      length = read_u32(m_data+pos+4);
+      header_length = 8;
+    } else if (is_explicit(group)) {
+      const char *vr = reinterpret_cast<const char *>(m_data+pos+4);
+      if (has_long_length(vr)) {
+        if (pos + 12 > m_length) return PARSE_NEED_MORE;
+        length = read_u32(m_data+pos+8);
+        header_length = 12;
+      } else {
+        length = read_u16(m_data+pos+6);
+        header_length = 8;
+      }
+    } else {
+      length = read_u32(m_data+pos+4);
+      header_length = 8;
+    }
+    size_t value_pos = pos + header_length;
+
+    if (tag == TAG_PIXEL_DATA && top_level) {
+      m_slice.m_encapsulated = length == DICOM_UNDEFINED_LENGTH;
+      m_slice.m_pixel_offset = value_pos;
+      m_slice.m_pixel_length = m_slice.m_encapsulated ? 0 : length;
+      m_done = true;
+      return PARSE_OK;
+    }
+
+    if (length == DICOM_UNDEFINED_LENGTH) {
+      // Sequences or items of undefined length, skip nested elements up to the matching delimitation
+      uint32_t delimitation = tag == TAG_ITEM ? TAG_ITEM_DELIMITATION : TAG_SEQUENCE_DELIMITATION;
+      pos = value_pos;
+      while (true) {
+        if (pos + 8 > m_length) return PARSE_NEED_MORE;
+        if (TAG(read_u16(m_data+pos), read_u16(m_data+pos+2)) == delimitation) {
+          pos += 8;
+          return PARSE_OK;
+        }
+        int rc = element(pos, false);
+        if (rc != PARSE_OK) return rc;
+      }
+    }
+
+    if (value_pos + length > m_length) return PARSE_NEED_MORE;
+    if (top_level) {
+      value(tag, m_data+value_pos, length);
+    }
+    pos = value_pos + length;
+    return PARSE_OK;
+  }
+
+  void value(uint32_t tag, const unsigned char *value, size_t length) {
+    switch (tag) {
+      case TAG_TRANSFER_SYNTAX:
+        m_slice.m_transfer_syntax = trim(value, length);
+        break;
+      case TAG_MODALITY:
+        m_slice.m_modality = trim(value, length);
+        break;
+      case TAG_SERIES_UID:
+        m_slice.m_series_uid = trim(value, length);
+        break;
+      case TAG_INSTANCE_NUMBER:
+        m_slice.m_instance_number = atoi(trim(value, length).c_str());
+        break;
+      case TAG_SLICE_THICKNESS:
+        m_slice.m_slice_thickness = strtod(trim(value, length).c_str(), NULL);
+        break;
+      case TAG_POSITION: {
+        std::vector<double> position = decimals(trim(value, length));
+        if (position.size() == 3) {
+          std::copy(position.begin(), position.end(), m_slice.m_position);
+          m_slice.m_has_position = true;
+        }
+        break;
+      }
+      case TAG_ORIENTATION: {
+        std::vector<double> orientation = decimals(trim(value, length));
+        if (orientation.size() == 6) {
+          std::copy(orientation.begin(), orientation.end(), m_slice.m_orientation);
+          m_slice.m_has_orientation = true;
+        }
+        break;
+      }
+      case TAG_PIXEL_SPACING: {
+        std::vector<double> spacing = decimals(trim(value, length));
+        if (spacing.size() == 2) {
+          std::copy(spacing.begin(), spacing.end(), m_slice.m_pixel_spacing);
+        }
+        break;
+      }
+      case TAG_RESCALE_INTERCEPT:
+        m_slice.m_rescale_intercept = strtod(trim(value, length).c_str(), NULL);
+        break;
+      case TAG_RESCALE_SLOPE:
+        m_slice.m_rescale_slope = strtod(trim(value, length).c_str(), NULL);
+        break;
+      case TAG_WINDOW_CENTER: {
+        // Only the first of multiple windows is kept
+        std::vector<double> centers = decimals(trim(value, length));
+        if (!centers.empty()) {
+          m_slice.m_window_center = centers[0];
+          m_slice.m_has_window = m_slice.m_window_width > 0;
+        }
+        break;
+      }
+      case TAG_WINDOW_WIDTH: {
+        std::vector<double> widths = decimals(trim(value, length));
+        if (!widths.empty()) {
+          m_slice.m_window_width = widths[0];
+          m_slice.m_has_window = m_slice.m_window_width > 0;
+        }
+        break;
+      }
+      case TAG_VOI_LUT_FUNCTION:
+        m_slice.m_voi_lut_function = trim(value, length);
+        break;
+      case TAG_SAMPLES_PER_PIXEL:
+        if (length == 2) m_slice.m_samples_per_pixel = read_u16(value);
+        break;
+      case TAG_ROWS:
+        if (length == 2) m_slice.m_rows = read_u16(value);
+        break;
+      case TAG_COLUMNS:
+        if (length == 2) m_slice.m_columns = read_u16(value);
+        break;
+      case TAG_BITS_ALLOCATED:
+        if (length == 2) m_slice.m_bits_allocated = read_u16(value);
+        break;
+      case TAG_PIXEL_REPRESENTATION:
+        if (length == 2) m_slice.m_pixel_representation = read_u16(value);
+        break;
+    }
+  }
+
+  const unsigned char *m_data;
+  size_t m_length;
+  ImageDSDicomSlice& m_slice;
+  bool m_done = false;
+};
+
+double ImageDSDicomSlice::slice_location() const {
+  if (!m_has_position) {
+    return m_instance_number;
+  }
+  // Project the position onto the normal of the image plane
+  const double *o = m_orientation;
+  double normal[3] = { o[1]*o[5] - o[2]*o[4], o[2]*o[3] - o[0]*o[5], o[0]*o[4] - o[1]*o[3] };
+  return m_position[0]*normal[0] + m_position[1]*normal[1] + m_position[2]*normal[2];
+}
+
+int ImageDSDicomSeries::validate() const {
+  if (m_slices.empty()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  const ImageDSDicomSlice& first = m_slices[0];
+  for (auto& slice : m_slices) {
+    if (slice.m_transfer_syntax != DICOM_IMPLICIT_VR_LITTLE_ENDIAN
+        && slice.m_transfer_syntax != DICOM_EXPLICIT_VR_LITTLE_ENDIAN) {
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+    if (slice.m_encapsulated || slice.m_samples_per_pixel != 1) {
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+    if (slice.m_rows != first.m_rows || slice.m_columns != first.m_columns
+        || slice.m_bits_allocated != first.m_bits_allocated
+        || slice.m_pixel_representation != first.m_pixel_representation
+        || slice.m_pixel_length < static_cast<uint64_t>(slice.m_rows)*slice.m_columns*(slice.m_bits_allocated/8)) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+  }
+  if (first.m_bits_allocated != 8 && first.m_bits_allocated != 16 && first.m_bits_allocated != 32) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+attr_type_t ImageDSDicomSeries::type() const {
+  bool is_signed = m_slices[0].m_pixel_representation == 1;
+  switch (m_slices[0].m_bits_allocated) {
+    case 8:
+      return is_signed ? INT8 : UINT8;
+    case 32:
+      return is_signed ? INT32 : UINT32;
+    default:
+      return is_signed ? INT16 : UINT16;
+  }
+}
+
+int imageds_dicom_read_header(const std::string& filename, ImageDSDicomSlice& slice) {
+  ssize_t file_length = TileDBUtils::file_size(filename);
+  if (file_length <= 0) {
+    errno = EIO;
+    return IMAGEDS_ERR;
+  }
+
+  // Most headers fit in the first chunk, reread the entire file otherwise
+  size_t length = std::min(static_cast<size_t>(file_length), static_cast<size_t>(DICOM_HEADER_READ_LENGTH));
+  while (true) {
+    std::vector<unsigned char> data(length);
+    RETURN_EIO_IF_ERROR(TileDBUtils::read_file(filename, 0, data.data(), length));
+    slice = ImageDSDicomSlice();
+    slice.m_filename = filename;
+    int rc = DicomParser(data.data(), length, slice).parse();
+    if (rc == PARSE_OK) {
+      return IMAGEDS_OK;
+    } else if (rc == PARSE_NEED_MORE && length < static_cast<size_t>(file_length)) {
+      length = file_length;
+    } else {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+  }
+}
+
+static void list_files(const std::string& directory, std::vector<std::string>& files) {
+  for (auto& file : TileDBUtils::get_files(directory)) {
+    files.push_back(file);
+  }
+  for (auto& dir : TileDBUtils::get_dirs(directory)) {
+    list_files(dir, files);
+  }
+}
+
+int imageds_dicom_scan(const std::string& directory, std::vector<ImageDSDicomSeries>& series) {
+  if (!TileDBUtils::is_dir(directory)) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+  std::vector<std::string> files;
+  list_files(directory, files);
+
+  std::vector<ImageDSDicomSlice> slices(files.size());
+  std::vector<char> is_dicom(files.size(), 0);
+  #pragma omp parallel for schedule(dynamic)
+  for (auto i=0ul; i<files.size(); i++) {
+    is_dicom[i] = !imageds_dicom_read_header(files[i], slices[i]);
+  }
+
+  std::map<std::string, ImageDSDicomSeries> series_by_uid;
+  for (auto i=0ul; i<files.size(); i++) {
+    if (is_dicom[i]) {
+      ImageDSDicomSeries& found = series_by_uid[slices[i].m_series_uid];
+      found.m_series_uid = slices[i].m_series_uid;
+      found.m_slices.push_back(slices[i]);
+    }
+  }
+
+  for (auto& entry : series_by_uid) {
+    ImageDSDicomSeries& found = entry.second;
+    std::sort(found.m_slices.begin(), found.m_slices.end(),
+              [](const ImageDSDicomSlice& a, const ImageDSDicomSlice& b) {
+                return a.slice_location() < b.slice_location();
+              });
+    found.m_spacing[1] = found.m_slices[0].m_pixel_spacing[0];
+    found.m_spacing[2] = found.m_slices[0].m_pixel_spacing[1];
+    if (found.m_slices.size() > 1 && found.m_slices[0].m_has_position) {
+      // Median distance between adjacent slices is robust against missing slices
+      std::vector<double> distances;
+      for (auto i=1ul; i<found.m_slices.size(); i++) {
+        distances.push_back(std::fabs(found.m_slices[i].slice_location() - found.m_slices[i-1].slice_location()));
+      }
+      std::nth_element(distances.begin(), distances.begin() + distances.size()/2, distances.end());
+      found.m_spacing[0] = distances[distances.size()/2];
+    } else if (found.m_slices[0].m_slice_thickness > 0) {
+      found.m_spacing[0] = found.m_slices[0].m_slice_thickness;
+    }
+    series.push_back(found);
+  }
+  return IMAGEDS_OK;
+}
+
+static std::string to_string(const double *values, size_t length) {
+  return imageds_metadata_value(std::vector<double>(values, values+length));
+}
+
+int imageds_dicom_ingest(ImageDS& imageds, const ImageDSDicomSeries& series, const std::string& array_path,
+                         uint64_t slab_slices, uint64_t tile_extent, compression_t compression, int compression_level) {
+  RETURN_EINVAL_IF_ERROR(series.validate());
+
+  const ImageDSDicomSlice& first = series.m_slices[0];
+  uint64_t slices = series.m_slices.size();
+  uint64_t rows = first.m_rows;
+  uint64_t columns = first.m_columns;
+  size_t cell_size = first.m_bits_allocated/8;
+  slab_slices = clamp_tile_extent(slab_slices, slices);
+
+  ImageDSArray array(array_path);
+  try {
+    array.add_dimension("Z", 0, slices-1, slab_slices);
+    array.add_dimension("Y", 0, rows-1, clamp_tile_extent(tile_extent, rows));
+    array.add_dimension("X", 0, columns-1, clamp_tile_extent(tile_extent, columns));
+  } catch (const ImageDSException& e) {
+    // Series too small to be tiled
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  array.add_attribute("Intensity", series.type(), compression, compression_level);
+
+  // Decode the next slab while the previous one is being written
+  size_t slice_size = rows*columns*cell_size;
+  std::vector<char> slab_buffers[2];
+  std::future<int> pending_write;
+  for (uint64_t start=0, slab=0; start<slices; start+=slab_slices, slab++) {
+    uint64_t end = std::min(start+slab_slices, slices) - 1;
+    std::vector<char>& buffer = slab_buffers[slab%2];
+    buffer.resize((end-start+1)*slice_size);
+
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (uint64_t i=start; i<=end; i++) {
+      const ImageDSDicomSlice& slice = series.m_slices[i];
+      if (TileDBUtils::read_file(slice.m_filename, slice.m_pixel_offset, buffer.data()+(i-start)*slice_size, slice_size)) {
+        status = IMAGEDS_ERR;
+      }
+    }
+
+    if (pending_write.valid() && pending_write.get()) {
+      return IMAGEDS_ERR;
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+
+    std::vector<uint64_t> subarray = { start, end, 0, rows-1, 0, columns-1 };
+    pending_write = std::async(std::launch::async, [&imageds, &array, subarray, &buffer]() {
+        return imageds.to_array(array, subarray, {buffer.data()}, {buffer.size()});
+      });
+  }
+  if (pending_write.valid() && pending_write.get()) {
+    return IMAGEDS_ERR;
+  }
+
+  std::map<std::string, std::string> metadata;
+  metadata["dicom_series_uid"] = series.m_series_uid;
+  metadata["dicom_modality"] = first.m_modality;
+  metadata["rescale_slope"] = imageds_metadata_value({first.m_rescale_slope});
+  metadata["rescale_intercept"] = imageds_metadata_value({first.m_rescale_intercept});
+  metadata["spacing"] = to_string(series.m_spacing, 3);
+  metadata["origin"] = to_string(first.m_position, 3);
+  metadata["orientation"] = to_string(first.m_orientation, 6);
+  if (first.m_has_window) {
+    metadata["window_center"] = imageds_metadata_value({first.m_window_center});
+    metadata["window_width"] = imageds_metadata_value({first.m_window_width});
+    metadata["voi_lut_function"] = first.m_voi_lut_function;
+  }
+  for (auto& slice : series.m_slices) {
+    if (slice.m_rescale_slope != first.m_rescale_slope || slice.m_rescale_intercept != first.m_rescale_intercept) {
+      // Rescale varies by slice, keep all of them in slice order
+      std::vector<double> slopes, intercepts;
+      for (auto& s : series.m_slices) {
+        slopes.push_back(s.m_rescale_slope);
+        intercepts.push_back(s.m_rescale_intercept);
+      }
+      metadata["rescale_slopes"] = imageds_metadata_value(slopes);
+      metadata["rescale_intercepts"] = imageds_metadata_value(intercepts);
+      break;
+    }
+  }
+  return imageds.write_metadata(array_path, metadata);
+}
+
+int imageds_dicom_display_conversion(ImageDS& imageds, const std::string& array_path, ImageDSConversion& conversion) {
+  std::map<std::string, std::string> metadata;
+  RETURN_EIO_IF_ERROR(imageds.read_metadata(array_path, metadata));
+  std::vector<double> center = imageds_metadata_values(metadata["window_center"]);
+  std::vector<double> width = imageds_metadata_values(metadata["window_width"]);
+  if (center.empty() || width.empty()) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+  std::vector<double> slope = imageds_metadata_values(metadata["rescale_slope"]);
+  std::vector<double> intercept = imageds_metadata_values(metadata["rescale_intercept"]);
+  conversion.m_slope = slope.empty() ? 1 : slope[0];
+  conversion.m_intercept = intercept.empty() ? 0 : intercept[0];
+  voi_function_t function = VOI_LINEAR;
+  if (metadata["voi_lut_function"] == "LINEAR_EXACT") {
+    function = VOI_LINEAR_EXACT;
+  } else if (metadata["voi_lut_function"] == "SIGMOID") {
+    function = VOI_SIGMOID;
+  }
+  conversion.window(center[0], width[0], function);
+  return IMAGEDS_OK;
+}
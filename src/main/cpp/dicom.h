@@ -0,0 +1,114 @@
+/**
+ * @file dicom.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Native ingestion of DICOM series into 3D ImageDS arrays
+ */
+
+#ifndef __DICOM_H__
+#define __DICOM_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define DICOM_IMPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2"
+#define DICOM_EXPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2.1"
+
+/**
+ * Header of a single DICOM file, pixel data is located by offset and length and only read on ingestion.
+ * Only grayscale images with uncompressed little endian transfer syntaxes can be ingested.
+ */
+class IMAGEDS_PUBLIC ImageDSDicomSlice {
+ public:
+  std::string m_filename;
+  std::string m_transfer_syntax = DICOM_IMPLICIT_VR_LITTLE_ENDIAN;
+  std::string m_series_uid;
+  std::string m_modality;
+  int m_instance_number = 0;
+  uint16_t m_rows = 0;
+  uint16_t m_columns = 0;
+  uint16_t m_bits_allocated = 0;
+  uint16_t m_pixel_representation = 0;
+  uint16_t m_samples_per_pixel = 1;
+  bool m_has_position = false;
+  double m_position[3] = {0, 0, 0};
+  bool m_has_orientation = false;
+  double m_orientation[6] = {1, 0, 0, 0, 1, 0};
+  double m_pixel_spacing[2] = {1, 1}; // Row spacing followed by column spacing
+  double m_slice_thickness = 0;
+  double m_rescale_slope = 1;
+  double m_rescale_intercept = 0;
+  bool m_has_window = false;
+  double m_window_center = 0;
+  double m_window_width = 0;
+  std::string m_voi_lut_function = "LINEAR";
+  bool m_encapsulated = false;
+  uint64_t m_pixel_offset = 0;
+  uint64_t m_pixel_length = 0;
+
+  /** Position along the slice normal, used for sorting slices */
+  double slice_location() const;
+};
+
+class IMAGEDS_PUBLIC ImageDSDicomSeries {
+ public:
+  std::string m_series_uid;
+  std::vector<ImageDSDicomSlice> m_slices; // Sorted by slice location
+  double m_spacing[3] = {1, 1, 1}; // Z, Y, X
+
+  /** Returns IMAGEDS_ERR with errno set if the slices cannot be stacked into one 3D array */
+  int validate() const;
+
+  attr_type_t type() const;
+};
+
+IMAGEDS_PUBLIC int imageds_dicom_read_header(const std::string& filename, ImageDSDicomSlice& slice);
+
+/** Recursively scans directory for DICOM files in parallel and groups them by series, non DICOM files are skipped */
+IMAGEDS_PUBLIC int imageds_dicom_scan(const std::string& directory, std::vector<ImageDSDicomSeries>& series);
+
+/**
+ * Ingests series into a dense 3D array with dimensions Z, Y, X. slab_slices is the Z tile extent and tile_extent
+ * the Y and X tile extents, both clamped to the series size. Tile-aligned slabs are decoded in parallel and written
+ * with to_array while the next slab is being decoded. Rescale slope/intercept, the first VOI window, spacing, origin
+ * and orientation are stored as array metadata.
+ */
+IMAGEDS_PUBLIC int imageds_dicom_ingest(ImageDS& imageds, const ImageDSDicomSeries& series, const std::string& array_path,
+                                        uint64_t slab_slices=16, uint64_t tile_extent=256,
+                                        compression_t compression=NONE, int compression_level=0);
+
+/**
+ * Sets the rescale and window of conversion to those of the first slice of a series ingested with
+ * imageds_dicom_ingest, so that from_array returns display values of conversion.m_type, for example UINT8. Fails with
+ * ENOENT if the series has no window.
+ */
+IMAGEDS_PUBLIC int imageds_dicom_display_conversion(ImageDS& imageds, const std::string& array_path,
+                                                   ImageDSConversion& conversion);
+
+#endif //__DICOM_H__
@@ -0,0 +1,237 @@
+/**
+ * @file filter.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Separable filters of tiles with the halos their kernels reach into
+ */
+
+
+#include "filter.h"
+#include "tile_layout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ImageDSFilter ImageDSFilter::gaussian(size_t dim_num, double sigma, attr_type_t type) {
+  std::vector<double> kernel;
+  if (sigma > 0) {
+    int radius = std::ceil(3*sigma);
+    double sum = 0;
+    for (int i=-radius; i<=radius; i++) {
+      kernel.push_back(std::exp(-0.5*i*i/(sigma*sigma)));
+      sum += kernel.back();
+    }
+    for (auto& weight : kernel) {
+      weight /= sum;
+    }
+  }
+  return ImageDSFilter(std::vector<std::vector<double>>(dim_num, kernel), FILTER_CORRELATE, type);
+}
+
+ImageDSFilter ImageDSFilter::gradient(size_t dim_num, size_t axis, attr_type_t type) {
+  if (axis >= dim_num) {
+    // Rejected by ImageDS::filter as there are fewer kernels than dimensions
+    return ImageDSFilter(std::vector<std::vector<double>>(), FILTER_CORRELATE, type);
+  }
+  std::vector<std::vector<double>> kernels(dim_num, {0.25, 0.5, 0.25});
+  kernels[axis] = {-0.5, 0, 0.5};
+  return ImageDSFilter(kernels, FILTER_CORRELATE, type);
+}
+
+ImageDSFilter ImageDSFilter::morphology(size_t dim_num, uint64_t radius, filter_operation_t operation,
+                                        attr_type_t type) {
+  return ImageDSFilter(std::vector<std::vector<double>>(dim_num, std::vector<double>(radius*2+1, 1)), operation,
+                       type);
+}
+
+int imageds_filter_radii(const ImageDSFilter& filter, size_t dim_num, std::vector<uint64_t>& radii) {
+  if (filter.m_kernels.size() != dim_num || (filter.m_operation != FILTER_CORRELATE
+                                             && filter.m_operation != FILTER_ERODE
+                                             && filter.m_operation != FILTER_DILATE)) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  radii.clear();
+  for (auto& kernel : filter.m_kernels) {
+    if (!kernel.empty() && kernel.size()%2 == 0) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    for (auto weight : kernel) {
+      if (!std::isfinite(weight)) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+    }
+    radii.push_back(kernel.size()/2);
+  }
+  return IMAGEDS_OK;
+}
+
+// Integers of up to 16 bits are exact in single precision, as in trilinear sampling
+static bool single_precision(attr_type_t type) {
+  return type == FLOAT32 || (type != FLOAT64 && attr_type_size(type) <= 2);
+}
+
+attr_type_t imageds_filter_work_type(attr_type_t source, attr_type_t result) {
+  return single_precision(source) && single_precision(result) ? FLOAT32 : FLOAT64;
+}
+
+template<typename A, filter_operation_t O>
+struct Filter {
+  static A identity() {
+    return O == FILTER_ERODE ? std::numeric_limits<A>::max()
+        : O == FILTER_DILATE ? std::numeric_limits<A>::lowest() : 0;
+  }
+
+  static A combine(A value, A weight, A cell) {
+    return O == FILTER_ERODE ? std::min(value, cell) : O == FILTER_DILATE ? std::max(value, cell) : value + weight*cell;
+  }
+};
+
+/**
+ * Filters in, laid out as outer x length x inner cells, along its middle dimension into out, laid out as
+ * outer x count x inner cells. Cells x of out are centered on cells first+x of in, taps past the ends of in repeat
+ * the end cells. The innermost loops run over contiguous cells so that they vectorize.
+ */
+template<typename A, filter_operation_t O>
+static void filter_dimension(const A *in, A *out, uint64_t outer, uint64_t length, uint64_t inner, uint64_t first,
+                             uint64_t count, const std::vector<A>& weights) {
+  typedef Filter<A, O> Op;
+  int64_t radius = weights.size()/2;
+  int64_t start = first;
+  int64_t end = count;
+  int64_t last = length-1;
+  auto clamp = [&](int64_t index) {
+    return std::min(std::max(index, static_cast<int64_t>(0)), last);
+  };
+  for (auto o=0ul; o<outer; o++) {
+    const A *src = in + o*length*inner;
+    A *dst = out + o*count*inner;
+    if (inner > 1) {
+      for (int64_t x=0; x<end; x++) {
+        A *row = dst + x*inner;
+        std::fill_n(row, inner, Op::identity());
+        for (int64_t k=0; k<=radius*2; k++) {
+          const A *src_row = src + clamp(start+x+k-radius)*inner;
+          A weight = weights[k];
+          for (auto i=0ul; i<inner; i++) {
+            row[i] = Op::combine(row[i], weight, src_row[i]);
+          }
+        }
+      }
+      continue;
+    }
+
+    // Rows along the last dimension, cells whose taps all fall within in are filtered a tap at a time
+    int64_t interior_start = std::min(std::max(radius-start, static_cast<int64_t>(0)), end);
+    int64_t interior_end = std::max(std::min(last-radius-start+1, end), interior_start);
+    std::fill(dst+interior_start, dst+interior_end, Op::identity());
+    for (int64_t k=0; k<=radius*2; k++) {
+      int64_t offset = start+k-radius;
+      A weight = weights[k];
+      for (int64_t x=interior_start; x<interior_end; x++) {
+        dst[x] = Op::combine(dst[x], weight, src[offset+x]);
+      }
+    }
+    auto filter_edge = [&](int64_t edge_start, int64_t edge_end) {
+      for (int64_t x=edge_start; x<edge_end; x++) {
+        A value = Op::identity();
+        for (int64_t k=0; k<=radius*2; k++) {
+          value = Op::combine(value, weights[k], src[clamp(start+x+k-radius)]);
+        }
+        dst[x] = value;
+      }
+    };
+    filter_edge(0, interior_start);
+    filter_edge(interior_end, end);
+  }
+}
+
+template<typename A, filter_operation_t O>
+static int filter_passes(const ImageDSFilter& filter, std::vector<char>& cells, const std::vector<uint64_t>& halo_box,
+                         const std::vector<uint64_t>& tile_box) {
+  size_t dim_num = tile_box.size()/2;
+  std::vector<uint64_t> extents(dim_num);
+  for (auto d=0ul; d<dim_num; d++) {
+    extents[d] = halo_box[d*2+1] - halo_box[d*2] + 1;
+  }
+  if (cells.size() != ImageDSTileLayout::cell_num(halo_box)*sizeof(A)) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  // Every pass shrinks the cells along its dimension from the halo to the tile
+  std::vector<char> filtered;
+  for (auto d=0ul; d<dim_num; d++) {
+    const std::vector<double>& kernel = filter.m_kernels[d];
+    if (kernel.empty()) {
+      continue;
+    }
+    uint64_t outer = 1, inner = 1;
+    for (auto i=0ul; i<d; i++) {
+      outer *= extents[i];
+    }
+    for (auto i=d+1; i<dim_num; i++) {
+      inner *= extents[i];
+    }
+    uint64_t count = tile_box[d*2+1] - tile_box[d*2] + 1;
+    filtered.resize(outer*count*inner*sizeof(A));
+    filter_dimension<A, O>(reinterpret_cast<const A *>(cells.data()), reinterpret_cast<A *>(filtered.data()), outer,
+                           extents[d], inner, tile_box[d*2]-halo_box[d*2], count,
+                           std::vector<A>(kernel.begin(), kernel.end()));
+    cells.swap(filtered);
+    extents[d] = count;
+  }
+  return IMAGEDS_OK;
+}
+
+template<typename A>
+static int filter_cells(const ImageDSFilter& filter, std::vector<char>& cells, const std::vector<uint64_t>& halo_box,
+                        const std::vector<uint64_t>& tile_box) {
+  switch (filter.m_operation) {
+    case FILTER_CORRELATE:
+      return filter_passes<A, FILTER_CORRELATE>(filter, cells, halo_box, tile_box);
+    case FILTER_ERODE:
+      return filter_passes<A, FILTER_ERODE>(filter, cells, halo_box, tile_box);
+    case FILTER_DILATE:
+      return filter_passes<A, FILTER_DILATE>(filter, cells, halo_box, tile_box);
+  }
+  errno = EINVAL;
+  return IMAGEDS_ERR;
+}
+
+int imageds_filter_cells(attr_type_t work_type, const ImageDSFilter& filter, std::vector<char>& cells,
+                         const std::vector<uint64_t>& halo_box, const std::vector<uint64_t>& tile_box) {
+  if (work_type == FLOAT32) {
+    return filter_cells<float>(filter, cells, halo_box, tile_box);
+  } else if (work_type == FLOAT64) {
+    return filter_cells<double>(filter, cells, halo_box, tile_box);
+  }
+  errno = EINVAL;
+  return IMAGEDS_ERR;
+}
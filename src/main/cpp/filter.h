@@ -0,0 +1,55 @@
+/**
+ * @file filter.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Separable filters of tiles with the halos their kernels reach into
+ */
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Radius of the kernel of filter along every dimension of arrays of dim_num dimensions, 0 for dimensions without a
+ * kernel. Fails with EINVAL for filters ImageDS::filter rejects.
+ */
+int imageds_filter_radii(const ImageDSFilter& filter, size_t dim_num, std::vector<uint64_t>& radii);
+
+/** Type filters of cells of type source into cells of type result work in, FLOAT32 or FLOAT64 */
+attr_type_t imageds_filter_work_type(attr_type_t source, attr_type_t result);
+
+/**
+ * Filters cells of type work_type laid out over halo_box into the cells of tile_box, which replace them. halo_box is
+ * tile_box grown by the radii of filter and clipped to the domain, cells past its edges repeat the edge cells.
+ */
+int imageds_filter_cells(attr_type_t work_type, const ImageDSFilter& filter, std::vector<char>& cells,
+                         const std::vector<uint64_t>& halo_box, const std::vector<uint64_t>& tile_box);
+
+#endif //__FILTER_H__
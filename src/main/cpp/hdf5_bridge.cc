@@ -0,0 +1,565 @@
+/**
+ * @file hdf5_bridge.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Import of HDF5 datasets into and export to ImageDS arrays
+ */
+
+
+#include "hdf5_bridge.h"
+#include "tile_layout.h"
+
+#include "tiledb_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <hdf5.h>
+#include <map>
+#include <string.h>
+#include <zlib.h>
+
+// Registered ids of the HDF5 filter plugins
+#define HDF5_FILTER_BLOSC 32001
+#define HDF5_FILTER_LZ4 32004
+#define HDF5_FILTER_ZSTD 32015
+
+#define HDF5_DEFAULT_TILE_EXTENT 64
+#define HDF5_DEFAULT_DEFLATE_LEVEL 6
+#define HDF5_MAX_RANK 7
+
+// Closes the HDF5 identifier when going out of scope
+class H5Handle {
+ public:
+  H5Handle(hid_t id, herr_t (*close)(hid_t)) : m_id(id), m_close(close) {}
+
+  ~H5Handle() {
+    if (m_id >= 0) {
+      m_close(m_id);
+    }
+  }
+
+  H5Handle(const H5Handle& other) = delete;
+
+  operator hid_t() const {
+    return m_id;
+  }
+
+ private:
+  hid_t m_id;
+  herr_t (*m_close)(hid_t);
+};
+
+#define RETURN_IF_H5_ERROR(X, ERRNO) if ((X) < 0) {errno = ERRNO; return IMAGEDS_ERR;}
+
+static int to_attr_type(hid_t type, attr_type_t& attr_type) {
+  size_t size = H5Tget_size(type);
+  switch (H5Tget_class(type)) {
+    case H5T_INTEGER: {
+      static const attr_type_t signed_types[] = { INT8, INT16, INT32, INT64 };
+      static const attr_type_t unsigned_types[] = { UINT8, UINT16, UINT32, UINT64 };
+      int index = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : size == 8 ? 3 : -1;
+      if (index >= 0) {
+        attr_type = H5Tget_sign(type) == H5T_SGN_2 ? signed_types[index] : unsigned_types[index];
+        return IMAGEDS_OK;
+      }
+      break;
+    }
+    case H5T_FLOAT:
+      if (size == 4 || size == 8) {
+        attr_type = size == 4 ? FLOAT32 : FLOAT64;
+        return IMAGEDS_OK;
+      }
+      break;
+    default:
+      break;
+  }
+  errno = ENOTSUP;
+  return IMAGEDS_ERR;
+}
+
+static hid_t native_type(attr_type_t type) {
+  switch (type) {
+    case CHAR:
+      return H5T_NATIVE_CHAR;
+    case INT8:
+      return H5T_NATIVE_INT8;
+    case UINT8:
+      return H5T_NATIVE_UINT8;
+    case INT16:
+      return H5T_NATIVE_INT16;
+    case UINT16:
+      return H5T_NATIVE_UINT16;
+    case INT32:
+      return H5T_NATIVE_INT32;
+    case UINT32:
+      return H5T_NATIVE_UINT32;
+    case INT64:
+      return H5T_NATIVE_INT64;
+    case UINT64:
+      return H5T_NATIVE_UINT64;
+    case FLOAT32:
+      return H5T_NATIVE_FLOAT;
+    case FLOAT64:
+      return H5T_NATIVE_DOUBLE;
+  }
+  throw std::runtime_error("Not yet implemented!");
+}
+
+// Reverses the HDF5 filter pipeline, filters set in mask were skipped when the chunk was written
+static int decode_chunk(std::vector<char>& raw, uint32_t mask, const std::vector<H5Z_filter_t>& filters,
+                        size_t type_size, std::vector<char>& chunk) {
+  for (auto i=filters.size(); i-- > 0; ) {
+    if (mask & (1u << i)) {
+      continue;
+    }
+    switch (filters[i]) {
+      case H5Z_FILTER_DEFLATE: {
+        // Room for the fletcher32 checksum
+        std::vector<char> inflated(chunk.size()+sizeof(uint32_t));
+        uLongf length = inflated.size();
+        if (uncompress(reinterpret_cast<Bytef *>(inflated.data()), &length,
+                       reinterpret_cast<const Bytef *>(raw.data()), raw.size()) != Z_OK) {
+          errno = EINVAL;
+          return IMAGEDS_ERR;
+        }
+        inflated.resize(length);
+        raw.swap(inflated);
+        break;
+      }
+      case H5Z_FILTER_SHUFFLE: {
+        // Bytes are grouped by significance, trailing bytes of a partial element are left as they are
+        std::vector<char> unshuffled(raw);
+        size_t element_num = raw.size()/type_size;
+        for (size_t byte=0; byte<type_size; byte++) {
+          for (size_t element=0; element<element_num; element++) {
+            unshuffled[element*type_size + byte] = raw[byte*element_num + element];
+          }
+        }
+        raw.swap(unshuffled);
+        break;
+      }
+      case H5Z_FILTER_FLETCHER32:
+        if (raw.size() < 4) {
+          errno = EINVAL;
+          return IMAGEDS_ERR;
+        }
+        raw.resize(raw.size()-4);
+        break;
+    }
+  }
+  if (raw.size() != chunk.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  chunk.swap(raw);
+  return IMAGEDS_OK;
+}
+
+// Row-major chunk boxes of the chunk grid intersecting box, in dataset coordinates
+static std::vector<std::vector<uint64_t>> chunk_boxes(const std::vector<uint64_t>& box,
+                                                      const std::vector<uint64_t>& chunk_dims) {
+  size_t rank = chunk_dims.size();
+  std::vector<uint64_t> low(rank), high(rank);
+  for (auto i=0ul; i<rank; i++) {
+    low[i] = box[i*2]/chunk_dims[i];
+    high[i] = box[i*2+1]/chunk_dims[i];
+  }
+  std::vector<std::vector<uint64_t>> boxes;
+  std::vector<uint64_t> coords(low);
+  while (true) {
+    std::vector<uint64_t> chunk_box(rank*2);
+    for (auto i=0ul; i<rank; i++) {
+      chunk_box[i*2] = coords[i]*chunk_dims[i];
+      chunk_box[i*2+1] = chunk_box[i*2] + chunk_dims[i] - 1;
+    }
+    boxes.push_back(chunk_box);
+    size_t dim = rank;
+    while (dim-- > 0) {
+      if (++coords[dim] <= high[dim]) break;
+      coords[dim] = low[dim];
+    }
+    if (dim == static_cast<size_t>(-1)) break;
+  }
+  return boxes;
+}
+
+static herr_t read_attribute(hid_t location, const char *name, const H5A_info_t *, void *data) {
+  std::map<std::string, std::string>& metadata = *reinterpret_cast<std::map<std::string, std::string> *>(data);
+  H5Handle attribute(H5Aopen(location, name, H5P_DEFAULT), H5Aclose);
+  H5Handle type(H5Aget_type(attribute), H5Tclose);
+  H5Handle space(H5Aget_space(attribute), H5Sclose);
+  hssize_t value_num = H5Sget_simple_extent_npoints(space);
+  if (attribute < 0 || type < 0 || value_num <= 0) {
+    return 0;
+  }
+  switch (H5Tget_class(type)) {
+    case H5T_INTEGER:
+    case H5T_FLOAT: {
+      std::vector<double> values(value_num);
+      if (H5Aread(attribute, H5T_NATIVE_DOUBLE, values.data()) >= 0) {
+        metadata[name] = imageds_metadata_value(values);
+      }
+      break;
+    }
+    case H5T_STRING:
+      if (value_num == 1 && H5Tis_variable_str(type) > 0) {
+        char *value = NULL;
+        H5Handle memory_type(H5Tget_native_type(type, H5T_DIR_DEFAULT), H5Tclose);
+        if (H5Aread(attribute, memory_type, &value) >= 0 && value) {
+          metadata[name] = value;
+          H5free_memory(value);
+        }
+      } else if (value_num == 1) {
+        std::vector<char> value(H5Tget_size(type)+1, 0);
+        if (H5Aread(attribute, type, value.data()) >= 0) {
+          metadata[name] = value.data();
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+int imageds_hdf5_import(ImageDS& imageds, const std::string& filename, const std::string& dataset,
+                        const std::string& array_path, const std::string& attribute, uint64_t tile_extent) {
+  if (!TileDBUtils::is_file(filename)) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+  hid_t file_id = -1, dset_id = -1;
+  // Failures are reported through errno, not printed from the HDF5 error stack
+  H5E_BEGIN_TRY {
+    file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    dset_id = file_id < 0 ? -1 : H5Dopen2(file_id, dataset.c_str(), H5P_DEFAULT);
+  } H5E_END_TRY;
+  H5Handle file(file_id, H5Fclose);
+  RETURN_IF_H5_ERROR(file, EINVAL);
+  H5Handle dset(dset_id, H5Dclose);
+  RETURN_IF_H5_ERROR(dset, EINVAL);
+  H5Handle type(H5Dget_type(dset), H5Tclose);
+  H5Handle space(H5Dget_space(dset), H5Sclose);
+  H5Handle dcpl(H5Dget_create_plist(dset), H5Pclose);
+  RETURN_IF_H5_ERROR(std::min<hid_t>(type, std::min<hid_t>(space, dcpl)), EIO);
+  attr_type_t attr_type;
+  RETURN_EINVAL_IF_ERROR(to_attr_type(type, attr_type));
+  size_t cell_size = attr_type_size(attr_type);
+  H5Handle memory_type(H5Tget_native_type(type, H5T_DIR_DEFAULT), H5Tclose);
+  bool swapped = cell_size > 1 && H5Tget_order(type) != H5Tget_order(memory_type);
+
+  int rank = H5Sget_simple_extent_ndims(space);
+  if (rank < 1 || rank > HDF5_MAX_RANK) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  std::vector<hsize_t> dims(rank), chunk(rank);
+  H5Sget_simple_extent_dims(space, dims.data(), NULL);
+  bool chunked = H5Pget_layout(dcpl) == H5D_CHUNKED;
+  if (chunked) {
+    H5Pget_chunk(dcpl, rank, chunk.data());
+  }
+
+  // Filters map onto the compression of the attribute, the pipeline can be reversed here only for zlib filters
+  std::vector<H5Z_filter_t> filters;
+  compression_t compression = NONE;
+  int compression_level = 0;
+  bool raw = chunked;
+  for (auto i=0; i<H5Pget_nfilters(dcpl); i++) {
+    unsigned flags, config;
+    unsigned cd_values[8] = {0};
+    size_t cd_num = 8;
+    H5Z_filter_t filter = H5Pget_filter2(dcpl, i, &flags, &cd_num, cd_values, 0, NULL, &config);
+    filters.push_back(filter);
+    switch (filter) {
+      case H5Z_FILTER_DEFLATE:
+        compression = GZIP;
+        compression_level = cd_num ? cd_values[0] : 0;
+        break;
+      case HDF5_FILTER_ZSTD:
+        compression = ZSTD;
+        break;
+      case HDF5_FILTER_LZ4:
+        compression = LZ4;
+        break;
+      case HDF5_FILTER_BLOSC:
+        compression = BLOSC;
+        break;
+    }
+    raw = raw && (filter == H5Z_FILTER_DEFLATE || filter == H5Z_FILTER_SHUFFLE || filter == H5Z_FILTER_FLETCHER32);
+  }
+
+  static const char *dimension_names[] = { "X", "Y", "Z", "T", "U", "V", "W" };
+  ImageDSArray array(array_path);
+  try {
+    for (auto i=0; i<rank; i++) {
+      uint64_t extent = tile_extent ? tile_extent : chunked ? chunk[i] : HDF5_DEFAULT_TILE_EXTENT;
+      array.add_dimension(dimension_names[rank-1-i], 0, dims[i]-1, clamp_tile_extent(extent, dims[i]));
+    }
+  } catch (const ImageDSException& e) {
+    // Dataset too small to be tiled
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  array.add_attribute(attribute, attr_type, compression, compression_level);
+
+  // Slabs span whole chunks of the slowest dimension, so that every chunk is decoded once. The next slab is decoded
+  // while the previous one is being written.
+  uint64_t slab_rows = chunked ? chunk[0] : array.m_dimensions[0]->m_tile_extent;
+  uint64_t row_cells = 1;
+  for (auto i=1; i<rank; i++) {
+    row_cells *= dims[i];
+  }
+  std::vector<uint64_t> chunk_dims(chunk.begin(), chunk.end());
+  size_t chunk_size = cell_size;
+  for (auto extent : chunk_dims) {
+    chunk_size *= extent;
+  }
+  std::vector<char> slab_buffers[2];
+  std::future<int> pending_write;
+  for (uint64_t start=0, slab=0; start<dims[0]; start+=slab_rows, slab++) {
+    uint64_t end = std::min<uint64_t>(start+slab_rows, dims[0]) - 1;
+    std::vector<uint64_t> slab_box = { start, end };
+    for (auto i=1; i<rank; i++) {
+      slab_box.push_back(0);
+      slab_box.push_back(dims[i]-1);
+    }
+    std::vector<char>& buffer = slab_buffers[slab%2];
+    buffer.resize((end-start+1)*row_cells*cell_size);
+
+    std::atomic<int> status(IMAGEDS_OK);
+    if (raw) {
+      std::vector<std::vector<uint64_t>> boxes = chunk_boxes(slab_box, chunk_dims);
+      #pragma omp parallel for schedule(dynamic)
+      for (size_t i=0; i<boxes.size(); i++) {
+        std::vector<hsize_t> offset(rank);
+        for (auto j=0; j<rank; j++) {
+          offset[j] = boxes[i][j*2];
+        }
+        std::vector<char> encoded, cells(chunk_size, 0);
+        hsize_t stored = 0;
+        uint32_t mask = 0;
+        herr_t h5_status = 0;
+        #pragma omp critical(hdf5)
+        {
+          // Chunks that were never written are not allocated and read as zeros
+          if (H5Dget_chunk_storage_size(dset, offset.data(), &stored) >= 0 && stored) {
+            encoded.resize(stored);
+            h5_status = H5Dread_chunk(dset, H5P_DEFAULT, offset.data(), &mask, encoded.data());
+          }
+        }
+        if (h5_status < 0 || (!encoded.empty() && decode_chunk(encoded, mask, filters, cell_size, cells))) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        if (swapped) {
+          for (size_t j=0; j<cells.size(); j+=cell_size) {
+            std::reverse(cells.begin()+j, cells.begin()+j+cell_size);
+          }
+        }
+        std::vector<uint64_t> overlap;
+        intersect(boxes[i], slab_box, overlap);
+        copy_region(cells.data(), boxes[i], buffer.data(), slab_box, overlap, cell_size);
+      }
+    } else {
+      std::vector<hsize_t> slab_start(rank, 0), slab_count(dims);
+      slab_start[0] = start;
+      slab_count[0] = end-start+1;
+      H5Handle file_space(H5Dget_space(dset), H5Sclose);
+      H5Handle memory_space(H5Screate_simple(rank, slab_count.data(), NULL), H5Sclose);
+      if (H5Sselect_hyperslab(file_space, H5S_SELECT_SET, slab_start.data(), NULL, slab_count.data(), NULL) < 0
+          || H5Dread(dset, native_type(attr_type), memory_space, file_space, H5P_DEFAULT, buffer.data()) < 0) {
+        status = IMAGEDS_ERR;
+      }
+    }
+
+    if (pending_write.valid() && pending_write.get()) {
+      return IMAGEDS_ERR;
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+
+    pending_write = std::async(std::launch::async, [&imageds, &array, slab_box, &buffer]() {
+        return imageds.to_array(array, slab_box, {buffer.data()}, {buffer.size()});
+      });
+  }
+  if (pending_write.valid() && pending_write.get()) {
+    return IMAGEDS_ERR;
+  }
+
+  std::map<std::string, std::string> metadata;
+  H5Aiterate2(dset, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, read_attribute, &metadata);
+  return metadata.empty() ? IMAGEDS_OK : imageds.write_metadata(array_path, metadata);
+}
+
+int imageds_hdf5_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                        const std::string& dataset, const std::string& attribute) {
+  ImageDSArray schema;
+  RETURN_EINVAL_IF_ERROR(imageds.array_info(array_path, schema));
+  ImageDSAttribute *selected = NULL;
+  for (auto& schema_attribute : schema.m_attributes) {
+    if (attribute.empty() ? schema.m_attributes.size() == 1 : schema_attribute->m_name == attribute) {
+      selected = schema_attribute.get();
+    }
+  }
+  if (!selected) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  std::map<std::string, std::string> metadata;
+  RETURN_EIO_IF_ERROR(imageds.read_metadata(array_path, metadata));
+
+  int rank = schema.m_dimensions.size();
+  std::vector<hsize_t> dims, chunk;
+  std::vector<uint64_t> domain_start;
+  for (auto& dimension : schema.m_dimensions) {
+    dims.push_back(dimension->m_end - dimension->m_start + 1);
+    chunk.push_back(std::min<hsize_t>(dimension->m_tile_extent, dims.back()));
+    domain_start.push_back(dimension->m_start);
+  }
+  size_t cell_size = attr_type_size(selected->m_type);
+  bool deflate = selected->m_compression != NONE;
+  int deflate_level = selected->m_compression == GZIP && selected->m_compression_level > 0
+      ? selected->m_compression_level : HDF5_DEFAULT_DEFLATE_LEVEL;
+
+  H5Handle file(TileDBUtils::is_file(filename) ? H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT)
+                : H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT), H5Fclose);
+  RETURN_IF_H5_ERROR(file, EIO);
+  htri_t exists = 0;
+  H5E_BEGIN_TRY {
+    // Fails when an intermediate group is missing too
+    exists = H5Lexists(file, dataset.c_str(), H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (exists > 0) {
+    RETURN_IF_H5_ERROR(H5Ldelete(file, dataset.c_str(), H5P_DEFAULT), EIO);
+  }
+  H5Handle space(H5Screate_simple(rank, dims.data(), NULL), H5Sclose);
+  H5Handle dcpl(H5Pcreate(H5P_DATASET_CREATE), H5Pclose);
+  H5Handle lcpl(H5Pcreate(H5P_LINK_CREATE), H5Pclose);
+  RETURN_IF_H5_ERROR(H5Pset_chunk(dcpl, rank, chunk.data()), EINVAL);
+  if (deflate) {
+    RETURN_IF_H5_ERROR(H5Pset_deflate(dcpl, deflate_level), EINVAL);
+  }
+  RETURN_IF_H5_ERROR(H5Pset_create_intermediate_group(lcpl, 1), EIO);
+  H5Handle dset(H5Dcreate2(file, dataset.c_str(), native_type(selected->m_type), space, lcpl, dcpl, H5P_DEFAULT),
+                H5Dclose);
+  RETURN_IF_H5_ERROR(dset, EINVAL);
+
+  ImageDSArray array(array_path);
+  array.add_attribute(selected->m_name, selected->m_type);
+  uint64_t row_cells = 1;
+  for (auto i=1; i<rank; i++) {
+    row_cells *= dims[i];
+  }
+  auto read_slab = [&](uint64_t slab_start, std::vector<char> *buffer) {
+    std::vector<uint64_t> subarray;
+    for (auto i=0; i<rank; i++) {
+      subarray.push_back(domain_start[i] + (i ? 0 : slab_start));
+      subarray.push_back(domain_start[i] + (i ? dims[i] : std::min<uint64_t>(slab_start+chunk[0], dims[0])) - 1);
+    }
+    buffer->resize((subarray[1]-subarray[0]+1)*row_cells*cell_size);
+    return imageds.from_array(array, subarray, {buffer->data()}, {buffer->size()});
+  };
+
+  // Read the next slab of whole chunks while the chunks of the previous one are being compressed and written
+  std::vector<uint64_t> chunk_dims(chunk.begin(), chunk.end());
+  size_t chunk_size = cell_size;
+  for (auto extent : chunk_dims) {
+    chunk_size *= extent;
+  }
+  std::vector<char> slab_buffers[2];
+  std::future<int> pending_read = std::async(std::launch::async, read_slab, 0, &slab_buffers[0]);
+  int rc = IMAGEDS_OK;
+  for (uint64_t start=0, slab=0; start<dims[0] && !rc; start+=chunk[0], slab++) {
+    if (pending_read.get()) {
+      rc = IMAGEDS_ERR;
+      break;
+    }
+    if (start+chunk[0] < dims[0]) {
+      pending_read = std::async(std::launch::async, read_slab, start+chunk[0], &slab_buffers[(slab+1)%2]);
+    }
+    std::vector<char>& buffer = slab_buffers[slab%2];
+    std::vector<uint64_t> slab_box = { start, std::min<uint64_t>(start+chunk[0], dims[0])-1 };
+    for (auto i=1; i<rank; i++) {
+      slab_box.push_back(0);
+      slab_box.push_back(dims[i]-1);
+    }
+
+    std::vector<std::vector<uint64_t>> boxes = chunk_boxes(slab_box, chunk_dims);
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i=0; i<boxes.size(); i++) {
+      // Edge chunks are padded with zeros
+      std::vector<char> cells(chunk_size, 0);
+      std::vector<uint64_t> overlap;
+      intersect(boxes[i], slab_box, overlap);
+      copy_region(buffer.data(), slab_box, cells.data(), boxes[i], overlap, cell_size);
+      if (deflate) {
+        uLongf length = compressBound(cells.size());
+        std::vector<char> compressed(length);
+        if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &length,
+                      reinterpret_cast<const Bytef *>(cells.data()), cells.size(), deflate_level) != Z_OK) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        compressed.resize(length);
+        cells.swap(compressed);
+      }
+      std::vector<hsize_t> offset(rank);
+      for (auto j=0; j<rank; j++) {
+        offset[j] = boxes[i][j*2];
+      }
+      #pragma omp critical(hdf5)
+      {
+        if (H5Dwrite_chunk(dset, H5P_DEFAULT, 0, offset.data(), cells.size(), cells.data()) < 0) {
+          status = IMAGEDS_ERR;
+        }
+      }
+    }
+    if (status) {
+      errno = EIO;
+      rc = IMAGEDS_ERR;
+    }
+  }
+  if (pending_read.valid()) {
+    pending_read.wait();
+  }
+  if (rc) {
+    return rc;
+  }
+
+  H5Handle scalar(H5Screate(H5S_SCALAR), H5Sclose);
+  for (auto& entry : metadata) {
+    H5Handle string_type(H5Tcopy(H5T_C_S1), H5Tclose);
+    H5Tset_size(string_type, std::max<size_t>(entry.second.size(), 1));
+    H5Handle h5_attribute(H5Acreate2(dset, entry.first.c_str(), string_type, scalar, H5P_DEFAULT, H5P_DEFAULT),
+                          H5Aclose);
+    std::string value = entry.second.empty() ? std::string(1, '\0') : entry.second;
+    RETURN_IF_H5_ERROR(std::min<hid_t>(h5_attribute, H5Awrite(h5_attribute, string_type, value.data())), EIO);
+  }
+  RETURN_IF_H5_ERROR(H5Fflush(file, H5F_SCOPE_LOCAL), EIO);
+  return IMAGEDS_OK;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file hdf5_bridge.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Import of HDF5 datasets into and export to ImageDS arrays
+ *
+ * HDF5 chunk dimensions map onto tile extents and the deflate, zstd, lz4 and blosc filters onto compression_t.
+ * Chunks compressed only with deflate, shuffle and fletcher32 are read and written raw with H5Dread_chunk and
+ * H5Dwrite_chunk and (de)compressed in parallel outside of the HDF5 library, which serializes all calls behind a
+ * global lock. Other layouts and filters go through H5Dread with HDF5 decoding slab by slab.
+ */
+
+#ifndef __HDF5_BRIDGE_H__
+#define __HDF5_BRIDGE_H__
+
+#include "imageds.h"
+
+#include <string>
+
+/**
+ * Imports dataset of an HDF5 file into a dense array with a single attribute. Dimensions are named X, Y, Z, T, ...
+ * from the fastest varying one. tile_extent overrides the chunk dimensions of chunked datasets and is used for
+ * contiguous datasets. Chunks are decoded in parallel into tile-aligned slabs of the slowest dimension that are
+ * written while the next slab is decoded. Numeric and string attributes of the dataset are stored as array metadata.
+ */
+IMAGEDS_PUBLIC int imageds_hdf5_import(ImageDS& imageds, const std::string& filename, const std::string& dataset,
+                                       const std::string& array_path, const std::string& attribute="Intensity",
+                                       uint64_t tile_extent=0);
+
+/**
+ * Exports one attribute of an array into dataset of an HDF5 file, which is created if needed. The dataset is
+ * chunked with the tile extents and deflate compressed if the attribute is compressed. Array metadata is stored
+ * as string attributes of the dataset. attribute can be empty for single attribute arrays.
+ */
+IMAGEDS_PUBLIC int imageds_hdf5_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                                       const std::string& dataset, const std::string& attribute="");
+
+#endif //__HDF5_BRIDGE_H__
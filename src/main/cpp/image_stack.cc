@@ -0,0 +1,403 @@
+/**
+ * @file image_stack.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Ingestion of TIFF and PNG images and image stacks into ImageDS arrays
+ */
+
+
+#include "image_stack.h"
+#include "tiff.h"
+#include "tile_layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+#ifdef IMAGEDS_PNG
+#include <png.h>
+#endif
+
+#define PNG_SIGNATURE_LENGTH 8
+
+size_t ImageDSImageFile::pixel_size() const {
+  return m_samples*attr_type_size(m_type);
+}
+
+#ifdef IMAGEDS_PNG
+// Decodes to 8/16 bit gray, gray+alpha, RGB or RGBA samples in host byte order, only the header if buffer is NULL
+static int png_decode(const std::string& filename, ImageDSImageFile& image, void *buffer) {
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    return IMAGEDS_ERR;
+  }
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  std::vector<png_bytep> rows;
+  if (!info || setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  png_init_io(png, fp);
+  png_read_info(png, info);
+  int color_type = png_get_color_type(png, info);
+  int bit_depth = png_get_bit_depth(png, info);
+  if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    png_set_palette_to_rgb(png);
+  }
+  if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+    png_set_expand_gray_1_2_4_to_8(png);
+  }
+  if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+    png_set_tRNS_to_alpha(png);
+  }
+  uint16_t endianness = 1;
+  if (bit_depth == 16 && *reinterpret_cast<char *>(&endianness) == 1) {
+    png_set_swap(png);
+  }
+  png_set_interlace_handling(png);
+  png_read_update_info(png, info);
+
+  image.m_format = PNG_IMAGE;
+  image.m_directory_num = 1;
+  image.m_width = png_get_image_width(png, info);
+  image.m_height = png_get_image_height(png, info);
+  image.m_samples = png_get_channels(png, info);
+  image.m_type = png_get_bit_depth(png, info) == 16 ? UINT16 : UINT8;
+  image.m_tiled = false;
+
+  if (buffer) {
+    size_t row_size = image.m_width*image.pixel_size();
+    for (uint64_t i=0; i<image.m_height; i++) {
+      rows.push_back(reinterpret_cast<png_bytep>(buffer) + i*row_size);
+    }
+    png_read_image(png, rows.data());
+    png_read_end(png, NULL);
+  }
+  png_destroy_read_struct(&png, &info, NULL);
+  fclose(fp);
+  return IMAGEDS_OK;
+}
+#endif
+
+int imageds_image_read_header(const std::string& filename, ImageDSImageFile& image, int directory) {
+  unsigned char signature[PNG_SIGNATURE_LENGTH] = {0};
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    return IMAGEDS_ERR;
+  }
+  size_t length = fread(signature, 1, PNG_SIGNATURE_LENGTH, fp);
+  fclose(fp);
+
+  image.m_filename = filename;
+  image.m_directory = directory;
+  if (length == PNG_SIGNATURE_LENGTH && !memcmp(signature, "\x89PNG\r\n\x1a\n", PNG_SIGNATURE_LENGTH)) {
+#ifdef IMAGEDS_PNG
+    if (directory) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    return png_decode(filename, image, NULL);
+#else
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+#endif
+  }
+
+  ImageDSTiff tiff;
+  RETURN_EINVAL_IF_ERROR(tiff.open(filename, directory));
+  image.m_format = TIFF_IMAGE;
+  image.m_directory_num = tiff.directory_num();
+  image.m_width = tiff.width();
+  image.m_height = tiff.height();
+  image.m_samples = tiff.samples();
+  image.m_type = tiff.type();
+  image.m_tiled = tiff.tiled();
+  image.m_tile_width = tiff.tiled() ? tiff.chunk_width() : 0;
+  image.m_tile_height = tiff.tiled() ? tiff.chunk_height() : 0;
+  return IMAGEDS_OK;
+}
+
+int imageds_image_read(const ImageDSImageFile& image, void *buffer) {
+  if (image.m_format == PNG_IMAGE) {
+#ifdef IMAGEDS_PNG
+    ImageDSImageFile decoded;
+    RETURN_EINVAL_IF_ERROR(png_decode(image.m_filename, decoded, buffer));
+    if (decoded.m_width != image.m_width || decoded.m_height != image.m_height
+        || decoded.pixel_size() != image.pixel_size()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    return IMAGEDS_OK;
+#else
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+#endif
+  }
+
+  ImageDSTiff tiff;
+  RETURN_EINVAL_IF_ERROR(tiff.open(image.m_filename, image.m_directory));
+  if (tiff.width() != image.m_width || tiff.height() != image.m_height || tiff.pixel_size() != image.pixel_size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return tiff.read({ 0, image.m_height-1, 0, image.m_width-1 }, buffer);
+}
+
+/**
+ * Copies the interleaved samples of region from a buffer laid out over src_box into one buffer per channel laid
+ * out over dst_box. Boxes and region are given as [y0, y1, x0, x1].
+ */
+static void deinterleave(const char *src, const std::vector<uint64_t>& src_box,
+                         const std::vector<char *>& dst, const std::vector<uint64_t>& dst_box,
+                         const std::vector<uint64_t>& region, size_t sample_size) {
+  size_t samples = dst.size();
+  uint64_t src_width = src_box[3] - src_box[2] + 1;
+  uint64_t dst_width = dst_box[3] - dst_box[2] + 1;
+  for (uint64_t y=region[0]; y<=region[1]; y++) {
+    const char *sample = src + ((y-src_box[0])*src_width + region[2]-src_box[2])*samples*sample_size;
+    uint64_t offset = ((y-dst_box[0])*dst_width + region[2]-dst_box[2])*sample_size;
+    for (uint64_t x=region[2]; x<=region[3]; x++, offset+=sample_size) {
+      for (size_t i=0; i<samples; i++, sample+=sample_size) {
+        memcpy(dst[i]+offset, sample, sample_size);
+      }
+    }
+  }
+}
+
+static void add_image_attributes(ImageDSArray& array, const ImageDSImageFile& image, compression_t compression,
+                                 int compression_level) {
+  if (image.m_samples == 1) {
+    array.add_attribute("Intensity", image.m_type, compression, compression_level);
+  } else {
+    for (auto i=0; i<image.m_samples; i++) {
+      array.add_attribute("Intensity_" + std::to_string(i), image.m_type, compression, compression_level);
+    }
+  }
+}
+
+/** Writes the channel buffers of a band or slab asynchronously, buffers have to be kept alive until it completes */
+static std::future<int> write_async(ImageDS& imageds, ImageDSArray& array, const std::vector<uint64_t>& subarray,
+                                    std::vector<std::vector<char>>& buffers) {
+  return std::async(std::launch::async, [&imageds, &array, subarray, &buffers]() {
+      std::vector<void *> pointers;
+      std::vector<size_t> sizes;
+      for (auto& buffer : buffers) {
+        pointers.push_back(buffer.data());
+        sizes.push_back(buffer.size());
+      }
+      return imageds.to_array(array, subarray, pointers, sizes);
+    });
+}
+
+int imageds_stack_ingest(ImageDS& imageds, const std::vector<std::string>& filenames, const std::string& array_path,
+                         uint64_t slab_slices, uint64_t tile_extent, compression_t compression, int compression_level) {
+  if (filenames.empty()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<ImageDSImageFile> images(filenames.size());
+  std::atomic<int> status(IMAGEDS_OK);
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t i=0; i<filenames.size(); i++) {
+    if (imageds_image_read_header(filenames[i], images[i])) {
+      status = IMAGEDS_ERR;
+    }
+  }
+  RETURN_EINVAL_IF_ERROR(status.load());
+
+  const ImageDSImageFile& first = images[0];
+  for (auto& image : images) {
+    if (image.m_width != first.m_width || image.m_height != first.m_height || image.m_samples != first.m_samples
+        || image.m_type != first.m_type) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+  }
+
+  uint64_t slices = images.size();
+  uint64_t rows = first.m_height;
+  uint64_t columns = first.m_width;
+  size_t sample_size = attr_type_size(first.m_type);
+  slab_slices = clamp_tile_extent(slab_slices, slices);
+
+  ImageDSArray array(array_path);
+  try {
+    array.add_dimension("Z", 0, slices-1, slab_slices);
+    array.add_dimension("Y", 0, rows-1, clamp_tile_extent(tile_extent, rows));
+    array.add_dimension("X", 0, columns-1, clamp_tile_extent(tile_extent, columns));
+  } catch (const ImageDSException& e) {
+    // Stack too small to be tiled
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  add_image_attributes(array, first, compression, compression_level);
+
+  // Decode the next slab while the previous one is being written
+  size_t plane_size = rows*columns*sample_size;
+  std::vector<uint64_t> plane = { 0, rows-1, 0, columns-1 };
+  std::vector<std::vector<char>> slab_buffers[2];
+  std::future<int> pending_write;
+  for (uint64_t start=0, slab=0; start<slices; start+=slab_slices, slab++) {
+    uint64_t end = std::min(start+slab_slices, slices) - 1;
+    std::vector<std::vector<char>>& buffers = slab_buffers[slab%2];
+    buffers.resize(first.m_samples);
+    for (auto& buffer : buffers) {
+      buffer.resize((end-start+1)*plane_size);
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (uint64_t i=start; i<=end; i++) {
+      if (first.m_samples == 1) {
+        if (imageds_image_read(images[i], buffers[0].data()+(i-start)*plane_size)) {
+          status = IMAGEDS_ERR;
+        }
+      } else {
+        std::vector<char> pixels(plane_size*first.m_samples);
+        std::vector<char *> channels;
+        for (auto& buffer : buffers) {
+          channels.push_back(buffer.data()+(i-start)*plane_size);
+        }
+        if (imageds_image_read(images[i], pixels.data())) {
+          status = IMAGEDS_ERR;
+        } else {
+          deinterleave(pixels.data(), plane, channels, plane, plane, sample_size);
+        }
+      }
+    }
+
+    if (pending_write.valid() && pending_write.get()) {
+      return IMAGEDS_ERR;
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+
+    pending_write = write_async(imageds, array, { start, end, 0, rows-1, 0, columns-1 }, buffers);
+  }
+  if (pending_write.valid() && pending_write.get()) {
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+int imageds_tiff_ingest(ImageDS& imageds, const std::string& filename, const std::string& array_path, int directory,
+                        uint64_t tile_extent, compression_t compression, int compression_level) {
+  ImageDSImageFile image;
+  RETURN_EINVAL_IF_ERROR(imageds_image_read_header(filename, image, directory));
+  if (image.m_format != TIFF_IMAGE) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  ImageDSTiff tiff;
+  RETURN_EINVAL_IF_ERROR(tiff.open(filename, directory));
+
+  uint64_t rows = image.m_height;
+  uint64_t columns = image.m_width;
+  size_t sample_size = attr_type_size(image.m_type);
+  uint64_t tile_rows = clamp_tile_extent(tile_extent ? tile_extent : image.m_tiled ? image.m_tile_height : 256, rows);
+  uint64_t tile_columns = clamp_tile_extent(tile_extent ? tile_extent : image.m_tiled ? image.m_tile_width : 256,
+                                            columns);
+
+  ImageDSArray array(array_path);
+  try {
+    array.add_dimension("Y", 0, rows-1, tile_rows);
+    array.add_dimension("X", 0, columns-1, tile_columns);
+  } catch (const ImageDSException& e) {
+    // Image too small to be tiled
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  add_image_attributes(array, image, compression, compression_level);
+
+  // Bands of tile_rows rows are decoded chunk by chunk while the previous band is being written. Chunks reaching
+  // past a band are carried over to the next one, so every TIFF tile is decompressed exactly once even when
+  // tile_rows is not a multiple of the TIFF tile height.
+  std::vector<std::vector<char>> band_buffers[2];
+  std::unordered_map<uint64_t, std::vector<char>> carried;
+  std::future<int> pending_write;
+  for (uint64_t start=0, band=0; start<rows; start+=tile_rows, band++) {
+    uint64_t end = std::min(start+tile_rows, rows) - 1;
+    std::vector<uint64_t> region = { start, end, 0, columns-1 };
+    std::vector<std::vector<char>>& buffers = band_buffers[band%2];
+    buffers.resize(image.m_samples);
+    std::vector<char *> channels;
+    for (auto& buffer : buffers) {
+      buffer.resize((end-start+1)*columns*sample_size);
+      channels.push_back(buffer.data());
+    }
+
+    std::vector<uint64_t> chunks = tiff.chunks(region);
+    std::vector<std::vector<char>> decoded(chunks.size());
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i=0; i<chunks.size(); i++) {
+      std::vector<char>& pixels = decoded[i];
+      std::vector<uint64_t> source = tiff.chunk_region(chunks[i]);
+      std::vector<uint64_t> overlap;
+      auto carried_chunk = carried.find(chunks[i]);
+      if (carried_chunk != carried.end()) {
+        pixels.swap(carried_chunk->second);
+      } else if (tiff.read_chunk(chunks[i], pixels)) {
+        status = IMAGEDS_ERR;
+        continue;
+      }
+      if (intersect(source, region, overlap)) {
+        if (image.m_samples == 1) {
+          copy_region(pixels.data(), source, channels[0], region, overlap, sample_size);
+        } else {
+          deinterleave(pixels.data(), source, channels, region, overlap, sample_size);
+        }
+      }
+      if (source[1] <= end || end+1 == rows) {
+        std::vector<char>().swap(pixels);
+      }
+    }
+
+    carried.clear();
+    for (size_t i=0; i<chunks.size(); i++) {
+      if (!decoded[i].empty()) {
+        carried[chunks[i]].swap(decoded[i]);
+      }
+    }
+
+    if (pending_write.valid() && pending_write.get()) {
+      return IMAGEDS_ERR;
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+
+    pending_write = write_async(imageds, array, region, buffers);
+  }
+  if (pending_write.valid() && pending_write.get()) {
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file image_stack.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Ingestion of TIFF and PNG images and image stacks into ImageDS arrays
+ *
+ * Images are stored with dimensions Y, X and stacks with dimensions Z, Y, X. Single channel images go to the
+ * Intensity attribute, multi-channel images to one attribute per channel named Intensity_0, Intensity_1, ...
+ */
+
+#ifndef __IMAGE_STACK_H__
+#define __IMAGE_STACK_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+typedef enum imageds_image_format_t {
+  TIFF_IMAGE=0,
+  PNG_IMAGE=1
+} image_format_t;
+
+/** Geometry of a single TIFF image file directory or PNG image */
+class IMAGEDS_PUBLIC ImageDSImageFile {
+ public:
+  std::string m_filename;
+  image_format_t m_format = TIFF_IMAGE;
+  int m_directory = 0;
+  int m_directory_num = 1; // Pyramid levels or pages of TIFF files
+  uint64_t m_width = 0;
+  uint64_t m_height = 0;
+  int m_samples = 1;
+  attr_type_t m_type = UINT8;
+  bool m_tiled = false;
+  uint64_t m_tile_width = 0;
+  uint64_t m_tile_height = 0;
+
+  size_t pixel_size() const;
+};
+
+/** Reads the header of a TIFF image file directory or a PNG file, PNG support needs libpng at build time */
+IMAGEDS_PUBLIC int imageds_image_read_header(const std::string& filename, ImageDSImageFile& image, int directory=0);
+
+/** Decodes the whole image into buffer as row-major interleaved samples in host byte order */
+IMAGEDS_PUBLIC int imageds_image_read(const ImageDSImageFile& image, void *buffer);
+
+/**
+ * Ingests a stack of equally sized images, e.g. one TIFF or PNG file per slice, into a dense 3D array. slab_slices
+ * is the Z tile extent and tile_extent the Y and X tile extents, both clamped to the stack size. The slices of every
+ * tile-aligned slab are decoded in parallel and the slab is written with to_array while the next one is decoded.
+ */
+IMAGEDS_PUBLIC int imageds_stack_ingest(ImageDS& imageds, const std::vector<std::string>& filenames,
+                                        const std::string& array_path, uint64_t slab_slices=16,
+                                        uint64_t tile_extent=256, compression_t compression=NONE,
+                                        int compression_level=0);
+
+/**
+ * Ingests one image file directory of a, possibly pyramidal, TIFF file into a dense 2D array. Tiles of tiled TIFFs
+ * are decoded exactly once, in parallel, straight into bands of tile_extent rows that are written while the next
+ * band is decoded, so the whole image is never held in memory. Tiles straddling two bands are held until the second
+ * band is decoded. tile_extent defaults to the TIFF tile size.
+ */
+IMAGEDS_PUBLIC int imageds_tiff_ingest(ImageDS& imageds, const std::string& filename, const std::string& array_path,
+                                       int directory=0, uint64_t tile_extent=0, compression_t compression=NONE,
+                                       int compression_level=0);
+
+#endif //__IMAGE_STACK_H__
@@ -28,57 +28,121 @@
  * @section DESCRIPTION ImageDS C++ Implementation
  */
 
+#include "batch_reader.h"
+#include "context_pool.h"
+#include "convert.h"
+#include "filter.h"
 #include "imageds.h"
+#include "interpolate.h"
+#include "io_pool.h"
+#include "memory_budget.h"
+#include "page_cache.h"
+#include "projection.h"
+#include "schema_cache.h"
+#include "single_flight.h"
+#include "stats.h"
+#include "tile_cache.h"
+#include "tile_layout.h"
+#include "tile_store.h"
+#include "trace.h"
 
 #include "tiledb.h"
 #include "tiledb_constants.h"
 #include "tiledb_storage.h"
 #include "tiledb_utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <sstream>
+#include <fcntl.h>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
 
 #define TILEDB_CTX reinterpret_cast<TileDB_CTX*>(m_tiledb_ctx)
 
+#define IMAGEDS_DEFAULT_TILE_CACHE_CAPACITY 256*1024*1024
+#define IMAGEDS_DEFAULT_IO_THREADS 4
+#define IMAGEDS_DEFAULT_IO_QUEUE_DEPTH 64
+#define IMAGEDS_IO_URING_QUEUE_DEPTH 64
+
+#define IMAGEDS_METADATA "__imageds_metadata"
+
 std::string imageds_version() {
   return IMAGEDS_VERSION;
 }
 
-ImageDS::ImageDS(const std::string& workspace, const bool overwrite, const bool disable_file_locking)
-    : m_workspace(workspace) {
-  TileDB_CTX* tiledb_ctx;
-  VERIFY(!TileDBUtils::initialize_workspace(&tiledb_ctx, workspace, overwrite, disable_file_locking) && "Could not create TileDB workspace");
+std::string imageds_metadata_value(const std::vector<double>& values) {
+  std::ostringstream out;
+  out.precision(17);
+  for (auto i=0ul; i<values.size(); i++) {
+    out << (i ? "\\" : "") << values[i];
+  }
+  return out.str();
+}
+
+std::vector<double> imageds_metadata_values(const std::string& value) {
+  std::vector<double> values;
+  std::istringstream in(value);
+  std::string item;
+  while (std::getline(in, item, '\\')) {
+    values.push_back(strtod(item.c_str(), NULL));
+  }
+  return values;
+}
+
+ImageDS::ImageDS(const std::string& workspace, const bool overwrite, const bool disable_file_locking,
+                 const bool open_existing)
+    : m_workspace(workspace), m_tile_dedup(false), m_read_coalescing(true),
+      m_io_uring(false), m_scan_mode(false) {
+  TileDB_CTX* tiledb_ctx = NULL;
+  int rc = TileDBUtils::initialize_workspace(&tiledb_ctx, workspace, overwrite, disable_file_locking);
+  // initialize_workspace returns 1 when the workspace already exists
+  VERIFY((!rc || (rc == 1 && open_existing && tiledb_ctx)) && "Could not create TileDB workspace");
   m_tiledb_ctx = reinterpret_cast<void*>(tiledb_ctx);
   m_working_dir = parent_dir(workspace);
   if (m_working_dir.empty()) {
     m_working_dir = current_working_dir(tiledb_ctx);
   }
+  m_tile_store = std::unique_ptr<ImageDSTileStore>(new ImageDSTileStore(m_tiledb_ctx));
+  m_tile_cache = std::make_shared<ImageDSTileCache>(IMAGEDS_DEFAULT_TILE_CACHE_CAPACITY);
+  m_memory_budget = std::make_shared<ImageDSMemoryBudget>(m_tile_cache);
+  m_stats = std::make_shared<ImageDSStatsCollector>();
+  m_schema_cache = std::make_shared<ImageDSSchemaCache>();
+  m_context_pool = std::make_shared<ImageDSContextPool>(workspace);
 }
 
 ImageDS::~ImageDS() {
+  // Outstanding requests run on the instances of the pool
+  m_io_pool.reset();
   if (tiledb_ctx_finalize(TILEDB_CTX)) {
     std::cerr << "Could not finalize TileDB:" << tiledb_errmsg << std::endl; 
   }
 }
 
 int ImageDS::array_info(const std::string& array_path, ImageDSArray& array) {
+  IMAGEDS_TRACE_SPAN("array_info", array_path);
   RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
   RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array_path));
+  RETURN_EINVAL_IF_ERROR(read_array_schema(array_path, array));
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
 
-  TileDB_Array* tiledb_array;
-  RETURN_EINVAL_IF_ERROR(
-      tiledb_array_init(TILEDB_CTX,
-                        &tiledb_array,
-                        array_path.c_str(),
-                        TILEDB_ARRAY_READ,
-                        NULL, // Entire domain
-                        NULL, // All attributes
-                        0));
-
+// Expects the TileDB working dir to be the workspace
+int ImageDS::read_array_schema(const std::string& array_path, ImageDSArray& array) {
+  IMAGEDS_TRACE_SPAN("read_array_schema");
   TileDB_ArraySchema array_schema;
-  RETURN_EINVAL_IF_ERROR(tiledb_array_get_schema(tiledb_array, &array_schema));
+  RETURN_EINVAL_IF_ERROR(tiledb_array_load_schema(TILEDB_CTX, array_path.c_str(), &array_schema));
   if (!array_schema.dense_) {
+    tiledb_array_free_schema(&array_schema);
     errno = ECANCELED;
     return IMAGEDS_ERR;
   }
@@ -96,18 +160,86 @@ int ImageDS::array_info(const std::string& array_path, ImageDSArray& array) {
   int64_t *tile_extents = (int64_t *)array_schema.tile_extents_;
   for (auto i=0; i<array_schema.dim_num_; i++) {
     ImageDSDimension *dimension = new ImageDSDimension(array_schema.dimensions_[i],
-                               domain[i],
-                               domain[i+1],
+                               domain[i*2],
+                               domain[i*2+1],
                                tile_extents[i]);
     array.m_dimensions.push_back(std::unique_ptr<ImageDSDimension>(dimension));
   }
 
-  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  RETURN_EINVAL_IF_ERROR(tiledb_array_free_schema(&array_schema));
   return IMAGEDS_OK;
 }
 
 int ImageDS::to_array(ImageDSArray& array, const std::vector<void *> buffers, const std::vector<size_t> buffer_sizes) {
-   RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  return to_array(array, std::vector<uint64_t>(), buffers, buffer_sizes);
+}
+
+static uint64_t elapsed_us(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bytes read from storage devices by the calling thread, reads served from the page cache are not counted
+static uint64_t thread_read_bytes() {
+#ifdef RUSAGE_THREAD
+  struct rusage usage;
+  if (!getrusage(RUSAGE_THREAD, &usage)) {
+    return usage.ru_inblock*512;
+  }
+#endif
+  return 0;
+}
+
+// Finalizes an initialized TileDB array once, whether the read or write returns early, throws or completes
+class TileDBArrayGuard {
+ public:
+  TileDBArrayGuard(TileDB_Array *tiledb_array) : m_tiledb_array(tiledb_array) {}
+
+  ~TileDBArrayGuard() {
+    finalize();
+  }
+
+  int finalize() {
+    TileDB_Array *tiledb_array = m_tiledb_array;
+    m_tiledb_array = NULL;
+    return tiledb_array ? tiledb_array_finalize(tiledb_array) : TILEDB_OK;
+  }
+
+ private:
+  TileDBArrayGuard(const TileDBArrayGuard&) = delete;
+  TileDBArrayGuard& operator=(const TileDBArrayGuard&) = delete;
+
+  TileDB_Array *m_tiledb_array;
+};
+
+int ImageDS::to_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *> buffers,
+                      const std::vector<size_t> buffer_sizes) {
+  // Slabs of ingesters are written to TileDB, tile references are only maintained for the entire domain
+  return to_array(array, subarray, buffers, buffer_sizes, m_tile_dedup && subarray.empty());
+}
+
+int ImageDS::to_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *>& buffers,
+                      const std::vector<size_t>& buffer_sizes, bool tile_dedup) {
+  auto start = std::chrono::steady_clock::now();
+  int status = write_array(array, subarray, buffers, buffer_sizes, tile_dedup);
+  uint64_t latency = elapsed_us(start);
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_to_array_calls++;
+      stats.m_to_array_latency.add(latency);
+      if (status) {
+        stats.m_errors++;
+      } else {
+        for (auto size : buffer_sizes) {
+          stats.m_bytes_written += size;
+        }
+      }
+    });
+  return status;
+}
+
+int ImageDS::write_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *>& buffers,
+                         const std::vector<size_t>& buffer_sizes, bool tile_dedup) {
+  IMAGEDS_TRACE_SPAN("to_array", array.m_path);
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
   
   if (is_array(TILEDB_CTX, array.m_path)) {
     // TODO: Validate existing schema
@@ -115,24 +247,85 @@ int ImageDS::to_array(ImageDSArray& array, const std::vector<void *> buffers, co
     RETURN_ECANCELED_IF_ERROR(setup_tiledb_schema(array));
   }
 
+  if (!subarray.empty()) {
+    IMAGEDS_TRACE_SPAN("validate_subarray");
+    // Dense writes are constrained to the subarray and have to cover it completely
+    ImageDSArray schema;
+    RETURN_EINVAL_IF_ERROR(read_array_schema(array.m_path, schema));
+    ImageDSTileLayout layout(schema.m_dimensions);
+    std::vector<uint64_t> clipped;
+    if (subarray.size() != layout.domain().size() || !intersect(subarray, layout.domain(), clipped)
+        || clipped != subarray || buffer_sizes.size() != schema.m_attributes.size()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    for (auto i=0ul; i<schema.m_attributes.size(); i++) {
+      if (buffer_sizes[i] != ImageDSTileLayout::cell_num(subarray)*attr_type_size(schema.m_attributes[i]->m_type)) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+    }
+  }
+
+  if (tile_dedup) {
+    if (!subarray.empty()) {
+      // Tile references are only maintained for writes of the entire domain
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+    RETURN_ECANCELED_IF_ERROR(to_tile_store(array, buffers, buffer_sizes));
+    RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+    return IMAGEDS_OK;
+  }
+
+  // Reads resolve tile references whenever they exist, so they cannot outlive a write to TileDB
+  bool tile_refs = m_tile_store->has_refs(array.m_path);
+  if (tile_refs && !subarray.empty()) {
+    // Cells outside the subarray are only held by the referenced tiles
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+
+  // TileDB copies the cells into tiles and compresses them before the fragment is flushed
+  size_t write_memory = 0;
+  for (auto size : buffer_sizes) {
+    write_memory += size;
+  }
+  ImageDSMemoryReservation reservation(*m_memory_budget, write_memory);
+
   TileDB_Array* tiledb_array;
-  RETURN_EINVAL_IF_ERROR(tiledb_array_init(TILEDB_CTX,
-                                           &tiledb_array,
-                                           array.m_path.c_str(),
-                                           TILEDB_ARRAY_WRITE_SORTED_ROW,
-                                           NULL, // Entire domain
-                                           NULL, // All attributes
-                                           0));
+  {
+    IMAGEDS_TRACE_SPAN("tiledb_array_init");
+    RETURN_EINVAL_IF_ERROR(tiledb_array_init(TILEDB_CTX,
+                                             &tiledb_array,
+                                             array.m_path.c_str(),
+                                             TILEDB_ARRAY_WRITE_SORTED_ROW,
+                                             subarray.empty() ? NULL : subarray.data(), // NULL is entire domain
+                                             NULL, // All attributes
+                                             0));
+  }
+  TileDBArrayGuard array_guard(tiledb_array);
 
   // TODO Validate that buffers are complete as this is a dense array
 
-  RETURN_EINVAL_IF_ERROR(tiledb_array_write(tiledb_array,
-                                            const_cast<const void **>(buffers.data()),
-                                            buffer_sizes.data()));
+  {
+    // Reordering into tiles and compression happen here, the fragment is flushed on finalize
+    IMAGEDS_TRACE_SPAN("tiledb_array_write");
+    RETURN_EINVAL_IF_ERROR(tiledb_array_write(tiledb_array,
+                                              const_cast<const void **>(buffers.data()),
+                                              buffer_sizes.data()));
+  }
 
   //TODO: Check for overflow
 
-  RETURN_ECANCELED_IF_ERROR(tiledb_array_finalize(tiledb_array));
+  {
+    IMAGEDS_TRACE_SPAN("tiledb_array_finalize");
+    RETURN_ECANCELED_IF_ERROR(array_guard.finalize());
+  }
+  if (tile_refs) {
+    // The fragment covers the entire domain and supersedes the referenced tiles
+    RETURN_EIO_IF_ERROR(m_tile_store->drop_refs(array.m_path));
+  }
 
   //TODO: Serialize TileDB_ArraySchema as JSON.
   //TileDB_ArraySchema schema;
@@ -170,41 +363,349 @@ ImageDSBuffers ImageDS::create_read_buffers(ImageDSArray& array) {
   std::vector<void *> buffers;
   std::vector<size_t> buffer_sizes;
   for (auto i=0ul; i<array.m_attributes.size(); i++) {
-    int attr_type = array.m_attributes[i]->m_type;
-    if(attr_type == TILEDB_CHAR)
-     required_length *= sizeof(char);
-    else if(attr_type == TILEDB_INT8)
-     required_length *= sizeof(int8_t);
-    else if(attr_type == TILEDB_INT16)
-     required_length *= sizeof(int16_t);
-    else if(attr_type == TILEDB_INT32)
-     required_length *= sizeof(int32_t);
-    else if(attr_type == TILEDB_INT64)
-     required_length *= sizeof(int64_t);
-    else if(attr_type == TILEDB_UINT8)
-     required_length *= sizeof(uint8_t);
-    else if(attr_type == TILEDB_UINT16)
-     required_length *= sizeof(uint16_t);
-    else if(attr_type == TILEDB_UINT32)
-     required_length *= sizeof(uint32_t);
-    else if(attr_type == TILEDB_UINT64)
-     required_length *= sizeof(uint64_t);
-    else if(attr_type == TILEDB_FLOAT32)
-     required_length *= sizeof(float);
-    else if(attr_type == TILEDB_FLOAT64)
-     required_length *= sizeof(double);
-    else
-      throw std::runtime_error("Not yet implemented!");
-    void *buffer = malloc(required_length);
-    imageds_buffers.add(buffer, required_length);
+    size_t length = required_length*attr_type_size(array.m_attributes[i]->m_type);
+    imageds_buffers.add(malloc(length), length);
   }
 
   return imageds_buffers;
 }
 
+ImageDSBuffers ImageDS::create_read_buffers(ImageDSArray& array, const std::vector<uint64_t>& subarray) {
+  ImageDSQueryEstimate query_estimate;
+  if (estimate(array, subarray, query_estimate)) {
+    throw std::runtime_error(std::string("Could not estimate the size of the read from ") + array.m_path);
+  }
+  ImageDSBuffers imageds_buffers;
+  for (auto size : query_estimate.m_result_sizes) {
+    imageds_buffers.add(malloc(size), size);
+  }
+  return imageds_buffers;
+}
+
 int ImageDS::from_array(ImageDSArray& array, std::vector<void *> buffers, std::vector<size_t> buffer_size) {
+  std::vector<uint64_t> subarray;
+  for (auto i=0ul; i<array.m_dimensions.size(); i++) {
+    subarray.push_back(array.m_dimensions[i]->m_start);
+    subarray.push_back(array.m_dimensions[i]->m_end);
+  }
+  return from_array(array, subarray, buffers, buffer_size);
+}
+
+int ImageDS::from_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *> buffers,
+                        std::vector<size_t> buffer_sizes) {
+  return from_array(array, subarray, buffers, buffer_sizes, {});
+}
+
+int ImageDS::from_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *> buffers,
+                        std::vector<size_t> buffer_sizes, const std::vector<ImageDSConversion>& conversions) {
+  auto start = std::chrono::steady_clock::now();
+  ImageDSQueryProfile profile;
+  int status = read_within_budget(array, subarray, buffers, buffer_sizes, m_query_profiler ? &profile : NULL,
+                                  conversions);
+  uint64_t latency = elapsed_us(start);
+  uint64_t bytes_returned = 0;
+  for (auto size : buffer_sizes) {
+    bytes_returned += size;
+  }
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_from_array_calls++;
+      stats.m_from_array_latency.add(latency);
+      if (status) {
+        stats.m_errors++;
+      } else {
+        stats.m_bytes_requested += bytes_returned;
+      }
+    });
+  if (m_query_profiler && !status) {
+    profile.m_array_path = array.m_path;
+    profile.m_bytes_returned = bytes_returned;
+    profile.m_latency_us = latency;
+    m_query_profiler(profile);
+  }
+  return status;
+}
+
+// Schema attributes read by array in buffer order, all attributes if array has none
+static int selected_attributes(const ImageDSArray& schema, const ImageDSArray& array,
+                               std::vector<const ImageDSAttribute *>& attributes) {
+  attributes.clear();
+  if (array.m_attributes.empty()) {
+    for (auto& schema_attribute : schema.m_attributes) {
+      attributes.push_back(schema_attribute.get());
+    }
+    return IMAGEDS_OK;
+  }
+  for (auto& attribute : array.m_attributes) {
+    for (auto& schema_attribute : schema.m_attributes) {
+      if (attribute->m_name == schema_attribute->m_name) {
+        attributes.push_back(schema_attribute.get());
+      }
+    }
+  }
+  if (attributes.size() != array.m_attributes.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+// Cells of the tiles overlapping subarray, tiles are decompressed whole
+static uint64_t tile_cell_num(const ImageDSTileLayout& layout, const std::vector<uint64_t>& tile_ids) {
+  uint64_t tile_cells = 0;
+  for (auto tile_id : tile_ids) {
+    tile_cells += ImageDSTileLayout::cell_num(layout.tile_subarray(tile_id));
+  }
+  return tile_cells;
+}
+
+// Bytes per cell of the decoded tiles a read holds at once, TileDB decodes the tiles of all attributes together and
+// the tile store one attribute at a time
+static size_t decoded_cell_size(const std::vector<const ImageDSAttribute *>& attributes, bool tile_store) {
+  size_t cell_size = 0;
+  for (auto attribute : attributes) {
+    size_t attribute_size = attr_type_size(attribute->m_type);
+    cell_size = tile_store ? std::max(cell_size, attribute_size) : cell_size + attribute_size;
+  }
+  return cell_size;
+}
+
+// Decoded tiles a read of subarray holds at once
+static uint64_t read_memory(const ImageDSTileLayout& layout, const std::vector<const ImageDSAttribute *>& attributes,
+                            const std::vector<uint64_t>& subarray, bool tile_store) {
+  return tile_cell_num(layout, layout.overlapping_tiles(subarray))*decoded_cell_size(attributes, tile_store);
+}
+
+// Tiles touched by subarray and their decompressed bytes for the attributes read
+static void profile_tiles(const ImageDSArray& schema, const ImageDSArray& array, const std::vector<uint64_t>& subarray,
+                          ImageDSQueryProfile& profile) {
+  ImageDSTileLayout layout(schema.m_dimensions);
+  profile.m_subarray = subarray.empty() ? layout.domain() : subarray;
+  std::vector<const ImageDSAttribute *> attributes;
+  selected_attributes(schema, array, attributes);
+  size_t cell_size = 0;
+  for (auto attribute : attributes) {
+    cell_size += attr_type_size(attribute->m_type);
+  }
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(profile.m_subarray);
+  profile.m_tiles_touched = tile_ids.size()*attributes.size();
+  profile.m_bytes_decompressed = tile_cell_num(layout, tile_ids)*cell_size;
+}
+
+// Expects the TileDB working dir to be the workspace
+std::shared_ptr<const ImageDSArray> ImageDS::cached_schema(const std::string& array_path) {
+  std::shared_ptr<const ImageDSArray> schema = m_schema_cache->get(array_path);
+  if (!schema) {
+    std::shared_ptr<ImageDSArray> loaded = std::make_shared<ImageDSArray>();
+    if (read_array_schema(array_path, *loaded)) {
+      return NULL;
+    }
+    schema = loaded;
+    m_schema_cache->put(array_path, schema);
+  }
+  return schema;
+}
+
+// Attribute files of all fragments of the array holding the attribute
+static std::vector<std::string> fragment_files(TileDB_CTX *tiledb_ctx, const std::string& array_path,
+                                               const std::string& attribute) {
+  std::vector<std::string> files;
+  for (auto& dir : get_dirs(tiledb_ctx, array_path)) {
+    if (is_fragment(tiledb_ctx, dir)) {
+      std::string file = append_paths(real_dir(tiledb_ctx, dir), attribute + TILEDB_FILE_SUFFIX);
+      if (is_file(tiledb_ctx, file)) {
+        files.push_back(file);
+      }
+    }
+  }
+  return files;
+}
+
+// Scans leave the page cache as they found it, the guards drop the pages of the fragments read once destroyed
+static void guard_page_cache(TileDB_CTX *tiledb_ctx, const std::string& array_path,
+                             const std::vector<const ImageDSAttribute *>& attributes,
+                             std::vector<std::unique_ptr<ImageDSPageCacheGuard>>& guards) {
+  for (auto attribute : attributes) {
+    for (auto& file : fragment_files(tiledb_ctx, array_path, attribute->m_name)) {
+      guards.push_back(std::unique_ptr<ImageDSPageCacheGuard>(new ImageDSPageCacheGuard(file)));
+    }
+  }
+}
+
+// Scratch buffers of the cells read by TileDB and converted afterwards are limited to slabs of this size
+#define IMAGEDS_CONVERSION_SLAB_SIZE 64*1024*1024
+// Cells converted by a thread at once
+#define IMAGEDS_CONVERSION_CHUNK_CELLS (64*1024)
+
+// Reads subarray in slabs of whole tiles along the first dimension when its tiles do not fit in the memory budget,
+// or when the cells read by TileDB are converted from scratch buffers. Slabs are contiguous in the row-major buffers.
+int ImageDS::read_within_budget(ImageDSArray& array, const std::vector<uint64_t>& requested,
+                                std::vector<void *>& buffers, std::vector<size_t>& buffer_sizes,
+                                ImageDSQueryProfile *profile, const std::vector<ImageDSConversion>& conversions) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  std::shared_ptr<const ImageDSArray> schema = is_array(TILEDB_CTX, array.m_path) ? cached_schema(array.m_path) : NULL;
+  bool tile_store = m_tile_store->has_refs(array.m_path);
+  // Workspaces may be relative to the working dir, read_array changes into them again
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+
+  // Requests that cannot be planned are left to read_array to fail, only the tile store converts cells itself
+  std::vector<const ImageDSAttribute *> attributes;
+  if (!schema || selected_attributes(*schema, array, attributes) || buffers.size() < attributes.size()
+      || buffer_sizes.size() < attributes.size()) {
+    if (!tile_store && !conversions.empty()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    return read_array(array, requested, buffers, buffer_sizes, profile, conversions);
+  }
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<uint64_t> subarray = requested.empty() ? layout.domain() : requested;
+  std::vector<uint64_t> clipped;
+  if (subarray.size() != layout.domain().size() || !intersect(subarray, layout.domain(), clipped)
+      || clipped != subarray) {
+    if (!tile_store && !conversions.empty()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    return read_array(array, requested, buffers, buffer_sizes, profile, conversions);
+  }
+  if (!conversions.empty() && conversions.size() != attributes.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<size_t> cell_sizes, result_cell_sizes;
+  std::vector<std::unique_ptr<ImageDSConverter>> converters;
+  bool scratch = false;
+  for (auto i=0ul; i<attributes.size(); i++) {
+    cell_sizes.push_back(attr_type_size(attributes[i]->m_type));
+    result_cell_sizes.push_back(cell_sizes[i]);
+    if (!conversions.empty()) {
+      converters.emplace_back(new ImageDSConverter(attributes[i]->m_type, conversions[i]));
+      if (!converters[i]->valid()) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+      result_cell_sizes[i] = attr_type_size(conversions[i].m_type);
+      scratch |= !tile_store && !conversions[i].identity(attributes[i]->m_type);
+    }
+  }
+  size_t scratch_cell_size = 0;
+  for (auto i=0ul; scratch && i<attributes.size(); i++) {
+    scratch_cell_size += cell_sizes[i];
+  }
+  auto slab_memory = [&](const std::vector<uint64_t>& slab) {
+    return read_memory(layout, attributes, slab, tile_store) + ImageDSTileLayout::cell_num(slab)*scratch_cell_size;
+  };
+
+  uint64_t memory = slab_memory(subarray);
+  size_t reservable = m_memory_budget->reservable();
+  if (!scratch && (!reservable || memory <= reservable)) {
+    ImageDSMemoryReservation reservation(*m_memory_budget, memory);
+    return read_array(array, requested, buffers, buffer_sizes, profile, conversions);
+  }
+  uint64_t limit = reservable ? reservable : std::numeric_limits<uint64_t>::max();
+  if (reservable && memory > reservable) {
+    m_memory_budget->count_split();
+  }
+  if (scratch) {
+    limit = std::min<uint64_t>(limit, IMAGEDS_CONVERSION_SLAB_SIZE);
+  }
+
+  IMAGEDS_TRACE_SPAN("read_slabs", array.m_path);
+  const std::vector<ImageDSConversion> no_conversions;
+  uint64_t start = layout.domain()[0];
+  uint64_t tile_extent = layout.tile_extents()[0];
+  uint64_t row_cells = ImageDSTileLayout::cell_num(subarray)/(subarray[1]-subarray[0]+1);
+  std::vector<size_t> read_sizes(attributes.size());
+  std::vector<std::vector<char>> scratch_buffers(scratch ? attributes.size() : 0);
+  for (uint64_t low = subarray[0]; low <= subarray[1];) {
+    // At least one row of tiles, more while they fit
+    std::vector<uint64_t> slab = subarray;
+    slab[0] = low;
+    slab[1] = std::min(start+((low-start)/tile_extent+1)*tile_extent-1, subarray[1]);
+    memory = slab_memory(slab);
+    while (slab[1] < subarray[1]) {
+      std::vector<uint64_t> grown = slab;
+      grown[1] = std::min(slab[1]+tile_extent, subarray[1]);
+      uint64_t grown_memory = slab_memory(grown);
+      if (grown_memory > limit) {
+        break;
+      }
+      slab = grown;
+      memory = grown_memory;
+    }
+
+    uint64_t slab_cells = ImageDSTileLayout::cell_num(slab);
+    std::vector<void *> slab_buffers;
+    std::vector<size_t> slab_sizes, offsets;
+    for (auto i=0ul; i<attributes.size(); i++) {
+      offsets.push_back(std::min((low-subarray[0])*row_cells*result_cell_sizes[i], buffer_sizes[i]));
+      if (scratch) {
+        if (buffer_sizes[i]-offsets[i] < slab_cells*result_cell_sizes[i]) {
+          throw std::runtime_error("Buffer overflow encountered");
+        }
+        scratch_buffers[i].resize(slab_cells*cell_sizes[i]);
+        slab_buffers.push_back(scratch_buffers[i].data());
+        slab_sizes.push_back(scratch_buffers[i].size());
+      } else {
+        slab_buffers.push_back(static_cast<char *>(buffers[i]) + offsets[i]);
+        slab_sizes.push_back(std::min(slab_cells*result_cell_sizes[i], buffer_sizes[i]-offsets[i]));
+      }
+    }
+    {
+      ImageDSMemoryReservation reservation(*m_memory_budget, memory);
+      // Fragments are only listed once for the profile
+      if (read_array(array, slab, slab_buffers, slab_sizes, low == subarray[0] ? profile : NULL,
+                     scratch ? no_conversions : conversions)) {
+        return IMAGEDS_ERR;
+      }
+      for (auto i=0ul; scratch && i<attributes.size(); i++) {
+        IMAGEDS_TRACE_SPAN("convert");
+        const char *src = static_cast<const char *>(slab_buffers[i]);
+        char *dst = static_cast<char *>(buffers[i]) + offsets[i];
+        uint64_t chunk_num = (slab_cells + IMAGEDS_CONVERSION_CHUNK_CELLS-1)/IMAGEDS_CONVERSION_CHUNK_CELLS;
+        #pragma omp parallel for
+        for (auto j=0ul; j<chunk_num; j++) {
+          uint64_t first = j*IMAGEDS_CONVERSION_CHUNK_CELLS;
+          uint64_t cell_num = std::min<uint64_t>(IMAGEDS_CONVERSION_CHUNK_CELLS, slab_cells-first);
+          converters[i]->convert(src + first*cell_sizes[i], dst + first*result_cell_sizes[i], cell_num);
+        }
+        slab_sizes[i] = slab_cells*result_cell_sizes[i];
+      }
+    }
+    for (auto i=0ul; i<attributes.size(); i++) {
+      read_sizes[i] += slab_sizes[i];
+    }
+    low = slab[1]+1;
+  }
+  for (auto i=0ul; i<attributes.size(); i++) {
+    buffer_sizes[i] = read_sizes[i];
+  }
+  if (profile) {
+    profile_tiles(*schema, array, subarray, *profile);
+  }
+  return IMAGEDS_OK;
+}
+
+// Buffer sizes are updated to the sizes read
+int ImageDS::read_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *>& buffers,
+                        std::vector<size_t>& buffer_size, ImageDSQueryProfile *profile,
+                        const std::vector<ImageDSConversion>& conversions) {
+  IMAGEDS_TRACE_SPAN("from_array", array.m_path);
   RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
 
+  if (m_tile_store->has_refs(array.m_path)) {
+    RETURN_ECANCELED_IF_ERROR(from_tile_store(array, subarray, buffers, buffer_size, conversions));
+    if (profile) {
+      // Tiles are held by the tile store, not by fragments
+      std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+      RETURN_IF_NULL(schema);
+      profile_tiles(*schema, array, subarray, *profile);
+    }
+    RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+    return IMAGEDS_OK;
+  }
+
   std::vector<char *> attributes;
   for (auto i=0ul; i<array.m_attributes.size(); i++) {
     attributes.push_back(const_cast<char *>(array.m_attributes[i]->m_name.c_str()));
@@ -221,44 +722,658 @@ int ImageDS::from_array(ImageDSArray& array, std::vector<void *> buffers, std::v
   }
   
   TileDB_Array* tiledb_array;
-  size_t dimensions_length = array.m_dimensions.size();
-  if (dimensions_length > 0) {
-    uint64_t subarray[dimensions_length*2];
-    for (auto i=0ul; i<dimensions_length; i++) {
-      subarray[i*2] = array.m_dimensions[i]->m_start;
-      subarray[i*2+1] = array.m_dimensions[i]->m_end;
-    }
-    RETURN_EINVAL_IF_ERROR(tiledb_array_init(TILEDB_CTX, &tiledb_array,
-                                             array.m_path.c_str(),
-                                             TILEDB_ARRAY_READ_SORTED_ROW,
-                                             subarray, 
-                                             tiledb_attributes,
-                                             attribute_num));
-  } else {
+  {
+    IMAGEDS_TRACE_SPAN("tiledb_array_init");
     RETURN_EINVAL_IF_ERROR(tiledb_array_init(TILEDB_CTX, &tiledb_array,
                                              array.m_path.c_str(),
                                              TILEDB_ARRAY_READ_SORTED_ROW,
-                                             NULL, // Entire Domain
+                                             subarray.empty() ? NULL : subarray.data(), // NULL is entire domain
                                              tiledb_attributes,
                                              attribute_num));
   }
-  
-  RETURN_ECANCELED_IF_ERROR(tiledb_array_read(tiledb_array,
-                                              buffers.data(),
-                                              buffer_size.data()));
+  TileDBArrayGuard array_guard(tiledb_array);
+
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<std::unique_ptr<ImageDSPageCacheGuard>> page_cache_guards;
+  if (m_scan_mode && m_workspace.find("://") == std::string::npos) {
+    std::vector<const ImageDSAttribute *> read_attributes;
+    RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, read_attributes));
+    guard_page_cache(TILEDB_CTX, array.m_path, read_attributes, page_cache_guards);
+  }
+  uint64_t read_bytes = thread_read_bytes();
+  {
+    // I/O, decompression and reordering of the tiles into row-major cells all happen within TileDB
+    IMAGEDS_TRACE_SPAN("tiledb_array_read");
+    RETURN_ECANCELED_IF_ERROR(tiledb_array_read(tiledb_array,
+                                                buffers.data(),
+                                                buffer_size.data()));
+  }
+  read_bytes = thread_read_bytes() - read_bytes;
+  uint64_t tiles_touched = layout.overlapping_tile_num(subarray.empty() ? layout.domain() : subarray)
+      *(attribute_num ? attribute_num : schema->m_attributes.size());
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_bytes_read += read_bytes;
+      stats.m_tiles_touched += tiles_touched;
+    });
+  if (profile) {
+    profile_tiles(*schema, array, subarray, *profile);
+    for (auto& dir : get_dirs(TILEDB_CTX, array.m_path)) {
+      profile->m_fragments_scanned += is_fragment(TILEDB_CTX, dir);
+    }
+  }
   
   for (auto i=0ul; i<array.m_attributes.size(); i++) {
     if (tiledb_array_overflow(tiledb_array, i) == 1) {
+      array_guard.finalize();
+      throw std::runtime_error("Buffer overflow encountered");
+    }
+  }
+  {
+    IMAGEDS_TRACE_SPAN("tiledb_array_finalize");
+    RETURN_ECANCELED_IF_ERROR(array_guard.finalize());
+  }
+
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+ImageDSBuffers ImageDS::create_gather_buffers(ImageDSArray& array, const std::vector<std::vector<uint64_t>>& subarrays) {
+  ImageDSBuffers imageds_buffers;
+  for (auto& subarray : subarrays) {
+    ImageDSQueryEstimate query_estimate;
+    if (estimate(array, subarray, query_estimate)) {
+      throw std::runtime_error(std::string("Could not estimate the size of the read from ") + array.m_path);
+    }
+    imageds_buffers.m_buffer_sizes.resize(query_estimate.m_result_sizes.size());
+    for (auto i=0ul; i<query_estimate.m_result_sizes.size(); i++) {
+      imageds_buffers.m_buffer_sizes[i] += query_estimate.m_result_sizes[i];
+    }
+  }
+  for (auto size : imageds_buffers.m_buffer_sizes) {
+    imageds_buffers.m_buffers.push_back(malloc(size));
+  }
+  return imageds_buffers;
+}
+
+// Decodes tile_ids of every attribute from the tile store or through TileDB and hands the row-major cells of every
+// tile to consume, which is called concurrently for different tiles
+// Decoded tiles decode_tiles holds at once. Tiles are decoded one at a time per thread, unless the tile store
+// prefetches the tiles of an attribute together.
+uint64_t ImageDS::decode_memory(const std::vector<const ImageDSAttribute *>& attributes,
+                                const ImageDSTileLayout& layout, const std::vector<uint64_t>& tile_ids,
+                                bool tile_store) {
+  if (tile_store && prefetches_tiles()) {
+    return tile_cell_num(layout, tile_ids)*decoded_cell_size(attributes, tile_store);
+  }
+  uint64_t thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+  uint64_t tile_num = std::min<uint64_t>(tile_ids.size(), thread_num);
+  return tile_num*ImageDSTileLayout::cell_num(layout.tile_subarray(0))*decoded_cell_size(attributes, tile_store);
+}
+
+int ImageDS::decode_tiles(ImageDSArray& array, const std::vector<const ImageDSAttribute *>& attributes,
+                          const ImageDSTileLayout& layout, const std::vector<uint64_t>& tile_ids, bool tile_store,
+                          const tile_consumer_t& consume) {
+  std::atomic<int> status(IMAGEDS_OK);
+  if (tile_store) {
+    ImageDSTileRefs refs;
+    RETURN_EIO_IF_ERROR(m_tile_store->read_refs(array.m_path, refs));
+    for (auto i=0ul; i<attributes.size(); i++) {
+      int attribute_id = refs.attribute_id(attributes[i]->m_name);
+      RETURN_EIO_IF_ERROR(attribute_id < 0);
+      const std::vector<std::string>& keys = refs.m_keys[attribute_id];
+      prefetched_tiles_t prefetched;
+      prefetch_tiles(array.m_path, keys, tile_ids, prefetched);
+      #pragma omp parallel for schedule(dynamic)
+      for (auto j=0ul; j<tile_ids.size(); j++) {
+        if (status) continue;
+        tile_buffer_t tile = fetch_tile(array.m_path, keys[tile_ids[j]], &prefetched);
+        if (!tile) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        consume(tile_ids[j], i, tile->data());
+      }
+      RETURN_EIO_IF_ERROR(status.load());
+    }
+  } else {
+    // TileDB contexts cannot be shared, every thread reads its tiles through a context of the pool and its own array
+    std::vector<const char *> attribute_names;
+    for (auto attribute : attributes) {
+      attribute_names.push_back(attribute->m_name.c_str());
+    }
+    std::vector<std::unique_ptr<ImageDSPageCacheGuard>> page_cache_guards;
+    if (m_scan_mode && m_workspace.find("://") == std::string::npos) {
+      guard_page_cache(TILEDB_CTX, array.m_path, attributes, page_cache_guards);
+    }
+    std::atomic<uint64_t> tiles_touched(0);
+    #pragma omp parallel
+    {
+      TileDB_Array* tiledb_array = NULL;
+      TileDB_CTX* tiledb_ctx = reinterpret_cast<TileDB_CTX*>(m_context_pool->acquire());
+      if (!tiledb_ctx || set_working_dir(tiledb_ctx, m_workspace)) {
+        status = IMAGEDS_ERR;
+      }
+      std::vector<std::vector<char>> tiles(attributes.size());
+      #pragma omp for schedule(dynamic)
+      for (auto j=0ul; j<tile_ids.size(); j++) {
+        if (status) continue;
+        std::vector<uint64_t> tile_subarray = layout.tile_subarray(tile_ids[j]);
+        // Arrays are initialized once per thread, later tiles only reset the subarray
+        if (tiledb_array ? tiledb_array_reset_subarray(tiledb_array, tile_subarray.data())
+            : tiledb_array_init(tiledb_ctx, &tiledb_array, array.m_path.c_str(), TILEDB_ARRAY_READ_SORTED_ROW,
+                                tile_subarray.data(), attribute_names.data(), attribute_names.size())) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        std::vector<void *> tile_buffers;
+        std::vector<size_t> tile_sizes;
+        for (auto i=0ul; i<attributes.size(); i++) {
+          tiles[i].resize(ImageDSTileLayout::cell_num(tile_subarray)*attr_type_size(attributes[i]->m_type));
+          tile_buffers.push_back(tiles[i].data());
+          tile_sizes.push_back(tiles[i].size());
+        }
+        if (tiledb_array_read(tiledb_array, tile_buffers.data(), tile_sizes.data())) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        for (auto i=0ul; i<attributes.size(); i++) {
+          if (tile_sizes[i] != tiles[i].size()) {
+            status = IMAGEDS_ERR;
+            break;
+          }
+          consume(tile_ids[j], i, tiles[i].data());
+        }
+        tiles_touched += attributes.size();
+      }
+      if (tiledb_array && tiledb_array_finalize(tiledb_array)) {
+        status = IMAGEDS_ERR;
+      }
+      m_context_pool->release(tiledb_ctx);
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+    m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+        stats.m_tiles_touched += tiles_touched;
+      });
+  }
+  return IMAGEDS_OK;
+}
+
+int ImageDS::gather(ImageDSArray& array, const std::vector<std::vector<uint64_t>>& subarrays,
+                    std::vector<void *> buffers, std::vector<size_t> buffer_sizes, std::vector<uint64_t>& cell_offsets) {
+  IMAGEDS_TRACE_SPAN("gather", array.m_path);
+  auto start = std::chrono::steady_clock::now();
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  if (buffers.size() < attributes.size() || buffer_sizes.size() < attributes.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  // ROIs are laid out back to back in every buffer
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<std::vector<uint64_t>> rois;
+  cell_offsets.clear();
+  uint64_t cell_num = 0;
+  for (auto& subarray : subarrays) {
+    rois.push_back(subarray.empty() ? layout.domain() : subarray);
+    std::vector<uint64_t> clipped;
+    if (rois.back().size() != layout.domain().size() || !intersect(rois.back(), layout.domain(), clipped)
+        || clipped != rois.back()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    cell_offsets.push_back(cell_num);
+    cell_num += ImageDSTileLayout::cell_num(rois.back());
+  }
+  for (auto i=0ul; i<attributes.size(); i++) {
+    if (buffer_sizes[i] < cell_num*attr_type_size(attributes[i]->m_type)) {
       throw std::runtime_error("Buffer overflow encountered");
     }
   }
 
+  // Union of the tiles of all ROIs, so that tiles shared by ROIs are decoded once
+  std::map<uint64_t, std::vector<size_t>> tile_rois;
+  for (auto k=0ul; k<rois.size(); k++) {
+    for (auto tile_id : layout.overlapping_tiles(rois[k])) {
+      tile_rois[tile_id].push_back(k);
+    }
+  }
+  std::vector<uint64_t> tile_ids;
+  for (auto& entry : tile_rois) {
+    tile_ids.push_back(entry.first);
+  }
+  bool tile_store = m_tile_store->has_refs(array.m_path);
+  ImageDSMemoryReservation reservation(*m_memory_budget, decode_memory(attributes, layout, tile_ids, tile_store));
+
+  // ROIs do not overlap in the buffers and tiles do not overlap in the ROIs, tiles are scattered concurrently
+  auto scatter = [&](uint64_t tile_id, size_t i, const void *tile) {
+    IMAGEDS_TRACE_SPAN("copy_region");
+    size_t cell_size = attr_type_size(attributes[i]->m_type);
+    std::vector<uint64_t> tile_subarray = layout.tile_subarray(tile_id);
+    for (auto k : tile_rois.at(tile_id)) {
+      std::vector<uint64_t> region;
+      intersect(tile_subarray, rois[k], region);
+      copy_region(tile, tile_subarray, static_cast<char *>(buffers[i]) + cell_offsets[k]*cell_size, rois[k], region,
+                  cell_size);
+    }
+  };
+
+  RETURN_EIO_IF_ERROR(decode_tiles(array, attributes, layout, tile_ids, tile_store, scatter));
+
+  uint64_t latency = elapsed_us(start);
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_from_array_calls++;
+      stats.m_from_array_latency.add(latency);
+      for (auto attribute : attributes) {
+        stats.m_bytes_requested += cell_num*attr_type_size(attribute->m_type);
+      }
+    });
   RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
   return IMAGEDS_OK;
 }
 
+int ImageDS::reslice(ImageDSArray& array, size_t axis, uint64_t index, std::vector<void *> buffers,
+                     std::vector<size_t> buffer_sizes, bool transpose) {
+  IMAGEDS_TRACE_SPAN("reslice", array.m_path);
+  auto start = std::chrono::steady_clock::now();
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  ImageDSTileLayout layout(schema->m_dimensions);
+  size_t dim_num = layout.dim_num();
+  if (buffers.size() < attributes.size() || buffer_sizes.size() < attributes.size() || dim_num < 2
+      || axis >= dim_num || index < layout.domain()[axis*2] || index > layout.domain()[axis*2+1]
+      || (transpose && dim_num != 3)) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  std::vector<uint64_t> plane = layout.domain();
+  plane[axis*2] = plane[axis*2+1] = index;
+  uint64_t cell_num = ImageDSTileLayout::cell_num(plane);
+  for (auto i=0ul; i<attributes.size(); i++) {
+    if (buffer_sizes[i] < cell_num*attr_type_size(attributes[i]->m_type)) {
+      throw std::runtime_error("Buffer overflow encountered");
+    }
+  }
+
+  // Dimensions of the plane in buffer order and their strides in the buffers
+  std::vector<size_t> plane_dims;
+  for (auto d=0ul; d<dim_num; d++) {
+    if (d != axis) {
+      plane_dims.push_back(d);
+    }
+  }
+  if (transpose) {
+    std::swap(plane_dims[0], plane_dims[1]);
+  }
+  std::vector<uint64_t> dst_strides(dim_num, 0);
+  uint64_t stride = 1;
+  for (auto k=plane_dims.size(); k-- > 0; ) {
+    dst_strides[plane_dims[k]] = stride;
+    stride *= plane[plane_dims[k]*2+1] - plane[plane_dims[k]*2] + 1;
+  }
+
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(plane);
+  bool tile_store = m_tile_store->has_refs(array.m_path);
+  ImageDSMemoryReservation reservation(*m_memory_budget, decode_memory(attributes, layout, tile_ids, tile_store));
+
+  // Every tile holds a disjoint region of the plane, copied as 2D planes over the last two plane dimensions
+  auto copy = [&](uint64_t tile_id, size_t i, const void *tile) {
+    IMAGEDS_TRACE_SPAN("copy_plane");
+    size_t cell_size = attr_type_size(attributes[i]->m_type);
+    std::vector<uint64_t> tile_subarray = layout.tile_subarray(tile_id);
+    std::vector<uint64_t> region;
+    intersect(tile_subarray, plane, region);
+    std::vector<uint64_t> src_strides(dim_num, 1);
+    for (auto d=dim_num-1; d-- > 0; ) {
+      src_strides[d] = src_strides[d+1]*(tile_subarray[(d+1)*2+1] - tile_subarray[(d+1)*2] + 1);
+    }
+    size_t rows_dim = plane_dims.size() > 1 ? plane_dims[plane_dims.size()-2] : axis;
+    size_t cols_dim = plane_dims.back();
+    std::vector<uint64_t> coords(dim_num);
+    for (auto d=0ul; d<dim_num; d++) {
+      coords[d] = region[d*2];
+    }
+    while (true) {
+      uint64_t src_offset = 0, dst_offset = 0;
+      for (auto d=0ul; d<dim_num; d++) {
+        src_offset += (coords[d] - tile_subarray[d*2])*src_strides[d];
+        dst_offset += (coords[d] - plane[d*2])*dst_strides[d];
+      }
+      copy_plane(static_cast<const char *>(tile) + src_offset*cell_size, src_strides[rows_dim], src_strides[cols_dim],
+                 static_cast<char *>(buffers[i]) + dst_offset*cell_size, dst_strides[rows_dim], dst_strides[cols_dim],
+                 region[rows_dim*2+1] - region[rows_dim*2] + 1, region[cols_dim*2+1] - region[cols_dim*2] + 1,
+                 cell_size);
+      // Odometer over the outer plane dimensions of 4D and higher arrays
+      size_t k = plane_dims.size() > 2 ? plane_dims.size()-2 : 0;
+      while (k-- > 0) {
+        if (++coords[plane_dims[k]] <= region[plane_dims[k]*2+1]) break;
+        coords[plane_dims[k]] = region[plane_dims[k]*2];
+      }
+      if (k == static_cast<size_t>(-1)) break;
+    }
+  };
+  RETURN_EIO_IF_ERROR(decode_tiles(array, attributes, layout, tile_ids, tile_store, copy));
+
+  uint64_t latency = elapsed_us(start);
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_from_array_calls++;
+      stats.m_from_array_latency.add(latency);
+      for (auto attribute : attributes) {
+        stats.m_bytes_requested += cell_num*attr_type_size(attribute->m_type);
+      }
+    });
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::oblique_slice(ImageDSArray& array, const ImageDSObliquePlane& plane, std::vector<void *> buffers,
+                           std::vector<size_t> buffer_sizes) {
+  IMAGEDS_TRACE_SPAN("oblique_slice", array.m_path);
+  auto start = std::chrono::steady_clock::now();
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  if (buffers.size() < attributes.size() || buffer_sizes.size() < attributes.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  ImageDSTileLayout layout(schema->m_dimensions);
+  ImageDSObliquePlane steps = plane;
+  RETURN_EINVAL_IF_ERROR(imageds_plane_steps(plane, layout.dim_num(), steps));
+  uint64_t cell_num = plane.m_rows*plane.m_cols;
+  for (auto i=0ul; i<attributes.size(); i++) {
+    if (buffer_sizes[i] < cell_num*attr_type_size(attributes[i]->m_type)) {
+      throw std::runtime_error("Buffer overflow encountered");
+    }
+  }
+
+  // Decoded tiles are held until all samples are taken, samples may interpolate cells from up to 8 tiles
+  std::vector<uint64_t> tile_ids = imageds_plane_tiles(layout, steps);
+  bool tile_store = m_tile_store->has_refs(array.m_path);
+  size_t held_cell_size = decoded_cell_size(attributes, tile_store) + decoded_cell_size(attributes, false);
+  ImageDSMemoryReservation reservation(*m_memory_budget, tile_cell_num(layout, tile_ids)*held_cell_size);
+  std::vector<std::vector<std::vector<char>>> decoded(attributes.size(),
+                                                      std::vector<std::vector<char>>(tile_ids.size()));
+  auto hold = [&](uint64_t tile_id, size_t i, const void *tile) {
+    size_t k = std::lower_bound(tile_ids.begin(), tile_ids.end(), tile_id) - tile_ids.begin();
+    const char *cells = static_cast<const char *>(tile);
+    decoded[i][k].assign(cells, cells + ImageDSTileLayout::cell_num(layout.tile_subarray(tile_id))
+                         *attr_type_size(attributes[i]->m_type));
+  };
+  RETURN_EIO_IF_ERROR(decode_tiles(array, attributes, layout, tile_ids, tile_store, hold));
+
+  for (auto i=0ul; i<attributes.size(); i++) {
+    IMAGEDS_TRACE_SPAN("sample_plane");
+    std::vector<const void *> tiles(layout.tile_num());
+    for (auto k=0ul; k<tile_ids.size(); k++) {
+      tiles[tile_ids[k]] = decoded[i][k].data();
+    }
+    RETURN_EINVAL_IF_ERROR(imageds_sample_plane(attributes[i]->m_type, layout, tiles, steps, buffers[i]));
+    std::vector<std::vector<char>>().swap(decoded[i]);
+  }
+
+  uint64_t latency = elapsed_us(start);
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_from_array_calls++;
+      stats.m_from_array_latency.add(latency);
+      for (auto attribute : attributes) {
+        stats.m_bytes_requested += cell_num*attr_type_size(attribute->m_type);
+      }
+    });
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+// Decoded tiles a projection reduces at once, fewer when the memory budget is smaller
+#define IMAGEDS_PROJECTION_BATCH_SIZE (64*1024*1024)
+
+int ImageDS::project(ImageDSArray& array, const std::vector<uint64_t>& subarray, size_t axis, projection_t projection,
+                     std::vector<void *> buffers, std::vector<size_t> buffer_sizes) {
+  IMAGEDS_TRACE_SPAN("project", array.m_path);
+  auto start = std::chrono::steady_clock::now();
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<uint64_t> box = subarray.empty() ? layout.domain() : subarray;
+  std::vector<uint64_t> clipped;
+  if (buffers.size() < attributes.size() || buffer_sizes.size() < attributes.size() || axis >= layout.dim_num()
+      || box.size() != layout.domain().size() || !intersect(box, layout.domain(), clipped) || clipped != box) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  uint64_t depth = box[axis*2+1] - box[axis*2] + 1;
+  uint64_t cell_num = ImageDSTileLayout::cell_num(box)/depth;
+  for (auto i=0ul; i<attributes.size(); i++) {
+    if (buffer_sizes[i] < cell_num*attr_type_size(imageds_projection_type(attributes[i]->m_type, projection))) {
+      throw std::runtime_error("Buffer overflow encountered");
+    }
+    RETURN_EINVAL_IF_ERROR(imageds_projection_init(attributes[i]->m_type, projection, buffers[i], cell_num));
+  }
+
+  // Tiles that differ only along axis reduce into the same cells and take turns, others are reduced concurrently
+  const std::vector<uint64_t>& tile_counts = layout.tile_counts();
+  uint64_t inner_tiles = 1;
+  for (auto d=axis+1; d<layout.dim_num(); d++) {
+    inner_tiles *= tile_counts[d];
+  }
+  std::vector<std::mutex> column_mutexes(layout.tile_num()/tile_counts[axis]);
+  std::atomic<int> status(IMAGEDS_OK);
+  auto reduce = [&](uint64_t tile_id, size_t i, const void *tile) {
+    IMAGEDS_TRACE_SPAN("reduce_tile");
+    std::vector<uint64_t> tile_subarray = layout.tile_subarray(tile_id);
+    std::vector<uint64_t> region;
+    intersect(tile_subarray, box, region);
+    uint64_t column = tile_id/(inner_tiles*tile_counts[axis])*inner_tiles + tile_id%inner_tiles;
+    std::lock_guard<std::mutex> lock(column_mutexes[column]);
+    if (imageds_projection_reduce(attributes[i]->m_type, projection, tile, tile_subarray, buffers[i], box, region,
+                                  axis)) {
+      status = IMAGEDS_ERR;
+    }
+  };
+
+  // Tiles are streamed in batches, so that the memory held does not grow with the depth of the projection
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(box);
+  bool tile_store = m_tile_store->has_refs(array.m_path);
+  size_t cell_size = decoded_cell_size(attributes, tile_store);
+  size_t reservable = m_memory_budget->reservable();
+  uint64_t limit = reservable ? std::min<uint64_t>(reservable, IMAGEDS_PROJECTION_BATCH_SIZE)
+      : IMAGEDS_PROJECTION_BATCH_SIZE;
+  for (auto first=tile_ids.begin(); first!=tile_ids.end(); ) {
+    auto last = first;
+    uint64_t memory = 0;
+    do {
+      memory += ImageDSTileLayout::cell_num(layout.tile_subarray(*last++))*cell_size;
+    } while (last != tile_ids.end()
+             && memory + ImageDSTileLayout::cell_num(layout.tile_subarray(*last))*cell_size <= limit);
+    ImageDSMemoryReservation reservation(*m_memory_budget, memory);
+    RETURN_EIO_IF_ERROR(decode_tiles(array, attributes, layout, std::vector<uint64_t>(first, last), tile_store,
+                                     reduce));
+    RETURN_EINVAL_IF_ERROR(status.load());
+    first = last;
+  }
+  for (auto i=0ul; i<attributes.size(); i++) {
+    imageds_projection_finish(projection, buffers[i], cell_num, depth);
+  }
+
+  uint64_t latency = elapsed_us(start);
+  m_stats->update(array.m_path, [&](ImageDSArrayStats& stats) {
+      stats.m_from_array_calls++;
+      stats.m_from_array_latency.add(latency);
+      for (auto attribute : attributes) {
+        stats.m_bytes_requested += cell_num*attr_type_size(imageds_projection_type(attribute->m_type, projection));
+      }
+    });
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::filter(ImageDSArray& array, const std::string& result_path, const ImageDSFilter& filter) {
+  IMAGEDS_TRACE_SPAN("filter", array.m_path);
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  if (result_path.empty() || is_array(TILEDB_CTX, result_path)) {
+    errno = result_path.empty() ? EINVAL : EEXIST;
+    return IMAGEDS_ERR;
+  }
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  std::vector<uint64_t> radii;
+  RETURN_EINVAL_IF_ERROR(imageds_filter_radii(filter, schema->m_dimensions.size(), radii));
+  if (!ImageDSConverter(FLOAT64, ImageDSConversion(filter.m_type)).valid()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  ImageDSArray result(result_path);
+  for (auto& dimension : schema->m_dimensions) {
+    result.add_dimension(dimension->m_name, dimension->m_start, dimension->m_end, dimension->m_tile_extent);
+  }
+  for (auto attribute : attributes) {
+    result.add_attribute(attribute->m_name, filter.m_type, attribute->m_compression, attribute->m_compression_level);
+  }
+
+  // Reads and writes of the rows of tiles resolve paths against the workspace themselves
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return filter_slabs(array, ImageDSTileLayout(schema->m_dimensions), attributes, radii, result, filter);
+}
+
+int ImageDS::filter_slabs(ImageDSArray& array, const ImageDSTileLayout& layout,
+                          const std::vector<const ImageDSAttribute *>& attributes, const std::vector<uint64_t>& radii,
+                          ImageDSArray& result, const ImageDSFilter& filter) {
+  const std::vector<uint64_t>& domain = layout.domain();
+  std::vector<attr_type_t> work_types;
+  std::vector<ImageDSConverter> loaders, stores;
+  for (auto attribute : attributes) {
+    work_types.push_back(imageds_filter_work_type(attribute->m_type, filter.m_type));
+    loaders.emplace_back(attribute->m_type, ImageDSConversion(work_types.back()));
+    stores.emplace_back(work_types.back(), ImageDSConversion(filter.m_type));
+  }
+  size_t result_size = attr_type_size(filter.m_type);
+
+  // Rows of tiles along the first dimension are read whole and once, and held while the kernels reach into them.
+  // Rows that fall behind the kernels hand their buffers over to the rows read ahead.
+  struct TileRow {
+    std::vector<uint64_t> m_box;
+    std::vector<std::vector<char>> m_cells;
+  };
+  uint64_t tile_extent = layout.tile_extents()[0];
+  std::deque<TileRow> rows;
+  std::vector<TileRow> spare_rows;
+  std::vector<std::vector<char>> slabs(attributes.size());
+  for (uint64_t slab_start=domain[0]; slab_start<=domain[1]; slab_start+=tile_extent) {
+    IMAGEDS_TRACE_SPAN("filter_slab");
+    uint64_t slab_end = std::min(slab_start+tile_extent-1, domain[1]);
+    uint64_t reach_start = slab_start - std::min(radii[0], slab_start-domain[0]);
+    uint64_t reach_end = slab_end + std::min(radii[0], domain[1]-slab_end);
+    while (!rows.empty() && rows.front().m_box[1] < reach_start) {
+      spare_rows.push_back(std::move(rows.front()));
+      rows.pop_front();
+    }
+    uint64_t row_start = rows.empty() ? domain[0] + (reach_start-domain[0])/tile_extent*tile_extent
+        : rows.back().m_box[1]+1;
+    for (; row_start<=reach_end; row_start+=tile_extent) {
+      TileRow row;
+      if (!spare_rows.empty()) {
+        row = std::move(spare_rows.back());
+        spare_rows.pop_back();
+      }
+      row.m_box = domain;
+      row.m_box[0] = row_start;
+      row.m_box[1] = std::min(row_start+tile_extent-1, domain[1]);
+      row.m_cells.resize(attributes.size());
+      std::vector<void *> buffers;
+      std::vector<size_t> buffer_sizes;
+      for (auto i=0ul; i<attributes.size(); i++) {
+        row.m_cells[i].resize(ImageDSTileLayout::cell_num(row.m_box)*attr_type_size(attributes[i]->m_type));
+        buffers.push_back(row.m_cells[i].data());
+        buffer_sizes.push_back(row.m_cells[i].size());
+      }
+      if (from_array(array, row.m_box, buffers, buffer_sizes)) {
+        return IMAGEDS_ERR;
+      }
+      rows.push_back(std::move(row));
+    }
+
+    // Tiles are filtered with their halos concurrently, each into its part of the slab
+    std::vector<uint64_t> slab_box(domain);
+    slab_box[0] = slab_start;
+    slab_box[1] = slab_end;
+    std::vector<void *> buffers;
+    std::vector<size_t> buffer_sizes;
+    for (auto i=0ul; i<attributes.size(); i++) {
+      slabs[i].resize(ImageDSTileLayout::cell_num(slab_box)*result_size);
+      buffers.push_back(slabs[i].data());
+      buffer_sizes.push_back(slabs[i].size());
+    }
+    std::vector<uint64_t> tile_ids = layout.overlapping_tiles(slab_box);
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t t=0; t<tile_ids.size(); t++) {
+      IMAGEDS_TRACE_SPAN("filter_tile");
+      std::vector<uint64_t> tile_box = layout.tile_subarray(tile_ids[t]);
+      std::vector<uint64_t> halo_box(tile_box);
+      for (auto d=0ul; d<radii.size(); d++) {
+        halo_box[d*2] -= std::min(radii[d], tile_box[d*2]-domain[d*2]);
+        halo_box[d*2+1] += std::min(radii[d], domain[d*2+1]-tile_box[d*2+1]);
+      }
+      std::vector<char> cells;
+      for (auto i=0ul; i<attributes.size(); i++) {
+        size_t work_size = attr_type_size(work_types[i]);
+        cells.resize(ImageDSTileLayout::cell_num(halo_box)*work_size);
+        for (auto& row : rows) {
+          std::vector<uint64_t> region;
+          if (!intersect(row.m_box, halo_box, region)) {
+            continue;
+          }
+          copy_region(row.m_cells[i].data(), row.m_box, attr_type_size(attributes[i]->m_type), cells.data(), halo_box,
+                      work_size, region, [&](const void *src, void *dst, uint64_t cell_num) {
+                        if (loaders[i].convert(src, dst, cell_num)) {
+                          status = IMAGEDS_ERR;
+                        }
+                      });
+        }
+        if (imageds_filter_cells(work_types[i], filter, cells, halo_box, tile_box)) {
+          status = IMAGEDS_ERR;
+          continue;
+        }
+        copy_region(cells.data(), tile_box, work_size, slabs[i].data(), slab_box, result_size, tile_box,
+                    [&](const void *src, void *dst, uint64_t cell_num) {
+                      if (stores[i].convert(src, dst, cell_num)) {
+                        status = IMAGEDS_ERR;
+                      }
+                    });
+      }
+    }
+    RETURN_EINVAL_IF_ERROR(status.load());
+    // Slabs are written as they are filtered, which the tile store does not support
+    if (to_array(result, slab_box, buffers, buffer_sizes, false)) {
+      return IMAGEDS_ERR;
+    }
+  }
+  return IMAGEDS_OK;
+}
 
 int ImageDS::create_tiledb_groups(const std::string& array_path) {
+  IMAGEDS_TRACE_SPAN("create_tiledb_groups");
   if (array_path[0] == '/') {
     errno = EINVAL;
     return IMAGEDS_ERR;
@@ -269,13 +1384,19 @@ int ImageDS::create_tiledb_groups(const std::string& array_path) {
     std::string group(m_workspace);
     while (std::getline(path, path_segment, '/')) {
       group.append("/").append(path_segment);
-      RETURN_EINVAL_IF_ERROR(tiledb_group_create(TILEDB_CTX, group.c_str()));
+      // Groups are shared by arrays and can be created concurrently by other ImageDS instances
+      if (!is_group(TILEDB_CTX, group) && tiledb_group_create(TILEDB_CTX, group.c_str())
+          && !is_group(TILEDB_CTX, group)) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
     }
   }
   return IMAGEDS_OK;
 }
 
 int ImageDS::setup_tiledb_schema(ImageDSArray& array) {
+  IMAGEDS_TRACE_SPAN("setup_tiledb_schema", array.m_path);
   RETURN_EINVAL_IF_ERROR(create_tiledb_groups(array.m_path));
 
   std::string array_path = array.m_path;
@@ -311,6 +1432,7 @@ int ImageDS::setup_tiledb_schema(ImageDSArray& array) {
 
 
   TileDB_ArraySchema array_schema;
+  IMAGEDS_TRACE_SPAN("tiledb_array_create");
   RETURN_EINVAL_IF_ERROR(
       tiledb_array_set_schema(&array_schema,
                               array_path.c_str(),
@@ -332,7 +1454,779 @@ int ImageDS::setup_tiledb_schema(ImageDSArray& array) {
                               attribute_types));
 
   RETURN_ECANCELED_IF_ERROR(tiledb_array_create(TILEDB_CTX, &array_schema));
+  m_schema_cache->erase(array.m_path);
   RETURN_ECANCELED_IF_ERROR(tiledb_array_free_schema(&array_schema));
 
   return IMAGEDS_OK;
 }
+
+int ImageDS::write_metadata(const std::string& array_path, const std::map<std::string, std::string>& metadata) {
+  for (auto& entry : metadata) {
+    if (entry.first.empty() || entry.first.find_first_of("=\n") != std::string::npos
+        || entry.second.find('\n') != std::string::npos) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+  }
+
+  std::map<std::string, std::string> merged;
+  RETURN_EIO_IF_ERROR(read_metadata(array_path, merged));
+  for (auto& entry : metadata) {
+    merged[entry.first] = entry.second;
+  }
+  std::ostringstream out;
+  for (auto& entry : merged) {
+    out << entry.first << "=" << entry.second << "\n";
+  }
+  std::string contents = out.str();
+
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  std::string path = append_paths(array_path, IMAGEDS_METADATA);
+  std::string tmp_path = path + ".tmp";
+  if (is_file(TILEDB_CTX, tmp_path)) {
+    RETURN_EIO_IF_ERROR(delete_file(TILEDB_CTX, tmp_path));
+  }
+  RETURN_EIO_IF_ERROR(write_to_file(TILEDB_CTX, tmp_path, contents.data(), contents.size()));
+  RETURN_EIO_IF_ERROR(close_file(TILEDB_CTX, tmp_path));
+  if (is_file(TILEDB_CTX, path)) {
+    RETURN_EIO_IF_ERROR(delete_file(TILEDB_CTX, path));
+  }
+  RETURN_EIO_IF_ERROR(move_path(TILEDB_CTX, tmp_path, path));
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::read_metadata(const std::string& array_path, std::map<std::string, std::string>& metadata) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array_path));
+  std::string path = append_paths(array_path, IMAGEDS_METADATA);
+  if (is_file(TILEDB_CTX, path)) {
+    ssize_t length = file_size(TILEDB_CTX, path);
+    if (length < 0) {
+      errno = EIO;
+      return IMAGEDS_ERR;
+    }
+    std::string contents(length, 0);
+    if (length > 0) {
+      RETURN_EIO_IF_ERROR(read_from_file(TILEDB_CTX, path, 0, &contents[0], length));
+    }
+    std::istringstream in(contents);
+    std::string line;
+    while (std::getline(in, line)) {
+      size_t separator = line.find('=');
+      if (separator != std::string::npos) {
+        metadata[line.substr(0, separator)] = line.substr(separator+1);
+      }
+    }
+  }
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::list_arrays(std::vector<std::string>& array_paths) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  std::string root = current_working_dir(TILEDB_CTX);
+  RETURN_EIO_IF_ERROR(list_arrays(root, root, array_paths));
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::list_arrays(const std::string& dir, const std::string& root, std::vector<std::string>& array_paths) {
+  for (auto& subdir : get_dirs(TILEDB_CTX, dir)) {
+    std::string path = real_dir(TILEDB_CTX, subdir);
+    if (pathname(path) == IMAGEDS_TILE_STORE) {
+      continue;
+    }
+    if (is_array(TILEDB_CTX, path)) {
+      if (path.compare(0, root.size(), root) || path.size() <= root.size()) {
+        errno = EIO;
+        return IMAGEDS_ERR;
+      }
+      array_paths.push_back(path.substr(root.size()+1));
+    } else if (is_group(TILEDB_CTX, path)) {
+      RETURN_EIO_IF_ERROR(list_arrays(path, root, array_paths));
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+void ImageDS::enable_tile_dedup(const bool enable) {
+  m_tile_dedup = enable;
+}
+
+void ImageDS::enable_read_coalescing(const bool enable) {
+  m_read_coalescing = enable;
+}
+
+void ImageDS::enable_io_uring(const bool enable) {
+  m_io_uring = enable;
+}
+
+void ImageDS::enable_scan_mode(const bool enable) {
+  m_scan_mode = enable;
+}
+
+bool ImageDS::io_uring_available() {
+  return ImageDSBatchReader::uring_available();
+}
+
+void ImageDS::set_tile_cache_capacity(size_t capacity) {
+  m_memory_budget->set_tile_cache_capacity(capacity);
+}
+
+void ImageDS::set_memory_budget(size_t bytes) {
+  m_memory_budget->set_budget(bytes);
+}
+
+ImageDSMemoryUsage ImageDS::memory_usage() {
+  return m_memory_budget->usage();
+}
+
+ImageDSStats ImageDS::stats() {
+  return m_stats->snapshot();
+}
+
+void ImageDS::reset_stats() {
+  m_stats->reset();
+  m_memory_budget->reset();
+}
+
+void ImageDS::set_query_profiler(query_profiler_t profiler) {
+  m_query_profiler = profiler;
+}
+
+int ImageDS::set_io_pool(size_t thread_num, size_t queue_depth) {
+  if (!thread_num || !queue_depth) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  m_io_pool.reset();
+  m_io_instances.clear();
+  try {
+    for (auto i=0ul; i<thread_num; i++) {
+      std::unique_ptr<ImageDS> instance(new ImageDS(m_workspace, false, false, true));
+      instance->m_tile_cache = m_tile_cache;
+      instance->m_memory_budget = m_memory_budget;
+      instance->m_stats = m_stats;
+      instance->m_schema_cache = m_schema_cache;
+      instance->m_context_pool = m_context_pool;
+      m_io_instances.push_back(std::move(instance));
+    }
+  } catch (const ImageDSException& e) {
+    m_io_instances.clear();
+    errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  m_io_pool = std::unique_ptr<ImageDSIOPool>(new ImageDSIOPool(thread_num, queue_depth));
+  return IMAGEDS_OK;
+}
+
+ImageDSRequest ImageDS::submit(std::function<int(ImageDS&)> request, completion_t completion) {
+  std::shared_ptr<ImageDSRequestState> state = std::make_shared<ImageDSRequestState>(completion);
+  if (!m_io_pool && set_io_pool(IMAGEDS_DEFAULT_IO_THREADS, IMAGEDS_DEFAULT_IO_QUEUE_DEPTH)) {
+    state->start();
+    state->complete(IMAGEDS_ERR, errno);
+    return ImageDSRequest(state);
+  }
+
+  bool tile_dedup = m_tile_dedup;
+  bool read_coalescing = m_read_coalescing;
+  bool io_uring = m_io_uring;
+  bool scan_mode = m_scan_mode;
+  query_profiler_t query_profiler = m_query_profiler;
+  bool queued = m_io_pool->submit([this, state, request, tile_dedup, read_coalescing, io_uring, scan_mode,
+                                   query_profiler](size_t thread_id) {
+      if (!state->start()) {
+        return; // Cancelled while queued
+      }
+      ImageDS& instance = *m_io_instances[thread_id];
+      instance.m_tile_dedup = tile_dedup;
+      instance.m_read_coalescing = read_coalescing;
+      instance.m_io_uring = io_uring;
+      instance.m_scan_mode = scan_mode;
+      instance.m_query_profiler = query_profiler;
+      int status;
+      errno = 0;
+      try {
+        status = request(instance);
+      } catch (const std::exception& e) {
+        status = IMAGEDS_ERR;
+        errno = EIO;
+      }
+      state->complete(status, errno ? errno : EIO);
+    }, state);
+  if (!queued) {
+    state->start();
+    state->complete(IMAGEDS_ERR, EAGAIN);
+  }
+  return ImageDSRequest(state);
+}
+
+// Arrays hold their dimensions and attributes by unique_ptr and cannot be copied
+static std::shared_ptr<ImageDSArray> clone_array(const ImageDSArray& array) {
+  std::shared_ptr<ImageDSArray> clone = std::make_shared<ImageDSArray>(array.m_path);
+  for (auto& dimension : array.m_dimensions) {
+    clone->add_dimension(dimension->m_name, dimension->m_start, dimension->m_end, dimension->m_tile_extent);
+  }
+  for (auto& attribute : array.m_attributes) {
+    clone->add_attribute(attribute->m_name, attribute->m_type, attribute->m_compression,
+                         attribute->m_compression_level);
+  }
+  return clone;
+}
+
+ImageDSRequest ImageDS::read_async(ImageDSArray& array, const std::vector<uint64_t>& subarray,
+                                   std::vector<void *> buffers, std::vector<size_t> buffer_sizes,
+                                   completion_t completion) {
+  std::shared_ptr<ImageDSArray> clone = clone_array(array);
+  return submit([clone, subarray, buffers, buffer_sizes](ImageDS& instance) {
+      return instance.from_array(*clone, subarray, buffers, buffer_sizes);
+    }, completion);
+}
+
+ImageDSRequest ImageDS::write_async(ImageDSArray& array, const std::vector<uint64_t>& subarray,
+                                    std::vector<void *> buffers, std::vector<size_t> buffer_sizes,
+                                    completion_t completion) {
+  std::shared_ptr<ImageDSArray> clone = clone_array(array);
+  return submit([clone, subarray, buffers, buffer_sizes](ImageDS& instance) {
+      return instance.to_array(*clone, subarray, buffers, buffer_sizes);
+    }, completion);
+}
+
+int ImageDS::estimate(ImageDSArray& array, const std::vector<uint64_t>& subarray, ImageDSQueryEstimate& estimate) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<uint64_t> query = subarray.empty() ? layout.domain() : subarray;
+  std::vector<uint64_t> clipped;
+  if (query.size() != layout.domain().size() || !intersect(query, layout.domain(), clipped) || clipped != query) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  estimate = ImageDSQueryEstimate();
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(query);
+  uint64_t tile_cells = tile_cell_num(layout, tile_ids);
+  for (auto attribute : attributes) {
+    size_t cell_size = attr_type_size(attribute->m_type);
+    estimate.m_result_sizes.push_back(ImageDSTileLayout::cell_num(query)*cell_size);
+    estimate.m_result_bytes += estimate.m_result_sizes.back();
+    estimate.m_decompressed_bytes += tile_cells*cell_size;
+  }
+  estimate.m_tiles_touched = tile_ids.size()*attributes.size();
+
+  if (m_tile_store->has_refs(array.m_path)) {
+    // Stored tile sizes are exact
+    ImageDSTileRefs refs;
+    RETURN_EIO_IF_ERROR(m_tile_store->read_refs(array.m_path, refs));
+    for (auto attribute : attributes) {
+      int attribute_id = refs.attribute_id(attribute->m_name);
+      if (attribute_id < 0) {
+        errno = EIO;
+        return IMAGEDS_ERR;
+      }
+      for (auto tile_id : tile_ids) {
+        ssize_t stored_size = m_tile_store->stored_size(refs.m_keys[attribute_id][tile_id]);
+        if (stored_size < 0) {
+          errno = EIO;
+          return IMAGEDS_ERR;
+        }
+        estimate.m_compressed_bytes += stored_size;
+      }
+    }
+  } else {
+    // Fragment bookkeeping with per tile offsets is private to TileDB, the attribute files of every fragment are
+    // assumed to be spread evenly over the tiles of the domain
+    double tile_fraction = static_cast<double>(tile_ids.size())/layout.tile_num();
+    for (auto& dir : get_dirs(TILEDB_CTX, array.m_path)) {
+      if (!is_fragment(TILEDB_CTX, dir)) {
+        continue;
+      }
+      for (auto attribute : attributes) {
+        std::string attribute_file = append_paths(dir, attribute->m_name + TILEDB_FILE_SUFFIX);
+        if (is_file(TILEDB_CTX, attribute_file)) {
+          ssize_t length = file_size(TILEDB_CTX, attribute_file);
+          estimate.m_compressed_bytes += length > 0 ? static_cast<uint64_t>(length*tile_fraction + 0.5) : 0;
+        }
+      }
+    }
+  }
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+// Read-only shared mapping of a whole file, unmapped when the last reference goes
+static std::shared_ptr<const void> map_file(const std::string& path, size_t& length) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || !st.st_size) {
+    close(fd);
+    errno = EIO;
+    return NULL;
+  }
+  length = st.st_size;
+  void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  return std::shared_ptr<const void>(data, [length](const void *mapped) {
+      munmap(const_cast<void *>(mapped), length);
+    });
+}
+
+int ImageDS::map(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<ImageDSMappedView>& views) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array.m_path));
+  std::shared_ptr<const ImageDSArray> schema = cached_schema(array.m_path);
+  RETURN_IF_NULL(schema);
+  std::vector<const ImageDSAttribute *> attributes;
+  RETURN_EINVAL_IF_ERROR(selected_attributes(*schema, array, attributes));
+  ImageDSTileLayout layout(schema->m_dimensions);
+  std::vector<uint64_t> query = subarray.empty() ? layout.domain() : subarray;
+  std::vector<uint64_t> clipped;
+  if (query.size() != layout.domain().size() || !intersect(query, layout.domain(), clipped) || clipped != query) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  // Files on HDFS or cloud stores cannot be mapped
+  bool mappable = m_workspace.find("://") == std::string::npos;
+  for (auto attribute : attributes) {
+    mappable = mappable && attribute->m_compression == NONE;
+  }
+  if (!mappable) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+
+  size_t dim_num = layout.dim_num();
+  const std::vector<uint64_t>& tile_extents = layout.tile_extents();
+  uint64_t tile_cells = 1;
+  for (auto extent : tile_extents) {
+    tile_cells *= extent;
+  }
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(query);
+  bool deduped = m_tile_store->has_refs(array.m_path);
+  ImageDSTileRefs refs;
+  if (deduped) {
+    RETURN_EIO_IF_ERROR(m_tile_store->read_refs(array.m_path, refs));
+  }
+
+  std::vector<ImageDSMappedView> mapped_views(attributes.size());
+  for (auto i=0ul; i<attributes.size(); i++) {
+    ImageDSMappedView& view = mapped_views[i];
+    view.m_attribute = attributes[i]->m_name;
+    view.m_type = attributes[i]->m_type;
+    view.m_subarray = query;
+    size_t cell_size = attr_type_size(attributes[i]->m_type);
+    size_t length;
+    if (deduped) {
+      int attribute_id = refs.attribute_id(attributes[i]->m_name);
+      if (attribute_id < 0) {
+        errno = EIO;
+        return IMAGEDS_ERR;
+      }
+      // Identical tiles share a file and a mapping
+      std::unordered_map<std::string, const char *> mapped;
+      for (auto tile_id : tile_ids) {
+        const std::string& key = refs.m_keys[attribute_id][tile_id];
+        std::vector<uint64_t> box = layout.tile_subarray(tile_id);
+        if (!mapped.count(key)) {
+          std::shared_ptr<const void> mapping = map_file(append_paths(m_workspace, m_tile_store->tile_path(key)),
+                                                         length);
+          RETURN_IF_NULL(mapping);
+          uint64_t tile_length;
+          mapped[key] = ImageDSTileStore::raw_cells(static_cast<const char *>(mapping.get()), length, tile_length);
+          if (!mapped[key] || tile_length != ImageDSTileLayout::cell_num(box)*cell_size) {
+            errno = ENOTSUP;
+            return IMAGEDS_ERR;
+          }
+          view.m_mappings.push_back(mapping);
+        }
+        view.m_tiles.push_back({tile_id, box, mapped[key]});
+      }
+    } else {
+      // Dense fragments hold full tiles in row-major tile order, a single fragment over the whole domain is
+      // recognized by its size
+      std::vector<std::string> attribute_files = fragment_files(TILEDB_CTX, array.m_path, attributes[i]->m_name);
+      if (attribute_files.size() != 1) {
+        errno = ENOTSUP;
+        return IMAGEDS_ERR;
+      }
+      std::shared_ptr<const void> mapping = map_file(attribute_files[0], length);
+      RETURN_IF_NULL(mapping);
+      if (length != layout.tile_num()*tile_cells*cell_size) {
+        errno = ENOTSUP;
+        return IMAGEDS_ERR;
+      }
+      view.m_mappings.push_back(mapping);
+      for (auto tile_id : tile_ids) {
+        std::vector<uint64_t> box = layout.tile_subarray(tile_id);
+        for (auto d=0ul; d<dim_num; d++) {
+          box[2*d+1] = box[2*d] + tile_extents[d] - 1;
+        }
+        view.m_tiles.push_back({tile_id, box, static_cast<const char *>(mapping.get()) + tile_id*tile_cells*cell_size});
+      }
+    }
+
+    // Within a fragment, cells stay evenly spaced across the tiles along a dimension when all later dimensions
+    // have a single tile and all earlier ones tiles of extent 1
+    const std::vector<uint64_t>& box = view.m_tiles[0].m_box;
+    bool strided = true;
+    for (auto d=0ul; d<dim_num; d++) {
+      if (query[2*d+1] <= box[2*d+1]) {
+        continue;
+      }
+      strided = strided && !deduped;
+      for (auto k=0ul; k<dim_num; k++) {
+        if ((k > d && layout.tile_counts()[k] != 1) || (k < d && tile_extents[k] != 1)) {
+          strided = false;
+        }
+      }
+    }
+    if (strided) {
+      view.m_strides.assign(dim_num, cell_size);
+      uint64_t offset = 0;
+      for (auto d=dim_num; d-->0;) {
+        if (d+1 < dim_num) {
+          view.m_strides[d] = view.m_strides[d+1]*(box[2*d+3]-box[2*d+2]+1);
+        }
+        offset += (query[2*d]-box[2*d])*view.m_strides[d];
+      }
+      view.m_data = static_cast<const char *>(view.m_tiles[0].m_data) + offset;
+    }
+  }
+  views.swap(mapped_views);
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::tile_store_size(uint64_t& tile_num, uint64_t& stored_bytes) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(m_tile_store->size(tile_num, stored_bytes));
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+int ImageDS::tile_keys(const std::string& array_path, const std::string& attribute, std::vector<std::string>& keys,
+                       bool& deduped) {
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_workspace));
+  RETURN_EIO_IF_ERROR(!is_array(TILEDB_CTX, array_path));
+
+  keys.clear();
+  deduped = m_tile_store->has_refs(array_path);
+  if (deduped) {
+    ImageDSTileRefs refs;
+    RETURN_EIO_IF_ERROR(m_tile_store->read_refs(array_path, refs));
+    int attribute_id = refs.attribute_id(attribute);
+    if (attribute_id < 0) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    keys = refs.m_keys[attribute_id];
+    RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+    return IMAGEDS_OK;
+  }
+
+  ImageDSArray schema;
+  RETURN_EINVAL_IF_ERROR(read_array_schema(array_path, schema));
+  size_t cell_size = 0;
+  for (auto& schema_attribute : schema.m_attributes) {
+    if (schema_attribute->m_name == attribute) {
+      cell_size = attr_type_size(schema_attribute->m_type);
+    }
+  }
+  if (!cell_size) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  ImageDSTileLayout layout(schema.m_dimensions);
+  std::vector<uint64_t> subarray = layout.tile_subarray(0);
+  const char *attributes[] = { attribute.c_str() };
+  TileDB_Array* tiledb_array;
+  RETURN_EINVAL_IF_ERROR(tiledb_array_init(TILEDB_CTX, &tiledb_array,
+                                           array_path.c_str(),
+                                           TILEDB_ARRAY_READ_SORTED_ROW,
+                                           subarray.data(),
+                                           attributes,
+                                           1));
+  std::vector<char> tile;
+  for (auto i=0ul; i<layout.tile_num(); i++) {
+    subarray = layout.tile_subarray(i);
+    tile.resize(ImageDSTileLayout::cell_num(subarray)*cell_size);
+    void *buffers[] = { tile.data() };
+    size_t buffer_sizes[] = { tile.size() };
+    if (tiledb_array_reset_subarray(tiledb_array, subarray.data())
+        || tiledb_array_read(tiledb_array, buffers, buffer_sizes)
+        || buffer_sizes[0] != tile.size()) {
+      tiledb_array_finalize(tiledb_array);
+      errno = EIO;
+      return IMAGEDS_ERR;
+    }
+    keys.push_back(ImageDSTileStore::key(tile.data(), tile.size()));
+  }
+  RETURN_ECANCELED_IF_ERROR(tiledb_array_finalize(tiledb_array));
+
+  RETURN_EIO_IF_ERROR(set_working_dir(TILEDB_CTX, m_working_dir));
+  return IMAGEDS_OK;
+}
+
+// Expects the TileDB working dir to be the workspace
+int ImageDS::to_tile_store(ImageDSArray& array, const std::vector<void *>& buffers, const std::vector<size_t>& buffer_sizes) {
+  IMAGEDS_TRACE_SPAN("to_tile_store");
+  ImageDSArray schema;
+  RETURN_EINVAL_IF_ERROR(read_array_schema(array.m_path, schema));
+  if (buffers.size() != schema.m_attributes.size() || buffer_sizes.size() != buffers.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  ImageDSTileLayout layout(schema.m_dimensions);
+  uint64_t tile_num = layout.tile_num();
+  // Every thread holds a tile and its encoding
+  uint64_t tile_bytes = 0;
+  for (auto& attribute : schema.m_attributes) {
+    tile_bytes = std::max<uint64_t>(tile_bytes, ImageDSTileLayout::cell_num(layout.tile_subarray(0))
+                                    *attr_type_size(attribute->m_type));
+  }
+  uint64_t thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+  ImageDSMemoryReservation reservation(*m_memory_budget, std::min(tile_num, thread_num)*tile_bytes*2);
+  ImageDSTileRefs refs;
+  for (auto i=0ul; i<schema.m_attributes.size(); i++) {
+    ImageDSAttribute *attribute = schema.m_attributes[i].get();
+    size_t cell_size = attr_type_size(attribute->m_type);
+    // Dense arrays are written in full
+    if (buffer_sizes[i] != ImageDSTileLayout::cell_num(layout.domain())*cell_size) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+
+    refs.m_attributes.push_back(attribute->m_name);
+    refs.m_keys.push_back(std::vector<std::string>(tile_num));
+    std::vector<std::string>& keys = refs.m_keys.back();
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (uint64_t j=0; j<tile_num; j++) {
+      if (status) continue;
+      std::vector<uint64_t> tile_subarray = layout.tile_subarray(j);
+      std::vector<char> tile(ImageDSTileLayout::cell_num(tile_subarray)*cell_size);
+      copy_region(buffers[i], layout.domain(), tile.data(), tile_subarray, tile_subarray, cell_size);
+      keys[j] = ImageDSTileStore::key(tile.data(), tile.size());
+      if (m_tile_store->put(keys[j], tile.data(), tile.size(), attribute->m_compression,
+                            attribute->m_compression_level) < 0) {
+        status = IMAGEDS_ERR;
+      }
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+  }
+
+  RETURN_EIO_IF_ERROR(m_tile_store->write_refs(array.m_path, refs));
+  return IMAGEDS_OK;
+}
+
+// Tile store loads in flight in the process. Tiles are content addressed, so loads of the same key by any
+// instance or workspace are interchangeable.
+static ImageDSSingleFlight<tile_buffer_t>& tile_flights() {
+  static ImageDSSingleFlight<tile_buffer_t> flights;
+  return flights;
+}
+
+// Decoded tile from the tile cache or the tile store, NULL if the tile could not be read
+tile_buffer_t ImageDS::fetch_tile(const std::string& array_path, const std::string& key,
+                                  const prefetched_tiles_t *prefetched) {
+  if (prefetched) {
+    auto found = prefetched->find(key);
+    if (found != prefetched->end()) {
+      m_stats->update(array_path, [](ImageDSArrayStats& stats) {
+          stats.m_tiles_touched++;
+        });
+      return found->second;
+    }
+  }
+  tile_buffer_t tile = m_tile_cache->get(key);
+  uint64_t read_bytes = 0, decompressed_bytes = 0;
+  bool cache_hit = tile != NULL;
+  bool coalesced = false;
+  if (!tile) {
+    auto load = [&]() -> tile_buffer_t {
+      std::shared_ptr<std::vector<char>> loaded(new std::vector<char>());
+      if (m_tile_store->get(key, *loaded, &read_bytes, &decompressed_bytes)) {
+        return NULL;
+      }
+      return loaded;
+    };
+    tile = m_read_coalescing ? tile_flights().run(key, load, &coalesced) : load();
+    if (!tile) {
+      return NULL;
+    }
+    // Scans do not displace the working set of the tile cache
+    if (!m_scan_mode) {
+      m_tile_cache->put(key, tile);
+    }
+  }
+  m_stats->update(array_path, [&](ImageDSArrayStats& stats) {
+      stats.m_tiles_touched++;
+      stats.m_cache_hits += cache_hit;
+      stats.m_coalesced_reads += coalesced;
+      stats.m_bytes_read += read_bytes;
+      stats.m_bytes_decompressed += decompressed_bytes;
+    });
+  return tile;
+}
+
+// Reads the tiles of tile_ids missing from the tile cache in one batch, decoding them in parallel as their reads
+// complete. Scans read around the page cache. Tiles that cannot be prefetched are left to fetch_tile.
+bool ImageDS::prefetches_tiles() {
+  // Workspaces on HDFS or cloud stores are only reachable through TileDB
+  return (m_io_uring || m_scan_mode) && m_workspace.find("://") == std::string::npos;
+}
+
+void ImageDS::prefetch_tiles(const std::string& array_path, const std::vector<std::string>& keys,
+                             const std::vector<uint64_t>& tile_ids, prefetched_tiles_t& prefetched) {
+  if (!prefetches_tiles()) {
+    return;
+  }
+  IMAGEDS_TRACE_SPAN("prefetch_tiles");
+  std::vector<std::string> missing, paths;
+  for (auto tile_id : tile_ids) {
+    const std::string& key = keys[tile_id];
+    if (!prefetched.count(key) && !m_tile_cache->get(key)) {
+      prefetched[key] = NULL;
+      missing.push_back(key);
+      paths.push_back(append_paths(m_workspace, m_tile_store->tile_path(key)));
+    }
+  }
+  if (!m_batch_reader || m_batch_reader->direct() != m_scan_mode
+      || (m_batch_reader->uses_uring() && !m_io_uring)) {
+    m_batch_reader = std::unique_ptr<ImageDSBatchReader>(
+        new ImageDSBatchReader(m_io_uring ? IMAGEDS_IO_URING_QUEUE_DEPTH : 0, m_scan_mode));
+  }
+
+  std::vector<tile_buffer_t> tiles(missing.size());
+  // Tasks inside the callback would otherwise get private copies of the variables it captures by reference
+  tile_buffer_t *decoded = tiles.data();
+  const std::string *decoded_keys = missing.data();
+  #pragma omp parallel
+  #pragma omp single
+  {
+    m_batch_reader->read(paths, [&](size_t i, std::vector<char>& data) {
+        std::shared_ptr<std::vector<char>> encoded = std::make_shared<std::vector<char>>();
+        encoded->swap(data);
+        // Decompression of completed reads overlaps the reads still in flight
+        #pragma omp task firstprivate(i, encoded, decoded, decoded_keys)
+        {
+          std::shared_ptr<std::vector<char>> tile(new std::vector<char>());
+          uint64_t decompressed_bytes = 0;
+          if (!ImageDSTileStore::decode(*encoded, *tile, &decompressed_bytes)) {
+            decoded[i] = tile;
+            if (!m_scan_mode) {
+              m_tile_cache->put(decoded_keys[i], tile);
+            }
+            m_stats->update(array_path, [&](ImageDSArrayStats& stats) {
+                stats.m_bytes_read += encoded->size();
+                stats.m_bytes_decompressed += decompressed_bytes;
+              });
+          }
+        }
+      });
+  }
+  for (auto i=0ul; i<missing.size(); i++) {
+    if (tiles[i]) {
+      prefetched[missing[i]] = tiles[i];
+    } else {
+      prefetched.erase(missing[i]);
+    }
+  }
+}
+
+// Expects the TileDB working dir to be the workspace
+int ImageDS::from_tile_store(ImageDSArray& array, const std::vector<uint64_t>& requested,
+                             std::vector<void *>& buffers, std::vector<size_t>& buffer_sizes,
+                             const std::vector<ImageDSConversion>& conversions) {
+  IMAGEDS_TRACE_SPAN("from_tile_store");
+  ImageDSArray schema;
+  RETURN_EINVAL_IF_ERROR(read_array_schema(array.m_path, schema));
+  ImageDSTileRefs refs;
+  RETURN_EIO_IF_ERROR(m_tile_store->read_refs(array.m_path, refs));
+
+  ImageDSTileLayout layout(schema.m_dimensions);
+  std::vector<uint64_t> subarray = requested.empty() ? layout.domain() : requested;
+  std::vector<uint64_t> clipped;
+  if (subarray.size() != layout.domain().size() || !intersect(subarray, layout.domain(), clipped)
+      || clipped != subarray) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<ImageDSAttribute *> attributes;
+  for (auto& attribute : array.m_attributes.empty() ? schema.m_attributes : array.m_attributes) {
+    attributes.push_back(attribute.get());
+  }
+  if (buffers.size() < attributes.size() || buffer_sizes.size() < attributes.size()
+      || (!conversions.empty() && conversions.size() != attributes.size())) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<uint64_t> tile_ids = layout.overlapping_tiles(subarray);
+  for (auto i=0ul; i<attributes.size(); i++) {
+    int attribute_id = refs.attribute_id(attributes[i]->m_name);
+    if (attribute_id < 0) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    attr_type_t type = schema.m_attributes[attribute_id]->m_type;
+    size_t cell_size = attr_type_size(type);
+    // Cells are converted while they are copied out of the tiles
+    std::unique_ptr<ImageDSConverter> converter;
+    if (!conversions.empty() && !conversions[i].identity(type)) {
+      converter.reset(new ImageDSConverter(type, conversions[i]));
+      if (!converter->valid()) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+    }
+    size_t result_cell_size = converter ? attr_type_size(conversions[i].m_type) : cell_size;
+    size_t required_size = ImageDSTileLayout::cell_num(subarray)*result_cell_size;
+    if (buffer_sizes[i] < required_size) {
+      throw std::runtime_error("Buffer overflow encountered");
+    }
+
+    const std::vector<std::string>& keys = refs.m_keys[attribute_id];
+    prefetched_tiles_t prefetched;
+    prefetch_tiles(array.m_path, keys, tile_ids, prefetched);
+    std::atomic<int> status(IMAGEDS_OK);
+    #pragma omp parallel for schedule(dynamic)
+    for (auto j=0ul; j<tile_ids.size(); j++) {
+      if (status) continue;
+      tile_buffer_t tile = fetch_tile(array.m_path, keys[tile_ids[j]], &prefetched);
+      if (!tile) {
+        status = IMAGEDS_ERR;
+        continue;
+      }
+      IMAGEDS_TRACE_SPAN("copy_region");
+      std::vector<uint64_t> tile_subarray = layout.tile_subarray(tile_ids[j]);
+      std::vector<uint64_t> region;
+      intersect(tile_subarray, subarray, region);
+      if (converter) {
+        copy_region(tile->data(), tile_subarray, cell_size, buffers[i], subarray, result_cell_size, region,
+                    [&](const void *src, void *dst, uint64_t cell_num) {
+                      converter->convert(src, dst, cell_num);
+                    });
+      } else {
+        copy_region(tile->data(), tile_subarray, buffers[i], subarray, region, cell_size);
+      }
+    }
+    RETURN_EIO_IF_ERROR(status.load());
+    buffer_sizes[i] = required_size;
+  }
+  return IMAGEDS_OK;
+}
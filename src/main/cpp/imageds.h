@@ -34,11 +34,15 @@
 
 #include "error.h"
 
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
 #include <stdarg.h>
 #include <stdint.h>
 #include <string>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #if (defined __GNUC__ && __GNUC__ >= 4) || defined __INTEL_COMPILER
@@ -49,6 +53,11 @@
 
 IMAGEDS_PUBLIC std::string imageds_version();
 
+/** Encodes numbers as a metadata value, multiple values are backslash separated as in DICOM */
+IMAGEDS_PUBLIC std::string imageds_metadata_value(const std::vector<double>& values);
+
+IMAGEDS_PUBLIC std::vector<double> imageds_metadata_values(const std::string& value);
+
 typedef enum imageds_attr_type_t {
   CHAR=4,         // TILEDB_CHAR
   UCHAR=5,        // TILEDB_INT8
@@ -242,27 +251,554 @@ class IMAGEDS_PUBLIC ImageDSBuffers {
   }
 };
 
+/** Latencies in power of two microsecond buckets, bucket i counts latencies in [2^(i-1), 2^i) us */
+class IMAGEDS_PUBLIC ImageDSLatencyHistogram {
+ public:
+  static const int BUCKET_NUM = 32;
+
+  uint64_t m_count = 0;
+  uint64_t m_total_us = 0;
+  uint64_t m_max_us = 0;
+  std::vector<uint64_t> m_buckets = std::vector<uint64_t>(BUCKET_NUM);
+
+  void add(uint64_t latency_us);
+
+  void merge(const ImageDSLatencyHistogram& other);
+
+  /** Upper bound in microseconds of the bucket holding quantile q of the latencies, 0 <= q <= 1 */
+  uint64_t percentile(double q) const;
+};
+
+/** Counters of the to_array and from_array calls on one array */
+class IMAGEDS_PUBLIC ImageDSArrayStats {
+ public:
+  uint64_t m_to_array_calls = 0;
+  uint64_t m_from_array_calls = 0;
+  uint64_t m_errors = 0;
+  uint64_t m_bytes_written = 0;      // Bytes passed to to_array
+  uint64_t m_bytes_requested = 0;    // Bytes returned by from_array
+  uint64_t m_bytes_read = 0;         // Bytes read from disk, page cache hits excluded for TileDB reads
+  uint64_t m_bytes_decompressed = 0; // Bytes inflated by tile store reads
+  uint64_t m_tiles_touched = 0;
+  uint64_t m_cache_hits = 0;
+  uint64_t m_coalesced_reads = 0;    // Tiles shared with a concurrent read of the same tile
+  ImageDSLatencyHistogram m_to_array_latency;
+  ImageDSLatencyHistogram m_from_array_latency;
+
+  void merge(const ImageDSArrayStats& other);
+};
+
+/** Snapshot of the statistics of an ImageDS instance keyed by array path */
+class IMAGEDS_PUBLIC ImageDSStats {
+ public:
+  std::map<std::string, ImageDSArrayStats> m_arrays;
+
+  /** Counters summed over all arrays */
+  ImageDSArrayStats total() const;
+};
+
+/** Cost of a single from_array call, see ImageDS::set_query_profiler */
+class IMAGEDS_PUBLIC ImageDSQueryProfile {
+ public:
+  std::string m_array_path;
+  std::vector<uint64_t> m_subarray;
+  uint64_t m_bytes_returned = 0;
+  uint64_t m_bytes_decompressed = 0; // Tiles are decompressed whole, so this counts every tile touched in full
+  uint64_t m_tiles_touched = 0;      // Tiles of all attributes read
+  uint64_t m_fragments_scanned = 0;
+  uint64_t m_latency_us = 0;
+
+  /** Bytes decompressed per byte returned */
+  double amplification() const {
+    return m_bytes_returned ? static_cast<double>(m_bytes_decompressed)/m_bytes_returned : 0;
+  }
+};
+
+typedef std::function<void(const ImageDSQueryProfile&)> query_profiler_t;
+
+/** Cost of a from_array call estimated from the schema and fragment metadata, see ImageDS::estimate */
+class IMAGEDS_PUBLIC ImageDSQueryEstimate {
+ public:
+  uint64_t m_tiles_touched = 0;         // Tiles of all attributes read
+  uint64_t m_compressed_bytes = 0;      // Bytes read from storage
+  uint64_t m_decompressed_bytes = 0;
+  uint64_t m_result_bytes = 0;
+  std::vector<uint64_t> m_result_sizes; // Per attribute read, in buffer order
+};
+
+/** DICOM VOI LUT functions, see ImageDSConversion::window */
+typedef enum imageds_voi_function_t {
+  VOI_LINEAR=0,
+  VOI_LINEAR_EXACT=1,
+  VOI_SIGMOID=2
+} voi_function_t;
+
+/**
+ * Conversion of the cells of one attribute as they are read, see ImageDS::from_array. Cells x are rescaled to
+ * slope*x+intercept, mapped through a window or lookup table if set, clipped to [m_min, m_max] when clipping is on and
+ * stored as m_type. Integer types round to nearest and saturate at the limits of the type.
+ */
+class IMAGEDS_PUBLIC ImageDSConversion {
+ public:
+  ImageDSConversion(attr_type_t type, double slope=1, double intercept=0)
+      : m_type(type), m_slope(slope), m_intercept(intercept) {}
+
+  ImageDSConversion& clip(double min, double max) {
+    m_clip = true;
+    m_min = min;
+    m_max = max;
+    return *this;
+  }
+
+  /**
+   * Maps the rescaled cells through a DICOM VOI window onto the range of m_type, or [0, 1] for floating point
+   * types, replacing any lookup table. Linear windows have to be at least 1 wide, others wider than 0.
+   */
+  ImageDSConversion& window(double center, double width, voi_function_t function=VOI_LINEAR) {
+    m_window = true;
+    m_center = center;
+    m_width = width;
+    m_function = function;
+    m_lut.clear();
+    return *this;
+  }
+
+  /**
+   * Maps the rescaled cells rounded to integers through table, whose first entry is the result of first. Cells
+   * outside of the table take its first or last entry. Replaces any window.
+   */
+  ImageDSConversion& lut(const std::vector<double>& table, double first=0) {
+    m_window = false;
+    m_lut = table;
+    m_lut_first = first;
+    return *this;
+  }
+
+  /** Whether cells of type source are returned unchanged */
+  bool identity(attr_type_t source) const {
+    return m_type == source && m_slope == 1 && m_intercept == 0 && !m_clip && !m_window && m_lut.empty();
+  }
+
+  attr_type_t m_type;
+  double m_slope;
+  double m_intercept;
+  bool m_clip = false;
+  double m_min = 0;
+  double m_max = 0;
+  bool m_window = false;
+  double m_center = 0;
+  double m_width = 1;
+  voi_function_t m_function = VOI_LINEAR;
+  std::vector<double> m_lut;
+  double m_lut_first = 0;
+};
+
+/**
+ * Plane through a 3D array sampled by ImageDS::oblique_slice, in cell coordinates in the order of the dimensions of
+ * the array. As with the DICOM image orientation, m_row_direction runs along the rows of the slice and
+ * m_column_direction down its columns, so that cell (row, col) of the slice is sampled at
+ * m_origin + col*m_column_spacing*m_row_direction + row*m_row_spacing*m_column_direction with unit directions.
+ */
+class IMAGEDS_PUBLIC ImageDSObliquePlane {
+ public:
+  ImageDSObliquePlane(const std::vector<double>& origin, const std::vector<double>& row_direction,
+                      const std::vector<double>& column_direction, uint64_t rows, uint64_t cols,
+                      double row_spacing=1, double column_spacing=1)
+      : m_origin(origin), m_row_direction(row_direction), m_column_direction(column_direction), m_rows(rows),
+        m_cols(cols), m_row_spacing(row_spacing), m_column_spacing(column_spacing) {}
+
+  std::vector<double> m_origin;
+  std::vector<double> m_row_direction;    // Normalized before sampling
+  std::vector<double> m_column_direction; // Normalized before sampling
+  uint64_t m_rows;
+  uint64_t m_cols;
+  double m_row_spacing;
+  double m_column_spacing;
+  double m_fill = 0; // Value of the samples outside of the domain
+};
+
+/** Intensity projections along an axis, see ImageDS::project */
+typedef enum imageds_projection_t {
+  PROJECTION_MAX=0, // MIP
+  PROJECTION_MIN=1, // MinIP
+  PROJECTION_MEAN=2 // AvgIP
+} projection_t;
+
+/** Operations of separable filters, see ImageDSFilter */
+typedef enum imageds_filter_operation_t {
+  FILTER_CORRELATE=0, // Weighted sums of the cells under the kernel, out[x] = sum of w[k]*in[x+k-r]
+  FILTER_ERODE=1,     // Minimums of the cells under the kernel, whose weights are ignored
+  FILTER_DILATE=2     // Maximums of the cells under the kernel, whose weights are ignored
+} filter_operation_t;
+
+/**
+ * Separable filter applied by ImageDS::filter, with a kernel of odd length 2r+1 centered on the filtered cell for
+ * every dimension of the array, or an empty kernel for dimensions that are not filtered. Cells past the edges of
+ * the domain repeat the edge cells. Results are stored as m_type, integer types rounded to nearest and saturated.
+ */
+class IMAGEDS_PUBLIC ImageDSFilter {
+ public:
+  ImageDSFilter(const std::vector<std::vector<double>>& kernels, filter_operation_t operation=FILTER_CORRELATE,
+                attr_type_t type=FLOAT32)
+      : m_kernels(kernels), m_operation(operation), m_type(type) {}
+
+  /** Gaussian smoothing, with kernels normalized and cut off at 3 sigma */
+  static ImageDSFilter gaussian(size_t dim_num, double sigma, attr_type_t type=FLOAT32);
+
+  /** Sobel gradient along axis, central differences smoothed with [1, 2, 1]/4 along the other dimensions */
+  static ImageDSFilter gradient(size_t dim_num, size_t axis, attr_type_t type=FLOAT32);
+
+  /** Erosion or dilation with a box of 2*radius+1 cells along every dimension */
+  static ImageDSFilter morphology(size_t dim_num, uint64_t radius, filter_operation_t operation,
+                                  attr_type_t type=FLOAT32);
+
+  std::vector<std::vector<double>> m_kernels;
+  filter_operation_t m_operation;
+  attr_type_t m_type;
+};
+
+/** Memory held by an ImageDS instance and its I/O pool, see ImageDS::set_memory_budget */
+class IMAGEDS_PUBLIC ImageDSMemoryUsage {
+ public:
+  size_t m_budget = 0;     // 0 is unlimited
+  size_t m_tile_cache = 0; // Bytes held by the tile cache
+  size_t m_in_flight = 0;  // Bytes reserved by the reads and writes in progress
+  size_t m_peak = 0;       // Highest sum of the above since creation or the last reset
+  uint64_t m_queued = 0;   // Requests that waited for others to release memory
+  uint64_t m_split = 0;    // Reads split into slabs
+};
+
+/** Tile of an ImageDSMappedView, cells are in row-major order over m_box */
+class IMAGEDS_PUBLIC ImageDSMappedTile {
+ public:
+  uint64_t m_tile_id;
+  std::vector<uint64_t> m_box; // Edge tiles of fragments are padded and extend past the domain
+  const void *m_data;
+};
+
+/**
+ * Read-only view of the cells of an uncompressed attribute backed by memory mappings of the files holding its tiles,
+ * see ImageDS::map. The files are unmapped with the last copy of the view.
+ */
+class IMAGEDS_PUBLIC ImageDSMappedView {
+ public:
+  std::string m_attribute;
+  attr_type_t m_type;
+  std::vector<uint64_t> m_subarray;
+  std::vector<ImageDSMappedTile> m_tiles; // Tiles overlapping m_subarray in row-major tile order
+  // First cell of m_subarray and byte strides per dimension when all of m_subarray is addressable from it,
+  // m_data is NULL otherwise
+  const void *m_data = NULL;
+  std::vector<uint64_t> m_strides;
+  std::vector<std::shared_ptr<const void>> m_mappings;
+};
+
+/** Called once per asynchronous request with its status and the errno of a failed request */
+typedef std::function<void(int status, int error)> completion_t;
+
+class ImageDSRequestState;
+
+/** Handle of an asynchronous read or write, see ImageDS::read_async */
+class IMAGEDS_PUBLIC ImageDSRequest {
+ public:
+  ImageDSRequest() {}
+
+  explicit ImageDSRequest(std::shared_ptr<ImageDSRequestState> state) : m_state(state) {}
+
+  /** Cancels the request unless it already started, cancelled requests fail with ECANCELED */
+  bool cancel();
+
+  bool done() const;
+
+  /** Waits for the request and returns its status, errno is set to the error of a failed request */
+  int wait();
+
+  /** Error of a failed request, 0 if the request succeeded or is not done yet */
+  int error() const;
+
+  /** Ready with the status of the request once it completes */
+  std::shared_future<int> future() const;
+
+ private:
+  std::shared_ptr<ImageDSRequestState> m_state;
+};
+
+class ImageDSBatchReader;
+class ImageDSContextPool;
+class ImageDSIOPool;
+class ImageDSMemoryBudget;
+class ImageDSSchemaCache;
+class ImageDSStatsCollector;
+class ImageDSTileCache;
+class ImageDSTileLayout;
+class ImageDSTileStore;
+
 class IMAGEDS_PUBLIC ImageDS {
  public:
-  ImageDS(const std::string& workspace, const bool overwrite=false, const bool disable_file_locking=false);
+  /**
+   * Creates the workspace, an already existing workspace is only reused when overwrite is false and
+   * open_existing is true.
+   */
+  ImageDS(const std::string& workspace, const bool overwrite=false, const bool disable_file_locking=false,
+          const bool open_existing=false);
 
   ~ImageDS();
 
+  /** Instances keep per context working dirs, threads open their own instances of the workspace */
+  const std::string& workspace() const {
+    return m_workspace;
+  }
+
   int array_info(const std::string& array_path, ImageDSArray& array);
 
+  /** Merges key/value pairs into the metadata of an existing array, keys and values cannot contain newlines */
+  int write_metadata(const std::string& array_path, const std::map<std::string, std::string>& metadata);
+
+  int read_metadata(const std::string& array_path, std::map<std::string, std::string>& metadata);
+
+  /** Paths relative to the workspace of all arrays in the workspace */
+  int list_arrays(std::vector<std::string>& array_paths);
+
+  /**
+   * Arrays written with tile dedup enabled store their tiles once per workspace in a content-addressed
+   * tile store and only keep references to the tiles. Reads resolve the references transparently.
+   * References are only maintained for writes of the entire domain. Subarray writes, such as the slabs of the
+   * ingesters, fall back to TileDB fragments and fail with ENOTSUP for arrays already holding references. Writes
+   * of the entire domain without dedup drop the references of the array.
+   */
+  void enable_tile_dedup(const bool enable=true);
+
+  /**
+   * Content keys of the tiles of an attribute in row-major tile order. Keys are read from the references
+   * for arrays written with tile dedup and are computed from the tile contents otherwise.
+   */
+  int tile_keys(const std::string& array_path, const std::string& attribute, std::vector<std::string>& keys,
+                bool& deduped);
+
+  /** Number of tiles and bytes on disk held by the workspace tile store */
+  int tile_store_size(uint64_t& tile_num, uint64_t& stored_bytes);
+
+  /**
+   * Concurrent reads of a tile from the tile store wait for the read already in flight in the process and share
+   * its decoded tile instead of repeating the I/O and decompression, on by default.
+   */
+  void enable_read_coalescing(const bool enable=true);
+
+  /**
+   * Reads of arrays written with tile dedup submit the reads of all missing tiles of a subarray to io_uring as one
+   * batch and decompress tiles as their reads complete. Falls back to the default read path when io_uring is not
+   * available, see io_uring_available, or the workspace is not on a local filesystem. Off by default.
+   */
+  void enable_io_uring(const bool enable=true);
+
+  /** Whether the library was built with io_uring support and the kernel allows its use */
+  static bool io_uring_available();
+
+  /**
+   * Reads of scans, such as full-array exports or statistics, leave the caches of interactive readers alone. Tiles
+   * read are not added to the tile cache, tile store tiles are read with O_DIRECT into aligned pooled buffers and
+   * the pages of fragments and tiles brought into the page cache are dropped after every read. Off by default.
+   */
+  void enable_scan_mode(const bool enable=true);
+
+  /** Capacity in bytes of the cache of decoded tiles used by the read path, see set_memory_budget */
+  void set_tile_cache_capacity(size_t capacity);
+
+  /**
+   * Bounds the memory of this instance and its I/O pool in bytes, 0 for no limit which is the default. The tile
+   * cache is included and is shrunk to half of the budget if larger. The rest is shared by the tiles decoded by
+   * reads and the buffers of writes in flight, estimated from the tiles overlapping the subarrays. Requests that
+   * do not fit wait for others to complete, and from_array splits reads of more tiles than fit into slabs of
+   * whole tiles along the first dimension.
+   */
+  void set_memory_budget(size_t bytes);
+
+  /** Current and peak memory since creation or the last reset_stats */
+  ImageDSMemoryUsage memory_usage();
+
+  /**
+   * Per-array counters and latency histograms of to_array and from_array since creation or the last reset.
+   * Counters are sharded by thread, so that the threads of parallel reads do not contend on them.
+   */
+  ImageDSStats stats();
+
+  void reset_stats();
+
+  /**
+   * Every successful from_array call is profiled and passed to profiler, an empty profiler disables profiling.
+   * Profiling lists the fragments of the array on every read and should not be left on in production.
+   */
+  void set_query_profiler(query_profiler_t profiler);
+
   int to_array(ImageDSArray& array, const std::vector<void *> buffers, const std::vector<size_t> buffer_sizes);
 
+  /**
+   * Writes buffers covering subarray, given as [start, end] pairs per dimension, creating the array from its
+   * dimensions if necessary. An empty subarray writes the entire domain.
+   */
+  int to_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *> buffers,
+               const std::vector<size_t> buffer_sizes);
+
   ImageDSBuffers create_read_buffers(ImageDSArray& array);
 
+  /** Buffers sized exactly for reading subarray into the attributes of array, or all attributes if it has none */
+  ImageDSBuffers create_read_buffers(ImageDSArray& array, const std::vector<uint64_t>& subarray);
+
+  /**
+   * Estimates the cost of from_array(array, subarray) without reading any tiles. Compressed bytes are exact for
+   * arrays written with tile dedup and are prorated from the sizes of the attribute files of the fragments
+   * otherwise. An empty subarray is the entire domain.
+   */
+  int estimate(ImageDSArray& array, const std::vector<uint64_t>& subarray, ImageDSQueryEstimate& estimate);
+
   int from_array(ImageDSArray& array, std::vector<void *> buffers, std::vector<size_t> buffer_sizes);
 
+  /**
+   * Reads the cells of subarray, given as [start, end] pairs per dimension, into buffers in row-major order.
+   * An empty subarray reads the entire domain.
+   */
+  int from_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *> buffers,
+                 std::vector<size_t> buffer_sizes);
+
+  /**
+   * Reads subarray converting the cells of every attribute read, in buffer order, while they are copied into
+   * buffers, which are sized for the converted types. Reads of arrays not written with tile dedup are converted
+   * slab by slab from a scratch buffer of the stored type.
+   */
+  int from_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *> buffers,
+                 std::vector<size_t> buffer_sizes, const std::vector<ImageDSConversion>& conversions);
+
+  /**
+   * Maps the tiles overlapping subarray of the attributes of array, or all attributes if it has none, without
+   * reading them. Only attributes stored without compression in a single fragment or in the tile store of a local
+   * workspace can be mapped, fails with ENOTSUP otherwise. Cells of tile store tiles may not be aligned to their
+   * size. An empty subarray is the entire domain.
+   */
+  int map(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<ImageDSMappedView>& views);
+
+  /**
+   * Threads and queue depth of the pool serving read_async and write_async, by default 4 threads and 64 requests.
+   * Every thread opens its own instance of the workspace that shares the statistics, tile cache and memory budget
+   * of this one. Waits for the outstanding requests of the current pool.
+   */
+  int set_io_pool(size_t thread_num, size_t queue_depth);
+
+  /**
+   * from_array on a pool thread. The array is copied, buffers have to stay valid until the request completes.
+   * Requests fail with EAGAIN when the queue of the pool is full. completion, if given, is called on the pool
+   * thread, or on the calling thread for requests that fail to queue or are cancelled. The settings of this
+   * instance at the time of the call apply to the request.
+   */
+  ImageDSRequest read_async(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *> buffers,
+                            std::vector<size_t> buffer_sizes, completion_t completion=NULL);
+
+  /** to_array on a pool thread, see read_async */
+  ImageDSRequest write_async(ImageDSArray& array, const std::vector<uint64_t>& subarray,
+                             std::vector<void *> buffers, std::vector<size_t> buffer_sizes,
+                             completion_t completion=NULL);
+
+  /** Buffers sized for gathering all of subarrays into the attributes of array, or all attributes if it has none */
+  ImageDSBuffers create_gather_buffers(ImageDSArray& array, const std::vector<std::vector<uint64_t>>& subarrays);
+
+  /**
+   * Reads many subarrays in one call. The tiles overlapping any of the subarrays are decoded once and in parallel,
+   * and scattered into buffers where every subarray is stored in row-major order starting at its offset in
+   * cell_offsets. Cell offsets are the same for all attributes, buffers are sized as with create_gather_buffers.
+   */
+  int gather(ImageDSArray& array, const std::vector<std::vector<uint64_t>>& subarrays, std::vector<void *> buffers,
+             std::vector<size_t> buffer_sizes, std::vector<uint64_t>& cell_offsets);
+
+  /**
+   * Reads the plane of the attributes of array, or all attributes if it has none, where dimension axis is index,
+   * e.g. axis 0, 1 and 2 of a ZYX volume are the axial, coronal and sagittal planes. Only the tiles the plane cuts
+   * are decoded. The plane is stored in buffers in row-major order over the remaining dimensions, swapped with
+   * transpose, which is only valid for 3D arrays. Buffers are sized as with create_gather_buffers for the plane.
+   */
+  int reslice(ImageDSArray& array, size_t axis, uint64_t index, std::vector<void *> buffers,
+              std::vector<size_t> buffer_sizes, bool transpose=false);
+
+  /**
+   * Samples plane through the attributes of the 3D array, or all attributes if it has none, with trilinear
+   * interpolation into buffers of m_rows x m_cols cells of the stored types, integer types rounded to nearest. Only
+   * the tiles holding cells around the samples are decoded, in parallel. Fails with EINVAL for arrays that are not
+   * 3D and for planes without cells or with zero or mis-sized vectors.
+   */
+  int oblique_slice(ImageDSArray& array, const ImageDSObliquePlane& plane, std::vector<void *> buffers,
+                    std::vector<size_t> buffer_sizes);
+
+  /**
+   * Projects subarray of the attributes of array, or all attributes if it has none, along dimension axis into
+   * buffers in row-major order over the remaining dimensions. Maximum and minimum projections are of the stored
+   * types, mean projections are FLOAT64. Tiles are decoded in batches that fit the memory budget and reduced into
+   * buffers as they are decoded. An empty subarray is the entire domain.
+   */
+  int project(ImageDSArray& array, const std::vector<uint64_t>& subarray, size_t axis, projection_t projection,
+              std::vector<void *> buffers, std::vector<size_t> buffer_sizes);
+
+  /**
+   * Applies filter to the attributes of array, or all attributes if it has none, into a new array at result_path
+   * with the same dimensions and attributes of type filter.m_type. The array is read a row of tiles along the first
+   * dimension at a time, with the rows of tiles the kernels reach into, and every tile is filtered with its halo on
+   * its own thread. The result is written a row of tiles at a time through TileDB, also when tile dedup is enabled.
+   * Fails with EINVAL for kernels that do not match the dimensions and EEXIST if result_path exists.
+   */
+  int filter(ImageDSArray& array, const std::string& result_path, const ImageDSFilter& filter);
+
  private:
+  // Tile references are maintained for the write only if tile_dedup is set
+  int to_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *>& buffers,
+               const std::vector<size_t>& buffer_sizes, bool tile_dedup);
+  int write_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, const std::vector<void *>& buffers,
+                  const std::vector<size_t>& buffer_sizes, bool tile_dedup);
+  int read_array(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *>& buffers,
+                 std::vector<size_t>& buffer_sizes, ImageDSQueryProfile *profile,
+                 const std::vector<ImageDSConversion>& conversions);
+  int read_within_budget(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *>& buffers,
+                         std::vector<size_t>& buffer_sizes, ImageDSQueryProfile *profile,
+                         const std::vector<ImageDSConversion>& conversions);
+  std::shared_ptr<const ImageDSArray> cached_schema(const std::string& array_path);
   int create_tiledb_groups(const std::string& array_path);
   int setup_tiledb_schema(ImageDSArray& array);
+  int read_array_schema(const std::string& array_path, ImageDSArray& array);
+  int to_tile_store(ImageDSArray& array, const std::vector<void *>& buffers, const std::vector<size_t>& buffer_sizes);
+  typedef std::unordered_map<std::string, std::shared_ptr<const std::vector<char>>> prefetched_tiles_t;
+  bool prefetches_tiles();
+  void prefetch_tiles(const std::string& array_path, const std::vector<std::string>& keys,
+                      const std::vector<uint64_t>& tile_ids, prefetched_tiles_t& prefetched);
+  std::shared_ptr<const std::vector<char>> fetch_tile(const std::string& array_path, const std::string& key,
+                                                      const prefetched_tiles_t *prefetched=NULL);
+  int from_tile_store(ImageDSArray& array, const std::vector<uint64_t>& subarray, std::vector<void *>& buffers,
+                      std::vector<size_t>& buffer_sizes, const std::vector<ImageDSConversion>& conversions);
+  int filter_slabs(ImageDSArray& array, const ImageDSTileLayout& layout,
+                   const std::vector<const ImageDSAttribute *>& attributes, const std::vector<uint64_t>& radii,
+                   ImageDSArray& result, const ImageDSFilter& filter);
+  typedef std::function<void(uint64_t tile_id, size_t attribute, const void *tile)> tile_consumer_t;
+  int decode_tiles(ImageDSArray& array, const std::vector<const ImageDSAttribute *>& attributes,
+                   const ImageDSTileLayout& layout, const std::vector<uint64_t>& tile_ids, bool tile_store,
+                   const tile_consumer_t& consume);
+  uint64_t decode_memory(const std::vector<const ImageDSAttribute *>& attributes, const ImageDSTileLayout& layout,
+                         const std::vector<uint64_t>& tile_ids, bool tile_store);
+  int list_arrays(const std::string& dir, const std::string& root, std::vector<std::string>& array_paths);
+  ImageDSRequest submit(std::function<int(ImageDS&)> request, completion_t completion);
 
   std::string m_workspace;
   std::string m_working_dir;
   void* m_tiledb_ctx;
+  bool m_tile_dedup;
+  bool m_read_coalescing;
+  bool m_io_uring;
+  bool m_scan_mode;
+  std::unique_ptr<ImageDSBatchReader> m_batch_reader;
+  std::unique_ptr<ImageDSTileStore> m_tile_store;
+  std::shared_ptr<ImageDSTileCache> m_tile_cache;
+  std::shared_ptr<ImageDSMemoryBudget> m_memory_budget;
+  std::shared_ptr<ImageDSStatsCollector> m_stats;
+  std::shared_ptr<ImageDSSchemaCache> m_schema_cache;
+  std::shared_ptr<ImageDSContextPool> m_context_pool;
+  query_profiler_t m_query_profiler;
+  // Pool threads use the instance with their index, the pool has to go first
+  std::vector<std::unique_ptr<ImageDS>> m_io_instances;
+  std::unique_ptr<ImageDSIOPool> m_io_pool;
 };
 
 #endif //__IMAGEDS_H__
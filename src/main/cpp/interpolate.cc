@@ -0,0 +1,233 @@
+/**
+ * @file interpolate.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Trilinear sampling of oblique planes from decoded tiles
+ */
+
+
+#include "interpolate.h"
+#include "typed_view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+int imageds_plane_steps(const ImageDSObliquePlane& plane, size_t dim_num, ImageDSObliquePlane& steps) {
+  if (dim_num != 3 || plane.m_origin.size() != dim_num || plane.m_row_direction.size() != dim_num
+      || plane.m_column_direction.size() != dim_num || !plane.m_rows || !plane.m_cols
+      || !(plane.m_row_spacing > 0) || !(plane.m_column_spacing > 0)) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  double row_norm = 0, column_norm = 0;
+  for (auto d=0ul; d<dim_num; d++) {
+    row_norm += plane.m_row_direction[d]*plane.m_row_direction[d];
+    column_norm += plane.m_column_direction[d]*plane.m_column_direction[d];
+  }
+  row_norm = std::sqrt(row_norm);
+  column_norm = std::sqrt(column_norm);
+  if (!(row_norm > 0) || !(column_norm > 0)) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  steps = plane;
+  for (auto d=0ul; d<dim_num; d++) {
+    steps.m_row_direction[d] = plane.m_row_direction[d]/row_norm*plane.m_column_spacing;
+    steps.m_column_direction[d] = plane.m_column_direction[d]/column_norm*plane.m_row_spacing;
+  }
+  steps.m_row_spacing = steps.m_column_spacing = 1;
+  return IMAGEDS_OK;
+}
+
+// Cells below and above a sample along every dimension, as tile indices and coordinates within the tiles
+class Corners {
+ public:
+  Corners(const ImageDSTileLayout& layout) : m_layout(layout) {}
+
+  // Whether the sample at position is inside the domain
+  bool locate(const ImageDSObliquePlane& steps, uint64_t row, uint64_t col) {
+    const std::vector<uint64_t>& domain = m_layout.domain();
+    const std::vector<uint64_t>& tile_extents = m_layout.tile_extents();
+    for (auto d=0ul; d<3; d++) {
+      double position = steps.m_origin[d] + row*steps.m_column_direction[d] + col*steps.m_row_direction[d];
+      if (!(position >= domain[d*2] && position <= domain[d*2+1])) {
+        return false;
+      }
+      uint64_t low = static_cast<uint64_t>(position) - domain[d*2];
+      uint64_t high = std::min(low+1, domain[d*2+1] - domain[d*2]);
+      m_weights[d] = position - domain[d*2] - low;
+      m_tiles[d][0] = low/tile_extents[d];
+      m_tiles[d][1] = high/tile_extents[d];
+      m_coords[d][0] = low - m_tiles[d][0]*tile_extents[d];
+      m_coords[d][1] = high - m_tiles[d][1]*tile_extents[d];
+      for (auto k=0; k<2; k++) {
+        m_sizes[d][k] = std::min(tile_extents[d], domain[d*2+1] - domain[d*2] + 1 - m_tiles[d][k]*tile_extents[d]);
+      }
+    }
+    return true;
+  }
+
+  // Tile of the corner whose bits 2, 1 and 0 select the cell above along the first, second and third dimension
+  uint64_t tile_id(int corner) const {
+    const std::vector<uint64_t>& tile_counts = m_layout.tile_counts();
+    return (m_tiles[0][corner >> 2]*tile_counts[1] + m_tiles[1][(corner >> 1) & 1])*tile_counts[2]
+        + m_tiles[2][corner & 1];
+  }
+
+  // Offset of the corner within its tile
+  uint64_t offset(int corner) const {
+    int z = corner >> 2, y = (corner >> 1) & 1, x = corner & 1;
+    return (m_coords[0][z]*m_sizes[1][y] + m_coords[1][y])*m_sizes[2][x] + m_coords[2][x];
+  }
+
+  double weight(size_t dim) const {
+    return m_weights[dim];
+  }
+
+ private:
+  const ImageDSTileLayout& m_layout;
+  double m_weights[3];
+  uint64_t m_tiles[3][2];
+  uint64_t m_coords[3][2];
+  uint64_t m_sizes[3][2];
+};
+
+std::vector<uint64_t> imageds_plane_tiles(const ImageDSTileLayout& layout, const ImageDSObliquePlane& steps) {
+  std::vector<char> marked(layout.tile_num());
+  #pragma omp parallel
+  {
+    Corners corners(layout);
+    std::vector<char> thread_marked(marked.size());
+    #pragma omp for schedule(static)
+    for (auto row=0ul; row<steps.m_rows; row++) {
+      for (auto col=0ul; col<steps.m_cols; col++) {
+        if (corners.locate(steps, row, col)) {
+          for (auto corner=0; corner<8; corner++) {
+            thread_marked[corners.tile_id(corner)] = 1;
+          }
+        }
+      }
+    }
+    #pragma omp critical
+    for (auto i=0ul; i<marked.size(); i++) {
+      marked[i] |= thread_marked[i];
+    }
+  }
+  std::vector<uint64_t> tile_ids;
+  for (auto i=0ul; i<marked.size(); i++) {
+    if (marked[i]) {
+      tile_ids.push_back(i);
+    }
+  }
+  return tile_ids;
+}
+
+// Float arithmetic for the 8 and 16 bit types whose cells float represents exactly, double otherwise
+template<typename T>
+struct Interpolation {
+  typedef typename std::conditional<sizeof(T) <= 2 || std::is_same<T, float>::value, float, double>::type type;
+};
+
+// Limits of the results of integer types, within which they round to nearest
+template<typename T, typename A>
+static A lowest() {
+  return std::is_integral<T>::value ? A(std::numeric_limits<T>::lowest()) : std::numeric_limits<A>::lowest();
+}
+
+template<typename T, typename A>
+static A upper_limit() {
+  return std::is_integral<T>::value ? std::nextafter(A(std::numeric_limits<T>::max()), A(0))
+      : std::numeric_limits<A>::max();
+}
+
+template<typename T, typename A>
+static inline typename std::enable_if<std::is_integral<T>::value, T>::type store(A value, A low, A high) {
+  value = std::min(std::max(value, low), high);
+  return static_cast<T>(value + std::copysign(A(0.5), value));
+}
+
+template<typename T, typename A>
+static inline typename std::enable_if<!std::is_integral<T>::value, T>::type store(A value, A, A) {
+  return static_cast<T>(value);
+}
+
+template<typename T>
+struct SamplePlane {
+  static int run(const ImageDSTileLayout& layout, const std::vector<const void *>& tiles,
+                 const ImageDSObliquePlane& steps, void *dst) {
+    typedef typename Interpolation<T>::type A;
+    uint64_t cols = steps.m_cols;
+    T *cells = static_cast<T *>(dst);
+    A fill = static_cast<A>(steps.m_fill);
+    A low = lowest<T, A>(), high = upper_limit<T, A>();
+    #pragma omp parallel
+    {
+      Corners corners(layout);
+      // Corner cells, weights and results of a row of samples, samples outside of the domain have no corners
+      std::vector<A> values(8*cols), weights(3*cols), outside(cols), results(cols);
+      #pragma omp for schedule(static)
+      for (auto row=0ul; row<steps.m_rows; row++) {
+        for (auto col=0ul; col<cols; col++) {
+          bool inside = corners.locate(steps, row, col);
+          outside[col] = !inside;
+          for (auto corner=0; corner<8; corner++) {
+            values[corner*cols+col] = inside
+                ? static_cast<A>(static_cast<const T *>(tiles[corners.tile_id(corner)])[corners.offset(corner)]) : 0;
+          }
+          for (auto d=0; d<3; d++) {
+            weights[d*cols+col] = inside ? static_cast<A>(corners.weight(d)) : 0;
+          }
+        }
+
+        // Once gathered, the corners are blended with vector instructions
+        const A *v = values.data();
+        const A *w = weights.data();
+        for (auto col=0ul; col<cols; col++) {
+          A x00 = v[col] + (v[cols+col] - v[col])*w[2*cols+col];
+          A x01 = v[2*cols+col] + (v[3*cols+col] - v[2*cols+col])*w[2*cols+col];
+          A x10 = v[4*cols+col] + (v[5*cols+col] - v[4*cols+col])*w[2*cols+col];
+          A x11 = v[6*cols+col] + (v[7*cols+col] - v[6*cols+col])*w[2*cols+col];
+          A y0 = x00 + (x01 - x00)*w[cols+col];
+          A y1 = x10 + (x11 - x10)*w[cols+col];
+          // Selected rather than added, so that fills that are not finite do not spread to the samples inside
+          results[col] = outside[col] ? fill : y0 + (y1 - y0)*w[col];
+        }
+        T *row_cells = cells + row*cols;
+        for (auto col=0ul; col<cols; col++) {
+          row_cells[col] = store<T, A>(results[col], low, high);
+        }
+      }
+    }
+    return IMAGEDS_OK;
+  }
+};
+
+int imageds_sample_plane(attr_type_t type, const ImageDSTileLayout& layout, const std::vector<const void *>& tiles,
+                         const ImageDSObliquePlane& steps, void *dst) {
+  return imageds_dispatch<SamplePlane>(type, layout, tiles, steps, dst);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file interpolate.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Trilinear sampling of oblique planes from decoded tiles
+ */
+
+#ifndef __INTERPOLATE_H__
+#define __INTERPOLATE_H__
+
+#include "imageds.h"
+#include "tile_layout.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** Plane with unit directions scaled by the spacings, fails with EINVAL for planes ImageDS::oblique_slice rejects */
+int imageds_plane_steps(const ImageDSObliquePlane& plane, size_t dim_num, ImageDSObliquePlane& steps);
+
+/** Ids of the tiles holding the cells around the samples of steps, in row-major tile order */
+std::vector<uint64_t> imageds_plane_tiles(const ImageDSTileLayout& layout, const ImageDSObliquePlane& steps);
+
+/**
+ * Samples steps with trilinear interpolation into the row-major m_rows x m_cols cells of type of dst. tiles holds
+ * the decoded cells of the tiles of imageds_plane_tiles by tile id.
+ */
+int imageds_sample_plane(attr_type_t type, const ImageDSTileLayout& layout, const std::vector<const void *>& tiles,
+                         const ImageDSObliquePlane& steps, void *dst);
+
+#endif //__INTERPOLATE_H__
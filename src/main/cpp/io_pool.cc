@@ -0,0 +1,140 @@
+/**
+ * @file io_pool.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Bounded thread pool and request state behind the asynchronous ImageDS API
+ */
+
+
+#include "io_pool.h"
+
+#include <algorithm>
+
+bool ImageDSRequestState::start() {
+  int expected = QUEUED;
+  return m_phase.compare_exchange_strong(expected, RUNNING);
+}
+
+bool ImageDSRequestState::cancel() {
+  int expected = QUEUED;
+  if (!m_phase.compare_exchange_strong(expected, DONE)) {
+    return false;
+  }
+  m_error = ECANCELED;
+  m_promise.set_value(IMAGEDS_ERR);
+  if (m_completion) {
+    m_completion(IMAGEDS_ERR, ECANCELED);
+  }
+  return true;
+}
+
+void ImageDSRequestState::complete(int status, int error) {
+  m_error = status ? error : 0;
+  m_phase = DONE;
+  m_promise.set_value(status);
+  if (m_completion) {
+    m_completion(status, m_error);
+  }
+}
+
+bool ImageDSRequest::cancel() {
+  return m_state && m_state->cancel();
+}
+
+bool ImageDSRequest::done() const {
+  return !m_state || m_state->done();
+}
+
+int ImageDSRequest::wait() {
+  if (!m_state) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  int status = m_state->future().get();
+  if (status) {
+    errno = m_state->error();
+  }
+  return status;
+}
+
+int ImageDSRequest::error() const {
+  return m_state ? m_state->error() : EINVAL;
+}
+
+std::shared_future<int> ImageDSRequest::future() const {
+  return m_state ? m_state->future() : std::shared_future<int>();
+}
+
+ImageDSIOPool::ImageDSIOPool(size_t thread_num, size_t queue_depth) : m_queue_depth(queue_depth), m_stopping(false) {
+  for (auto i=0ul; i<thread_num; i++) {
+    m_threads.push_back(std::thread(&ImageDSIOPool::run, this, i));
+  }
+}
+
+ImageDSIOPool::~ImageDSIOPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queued.notify_all();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+bool ImageDSIOPool::submit(const task_t& task, const std::shared_ptr<ImageDSRequestState>& state) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= m_queue_depth) {
+      // Queued requests are only done once cancelled
+      m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [](const QueuedTask& queued) {
+            return queued.m_state && queued.m_state->done();
+          }), m_queue.end());
+    }
+    if (m_stopping || m_queue.size() >= m_queue_depth) {
+      return false;
+    }
+    m_queue.push_back(QueuedTask{task, state});
+  }
+  m_queued.notify_one();
+  return true;
+}
+
+void ImageDSIOPool::run(size_t thread_id) {
+  while (true) {
+    task_t task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queued.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty()) {
+        return;
+      }
+      task = m_queue.front().m_task;
+      m_queue.pop_front();
+    }
+    task(thread_id);
+  }
+}
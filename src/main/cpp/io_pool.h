@@ -0,0 +1,122 @@
+/**
+ * @file io_pool.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Bounded thread pool and request state behind the asynchronous ImageDS API
+ */
+
+#ifndef __IO_POOL_H__
+#define __IO_POOL_H__
+
+#include "imageds.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Shared by an ImageDSRequest and the pool task serving it */
+class ImageDSRequestState {
+ public:
+  ImageDSRequestState(completion_t completion)
+      : m_phase(QUEUED), m_error(0), m_completion(completion), m_future(m_promise.get_future().share()) {}
+
+  /** Moves a queued request to running, false if the request was cancelled */
+  bool start();
+
+  /** Completes a queued request with ECANCELED, false if the request already started */
+  bool cancel();
+
+  /** Sets the result and then calls the completion callback, exactly once per request */
+  void complete(int status, int error);
+
+  bool done() const {
+    return m_phase == DONE;
+  }
+
+  int error() const {
+    return m_error;
+  }
+
+  std::shared_future<int> future() const {
+    return m_future;
+  }
+
+ private:
+  enum { QUEUED, RUNNING, DONE };
+
+  std::atomic<int> m_phase;
+  std::atomic<int> m_error;
+  completion_t m_completion;
+  std::promise<int> m_promise;
+  std::shared_future<int> m_future;
+};
+
+/** Fixed number of threads serving a bounded FIFO queue of tasks, tasks are given the index of their thread */
+class ImageDSIOPool {
+ public:
+  typedef std::function<void(size_t thread_id)> task_t;
+
+  ImageDSIOPool(size_t thread_num, size_t queue_depth);
+
+  // Delete copy constructor
+  ImageDSIOPool(const ImageDSIOPool& other) = delete;
+
+  /** Runs the tasks still queued and joins the threads */
+  ~ImageDSIOPool();
+
+  /**
+   * Queues task serving the request of state, if any, false if queue_depth tasks are already queued. Tasks of
+   * requests cancelled while queued are dropped instead of counting against the depth.
+   */
+  bool submit(const task_t& task, const std::shared_ptr<ImageDSRequestState>& state=NULL);
+
+  size_t thread_num() const {
+    return m_threads.size();
+  }
+
+ private:
+  void run(size_t thread_id);
+
+  struct QueuedTask {
+    task_t m_task;
+    std::shared_ptr<ImageDSRequestState> m_state;
+  };
+
+  size_t m_queue_depth;
+  bool m_stopping;
+  std::deque<QueuedTask> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_queued;
+  std::vector<std::thread> m_threads;
+};
+
+#endif //__IO_POOL_H__
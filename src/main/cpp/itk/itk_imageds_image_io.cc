@@ -0,0 +1,429 @@
+/**
+ * @file itk_imageds_image_io.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION ITK ImageIO backed by ImageDS arrays
+ */
+
+
+#include "itk_imageds_image_io.h"
+
+#include "tiledb_utils.h"
+
+#include "itkMetaDataObject.h"
+#include "itkVersion.h"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+namespace itk {
+
+#define IMAGEDS_DEFAULT_ATTRIBUTE "Intensity"
+
+/** Splits filename into the closest enclosing workspace and the array path relative to it */
+static bool split_filename(const std::string& filename, std::string& workspace, std::string& array_path) {
+  if (filename.empty()) {
+    return false;
+  }
+  std::string path = remove_trailing_slash(itksys::SystemTools::CollapseFullPath(filename));
+  for (size_t pos = path.rfind('/'); pos != std::string::npos && pos > 0; pos = path.rfind('/', pos-1)) {
+    if (TileDBUtils::workspace_exists(path.substr(0, pos))) {
+      workspace = path.substr(0, pos);
+      array_path = path.substr(pos+1);
+      return true;
+    }
+  }
+  return false;
+}
+
+static IOComponentEnum to_component_type(attr_type_t type) {
+  switch (type) {
+    case CHAR:
+    case INT8:
+      return IOComponentEnum::CHAR;
+    case UINT8:
+      return IOComponentEnum::UCHAR;
+    case INT16:
+      return IOComponentEnum::SHORT;
+    case UINT16:
+      return IOComponentEnum::USHORT;
+    case INT32:
+      return IOComponentEnum::INT;
+    case UINT32:
+      return IOComponentEnum::UINT;
+    case INT64:
+      return IOComponentEnum::LONGLONG;
+    case UINT64:
+      return IOComponentEnum::ULONGLONG;
+    case FLOAT32:
+      return IOComponentEnum::FLOAT;
+    case FLOAT64:
+      return IOComponentEnum::DOUBLE;
+  }
+  return IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+}
+
+static bool to_attr_type(IOComponentEnum component_type, size_t component_size, attr_type_t& type) {
+  switch (component_type) {
+    case IOComponentEnum::CHAR:
+      type = INT8;
+      return true;
+    case IOComponentEnum::UCHAR:
+      type = UINT8;
+      return true;
+    case IOComponentEnum::SHORT:
+      type = INT16;
+      return true;
+    case IOComponentEnum::USHORT:
+      type = UINT16;
+      return true;
+    case IOComponentEnum::INT:
+      type = INT32;
+      return true;
+    case IOComponentEnum::UINT:
+      type = UINT32;
+      return true;
+    case IOComponentEnum::LONG:
+    case IOComponentEnum::LONGLONG:
+      type = component_size == 8 ? INT64 : INT32;
+      return true;
+    case IOComponentEnum::ULONG:
+    case IOComponentEnum::ULONGLONG:
+      type = component_size == 8 ? UINT64 : UINT32;
+      return true;
+    case IOComponentEnum::FLOAT:
+      type = FLOAT32;
+      return true;
+    case IOComponentEnum::DOUBLE:
+      type = FLOAT64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+ImageDSImageIO::ImageDSImageIO()
+    : m_Attribute(), m_TileExtent(64), m_AttributeType(UINT8) {
+  this->SetNumberOfDimensions(3);
+  this->m_UseStreamedReading = true;
+  this->m_UseStreamedWriting = true;
+}
+
+ImageDSImageIO::~ImageDSImageIO() = default;
+
+void ImageDSImageIO::PrintSelf(std::ostream& os, Indent indent) const {
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Attribute: " << m_Attribute << std::endl;
+  os << indent << "TileExtent: " << m_TileExtent << std::endl;
+  os << indent << "Workspace: " << m_Workspace << std::endl;
+  os << indent << "ArrayPath: " << m_ArrayPath << std::endl;
+}
+
+void ImageDSImageIO::Open(const std::string& workspace) {
+  if (m_ImageDS && m_Workspace == workspace) {
+    return;
+  }
+  m_ImageDS.reset();
+  try {
+    m_ImageDS = std::unique_ptr<ImageDS>(new ImageDS(workspace, false, false, true));
+  } catch (const std::exception& e) {
+    itkExceptionMacro(<< "Could not open ImageDS workspace " << workspace << ": " << e.what());
+  }
+  m_Workspace = workspace;
+}
+
+std::vector<uint64_t> ImageDSImageIO::IORegionToSubarray() const {
+  unsigned int dim_num = this->GetNumberOfDimensions();
+  std::vector<uint64_t> subarray(dim_num*2);
+  for (unsigned int i=0; i<dim_num; i++) {
+    unsigned int dim = dim_num-1-i;
+    subarray[dim*2] = m_DomainStart[dim] + m_IORegion.GetIndex(i);
+    subarray[dim*2+1] = subarray[dim*2] + m_IORegion.GetSize(i) - 1;
+  }
+  return subarray;
+}
+
+bool ImageDSImageIO::CanReadFile(const char *filename) {
+  std::string workspace, array_path;
+  return split_filename(filename, workspace, array_path) && TileDBUtils::array_exists(workspace, array_path);
+}
+
+void ImageDSImageIO::ReadImageInformation() {
+  std::string workspace;
+  if (!split_filename(m_FileName, workspace, m_ArrayPath)) {
+    itkExceptionMacro(<< m_FileName << " is not in an ImageDS workspace");
+  }
+  Open(workspace);
+
+  ImageDSArray array;
+  if (m_ImageDS->array_info(m_ArrayPath, array)) {
+    itkExceptionMacro(<< "Could not read ImageDS array " << m_FileName << ": " << strerror(errno));
+  }
+
+  m_AttributeNames.clear();
+  for (auto& attribute : array.m_attributes) {
+    if (m_Attribute.empty() || attribute->m_name == m_Attribute) {
+      if (!m_AttributeNames.empty() && attribute->m_type != m_AttributeType) {
+        itkExceptionMacro(<< "Attributes of " << m_FileName << " have different types, select one with SetAttribute");
+      }
+      m_AttributeNames.push_back(attribute->m_name);
+      m_AttributeType = attribute->m_type;
+    }
+  }
+  if (m_AttributeNames.empty()) {
+    itkExceptionMacro(<< "Attribute " << m_Attribute << " not found in " << m_FileName);
+  }
+
+  unsigned int dim_num = array.m_dimensions.size();
+  this->SetNumberOfDimensions(dim_num);
+  m_DomainStart.resize(dim_num);
+  for (unsigned int i=0; i<dim_num; i++) {
+    ImageDSDimension *dimension = array.m_dimensions[dim_num-1-i].get();
+    m_DomainStart[dim_num-1-i] = dimension->m_start;
+    this->SetDimensions(i, dimension->m_end - dimension->m_start + 1);
+    this->SetSpacing(i, 1.0);
+    this->SetOrigin(i, 0.0);
+  }
+  this->SetComponentType(to_component_type(m_AttributeType));
+  this->SetNumberOfComponents(m_AttributeNames.size());
+  this->SetPixelType(m_AttributeNames.size() == 1 ? IOPixelEnum::SCALAR : IOPixelEnum::VECTOR);
+
+  // Geometry follows the metadata conventions of imageds_dicom_ingest, spacing is in ImageDS dimension order
+  // while origin and orientation are physical coordinates
+  std::map<std::string, std::string> metadata;
+  if (m_ImageDS->read_metadata(m_ArrayPath, metadata)) {
+    itkExceptionMacro(<< "Could not read metadata of " << m_FileName << ": " << strerror(errno));
+  }
+  MetaDataDictionary& dictionary = this->GetMetaDataDictionary();
+  for (auto& entry : metadata) {
+    EncapsulateMetaData<std::string>(dictionary, entry.first, entry.second);
+  }
+  if (metadata.count("spacing")) {
+    std::vector<double> spacing = imageds_metadata_values(metadata["spacing"]);
+    if (spacing.size() == dim_num) {
+      for (unsigned int i=0; i<dim_num; i++) {
+        this->SetSpacing(i, spacing[dim_num-1-i]);
+      }
+    }
+  }
+  if (metadata.count("origin")) {
+    std::vector<double> origin = imageds_metadata_values(metadata["origin"]);
+    if (origin.size() == dim_num) {
+      for (unsigned int i=0; i<dim_num; i++) {
+        this->SetOrigin(i, origin[i]);
+      }
+    }
+  }
+  if (metadata.count("orientation") && dim_num == 3) {
+    std::vector<double> orientation = imageds_metadata_values(metadata["orientation"]);
+    if (orientation.size() == 6) {
+      std::vector<double> row(orientation.begin(), orientation.begin()+3);
+      std::vector<double> column(orientation.begin()+3, orientation.end());
+      std::vector<double> normal = { row[1]*column[2] - row[2]*column[1],
+                                     row[2]*column[0] - row[0]*column[2],
+                                     row[0]*column[1] - row[1]*column[0] };
+      this->SetDirection(0, row);
+      this->SetDirection(1, column);
+      this->SetDirection(2, normal);
+    }
+  }
+}
+
+void ImageDSImageIO::Read(void *buffer) {
+  if (!m_ImageDS || m_AttributeNames.empty()) {
+    this->ReadImageInformation();
+  }
+
+  std::vector<uint64_t> subarray = IORegionToSubarray();
+  size_t cell_num = m_IORegion.GetNumberOfPixels();
+  size_t component_size = this->GetComponentSize();
+
+  ImageDSArray array(m_ArrayPath);
+  for (auto& name : m_AttributeNames) {
+    array.add_attribute(name, m_AttributeType);
+  }
+
+  // Scalar pixels are read in place, vector pixels are interleaved from one buffer per attribute
+  std::vector<std::vector<char>> components;
+  std::vector<void *> buffers;
+  std::vector<size_t> buffer_sizes;
+  if (m_AttributeNames.size() == 1) {
+    buffers.push_back(buffer);
+    buffer_sizes.push_back(cell_num*component_size);
+  } else {
+    components.resize(m_AttributeNames.size(), std::vector<char>(cell_num*component_size));
+    for (auto& component : components) {
+      buffers.push_back(component.data());
+      buffer_sizes.push_back(component.size());
+    }
+  }
+
+  try {
+    if (m_ImageDS->from_array(array, subarray, buffers, buffer_sizes)) {
+      itkExceptionMacro(<< "Could not read " << m_IORegion << " from " << m_FileName << ": " << strerror(errno));
+    }
+  } catch (const std::runtime_error& e) {
+    itkExceptionMacro(<< "Could not read " << m_IORegion << " from " << m_FileName << ": " << e.what());
+  }
+
+  if (!components.empty()) {
+    char *pixels = reinterpret_cast<char *>(buffer);
+    size_t component_num = components.size();
+    for (size_t i=0; i<cell_num; i++) {
+      for (size_t j=0; j<component_num; j++) {
+        memcpy(pixels + (i*component_num + j)*component_size, components[j].data() + i*component_size,
+               component_size);
+      }
+    }
+  }
+}
+
+bool ImageDSImageIO::CanWriteFile(const char *filename) {
+  std::string workspace, array_path;
+  if (!split_filename(filename, workspace, array_path)) {
+    return false;
+  }
+  // Only new paths or existing arrays can be written
+  return !TileDBUtils::is_file(filename)
+      && (!TileDBUtils::is_dir(filename) || TileDBUtils::array_exists(workspace, array_path));
+}
+
+void ImageDSImageIO::Write(const void *buffer) {
+  std::string workspace;
+  if (!split_filename(m_FileName, workspace, m_ArrayPath)) {
+    itkExceptionMacro(<< m_FileName << " is not in an ImageDS workspace");
+  }
+  Open(workspace);
+
+  unsigned int dim_num = this->GetNumberOfDimensions();
+  if (!to_attr_type(this->GetComponentType(), this->GetComponentSize(), m_AttributeType)) {
+    itkExceptionMacro(<< "Component type " << this->GetComponentTypeAsString(this->GetComponentType())
+                      << " cannot be written to ImageDS");
+  }
+  std::string attribute = m_Attribute.empty() ? IMAGEDS_DEFAULT_ATTRIBUTE : m_Attribute;
+  unsigned int component_num = this->GetNumberOfComponents();
+  m_AttributeNames.clear();
+  for (unsigned int i=0; i<component_num; i++) {
+    m_AttributeNames.push_back(component_num == 1 ? attribute : attribute + "_" + std::to_string(i));
+  }
+
+  ImageDSArray array(m_ArrayPath);
+  for (unsigned int i=0; i<dim_num; i++) {
+    unsigned int axis = dim_num-1-i;
+    SizeValueType length = this->GetDimensions(axis);
+    if (length < 3) {
+      itkExceptionMacro(<< "ImageDS dimensions need at least 3 cells, axis " << axis << " has " << length);
+    }
+    std::string name = axis < 4 ? std::string(1, "XYZT"[axis]) : "D" + std::to_string(axis);
+    array.add_dimension(name, 0, length-1, std::max<SizeValueType>(1, std::min(m_TileExtent, length-2)));
+  }
+  for (auto& name : m_AttributeNames) {
+    array.add_attribute(name, m_AttributeType, this->GetUseCompression() ? GZIP : NONE);
+  }
+  m_DomainStart.assign(dim_num, 0);
+
+  if (TileDBUtils::array_exists(workspace, m_ArrayPath)) {
+    // Regions streamed or pasted into an existing array have to match its schema
+    ImageDSArray existing;
+    if (m_ImageDS->array_info(m_ArrayPath, existing)) {
+      itkExceptionMacro(<< "Could not read ImageDS array " << m_FileName << ": " << strerror(errno));
+    }
+    bool matches = existing.m_dimensions.size() == dim_num && existing.m_attributes.size() == component_num;
+    for (unsigned int i=0; matches && i<dim_num; i++) {
+      m_DomainStart[i] = existing.m_dimensions[i]->m_start;
+      matches = existing.m_dimensions[i]->m_end - existing.m_dimensions[i]->m_start == array.m_dimensions[i]->m_end;
+    }
+    for (unsigned int i=0; matches && i<component_num; i++) {
+      matches = existing.m_attributes[i]->m_name == m_AttributeNames[i]
+          && existing.m_attributes[i]->m_type == m_AttributeType;
+    }
+    if (!matches) {
+      itkExceptionMacro(<< "ImageDS array " << m_FileName << " exists with a different schema");
+    }
+  }
+
+  size_t cell_num = m_IORegion.GetNumberOfPixels();
+  size_t component_size = this->GetComponentSize();
+  std::vector<std::vector<char>> components;
+  std::vector<void *> buffers;
+  std::vector<size_t> buffer_sizes;
+  if (component_num == 1) {
+    buffers.push_back(const_cast<void *>(buffer));
+    buffer_sizes.push_back(cell_num*component_size);
+  } else {
+    const char *pixels = reinterpret_cast<const char *>(buffer);
+    components.resize(component_num, std::vector<char>(cell_num*component_size));
+    for (size_t i=0; i<cell_num; i++) {
+      for (size_t j=0; j<component_num; j++) {
+        memcpy(components[j].data() + i*component_size, pixels + (i*component_num + j)*component_size,
+               component_size);
+      }
+    }
+    for (auto& component : components) {
+      buffers.push_back(component.data());
+      buffer_sizes.push_back(component.size());
+    }
+  }
+
+  if (m_ImageDS->to_array(array, IORegionToSubarray(), buffers, buffer_sizes)) {
+    itkExceptionMacro(<< "Could not write " << m_IORegion << " to " << m_FileName << ": " << strerror(errno));
+  }
+
+  std::vector<double> spacing, origin;
+  for (unsigned int i=0; i<dim_num; i++) {
+    spacing.push_back(this->GetSpacing(dim_num-1-i));
+    origin.push_back(this->GetOrigin(i));
+  }
+  std::map<std::string, std::string> metadata;
+  metadata["spacing"] = imageds_metadata_value(spacing);
+  metadata["origin"] = imageds_metadata_value(origin);
+  if (dim_num == 3) {
+    std::vector<double> orientation = this->GetDirection(0);
+    std::vector<double> column = this->GetDirection(1);
+    orientation.insert(orientation.end(), column.begin(), column.end());
+    metadata["orientation"] = imageds_metadata_value(orientation);
+  }
+  if (m_ImageDS->write_metadata(m_ArrayPath, metadata)) {
+    itkExceptionMacro(<< "Could not write metadata of " << m_FileName << ": " << strerror(errno));
+  }
+}
+
+ImageDSImageIOFactory::ImageDSImageIOFactory() {
+  this->RegisterOverride("itkImageIOBase", "itkImageDSImageIO", "ImageDS Image IO", true,
+                         CreateObjectFunction<ImageDSImageIO>::New());
+}
+
+const char *ImageDSImageIOFactory::GetITKSourceVersion() const {
+  return ITK_SOURCE_VERSION;
+}
+
+const char *ImageDSImageIOFactory::GetDescription() const {
+  return "ImageDS ImageIO Factory, allows the loading of ImageDS arrays into ITK";
+}
+
+} // namespace itk
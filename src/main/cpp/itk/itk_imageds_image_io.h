@@ -0,0 +1,151 @@
+/**
+ * @file itk_imageds_image_io.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION ITK ImageIO backed by ImageDS arrays
+ *
+ * File names are paths to arrays inside an existing ImageDS workspace, e.g. /data/ws/ct/series1 for the array
+ * ct/series1 of workspace /data/ws. ITK image axis 0 is the last, fastest varying, ImageDS dimension so that
+ * ITK buffers and row-major ImageDS buffers share the same layout. Streamed regions are read and written as
+ * ImageDS subarrays without intermediate files.
+ */
+
+
+#ifndef __ITK_IMAGEDS_IMAGE_IO_H__
+#define __ITK_IMAGEDS_IMAGE_IO_H__
+
+#include "imageds.h"
+
+#include "itkImageIOBase.h"
+#include "itkObjectFactoryBase.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace itk {
+
+class IMAGEDS_PUBLIC ImageDSImageIO : public ImageIOBase {
+ public:
+  using Self = ImageDSImageIO;
+  using Superclass = ImageIOBase;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  itkNewMacro(Self);
+  itkTypeMacro(ImageDSImageIO, ImageIOBase);
+
+  /**
+   * Attribute read as the pixel, all attributes are read as components of a vector pixel when empty. Written
+   * arrays use it as the attribute name, Intensity by default, suffixed with the component for vector pixels.
+   */
+  itkSetStringMacro(Attribute);
+  itkGetStringMacro(Attribute);
+
+  /** Tile extent of every dimension of newly written arrays, clamped to the dimension lengths */
+  itkSetMacro(TileExtent, SizeValueType);
+  itkGetConstMacro(TileExtent, SizeValueType);
+
+  bool SupportsDimension(unsigned long dimension) override {
+    return dimension > 0;
+  }
+
+  bool CanStreamRead() override {
+    return true;
+  }
+
+  bool CanStreamWrite() override {
+    return true;
+  }
+
+  bool CanReadFile(const char *filename) override;
+
+  void ReadImageInformation() override;
+
+  /** Reads the current IORegion straight into buffer */
+  void Read(void *buffer) override;
+
+  bool CanWriteFile(const char *filename) override;
+
+  /** Image information is written along with the first region by Write */
+  void WriteImageInformation() override {}
+
+  /** Writes the current IORegion, creating the array from the image information if necessary */
+  void Write(const void *buffer) override;
+
+ protected:
+  ImageDSImageIO();
+  ~ImageDSImageIO() override;
+
+  void PrintSelf(std::ostream& os, Indent indent) const override;
+
+ private:
+  ImageDSImageIO(const Self&) = delete;
+  void operator=(const Self&) = delete;
+
+  void Open(const std::string& workspace);
+  std::vector<uint64_t> IORegionToSubarray() const;
+
+  std::string m_Attribute;
+  SizeValueType m_TileExtent;
+  std::string m_Workspace;
+  std::unique_ptr<ImageDS> m_ImageDS;
+  std::string m_ArrayPath;
+  std::vector<uint64_t> m_DomainStart;
+  std::vector<std::string> m_AttributeNames;
+  attr_type_t m_AttributeType;
+};
+
+class IMAGEDS_PUBLIC ImageDSImageIOFactory : public ObjectFactoryBase {
+ public:
+  using Self = ImageDSImageIOFactory;
+  using Superclass = ObjectFactoryBase;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  const char *GetITKSourceVersion() const override;
+  const char *GetDescription() const override;
+
+  itkFactorylessNewMacro(Self);
+  itkTypeMacro(ImageDSImageIOFactory, ObjectFactoryBase);
+
+  /** Registers ImageDSImageIO with ImageIOFactory so that ImageFileReader/Writer pick it up for ImageDS paths */
+  static void RegisterOneFactory() {
+    ImageDSImageIOFactory::Pointer factory = ImageDSImageIOFactory::New();
+    ObjectFactoryBase::RegisterFactoryInternal(factory);
+  }
+
+ protected:
+  ImageDSImageIOFactory();
+
+ private:
+  ImageDSImageIOFactory(const Self&) = delete;
+  void operator=(const Self&) = delete;
+};
+
+} // namespace itk
+
+#endif //__ITK_IMAGEDS_IMAGE_IO_H__
@@ -0,0 +1,94 @@
+/**
+ * @file memory_budget.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Memory budget shared by the reads and writes of an ImageDS instance and its I/O pool
+ */
+
+
+#include "memory_budget.h"
+#include "tile_cache.h"
+
+#include <algorithm>
+
+void ImageDSMemoryBudget::set_budget(size_t budget) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = budget;
+  if (m_budget && m_tile_cache->capacity() > m_budget/2) {
+    m_tile_cache->set_capacity(m_budget/2);
+  }
+  m_released.notify_all();
+}
+
+void ImageDSMemoryBudget::set_tile_cache_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_tile_cache->set_capacity(m_budget ? std::min(capacity, m_budget/2) : capacity);
+  m_released.notify_all();
+}
+
+size_t ImageDSMemoryBudget::reservable() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_budget ? m_budget - m_tile_cache->capacity() : 0;
+}
+
+void ImageDSMemoryBudget::acquire(size_t bytes) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto fits = [&]() {
+    return !m_budget || !m_reserved || m_reserved + bytes <= m_budget - m_tile_cache->capacity();
+  };
+  if (!fits()) {
+    m_usage.m_queued++;
+    m_released.wait(lock, fits);
+  }
+  m_reserved += bytes;
+  m_usage.m_peak = std::max(m_usage.m_peak, m_reserved + m_tile_cache->size());
+}
+
+void ImageDSMemoryBudget::release(size_t bytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_reserved -= bytes;
+  m_released.notify_all();
+}
+
+void ImageDSMemoryBudget::count_split() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_usage.m_split++;
+}
+
+ImageDSMemoryUsage ImageDSMemoryBudget::usage() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ImageDSMemoryUsage usage = m_usage;
+  usage.m_budget = m_budget;
+  usage.m_tile_cache = m_tile_cache->size();
+  usage.m_in_flight = m_reserved;
+  usage.m_peak = std::max(usage.m_peak, usage.m_tile_cache + usage.m_in_flight);
+  return usage;
+}
+
+void ImageDSMemoryBudget::reset() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_usage = ImageDSMemoryUsage();
+}
@@ -0,0 +1,105 @@
+/**
+ * @file memory_budget.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Memory budget shared by the reads and writes of an ImageDS instance and its I/O pool
+ */
+
+#ifndef __MEMORY_BUDGET_H__
+#define __MEMORY_BUDGET_H__
+
+#include "imageds.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+class ImageDSTileCache;
+
+/**
+ * Bounds the memory of the tile cache together with the tiles decoded and the buffers written by requests in
+ * flight. The capacity of the tile cache is held for the lifetime of the budget, requests reserve what they need
+ * from the rest and wait for other requests to release enough of it. Reservations larger than the rest are granted
+ * once nothing else is reserved, so that every request eventually runs. A budget of 0 is unlimited.
+ */
+class ImageDSMemoryBudget {
+ public:
+  ImageDSMemoryBudget(std::shared_ptr<ImageDSTileCache> tile_cache)
+      : m_tile_cache(tile_cache), m_budget(0), m_reserved(0) {}
+
+  // Delete copy constructor
+  ImageDSMemoryBudget(const ImageDSMemoryBudget& other) = delete;
+
+  /** Shrinks the tile cache to half of budget if it is larger */
+  void set_budget(size_t budget);
+
+  /** Capped at half of the budget if one is set */
+  void set_tile_cache_capacity(size_t capacity);
+
+  /** Bytes requests can reserve at once, 0 if unlimited */
+  size_t reservable();
+
+  void acquire(size_t bytes);
+
+  void release(size_t bytes);
+
+  /** Counts a read split into slabs to fit in the budget */
+  void count_split();
+
+  ImageDSMemoryUsage usage();
+
+  /** Resets the peak and the counters of queued and split requests */
+  void reset();
+
+ private:
+  std::shared_ptr<ImageDSTileCache> m_tile_cache;
+  std::mutex m_mutex;
+  std::condition_variable m_released;
+  size_t m_budget;
+  size_t m_reserved;
+  ImageDSMemoryUsage m_usage;
+};
+
+/** Holds bytes of a budget until destroyed */
+class ImageDSMemoryReservation {
+ public:
+  ImageDSMemoryReservation(ImageDSMemoryBudget& budget, size_t bytes) : m_budget(budget), m_bytes(bytes) {
+    m_budget.acquire(m_bytes);
+  }
+
+  // Delete copy constructor
+  ImageDSMemoryReservation(const ImageDSMemoryReservation& other) = delete;
+
+  ~ImageDSMemoryReservation() {
+    m_budget.release(m_bytes);
+  }
+
+ private:
+  ImageDSMemoryBudget& m_budget;
+  size_t m_bytes;
+};
+
+#endif //__MEMORY_BUDGET_H__
@@ -0,0 +1,794 @@
+/**
+ * @file nifti.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION NIfTI-1/NIfTI-2 import into and export from ImageDS arrays
+ */
+
+
+#include "nifti.h"
+#include "tile_layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fcntl.h>
+#include <future>
+#include <map>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#pragma pack(push, 1)
+struct nifti_1_header {
+  int32_t sizeof_hdr;
+  char data_type[10];
+  char db_name[18];
+  int32_t extents;
+  int16_t session_error;
+  char regular;
+  char dim_info;
+  int16_t dim[8];
+  float intent_p1;
+  float intent_p2;
+  float intent_p3;
+  int16_t intent_code;
+  int16_t datatype;
+  int16_t bitpix;
+  int16_t slice_start;
+  float pixdim[8];
+  float vox_offset;
+  float scl_slope;
+  float scl_inter;
+  int16_t slice_end;
+  char slice_code;
+  char xyzt_units;
+  float cal_max;
+  float cal_min;
+  float slice_duration;
+  float toffset;
+  int32_t glmax;
+  int32_t glmin;
+  char descrip[80];
+  char aux_file[24];
+  int16_t qform_code;
+  int16_t sform_code;
+  float quatern[6];
+  float srow[12];
+  char intent_name[16];
+  char magic[4];
+};
+
+struct nifti_2_header {
+  int32_t sizeof_hdr;
+  char magic[8];
+  int16_t datatype;
+  int16_t bitpix;
+  int64_t dim[8];
+  double intent_p1;
+  double intent_p2;
+  double intent_p3;
+  double pixdim[8];
+  int64_t vox_offset;
+  double scl_slope;
+  double scl_inter;
+  double cal_max;
+  double cal_min;
+  double slice_duration;
+  double toffset;
+  int64_t slice_start;
+  int64_t slice_end;
+  char descrip[80];
+  char aux_file[24];
+  int32_t qform_code;
+  int32_t sform_code;
+  double quatern[6];
+  double srow[12];
+  int32_t slice_code;
+  int32_t xyzt_units;
+  int32_t intent_code;
+  char intent_name[16];
+  char dim_info;
+  char unused_str[15];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(nifti_1_header) == 348, "NIfTI-1 header is 348 bytes");
+static_assert(sizeof(nifti_2_header) == 540, "NIfTI-2 header is 540 bytes");
+
+#define NIFTI_1_MAGIC "n+1"
+#define NIFTI_2_MAGIC "n+2\0\r\n\032\n"
+
+// Data block offsets of the exported single file images, headers are followed by an empty extension flag
+#define NIFTI_1_VOX_OFFSET 352
+#define NIFTI_2_VOX_OFFSET 544
+
+// Decompressed slabs are read from gzip in chunks that fit gzread's unsigned length
+#define NIFTI_GZ_CHUNK (1u << 30)
+
+static const char *dimension_names[] = { "X", "Y", "Z", "T", "U", "V", "W" };
+
+template<typename T>
+static T swap_bytes(T value) {
+  char *bytes = reinterpret_cast<char *>(&value);
+  std::reverse(bytes, bytes+sizeof(T));
+  return value;
+}
+
+static void swap_buffer(char *buffer, size_t size, size_t cell_size) {
+  if (cell_size > 1) {
+    for (size_t i=0; i+cell_size<=size; i+=cell_size) {
+      std::reverse(buffer+i, buffer+i+cell_size);
+    }
+  }
+}
+
+static struct {
+  int datatype;
+  attr_type_t type;
+} datatypes[] = {
+  { 2, UINT8 },
+  { 4, INT16 },
+  { 8, INT32 },
+  { 16, FLOAT32 },
+  { 64, FLOAT64 },
+  { 256, INT8 },
+  { 512, UINT16 },
+  { 768, UINT32 },
+  { 1024, INT64 },
+  { 1280, UINT64 },
+};
+
+// NIfTI dimension lengths in ImageDS order, i.e. slowest varying first, without trailing dimensions of length 1
+static std::vector<uint64_t> array_lengths(const ImageDSNiftiHeader& header) {
+  int dim_num = header.m_dim[0];
+  while (dim_num > 1 && header.m_dim[dim_num] == 1) {
+    dim_num--;
+  }
+  std::vector<uint64_t> lengths;
+  for (int i=dim_num; i>0; i--) {
+    lengths.push_back(header.m_dim[i]);
+  }
+  return lengths;
+}
+
+template<typename T>
+static T field(const T& value, bool swapped) {
+  return swapped ? swap_bytes(value) : value;
+}
+
+static std::string trim(const char *str, size_t length) {
+  std::string trimmed(str, strnlen(str, length));
+  trimmed.erase(std::find_if(trimmed.rbegin(), trimmed.rend(), [](char c) { return !isspace(c); }).base(),
+                trimmed.end());
+  return trimmed;
+}
+
+template<typename H>
+static void copy_fields(const H& hdr, bool swapped, ImageDSNiftiHeader& header) {
+  for (auto i=0; i<8; i++) {
+    header.m_dim[i] = field(hdr.dim[i], swapped);
+    header.m_pixdim[i] = field(hdr.pixdim[i], swapped);
+  }
+  header.m_datatype = field(hdr.datatype, swapped);
+  header.m_bitpix = field(hdr.bitpix, swapped);
+  header.m_vox_offset = field(hdr.vox_offset, swapped);
+  header.m_scl_slope = field(hdr.scl_slope, swapped);
+  header.m_scl_inter = field(hdr.scl_inter, swapped);
+  header.m_xyzt_units = field(hdr.xyzt_units, swapped);
+  header.m_qform_code = field(hdr.qform_code, swapped);
+  header.m_sform_code = field(hdr.sform_code, swapped);
+  for (auto i=0; i<6; i++) {
+    header.m_quatern[i] = field(hdr.quatern[i], swapped);
+  }
+  for (auto i=0; i<12; i++) {
+    header.m_srow[i] = field(hdr.srow[i], swapped);
+  }
+  header.m_description = trim(hdr.descrip, sizeof(hdr.descrip));
+}
+
+int imageds_nifti_read_header(const std::string& filename, ImageDSNiftiHeader& header) {
+  // gzopen reads uncompressed files transparently
+  gzFile file = gzopen(filename.c_str(), "rb");
+  if (!file) {
+    if (!errno) errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  char buffer[sizeof(nifti_2_header)];
+  int length = gzread(file, buffer, sizeof(buffer));
+  bool gzip = !gzdirect(file);
+  gzclose(file);
+
+  header = ImageDSNiftiHeader();
+  header.m_filename = filename;
+  header.m_gzip = gzip;
+  int32_t sizeof_hdr;
+  if (length < static_cast<int>(sizeof(nifti_1_header))) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  memcpy(&sizeof_hdr, buffer, sizeof(sizeof_hdr));
+
+  if (sizeof_hdr == sizeof(nifti_1_header) || swap_bytes(sizeof_hdr) == sizeof(nifti_1_header)) {
+    nifti_1_header hdr;
+    memcpy(&hdr, buffer, sizeof(hdr));
+    header.m_version = 1;
+    header.m_swapped = sizeof_hdr != sizeof(nifti_1_header);
+    if (strncmp(hdr.magic, NIFTI_1_MAGIC, 4) != 0) {
+      // Header/image pairs (ni1) and ANALYZE 7.5 are not supported
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+    copy_fields(hdr, header.m_swapped, header);
+  } else if (sizeof_hdr == sizeof(nifti_2_header) || swap_bytes(sizeof_hdr) == sizeof(nifti_2_header)) {
+    nifti_2_header hdr;
+    if (length < static_cast<int>(sizeof(hdr))) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    memcpy(&hdr, buffer, sizeof(hdr));
+    header.m_version = 2;
+    header.m_swapped = sizeof_hdr != sizeof(nifti_2_header);
+    if (memcmp(hdr.magic, NIFTI_2_MAGIC, 8) != 0) {
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+    copy_fields(hdr, header.m_swapped, header);
+  } else {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  int64_t header_size = header.m_version == 1 ? sizeof(nifti_1_header) : sizeof(nifti_2_header);
+  if (header.m_dim[0] < 1 || header.m_dim[0] > 7 || header.m_vox_offset < header_size) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  for (auto i=1; i<=header.m_dim[0]; i++) {
+    if (header.m_dim[i] < 1) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+std::vector<double> ImageDSNiftiHeader::affine() const {
+  std::vector<double> affine(16, 0);
+  affine[15] = 1;
+  if (m_sform_code > 0) {
+    std::copy(m_srow, m_srow+12, affine.begin());
+  } else if (m_qform_code > 0) {
+    // Rotation from the quaternion, scaled by pixdim with the qfac sign on the third column
+    double b = m_quatern[0], c = m_quatern[1], d = m_quatern[2];
+    double a = std::sqrt(std::max(0.0, 1.0 - (b*b + c*c + d*d)));
+    double qfac = m_pixdim[0] < 0 ? -1 : 1;
+    double rotation[9] = { a*a + b*b - c*c - d*d, 2*(b*c - a*d), 2*(b*d + a*c),
+                           2*(b*c + a*d), a*a + c*c - b*b - d*d, 2*(c*d - a*b),
+                           2*(b*d - a*c), 2*(c*d + a*b), a*a + d*d - c*c - b*b };
+    double scale[3] = { m_pixdim[1], m_pixdim[2], qfac*m_pixdim[3] };
+    for (auto i=0; i<3; i++) {
+      for (auto j=0; j<3; j++) {
+        affine[i*4+j] = rotation[i*3+j]*scale[j];
+      }
+      affine[i*4+3] = m_quatern[3+i];
+    }
+  } else {
+    for (auto i=0; i<3; i++) {
+      affine[i*4+i] = m_pixdim[i+1];
+    }
+  }
+  return affine;
+}
+
+int ImageDSNiftiHeader::type(attr_type_t& type) const {
+  std::vector<uint64_t> lengths = array_lengths(*this);
+  for (auto length : lengths) {
+    if (length < 3) {
+      // ImageDSDimension needs at least 3 cells
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+  }
+  for (auto& datatype : datatypes) {
+    if (datatype.datatype == m_datatype) {
+      type = datatype.type;
+      if (m_bitpix != static_cast<int>(attr_type_size(type)*8)) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+      return IMAGEDS_OK;
+    }
+  }
+  // RGB, complex and binary images
+  errno = ENOTSUP;
+  return IMAGEDS_ERR;
+}
+
+uint64_t ImageDSNiftiHeader::data_size() const {
+  uint64_t cell_num = 1;
+  for (auto i=1; i<=m_dim[0]; i++) {
+    cell_num *= m_dim[i];
+  }
+  return cell_num*m_bitpix/8;
+}
+
+static int import_mapped(ImageDS& imageds, const ImageDSNiftiHeader& header, ImageDSArray& array) {
+  int fd = open(header.m_filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return IMAGEDS_ERR;
+  }
+  struct stat st;
+  size_t length = header.m_vox_offset + header.data_size();
+  if (fstat(fd, &st) || static_cast<size_t>(st.st_size) < length) {
+    close(fd);
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  // Byte swapping happens in place on private copy-on-write pages, the file is never modified
+  void *mapped = mmap(NULL, length, header.m_swapped ? PROT_READ|PROT_WRITE : PROT_READ,
+                      header.m_swapped ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return IMAGEDS_ERR;
+  }
+  madvise(mapped, length, MADV_SEQUENTIAL);
+
+  char *data = reinterpret_cast<char *>(mapped) + header.m_vox_offset;
+  if (header.m_swapped) {
+    swap_buffer(data, header.data_size(), header.m_bitpix/8);
+  }
+  int rc = imageds.to_array(array, {data}, {header.data_size()});
+  int saved_errno = errno;
+  munmap(mapped, length);
+  errno = saved_errno;
+  return rc;
+}
+
+static int gzread_fully(gzFile file, char *buffer, size_t size) {
+  for (size_t offset=0; offset<size; ) {
+    unsigned chunk = std::min<size_t>(size-offset, NIFTI_GZ_CHUNK);
+    int length = gzread(file, buffer+offset, chunk);
+    if (length <= 0) {
+      errno = length < 0 ? EIO : EINVAL; // Truncated images are invalid
+      return IMAGEDS_ERR;
+    }
+    offset += length;
+  }
+  return IMAGEDS_OK;
+}
+
+static int import_gzip(ImageDS& imageds, const ImageDSNiftiHeader& header, ImageDSArray& array) {
+  gzFile file = gzopen(header.m_filename.c_str(), "rb");
+  if (!file) {
+    if (!errno) errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  gzbuffer(file, 1 << 20);
+  if (gzseek(file, header.m_vox_offset, SEEK_SET) != header.m_vox_offset) {
+    gzclose(file);
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  // Inflate the next tile-aligned slab of the slowest dimension while the previous one is being written
+  std::vector<uint64_t> subarray;
+  for (auto& dimension : array.m_dimensions) {
+    subarray.push_back(dimension->m_start);
+    subarray.push_back(dimension->m_end);
+  }
+  uint64_t length = subarray[1] + 1;
+  uint64_t slab_extent = array.m_dimensions[0]->m_tile_extent;
+  size_t row_size = header.data_size()/length;
+  std::vector<char> slab_buffers[2];
+  std::future<int> pending_write;
+  int rc = IMAGEDS_OK;
+  for (uint64_t start=0, slab=0; start<length && !rc; start+=slab_extent, slab++) {
+    uint64_t end = std::min(start+slab_extent, length) - 1;
+    std::vector<char>& buffer = slab_buffers[slab%2];
+    buffer.resize((end-start+1)*row_size);
+    rc = gzread_fully(file, buffer.data(), buffer.size());
+    if (!rc && header.m_swapped) {
+      swap_buffer(buffer.data(), buffer.size(), header.m_bitpix/8);
+    }
+
+    if (pending_write.valid() && pending_write.get()) {
+      rc = IMAGEDS_ERR;
+    }
+    if (rc) break;
+
+    subarray[0] = start;
+    subarray[1] = end;
+    pending_write = std::async(std::launch::async, [&imageds, &array, subarray, &buffer]() {
+        return imageds.to_array(array, subarray, {buffer.data()}, {buffer.size()});
+      });
+  }
+  if (pending_write.valid() && pending_write.get()) {
+    rc = IMAGEDS_ERR;
+  }
+  int saved_errno = errno;
+  gzclose(file);
+  errno = saved_errno;
+  return rc;
+}
+
+static std::map<std::string, std::string> to_metadata(const ImageDSNiftiHeader& header, size_t dim_num) {
+  std::map<std::string, std::string> metadata;
+  std::vector<double> affine = header.affine();
+  metadata["affine"] = imageds_metadata_value(affine);
+  metadata["nifti_qform_code"] = std::to_string(header.m_qform_code);
+  metadata["nifti_sform_code"] = std::to_string(header.m_sform_code);
+  std::vector<double> quatern(header.m_quatern, header.m_quatern+6);
+  quatern.push_back(header.m_pixdim[0] < 0 ? -1 : 1);
+  metadata["nifti_quatern"] = imageds_metadata_value(quatern);
+  metadata["nifti_xyzt_units"] = std::to_string(header.m_xyzt_units);
+  if (!header.m_description.empty() && header.m_description.find('\n') == std::string::npos) {
+    metadata["nifti_description"] = header.m_description;
+  }
+  if (header.m_scl_slope != 0) {
+    metadata["rescale_slope"] = imageds_metadata_value({header.m_scl_slope});
+    metadata["rescale_intercept"] = imageds_metadata_value({header.m_scl_inter});
+  }
+
+  std::vector<double> spacing;
+  for (auto i=dim_num; i>0; i--) {
+    spacing.push_back(header.m_pixdim[i]);
+  }
+  metadata["spacing"] = imageds_metadata_value(spacing);
+
+  // Origin and orientation follow the DICOM conventions, i.e. LPS+ instead of the RAS+ NIfTI world
+  auto negate = [](double value) { return value == 0 ? 0.0 : -value; };
+  std::vector<double> origin = { negate(affine[3]), negate(affine[7]), affine[11] };
+  metadata["origin"] = imageds_metadata_value(origin);
+  std::vector<double> orientation;
+  for (auto j=0; j<2; j++) {
+    double norm = std::sqrt(affine[j]*affine[j] + affine[4+j]*affine[4+j] + affine[8+j]*affine[8+j]);
+    if (norm == 0) {
+      orientation.clear();
+      break;
+    }
+    orientation.push_back(negate(affine[j]/norm));
+    orientation.push_back(negate(affine[4+j]/norm));
+    orientation.push_back(affine[8+j]/norm);
+  }
+  if (!orientation.empty()) {
+    metadata["orientation"] = imageds_metadata_value(orientation);
+  }
+  return metadata;
+}
+
+int imageds_nifti_import(ImageDS& imageds, const std::string& filename, const std::string& array_path,
+                         uint64_t tile_extent, compression_t compression, int compression_level) {
+  ImageDSNiftiHeader header;
+  RETURN_EINVAL_IF_ERROR(imageds_nifti_read_header(filename, header));
+  attr_type_t type;
+  RETURN_EINVAL_IF_ERROR(header.type(type));
+
+  std::vector<uint64_t> lengths = array_lengths(header);
+  ImageDSArray array(array_path);
+  try {
+    for (auto i=0ul; i<lengths.size(); i++) {
+      array.add_dimension(dimension_names[lengths.size()-1-i], 0, lengths[i]-1,
+                          clamp_tile_extent(tile_extent, lengths[i]));
+    }
+  } catch (const ImageDSException& e) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  array.add_attribute("Intensity", type, compression, compression_level);
+
+  if (header.m_gzip) {
+    RETURN_EIO_IF_ERROR(import_gzip(imageds, header, array));
+  } else {
+    RETURN_EIO_IF_ERROR(import_mapped(imageds, header, array));
+  }
+  return imageds.write_metadata(array_path, to_metadata(header, lengths.size()));
+}
+
+int imageds_nifti_import_batch(const std::string& workspace, const std::vector<std::string>& filenames,
+                               const std::vector<std::string>& array_paths, std::vector<int>& errnos,
+                               uint64_t tile_extent, compression_t compression, int compression_level) {
+  if (filenames.size() != array_paths.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  errnos.assign(filenames.size(), 0);
+
+  #pragma omp parallel
+  {
+    // ImageDS instances keep per context working dirs and cannot be shared across threads
+    std::unique_ptr<ImageDS> imageds;
+    try {
+      imageds = std::unique_ptr<ImageDS>(new ImageDS(workspace, false, false, true));
+    } catch (const ImageDSException& e) {
+    }
+    #pragma omp for schedule(dynamic)
+    for (size_t i=0; i<filenames.size(); i++) {
+      errno = 0;
+      if (!imageds) {
+        errnos[i] = EIO;
+      } else if (imageds_nifti_import(*imageds, filenames[i], array_paths[i], tile_extent, compression,
+                                      compression_level)) {
+        errnos[i] = errno ? errno : EIO;
+      }
+    }
+  }
+
+  for (auto error : errnos) {
+    if (error) {
+      errno = error;
+      return IMAGEDS_ERR;
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+// Builds the export header from the array schema and the metadata written on import
+static int to_header(const ImageDSArray& schema, attr_type_t type, std::map<std::string, std::string>& metadata,
+                     ImageDSNiftiHeader& header) {
+  size_t dim_num = schema.m_dimensions.size();
+  if (dim_num > 7) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  header.m_datatype = 0;
+  for (auto& datatype : datatypes) {
+    if (datatype.type == type || (type == CHAR && datatype.type == INT8)) {
+      header.m_datatype = datatype.datatype;
+      break;
+    }
+  }
+  header.m_bitpix = attr_type_size(type)*8;
+
+  header.m_version = 1;
+  header.m_dim[0] = dim_num;
+  for (auto i=0ul; i<dim_num; i++) {
+    header.m_dim[dim_num-i] = schema.m_dimensions[i]->m_end - schema.m_dimensions[i]->m_start + 1;
+    if (header.m_dim[dim_num-i] > INT16_MAX) {
+      header.m_version = 2;
+    }
+  }
+  header.m_vox_offset = header.m_version == 1 ? NIFTI_1_VOX_OFFSET : NIFTI_2_VOX_OFFSET;
+
+  std::vector<double> spacing = imageds_metadata_values(metadata["spacing"]);
+  if (spacing.size() == dim_num) {
+    for (auto i=0ul; i<dim_num; i++) {
+      header.m_pixdim[dim_num-i] = spacing[i];
+    }
+  }
+  std::vector<double> rescale_slope = imageds_metadata_values(metadata["rescale_slope"]);
+  std::vector<double> rescale_intercept = imageds_metadata_values(metadata["rescale_intercept"]);
+  if (rescale_slope.size() == 1 && rescale_intercept.size() == 1) {
+    header.m_scl_slope = rescale_slope[0];
+    header.m_scl_inter = rescale_intercept[0];
+  }
+  header.m_xyzt_units = atoi(metadata["nifti_xyzt_units"].c_str());
+  header.m_description = metadata["nifti_description"];
+
+  std::vector<double> affine = imageds_metadata_values(metadata["affine"]);
+  std::vector<double> quatern = imageds_metadata_values(metadata["nifti_quatern"]);
+  if (affine.size() == 16) {
+    header.m_sform_code = metadata.count("nifti_sform_code") ? atoi(metadata["nifti_sform_code"].c_str()) : 1;
+    header.m_qform_code = atoi(metadata["nifti_qform_code"].c_str());
+    std::copy(affine.begin(), affine.begin()+12, header.m_srow);
+    if (header.m_qform_code > 0 && quatern.size() == 7) {
+      std::copy(quatern.begin(), quatern.begin()+6, header.m_quatern);
+      header.m_pixdim[0] = quatern[6];
+    }
+    if (header.m_sform_code == 0 && header.m_qform_code == 0) {
+      std::fill(header.m_srow, header.m_srow+12, 0);
+    }
+  } else if (dim_num >= 3) {
+    // Arrays from other sources carry LPS+ origin and orientation
+    std::vector<double> origin = imageds_metadata_values(metadata["origin"]);
+    std::vector<double> orientation = imageds_metadata_values(metadata["orientation"]);
+    if (origin.size() == 3 && orientation.size() == 6) {
+      double *row = &orientation[0], *column = &orientation[3];
+      double normal[3] = { row[1]*column[2] - row[2]*column[1],
+                           row[2]*column[0] - row[0]*column[2],
+                           row[0]*column[1] - row[1]*column[0] };
+      double *axes[3] = { row, column, normal };
+      double flip[3] = { -1, -1, 1 };
+      for (auto i=0; i<3; i++) {
+        for (auto j=0; j<3; j++) {
+          header.m_srow[i*4+j] = flip[i]*axes[j][i]*header.m_pixdim[j+1];
+        }
+        header.m_srow[i*4+3] = flip[i]*origin[i];
+      }
+      header.m_sform_code = 1; // Scanner anatomical
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+template<typename H>
+static void fill_fields(const ImageDSNiftiHeader& header, H& hdr) {
+  for (auto i=0; i<8; i++) {
+    hdr.dim[i] = header.m_dim[i];
+    hdr.pixdim[i] = header.m_pixdim[i];
+  }
+  hdr.datatype = header.m_datatype;
+  hdr.bitpix = header.m_bitpix;
+  hdr.vox_offset = header.m_vox_offset;
+  hdr.scl_slope = header.m_scl_slope;
+  hdr.scl_inter = header.m_scl_inter;
+  hdr.xyzt_units = header.m_xyzt_units;
+  hdr.qform_code = header.m_qform_code;
+  hdr.sform_code = header.m_sform_code;
+  for (auto i=0; i<6; i++) {
+    hdr.quatern[i] = header.m_quatern[i];
+  }
+  for (auto i=0; i<12; i++) {
+    hdr.srow[i] = header.m_srow[i];
+  }
+  strncpy(hdr.descrip, header.m_description.c_str(), sizeof(hdr.descrip)-1);
+}
+
+// Header bytes up to the data block including the empty extension flag
+static std::vector<char> serialize(const ImageDSNiftiHeader& header) {
+  std::vector<char> bytes(header.m_vox_offset, 0);
+  if (header.m_version == 1) {
+    nifti_1_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sizeof_hdr = sizeof(hdr);
+    hdr.regular = 'r';
+    fill_fields(header, hdr);
+    memcpy(hdr.magic, NIFTI_1_MAGIC, 4);
+    memcpy(bytes.data(), &hdr, sizeof(hdr));
+  } else {
+    nifti_2_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sizeof_hdr = sizeof(hdr);
+    fill_fields(header, hdr);
+    memcpy(hdr.magic, NIFTI_2_MAGIC, 8);
+    memcpy(bytes.data(), &hdr, sizeof(hdr));
+  }
+  return bytes;
+}
+
+static int export_mapped(ImageDS& imageds, ImageDSArray& array, const ImageDSNiftiHeader& header,
+                         const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0) {
+    return IMAGEDS_ERR;
+  }
+  size_t length = header.m_vox_offset + header.data_size();
+  if (ftruncate(fd, length)) {
+    close(fd);
+    return IMAGEDS_ERR;
+  }
+  void *mapped = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<char> bytes = serialize(header);
+  memcpy(mapped, bytes.data(), bytes.size());
+  char *data = reinterpret_cast<char *>(mapped) + header.m_vox_offset;
+  int rc = imageds.from_array(array, std::vector<uint64_t>(), {data}, {header.data_size()});
+  int saved_errno = errno;
+  if (msync(mapped, length, MS_SYNC) && !rc) {
+    saved_errno = errno;
+    rc = IMAGEDS_ERR;
+  }
+  munmap(mapped, length);
+  errno = saved_errno;
+  return rc;
+}
+
+static int export_gzip(ImageDS& imageds, ImageDSArray& array, const ImageDSArray& schema,
+                       const ImageDSNiftiHeader& header, const std::string& filename) {
+  gzFile file = gzopen(filename.c_str(), "wb");
+  if (!file) {
+    if (!errno) errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  gzbuffer(file, 1 << 20);
+  std::vector<char> bytes = serialize(header);
+  int rc = gzwrite(file, bytes.data(), bytes.size()) == static_cast<int>(bytes.size()) ? IMAGEDS_OK : IMAGEDS_ERR;
+
+  // Read the next tile-aligned slab of the slowest dimension while the previous one is being compressed
+  std::vector<uint64_t> subarray;
+  for (auto& dimension : schema.m_dimensions) {
+    subarray.push_back(dimension->m_start);
+    subarray.push_back(dimension->m_end);
+  }
+  uint64_t start = subarray[0], end = subarray[1];
+  uint64_t slab_extent = schema.m_dimensions[0]->m_tile_extent;
+  size_t row_size = header.data_size()/(end-start+1);
+  auto read_slab = [&imageds, &array, subarray, slab_extent, row_size](uint64_t slab_start, std::vector<char> *buffer) {
+    std::vector<uint64_t> slab_subarray(subarray);
+    slab_subarray[0] = slab_start;
+    slab_subarray[1] = std::min(subarray[1], slab_start+slab_extent-1);
+    buffer->resize((slab_subarray[1]-slab_start+1)*row_size);
+    return imageds.from_array(array, slab_subarray, {buffer->data()}, {buffer->size()});
+  };
+
+  std::vector<char> slab_buffers[2];
+  std::future<int> pending_read;
+  if (!rc) {
+    pending_read = std::async(std::launch::async, read_slab, start, &slab_buffers[0]);
+  }
+  for (uint64_t slab_start=start, slab=0; slab_start<=end && !rc; slab_start+=slab_extent, slab++) {
+    if (pending_read.get()) {
+      rc = IMAGEDS_ERR;
+      break;
+    }
+    if (slab_start+slab_extent <= end) {
+      pending_read = std::async(std::launch::async, read_slab, slab_start+slab_extent, &slab_buffers[(slab+1)%2]);
+    }
+    std::vector<char>& buffer = slab_buffers[slab%2];
+    for (size_t offset=0; offset<buffer.size() && !rc; offset+=NIFTI_GZ_CHUNK) {
+      unsigned chunk = std::min<size_t>(buffer.size()-offset, NIFTI_GZ_CHUNK);
+      if (gzwrite(file, buffer.data()+offset, chunk) != static_cast<int>(chunk)) {
+        errno = EIO;
+        rc = IMAGEDS_ERR;
+      }
+    }
+  }
+  if (pending_read.valid()) {
+    pending_read.wait();
+  }
+  int saved_errno = errno;
+  if (gzclose(file) != Z_OK && !rc) {
+    saved_errno = EIO;
+    rc = IMAGEDS_ERR;
+  }
+  errno = saved_errno;
+  return rc;
+}
+
+int imageds_nifti_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                         const std::string& attribute) {
+  ImageDSArray schema;
+  RETURN_EINVAL_IF_ERROR(imageds.array_info(array_path, schema));
+  ImageDSAttribute *selected = NULL;
+  for (auto& schema_attribute : schema.m_attributes) {
+    if (attribute.empty() ? schema.m_attributes.size() == 1 : schema_attribute->m_name == attribute) {
+      selected = schema_attribute.get();
+    }
+  }
+  if (!selected) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  std::map<std::string, std::string> metadata;
+  RETURN_EIO_IF_ERROR(imageds.read_metadata(array_path, metadata));
+  ImageDSNiftiHeader header;
+  RETURN_EINVAL_IF_ERROR(to_header(schema, selected->m_type, metadata, header));
+
+  ImageDSArray array(array_path);
+  array.add_attribute(selected->m_name, selected->m_type);
+  if (filename.size() > 3 && filename.compare(filename.size()-3, 3, ".gz") == 0) {
+    return export_gzip(imageds, array, schema, header, filename);
+  } else {
+    return export_mapped(imageds, array, header, filename);
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * @file nifti.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION NIfTI-1/NIfTI-2 import into and export from ImageDS arrays
+ *
+ * NIfTI dim[1] varies fastest, so an image with dim[1..n] = X, Y, Z, T is stored as an ImageDS array with
+ * dimensions T, Z, Y, X whose row-major layout is the layout of the NIfTI data block.
+ */
+
+
+#ifndef __NIFTI_H__
+#define __NIFTI_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Header fields of single file NIfTI-1 and NIfTI-2 images needed for import and export */
+class IMAGEDS_PUBLIC ImageDSNiftiHeader {
+ public:
+  std::string m_filename;
+  int m_version = 1;
+  bool m_gzip = false;
+  bool m_swapped = false; // Header and data are in the opposite byte order
+  int64_t m_dim[8] = {0, 1, 1, 1, 1, 1, 1, 1};
+  int m_datatype = 0;
+  int m_bitpix = 0;
+  double m_pixdim[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+  int64_t m_vox_offset = 0;
+  double m_scl_slope = 0;
+  double m_scl_inter = 0;
+  int m_xyzt_units = 0;
+  int m_qform_code = 0;
+  int m_sform_code = 0;
+  double m_quatern[6] = {0, 0, 0, 0, 0, 0}; // quatern_b, c, d followed by qoffset_x, y, z
+  double m_srow[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  std::string m_description;
+
+  /** Voxel to RAS+ world transform as a row-major 4x4 matrix, from sform, qform or pixdim in that order */
+  std::vector<double> affine() const;
+
+  /** Returns IMAGEDS_ERR with errno set if the datatype or dimensions cannot be stored in an ImageDS array */
+  int type(attr_type_t& type) const;
+
+  uint64_t data_size() const;
+};
+
+IMAGEDS_PUBLIC int imageds_nifti_read_header(const std::string& filename, ImageDSNiftiHeader& header);
+
+/**
+ * Imports a .nii or .nii.gz file into a dense array with one dimension per NIfTI dimension in reverse order,
+ * trailing dimensions of length 1 are dropped. Uncompressed files are memory mapped and the mapping is handed to
+ * to_array without a copy. Compressed files are decompressed in tile-aligned slabs of the slowest dimension that
+ * are written while the next slab is inflated. The affine, spacing, origin, orientation and rescale slope/intercept
+ * are stored as array metadata.
+ */
+IMAGEDS_PUBLIC int imageds_nifti_import(ImageDS& imageds, const std::string& filename, const std::string& array_path,
+                                        uint64_t tile_extent=64, compression_t compression=NONE,
+                                        int compression_level=0);
+
+/**
+ * Imports filenames into array_paths of workspace in parallel, every thread uses its own ImageDS instance.
+ * errnos is set to 0 or the errno of every failed import, IMAGEDS_ERR is returned if any import failed.
+ */
+IMAGEDS_PUBLIC int imageds_nifti_import_batch(const std::string& workspace, const std::vector<std::string>& filenames,
+                                              const std::vector<std::string>& array_paths, std::vector<int>& errnos,
+                                              uint64_t tile_extent=64, compression_t compression=NONE,
+                                              int compression_level=0);
+
+/**
+ * Exports an attribute of an array to a .nii, or .nii.gz if filename ends with .gz. The attribute can be empty
+ * for arrays with a single attribute. Uncompressed files are memory mapped and filled by from_array in place,
+ * compressed files are streamed in slabs of the slowest dimension. Arrays imported from NIfTI keep their
+ * original affine.
+ */
+IMAGEDS_PUBLIC int imageds_nifti_export(ImageDS& imageds, const std::string& array_path, const std::string& filename,
+                                        const std::string& attribute="");
+
+#endif //__NIFTI_H__
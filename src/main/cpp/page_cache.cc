@@ -0,0 +1,91 @@
+/**
+ * @file page_cache.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Page cache residency of files read by scans
+ */
+
+
+#include "page_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ImageDSPageCacheGuard::ImageDSPageCacheGuard(const std::string& path) : m_path(path) {
+  int saved_errno = errno;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd >= 0 && !fstat(fd, &st) && st.st_size) {
+    // Mapping without touching the pages does not change their residency
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      long page_size = sysconf(_SC_PAGESIZE);
+      m_resident.resize((st.st_size + page_size - 1)/page_size);
+      if (mincore(data, st.st_size, m_resident.data())) {
+        m_resident.clear();
+      }
+      munmap(data, st.st_size);
+    }
+  }
+  if (fd >= 0) close(fd);
+  errno = saved_errno;
+}
+
+ImageDSPageCacheGuard::~ImageDSPageCacheGuard() {
+  int saved_errno = errno;
+  int fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd >= 0 && !fstat(fd, &st)) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t page_num = (st.st_size + page_size - 1)/page_size;
+    // Pages past the end of the file at creation were not cached
+    for (size_t page=0; page<page_num;) {
+      if (page < m_resident.size() && (m_resident[page] & 1)) {
+        page++;
+        continue;
+      }
+      size_t end = page+1;
+      while (end < page_num && !(end < m_resident.size() && (m_resident[end] & 1))) {
+        end++;
+      }
+      posix_fadvise(fd, page*page_size, (end-page)*page_size, POSIX_FADV_DONTNEED);
+      page = end;
+    }
+  }
+  if (fd >= 0) close(fd);
+  errno = saved_errno;
+}
+
+size_t ImageDSPageCacheGuard::resident_pages() const {
+  size_t pages = 0;
+  for (auto resident : m_resident) {
+    pages += resident & 1;
+  }
+  return pages;
+}
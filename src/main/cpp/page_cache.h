@@ -0,0 +1,60 @@
+/**
+ * @file page_cache.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Page cache residency of files read by scans
+ */
+
+#ifndef __PAGE_CACHE_H__
+#define __PAGE_CACHE_H__
+
+#include <string>
+#include <vector>
+
+/**
+ * Remembers which pages of a local file are in the page cache, so that the pages brought in by a scan can be
+ * dropped afterwards without evicting the pages other readers rely on. Pages are assumed not cached when the
+ * residency of the file cannot be determined.
+ */
+class ImageDSPageCacheGuard {
+ public:
+  explicit ImageDSPageCacheGuard(const std::string& path);
+
+  // Delete copy constructor
+  ImageDSPageCacheGuard(const ImageDSPageCacheGuard& other) = delete;
+
+  /** Drops the pages of the file cached since the guard was created */
+  ~ImageDSPageCacheGuard();
+
+  /** Pages of the file in the page cache when the guard was created */
+  size_t resident_pages() const;
+
+ private:
+  std::string m_path;
+  std::vector<unsigned char> m_resident;
+};
+
+#endif //__PAGE_CACHE_H__
@@ -0,0 +1,184 @@
+/**
+ * @file projection.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Reductions of tiles into intensity projections
+ */
+
+
+#include "projection.h"
+#include "typed_view.h"
+
+#include <algorithm>
+#include <limits>
+
+attr_type_t imageds_projection_type(attr_type_t type, projection_t projection) {
+  return projection == PROJECTION_MEAN ? FLOAT64 : type;
+}
+
+// Projections of cells of type T into cells of result_type
+template<typename T, projection_t P>
+struct Projection {
+  typedef T result_type;
+
+  static T identity() {
+    return P == PROJECTION_MAX ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+  }
+
+  static T combine(T a, T b) {
+    return P == PROJECTION_MAX ? std::max(a, b) : std::min(a, b);
+  }
+};
+
+// Means are summed and divided by the number of cells once all tiles are reduced
+template<typename T>
+struct Projection<T, PROJECTION_MEAN> {
+  typedef double result_type;
+
+  static double identity() {
+    return 0;
+  }
+
+  static double combine(double a, double b) {
+    return a + b;
+  }
+};
+
+template<typename T, projection_t P>
+static void reduce_rows(const T *tile, const std::vector<uint64_t>& tile_box, void *projection,
+                        const std::vector<uint64_t>& dst_box, const std::vector<uint64_t>& region, size_t axis) {
+  typedef Projection<T, P> Op;
+  typedef typename Op::result_type R;
+  R *dst = static_cast<R *>(projection);
+  size_t dim_num = region.size()/2;
+  size_t last = dim_num-1;
+  uint64_t run = region[last*2+1] - region[last*2] + 1;
+
+  // Strides in cells, cells along axis all reduce into the same cell of dst
+  std::vector<uint64_t> src_strides(dim_num), dst_strides(dim_num);
+  uint64_t src_stride = 1, dst_stride = 1;
+  for (auto d=dim_num; d-- > 0; ) {
+    src_strides[d] = src_stride;
+    src_stride *= tile_box[d*2+1] - tile_box[d*2] + 1;
+    dst_strides[d] = d == axis ? 0 : dst_stride;
+    dst_stride *= d == axis ? 1 : dst_box[d*2+1] - dst_box[d*2] + 1;
+  }
+
+  std::vector<uint64_t> coords(dim_num);
+  for (auto d=0ul; d<dim_num; d++) {
+    coords[d] = region[d*2];
+  }
+  while (true) {
+    uint64_t src_offset = 0, dst_offset = 0;
+    for (auto d=0ul; d<dim_num; d++) {
+      src_offset += (coords[d] - tile_box[d*2])*src_strides[d];
+      dst_offset += (coords[d] - dst_box[d*2])*dst_strides[d];
+    }
+    const T *src_row = tile + src_offset;
+    R *dst_row = dst + dst_offset;
+    if (axis == last) {
+      R value = dst_row[0];
+      for (auto i=0ul; i<run; i++) {
+        value = Op::combine(value, static_cast<R>(src_row[i]));
+      }
+      dst_row[0] = value;
+    } else {
+      for (auto i=0ul; i<run; i++) {
+        dst_row[i] = Op::combine(dst_row[i], static_cast<R>(src_row[i]));
+      }
+    }
+
+    size_t dim = last;
+    while (dim-- > 0) {
+      if (++coords[dim] <= region[dim*2+1]) break;
+      coords[dim] = region[dim*2];
+    }
+    if (dim == static_cast<size_t>(-1)) break;
+  }
+}
+
+template<typename T, projection_t P>
+static int fill_identity(void *dst, uint64_t cell_num) {
+  typedef Projection<T, P> Op;
+  std::fill_n(static_cast<typename Op::result_type *>(dst), cell_num, Op::identity());
+  return IMAGEDS_OK;
+}
+
+template<typename T>
+struct Init {
+  static int run(projection_t projection, void *dst, uint64_t cell_num) {
+    switch (projection) {
+      case PROJECTION_MAX:
+        return fill_identity<T, PROJECTION_MAX>(dst, cell_num);
+      case PROJECTION_MIN:
+        return fill_identity<T, PROJECTION_MIN>(dst, cell_num);
+      case PROJECTION_MEAN:
+        return fill_identity<T, PROJECTION_MEAN>(dst, cell_num);
+    }
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+};
+
+template<typename T>
+struct Reduce {
+  static int run(projection_t projection, const void *tile, const std::vector<uint64_t>& tile_box, void *dst,
+                 const std::vector<uint64_t>& dst_box, const std::vector<uint64_t>& region, size_t axis) {
+    const T *cells = static_cast<const T *>(tile);
+    switch (projection) {
+      case PROJECTION_MAX:
+        reduce_rows<T, PROJECTION_MAX>(cells, tile_box, dst, dst_box, region, axis);
+        return IMAGEDS_OK;
+      case PROJECTION_MIN:
+        reduce_rows<T, PROJECTION_MIN>(cells, tile_box, dst, dst_box, region, axis);
+        return IMAGEDS_OK;
+      case PROJECTION_MEAN:
+        reduce_rows<T, PROJECTION_MEAN>(cells, tile_box, dst, dst_box, region, axis);
+        return IMAGEDS_OK;
+    }
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+};
+
+int imageds_projection_init(attr_type_t type, projection_t projection, void *dst, uint64_t cell_num) {
+  return imageds_dispatch<Init>(type, projection, dst, cell_num);
+}
+
+int imageds_projection_reduce(attr_type_t type, projection_t projection, const void *tile,
+                              const std::vector<uint64_t>& tile_box, void *dst, const std::vector<uint64_t>& dst_box,
+                              const std::vector<uint64_t>& region, size_t axis) {
+  return imageds_dispatch<Reduce>(type, projection, tile, tile_box, dst, dst_box, region, axis);
+}
+
+void imageds_projection_finish(projection_t projection, void *dst, uint64_t cell_num, uint64_t count) {
+  if (projection == PROJECTION_MEAN) {
+    double *means = static_cast<double *>(dst);
+    for (auto i=0ul; i<cell_num; i++) {
+      means[i] /= count;
+    }
+  }
+}
@@ -0,0 +1,56 @@
+/**
+ * @file projection.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Reductions of tiles into intensity projections
+ */
+
+#ifndef __PROJECTION_H__
+#define __PROJECTION_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** Type of the cells of projections of cells of type */
+attr_type_t imageds_projection_type(attr_type_t type, projection_t projection);
+
+/** Sets cell_num cells of dst to the identity of projection, e.g. the lowest value of type for maximums */
+int imageds_projection_init(attr_type_t type, projection_t projection, void *dst, uint64_t cell_num);
+
+/**
+ * Reduces the cells of region of a tile laid out over tile_box along axis into dst, laid out in row-major order
+ * over dst_box without axis. region has to be contained in both boxes.
+ */
+int imageds_projection_reduce(attr_type_t type, projection_t projection, const void *tile,
+                              const std::vector<uint64_t>& tile_box, void *dst, const std::vector<uint64_t>& dst_box,
+                              const std::vector<uint64_t>& region, size_t axis);
+
+/** Divides the sums of cell_num cells of mean projections by count, other projections are left as they are */
+void imageds_projection_finish(projection_t projection, void *dst, uint64_t cell_num, uint64_t count);
+
+#endif //__PROJECTION_H__
@@ -0,0 +1,74 @@
+/**
+ * @file schema_cache.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Array schemas cached by array path
+ */
+
+#ifndef __SCHEMA_CACHE_H__
+#define __SCHEMA_CACHE_H__
+
+#include "imageds.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Schemas of the arrays of a workspace, loaded once and shared by the reads of an ImageDS instance and its I/O pool
+ * instances. Schemas are dropped when their array is created again.
+ */
+class ImageDSSchemaCache {
+ public:
+  ImageDSSchemaCache() {}
+
+  // Delete copy constructor
+  ImageDSSchemaCache(const ImageDSSchemaCache& other) = delete;
+
+  /** Schema of array_path, NULL if not cached */
+  std::shared_ptr<const ImageDSArray> get(const std::string& array_path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_schemas.find(array_path);
+    return found == m_schemas.end() ? NULL : found->second;
+  }
+
+  void put(const std::string& array_path, std::shared_ptr<const ImageDSArray> schema) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_schemas[array_path] = schema;
+  }
+
+  void erase(const std::string& array_path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_schemas.erase(array_path);
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::shared_ptr<const ImageDSArray>> m_schemas;
+};
+
+#endif //__SCHEMA_CACHE_H__
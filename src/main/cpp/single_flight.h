@@ -0,0 +1,96 @@
+/**
+ * @file single_flight.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Coalescing of concurrent loads of the same key
+ */
+
+#ifndef __SINGLE_FLIGHT_H__
+#define __SINGLE_FLIGHT_H__
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * In-flight table of loads by key. A load of a key that is already being loaded waits for the running load and
+ * shares its result, including a failed result, instead of repeating it. Results are not kept once the load is done.
+ */
+template<typename T>
+class ImageDSSingleFlight {
+ public:
+  ImageDSSingleFlight() {}
+
+  // Delete copy constructor
+  ImageDSSingleFlight(const ImageDSSingleFlight& other) = delete;
+
+  /** Result of load or of the load of key in flight, coalesced is set when the result was shared */
+  T run(const std::string& key, const std::function<T()>& load, bool *coalesced=NULL) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto found = m_flights.find(key);
+    if (found != m_flights.end()) {
+      std::shared_future<T> flight = found->second;
+      lock.unlock();
+      if (coalesced) *coalesced = true;
+      return flight.get();
+    }
+    std::promise<T> promise;
+    m_flights[key] = promise.get_future().share();
+    lock.unlock();
+
+    if (coalesced) *coalesced = false;
+    T result;
+    try {
+      result = load();
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      land(key);
+      throw;
+    }
+    promise.set_value(result);
+    land(key);
+    return result;
+  }
+
+  /** Number of loads in flight */
+  size_t size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_flights.size();
+  }
+
+ private:
+  void land(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flights.erase(key);
+  }
+
+  std::unordered_map<std::string, std::shared_future<T>> m_flights;
+  std::mutex m_mutex;
+};
+
+#endif //__SINGLE_FLIGHT_H__
@@ -0,0 +1,127 @@
+/**
+ * @file stats.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Thread-sharded collection of ImageDS statistics
+ */
+
+
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define IMAGEDS_MAX_STATS_SHARDS 64
+
+void ImageDSLatencyHistogram::add(uint64_t latency_us) {
+  int bucket = 0;
+  while (bucket < BUCKET_NUM-1 && latency_us >= (1ull << bucket)) {
+    bucket++;
+  }
+  m_buckets[bucket]++;
+  m_count++;
+  m_total_us += latency_us;
+  m_max_us = std::max(m_max_us, latency_us);
+}
+
+void ImageDSLatencyHistogram::merge(const ImageDSLatencyHistogram& other) {
+  for (auto i=0; i<BUCKET_NUM; i++) {
+    m_buckets[i] += other.m_buckets[i];
+  }
+  m_count += other.m_count;
+  m_total_us += other.m_total_us;
+  m_max_us = std::max(m_max_us, other.m_max_us);
+}
+
+uint64_t ImageDSLatencyHistogram::percentile(double q) const {
+  if (!m_count) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q*m_count + 0.5));
+  uint64_t seen = 0;
+  for (auto i=0; i<BUCKET_NUM; i++) {
+    seen += m_buckets[i];
+    if (seen >= rank) {
+      // The last bucket is open ended
+      return i == BUCKET_NUM-1 ? m_max_us : std::min<uint64_t>(m_max_us, (1ull << i) - 1);
+    }
+  }
+  return m_max_us;
+}
+
+void ImageDSArrayStats::merge(const ImageDSArrayStats& other) {
+  m_to_array_calls += other.m_to_array_calls;
+  m_from_array_calls += other.m_from_array_calls;
+  m_errors += other.m_errors;
+  m_bytes_written += other.m_bytes_written;
+  m_bytes_requested += other.m_bytes_requested;
+  m_bytes_read += other.m_bytes_read;
+  m_bytes_decompressed += other.m_bytes_decompressed;
+  m_tiles_touched += other.m_tiles_touched;
+  m_cache_hits += other.m_cache_hits;
+  m_coalesced_reads += other.m_coalesced_reads;
+  m_to_array_latency.merge(other.m_to_array_latency);
+  m_from_array_latency.merge(other.m_from_array_latency);
+}
+
+ImageDSArrayStats ImageDSStats::total() const {
+  ImageDSArrayStats total;
+  for (auto& entry : m_arrays) {
+    total.merge(entry.second);
+  }
+  return total;
+}
+
+ImageDSStatsCollector::ImageDSStatsCollector()
+    : m_shard_num(std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), IMAGEDS_MAX_STATS_SHARDS)),
+      m_shards(new Shard[m_shard_num]) {
+}
+
+// Threads are assigned shards round robin on first use and keep them for their lifetime
+size_t ImageDSStatsCollector::shard_id() {
+  static std::atomic<size_t> next_thread(0);
+  thread_local size_t thread_id = next_thread++;
+  return thread_id%m_shard_num;
+}
+
+ImageDSStats ImageDSStatsCollector::snapshot() {
+  ImageDSStats stats;
+  for (auto i=0ul; i<m_shard_num; i++) {
+    std::lock_guard<std::mutex> lock(m_shards[i].m_mutex);
+    for (auto& entry : m_shards[i].m_arrays) {
+      stats.m_arrays[entry.first].merge(entry.second);
+    }
+  }
+  return stats;
+}
+
+void ImageDSStatsCollector::reset() {
+  for (auto i=0ul; i<m_shard_num; i++) {
+    std::lock_guard<std::mutex> lock(m_shards[i].m_mutex);
+    m_shards[i].m_arrays.clear();
+  }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file stats.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Thread-sharded collection of ImageDS statistics
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "imageds.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class ImageDSStatsCollector {
+ public:
+  ImageDSStatsCollector();
+
+  // Delete copy constructor
+  ImageDSStatsCollector(const ImageDSStatsCollector& other) = delete;
+
+  /** Applies update to the counters of array_path in the shard of the calling thread */
+  template<typename F>
+  void update(const std::string& array_path, F update) {
+    Shard& shard = m_shards[shard_id()];
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+    update(shard.m_arrays[array_path]);
+  }
+
+  ImageDSStats snapshot();
+
+  void reset();
+
+ private:
+  // Padded, so that threads updating neighbouring shards do not share cache lines
+  struct Shard {
+    std::mutex m_mutex;
+    std::unordered_map<std::string, ImageDSArrayStats> m_arrays;
+    char m_padding[64];
+  };
+
+  size_t shard_id();
+
+  size_t m_shard_num;
+  std::unique_ptr<Shard[]> m_shards;
+};
+
+#endif //__STATS_H__
@@ -0,0 +1,475 @@
+/**
+ * @file tiff.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Native reader of baseline and tiled TIFF/BigTIFF images
+ */
+
+
+#include "tiff.h"
+#include "tile_layout.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define TIFF_MAX_DIRECTORIES 65536
+
+// Tags
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION 259
+#define TIFF_PHOTOMETRIC 262
+#define TIFF_STRIP_OFFSETS 273
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_ROWS_PER_STRIP 278
+#define TIFF_STRIP_BYTE_COUNTS 279
+#define TIFF_PLANAR_CONFIG 284
+#define TIFF_PREDICTOR 317
+#define TIFF_TILE_WIDTH 322
+#define TIFF_TILE_LENGTH 323
+#define TIFF_TILE_OFFSETS 324
+#define TIFF_TILE_BYTE_COUNTS 325
+#define TIFF_SAMPLE_FORMAT 339
+
+// Compressions
+#define TIFF_NONE 1
+#define TIFF_LZW 5
+#define TIFF_DEFLATE 8
+#define TIFF_ADOBE_DEFLATE 32946
+#define TIFF_PACKBITS 32773
+
+template<typename T>
+static T swap_bytes(T value) {
+  char *bytes = reinterpret_cast<char *>(&value);
+  std::reverse(bytes, bytes+sizeof(T));
+  return value;
+}
+
+static bool host_is_little_endian() {
+  uint16_t value = 1;
+  return *reinterpret_cast<char *>(&value) == 1;
+}
+
+static int pread_fully(int fd, void *buffer, size_t size, uint64_t offset) {
+  char *bytes = reinterpret_cast<char *>(buffer);
+  while (size > 0) {
+    ssize_t length = pread(fd, bytes, size, offset);
+    if (length <= 0) {
+      if (!length) errno = EINVAL; // Truncated file
+      return IMAGEDS_ERR;
+    }
+    bytes += length;
+    size -= length;
+    offset += length;
+  }
+  return IMAGEDS_OK;
+}
+
+static size_t field_type_size(int type) {
+  switch (type) {
+    case 1: case 2: case 6: case 7:
+      return 1;
+    case 3: case 8:
+      return 2;
+    case 4: case 9: case 11: case 13:
+      return 4;
+    case 5: case 10: case 12: case 16: case 17: case 18:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+// TIFF variant of LZW, codes are MSB first and the code width grows one code early
+static int lzw_decode(const unsigned char *in, size_t in_size, char *out, size_t out_size) {
+  std::vector<int> prefix(4096, -1);
+  std::vector<unsigned char> suffix(4096), first(4096);
+  std::vector<size_t> length(4096, 1);
+  for (auto i=0; i<256; i++) {
+    suffix[i] = first[i] = i;
+  }
+
+  size_t out_pos = 0;
+  uint64_t bits = 0;
+  int bit_count = 0;
+  int width = 9;
+  int next = 258;
+  int old = -1;
+  size_t in_pos = 0;
+  while (out_pos < out_size) {
+    while (bit_count < width && in_pos < in_size) {
+      bits = (bits << 8) | in[in_pos++];
+      bit_count += 8;
+    }
+    if (bit_count < width) break;
+    int code = (bits >> (bit_count - width)) & ((1 << width) - 1);
+    bit_count -= width;
+
+    if (code == 257) break;
+    if (code == 256) {
+      next = 258;
+      width = 9;
+      old = -1;
+      continue;
+    }
+    if (code > next || (code == next && old < 0) || next >= 4096) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    if (old >= 0) {
+      prefix[next] = old;
+      suffix[next] = code < next ? first[code] : first[old];
+      first[next] = first[old];
+      length[next] = length[old] + 1;
+      next++;
+    }
+    // Strings are emitted back to front following the prefixes
+    size_t string_length = std::min(length[code], out_size - out_pos);
+    int entry = code;
+    for (size_t skip = length[code]; skip > string_length; skip--) {
+      entry = prefix[entry];
+    }
+    for (size_t i=string_length; i-- > 0; ) {
+      out[out_pos+i] = suffix[entry];
+      entry = prefix[entry];
+    }
+    out_pos += string_length;
+    old = code;
+    if (next + 1 >= (1 << width) && width < 12) {
+      width++;
+    }
+  }
+  if (out_pos < out_size) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+static int packbits_decode(const unsigned char *in, size_t in_size, char *out, size_t out_size) {
+  size_t in_pos = 0, out_pos = 0;
+  while (in_pos < in_size && out_pos < out_size) {
+    int n = static_cast<signed char>(in[in_pos++]);
+    if (n >= 0) {
+      size_t count = std::min<size_t>(n+1, std::min(in_size-in_pos, out_size-out_pos));
+      memcpy(out+out_pos, in+in_pos, count);
+      in_pos += n+1;
+      out_pos += count;
+    } else if (n != -128 && in_pos < in_size) {
+      size_t count = std::min<size_t>(1-n, out_size-out_pos);
+      memset(out+out_pos, in[in_pos++], count);
+      out_pos += count;
+    }
+  }
+  if (out_pos < out_size) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+template<typename T>
+static void undo_horizontal_differencing(char *pixels, uint64_t rows, uint64_t columns, int samples) {
+  T *values = reinterpret_cast<T *>(pixels);
+  uint64_t row_length = columns*samples;
+  for (uint64_t row=0; row<rows; row++) {
+    T *row_values = values + row*row_length;
+    for (uint64_t i=samples; i<row_length; i++) {
+      row_values[i] += row_values[i-samples];
+    }
+  }
+}
+
+ImageDSTiff::~ImageDSTiff() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+int ImageDSTiff::open(const std::string& filename, int directory) {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  m_fd = ::open(filename.c_str(), O_RDONLY);
+  if (m_fd < 0) {
+    return IMAGEDS_ERR;
+  }
+
+  unsigned char header[16];
+  RETURN_EINVAL_IF_ERROR(pread_fully(m_fd, header, 8, 0));
+  bool little_endian;
+  if (header[0] == 'I' && header[1] == 'I') {
+    little_endian = true;
+  } else if (header[0] == 'M' && header[1] == 'M') {
+    little_endian = false;
+  } else {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  m_swapped = little_endian != host_is_little_endian();
+
+  auto u16 = [this](const unsigned char *p) { uint16_t v; memcpy(&v, p, 2); return m_swapped ? swap_bytes(v) : v; };
+  auto u32 = [this](const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return m_swapped ? swap_bytes(v) : v; };
+  auto u64 = [this](const unsigned char *p) { uint64_t v; memcpy(&v, p, 8); return m_swapped ? swap_bytes(v) : v; };
+
+  bool big_tiff;
+  uint64_t ifd_offset;
+  if (u16(header+2) == 42) {
+    big_tiff = false;
+    ifd_offset = u32(header+4);
+  } else if (u16(header+2) == 43) {
+    big_tiff = true;
+    RETURN_EINVAL_IF_ERROR(pread_fully(m_fd, header, 16, 0));
+    ifd_offset = u64(header+8);
+  } else {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  size_t count_size = big_tiff ? 8 : 2;
+  size_t entry_size = big_tiff ? 20 : 12;
+  size_t inline_size = big_tiff ? 8 : 4;
+
+  // Walk the chain of image file directories, only the requested one is parsed
+  std::map<int, std::vector<uint64_t>> tags;
+  m_directory_num = 0;
+  while (ifd_offset && m_directory_num < TIFF_MAX_DIRECTORIES) {
+    unsigned char count_bytes[8];
+    RETURN_EINVAL_IF_ERROR(pread_fully(m_fd, count_bytes, count_size, ifd_offset));
+    uint64_t entry_num = big_tiff ? u64(count_bytes) : u16(count_bytes);
+    std::vector<unsigned char> entries(entry_num*entry_size + inline_size);
+    RETURN_EINVAL_IF_ERROR(pread_fully(m_fd, entries.data(), entries.size(), ifd_offset+count_size));
+
+    if (m_directory_num == directory) {
+      for (uint64_t i=0; i<entry_num; i++) {
+        const unsigned char *entry = entries.data() + i*entry_size;
+        int tag = u16(entry);
+        int type = u16(entry+2);
+        uint64_t count = big_tiff ? u64(entry+4) : u32(entry+4);
+        const unsigned char *value = entry + (big_tiff ? 12 : 8);
+        size_t type_size = field_type_size(type);
+        // Only integer fields are of interest
+        if (!type_size || type == 2 || type == 5 || type == 10 || type == 11 || type == 12 || count > (1ul << 32)) {
+          continue;
+        }
+        std::vector<unsigned char> data(count*type_size);
+        if (data.size() <= inline_size) {
+          memcpy(data.data(), value, data.size());
+        } else {
+          RETURN_EINVAL_IF_ERROR(pread_fully(m_fd, data.data(), data.size(), big_tiff ? u64(value) : u32(value)));
+        }
+        std::vector<uint64_t>& values = tags[tag];
+        for (uint64_t j=0; j<count; j++) {
+          const unsigned char *p = data.data() + j*type_size;
+          values.push_back(type_size == 1 ? *p : type_size == 2 ? u16(p) : type_size == 4 ? u32(p) : u64(p));
+        }
+      }
+    }
+    const unsigned char *next = entries.data() + entry_num*entry_size;
+    ifd_offset = big_tiff ? u64(next) : u32(next);
+    m_directory_num++;
+  }
+  if (directory < 0 || directory >= m_directory_num) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+
+  auto tag = [&tags](int id, uint64_t default_value) {
+    return tags.count(id) && !tags[id].empty() ? tags[id][0] : default_value;
+  };
+  m_width = tag(TIFF_IMAGE_WIDTH, 0);
+  m_height = tag(TIFF_IMAGE_LENGTH, 0);
+  m_samples = tag(TIFF_SAMPLES_PER_PIXEL, 1);
+  m_bits = tag(TIFF_BITS_PER_SAMPLE, 1);
+  m_compression = tag(TIFF_COMPRESSION, TIFF_NONE);
+  m_predictor = tag(TIFF_PREDICTOR, 1);
+  int photometric = tag(TIFF_PHOTOMETRIC, 1);
+  int planar_config = tag(TIFF_PLANAR_CONFIG, 1);
+  int sample_format = tag(TIFF_SAMPLE_FORMAT, 1);
+  if (!m_width || !m_height || !m_samples) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  // Palette indices and WhiteIsZero values are stored as they are
+  if ((m_samples > 1 && planar_config != 1) || photometric > 3
+      || (m_compression != TIFF_NONE && m_compression != TIFF_LZW && m_compression != TIFF_DEFLATE
+          && m_compression != TIFF_ADOBE_DEFLATE && m_compression != TIFF_PACKBITS)
+      || (m_predictor != 1 && (m_predictor != 2 || sample_format == 3))) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  for (auto bits : tags[TIFF_BITS_PER_SAMPLE]) {
+    if (bits != static_cast<uint64_t>(m_bits)) {
+      errno = ENOTSUP;
+      return IMAGEDS_ERR;
+    }
+  }
+  static const attr_type_t unsigned_types[] = { UINT8, UINT16, UINT32, UINT64 };
+  static const attr_type_t signed_types[] = { INT8, INT16, INT32, INT64 };
+  int type_index = m_bits == 8 ? 0 : m_bits == 16 ? 1 : m_bits == 32 ? 2 : m_bits == 64 ? 3 : -1;
+  if (type_index < 0 || sample_format < 1 || sample_format > 3 || (sample_format == 3 && type_index < 2)) {
+    errno = ENOTSUP;
+    return IMAGEDS_ERR;
+  }
+  m_type = sample_format == 1 ? unsigned_types[type_index] : sample_format == 2 ? signed_types[type_index]
+      : type_index == 2 ? FLOAT32 : FLOAT64;
+
+  m_tiled = tags.count(TIFF_TILE_OFFSETS) > 0;
+  uint64_t chunk_num;
+  if (m_tiled) {
+    m_chunk_width = tag(TIFF_TILE_WIDTH, 0);
+    m_chunk_height = tag(TIFF_TILE_LENGTH, 0);
+    m_offsets = tags[TIFF_TILE_OFFSETS];
+    m_byte_counts = tags[TIFF_TILE_BYTE_COUNTS];
+    if (!m_chunk_width || !m_chunk_height) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    chunk_num = ((m_width+m_chunk_width-1)/m_chunk_width) * ((m_height+m_chunk_height-1)/m_chunk_height);
+  } else {
+    m_chunk_width = m_width;
+    m_chunk_height = std::min(tag(TIFF_ROWS_PER_STRIP, m_height), m_height);
+    m_offsets = tags[TIFF_STRIP_OFFSETS];
+    m_byte_counts = tags[TIFF_STRIP_BYTE_COUNTS];
+    if (!m_chunk_height) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    chunk_num = (m_height+m_chunk_height-1)/m_chunk_height;
+  }
+  if (m_offsets.size() != chunk_num || m_byte_counts.size() != chunk_num) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
+
+std::vector<uint64_t> ImageDSTiff::chunks(const std::vector<uint64_t>& region) const {
+  std::vector<uint64_t> ids;
+  uint64_t across = (m_width+m_chunk_width-1)/m_chunk_width;
+  for (uint64_t row=region[0]/m_chunk_height; row<=region[1]/m_chunk_height; row++) {
+    for (uint64_t column=region[2]/m_chunk_width; column<=region[3]/m_chunk_width; column++) {
+      ids.push_back(row*across + column);
+    }
+  }
+  return ids;
+}
+
+std::vector<uint64_t> ImageDSTiff::chunk_region(uint64_t chunk) const {
+  uint64_t across = (m_width+m_chunk_width-1)/m_chunk_width;
+  uint64_t y0 = (chunk/across)*m_chunk_height;
+  uint64_t x0 = (chunk%across)*m_chunk_width;
+  // Edge tiles are padded while the last strip only holds the remaining rows
+  uint64_t y1 = m_tiled ? y0+m_chunk_height-1 : std::min(y0+m_chunk_height, m_height)-1;
+  return { y0, y1, x0, x0+m_chunk_width-1 };
+}
+
+int ImageDSTiff::read_chunk(uint64_t chunk, std::vector<char>& pixels) const {
+  if (chunk >= m_offsets.size()) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  IMAGEDS_TRACE_SPAN("tiff_read_chunk");
+  std::vector<uint64_t> region = chunk_region(chunk);
+  uint64_t rows = region[1]-region[0]+1;
+  uint64_t columns = region[3]-region[2]+1;
+  pixels.resize(rows*columns*pixel_size());
+
+  std::vector<unsigned char> encoded(m_byte_counts[chunk]);
+  RETURN_EIO_IF_ERROR(pread_fully(m_fd, encoded.data(), encoded.size(), m_offsets[chunk]));
+  switch (m_compression) {
+    case TIFF_NONE:
+      if (encoded.size() < pixels.size()) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+      memcpy(pixels.data(), encoded.data(), pixels.size());
+      break;
+    case TIFF_LZW:
+      RETURN_EINVAL_IF_ERROR(lzw_decode(encoded.data(), encoded.size(), pixels.data(), pixels.size()));
+      break;
+    case TIFF_DEFLATE:
+    case TIFF_ADOBE_DEFLATE: {
+      uLongf length = pixels.size();
+      if (uncompress(reinterpret_cast<Bytef *>(pixels.data()), &length, encoded.data(), encoded.size()) != Z_OK
+          || length != pixels.size()) {
+        errno = EINVAL;
+        return IMAGEDS_ERR;
+      }
+      break;
+    }
+    case TIFF_PACKBITS:
+      RETURN_EINVAL_IF_ERROR(packbits_decode(encoded.data(), encoded.size(), pixels.data(), pixels.size()));
+      break;
+  }
+
+  size_t sample_size = m_bits/8;
+  if (m_swapped && sample_size > 1) {
+    for (size_t i=0; i<pixels.size(); i+=sample_size) {
+      std::reverse(pixels.begin()+i, pixels.begin()+i+sample_size);
+    }
+  }
+  if (m_predictor == 2) {
+    switch (sample_size) {
+      case 1:
+        undo_horizontal_differencing<uint8_t>(pixels.data(), rows, columns, m_samples);
+        break;
+      case 2:
+        undo_horizontal_differencing<uint16_t>(pixels.data(), rows, columns, m_samples);
+        break;
+      case 4:
+        undo_horizontal_differencing<uint32_t>(pixels.data(), rows, columns, m_samples);
+        break;
+      case 8:
+        undo_horizontal_differencing<uint64_t>(pixels.data(), rows, columns, m_samples);
+        break;
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+int ImageDSTiff::read(const std::vector<uint64_t>& region, void *buffer) const {
+  if (region.size() != 4 || region[0] > region[1] || region[2] > region[3] || region[1] >= m_height
+      || region[3] >= m_width) {
+    errno = EINVAL;
+    return IMAGEDS_ERR;
+  }
+  std::vector<char> pixels;
+  for (auto chunk : chunks(region)) {
+    RETURN_EIO_IF_ERROR(read_chunk(chunk, pixels));
+    std::vector<uint64_t> source = chunk_region(chunk);
+    std::vector<uint64_t> overlap;
+    if (intersect(source, region, overlap)) {
+      copy_region(pixels.data(), source, buffer, region, overlap, pixel_size());
+    }
+  }
+  return IMAGEDS_OK;
+}
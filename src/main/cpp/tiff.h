@@ -0,0 +1,123 @@
+/**
+ * @file tiff.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Native reader of baseline and tiled TIFF/BigTIFF images
+ *
+ * Supports chunky grayscale/RGB(A) images with 8 to 64 bit samples stored in strips or tiles, either
+ * uncompressed or compressed with LZW, Deflate or PackBits. Every image file directory, e.g. the levels of a
+ * pyramidal TIFF, can be opened on its own.
+ */
+
+#ifndef __TIFF_H__
+#define __TIFF_H__
+
+#include "imageds.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ImageDSTiff {
+ public:
+  ImageDSTiff() {}
+  ~ImageDSTiff();
+
+  // Delete copy constructor
+  ImageDSTiff(const ImageDSTiff& other) = delete;
+
+  /** Opens the given image file directory, returns IMAGEDS_ERR with errno ENOTSUP for unsupported encodings */
+  int open(const std::string& filename, int directory=0);
+
+  /** Number of image file directories in the file */
+  int directory_num() const {
+    return m_directory_num;
+  }
+
+  uint64_t width() const {
+    return m_width;
+  }
+
+  uint64_t height() const {
+    return m_height;
+  }
+
+  int samples() const {
+    return m_samples;
+  }
+
+  attr_type_t type() const {
+    return m_type;
+  }
+
+  size_t pixel_size() const {
+    return m_samples*m_bits/8;
+  }
+
+  bool tiled() const {
+    return m_tiled;
+  }
+
+  /** Tile size, or image width and rows per strip for stripped images */
+  uint64_t chunk_width() const {
+    return m_chunk_width;
+  }
+
+  uint64_t chunk_height() const {
+    return m_chunk_height;
+  }
+
+  /** Ids of the strips or tiles overlapping region, given as [y0, y1, x0, x1] */
+  std::vector<uint64_t> chunks(const std::vector<uint64_t>& region) const;
+
+  /** Region of the image, as [y0, y1, x0, x1], covered by a chunk including padding of edge tiles */
+  std::vector<uint64_t> chunk_region(uint64_t chunk) const;
+
+  /** Decompresses a chunk into pixels in host byte order laid out over chunk_region, thread safe */
+  int read_chunk(uint64_t chunk, std::vector<char>& pixels) const;
+
+  /** Decodes region, given as [y0, y1, x0, x1], into a row-major buffer of interleaved samples */
+  int read(const std::vector<uint64_t>& region, void *buffer) const;
+
+ private:
+  int m_fd = -1;
+  int m_directory_num = 0;
+  bool m_swapped = false;
+  uint64_t m_width = 0;
+  uint64_t m_height = 0;
+  int m_samples = 1;
+  int m_bits = 0;
+  attr_type_t m_type = UINT8;
+  int m_compression = 1;
+  int m_predictor = 1;
+  bool m_tiled = false;
+  uint64_t m_chunk_width = 0;
+  uint64_t m_chunk_height = 0;
+  std::vector<uint64_t> m_offsets;
+  std::vector<uint64_t> m_byte_counts;
+};
+
+#endif //__TIFF_H__
@@ -0,0 +1,100 @@
+/**
+ * @file tile_cache.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Thread-safe LRU cache of decoded ImageDS tiles
+ */
+
+#include "tile_cache.h"
+
+tile_buffer_t ImageDSTileCache::get(const std::string& key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto found = m_index.find(key);
+  if (found == m_index.end()) {
+    return tile_buffer_t();
+  }
+  m_lru.splice(m_lru.begin(), m_lru, found->second);
+  return found->second->second;
+}
+
+void ImageDSTileCache::put(const std::string& key, tile_buffer_t tile) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!tile || tile->size() > m_capacity) {
+    return;
+  }
+  auto found = m_index.find(key);
+  if (found != m_index.end()) {
+    m_size -= found->second->second->size();
+    m_lru.erase(found->second);
+    m_index.erase(found);
+  }
+  m_lru.push_front(std::make_pair(key, tile));
+  m_index[key] = m_lru.begin();
+  m_size += tile->size();
+  evict();
+}
+
+void ImageDSTileCache::erase(const std::string& key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto found = m_index.find(key);
+  if (found != m_index.end()) {
+    m_size -= found->second->second->size();
+    m_lru.erase(found->second);
+    m_index.erase(found);
+  }
+}
+
+void ImageDSTileCache::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_lru.clear();
+  m_index.clear();
+  m_size = 0;
+}
+
+size_t ImageDSTileCache::capacity() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_capacity;
+}
+
+void ImageDSTileCache::set_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_capacity = capacity;
+  evict();
+}
+
+size_t ImageDSTileCache::size() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_size;
+}
+
+// Expects m_mutex to be held
+void ImageDSTileCache::evict() {
+  while (m_size > m_capacity && !m_lru.empty()) {
+    m_size -= m_lru.back().second->size();
+    m_index.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file tile_cache.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Thread-safe LRU cache of decoded ImageDS tiles
+ */
+
+#ifndef __TILE_CACHE_H__
+#define __TILE_CACHE_H__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef std::shared_ptr<const std::vector<char>> tile_buffer_t;
+
+class ImageDSTileCache {
+ public:
+  ImageDSTileCache(size_t capacity) : m_capacity(capacity), m_size(0) {}
+
+  // Delete copy constructor
+  ImageDSTileCache(const ImageDSTileCache& other) = delete;
+
+  /** Returns the cached tile or an empty pointer if the tile is not cached */
+  tile_buffer_t get(const std::string& key);
+
+  /** Tiles larger than the capacity are not cached */
+  void put(const std::string& key, tile_buffer_t tile);
+
+  void erase(const std::string& key);
+
+  void clear();
+
+  size_t capacity();
+
+  void set_capacity(size_t capacity);
+
+  /** Bytes currently held by the cache */
+  size_t size();
+
+ private:
+  typedef std::list<std::pair<std::string, tile_buffer_t>> lru_list_t;
+
+  void evict();
+
+  size_t m_capacity;
+  size_t m_size;
+  lru_list_t m_lru;
+  std::unordered_map<std::string, lru_list_t::iterator> m_index;
+  std::mutex m_mutex;
+};
+
+#endif //__TILE_CACHE_H__
@@ -0,0 +1,268 @@
+/**
+ * @file tile_layout.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Row-major tile geometry of dense ImageDS arrays
+ */
+
+#include "tile_layout.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+// Rows and columns of the blocks of strided plane copies, 32 rows of 32 cells of up to 8 bytes fit in L1
+#define IMAGEDS_PLANE_BLOCK 32
+
+size_t attr_type_size(attr_type_t type) {
+  switch (type) {
+    case CHAR:
+    case INT8:
+    case UINT8:
+      return 1;
+    case INT16:
+    case UINT16:
+      return 2;
+    case INT32:
+    case UINT32:
+    case FLOAT32:
+      return 4;
+    case INT64:
+    case UINT64:
+    case FLOAT64:
+      return 8;
+  }
+  throw std::runtime_error("Not yet implemented!");
+}
+
+uint64_t clamp_tile_extent(uint64_t tile_extent, uint64_t length) {
+  return std::max<uint64_t>(1, std::min<uint64_t>(tile_extent, length > 2 ? length-2 : 1));
+}
+
+ImageDSTileLayout::ImageDSTileLayout(const std::vector<std::unique_ptr<ImageDSDimension>>& dimensions) {
+  VERIFY(dimensions.size() > 0 && "Array Dimensions required to compute tile layout");
+  for (auto i=0ul; i<dimensions.size(); i++) {
+    VERIFY(dimensions[i]->m_start <= dimensions[i]->m_end && "Only dimensions with start <= end are supported");
+    m_domain.push_back(dimensions[i]->m_start);
+    m_domain.push_back(dimensions[i]->m_end);
+    m_tile_extents.push_back(dimensions[i]->m_tile_extent);
+    uint64_t length = dimensions[i]->m_end - dimensions[i]->m_start + 1;
+    m_tile_counts.push_back((length + dimensions[i]->m_tile_extent - 1)/dimensions[i]->m_tile_extent);
+  }
+}
+
+uint64_t ImageDSTileLayout::tile_num() const {
+  uint64_t num = 1;
+  for (auto count : m_tile_counts) {
+    num *= count;
+  }
+  return num;
+}
+
+std::vector<uint64_t> ImageDSTileLayout::tile_subarray(uint64_t tile_id) const {
+  std::vector<uint64_t> subarray(dim_num()*2);
+  for (auto i=dim_num(); i-- > 0; ) {
+    uint64_t tile_coord = tile_id % m_tile_counts[i];
+    tile_id /= m_tile_counts[i];
+    subarray[i*2] = m_domain[i*2] + tile_coord*m_tile_extents[i];
+    subarray[i*2+1] = std::min(subarray[i*2] + m_tile_extents[i] - 1, m_domain[i*2+1]);
+  }
+  return subarray;
+}
+
+uint64_t ImageDSTileLayout::overlapping_tile_num(const std::vector<uint64_t>& subarray) const {
+  std::vector<uint64_t> clipped;
+  if (subarray.size() != m_domain.size() || !intersect(subarray, m_domain, clipped)) {
+    return 0;
+  }
+  uint64_t num = 1;
+  for (auto i=0ul; i<dim_num(); i++) {
+    num *= (clipped[i*2+1] - m_domain[i*2])/m_tile_extents[i] - (clipped[i*2] - m_domain[i*2])/m_tile_extents[i] + 1;
+  }
+  return num;
+}
+
+std::vector<uint64_t> ImageDSTileLayout::overlapping_tiles(const std::vector<uint64_t>& subarray) const {
+  std::vector<uint64_t> tile_ids;
+  std::vector<uint64_t> clipped;
+  if (subarray.size() != m_domain.size() || !intersect(subarray, m_domain, clipped)) {
+    return tile_ids;
+  }
+
+  std::vector<uint64_t> low(dim_num()), high(dim_num());
+  for (auto i=0ul; i<dim_num(); i++) {
+    low[i] = (clipped[i*2] - m_domain[i*2])/m_tile_extents[i];
+    high[i] = (clipped[i*2+1] - m_domain[i*2])/m_tile_extents[i];
+  }
+
+  std::vector<uint64_t> coords(low);
+  while (true) {
+    uint64_t tile_id = 0;
+    for (auto i=0ul; i<dim_num(); i++) {
+      tile_id = tile_id*m_tile_counts[i] + coords[i];
+    }
+    tile_ids.push_back(tile_id);
+
+    size_t dim = dim_num();
+    while (dim-- > 0) {
+      if (++coords[dim] <= high[dim]) break;
+      coords[dim] = low[dim];
+    }
+    if (dim == static_cast<size_t>(-1)) break;
+  }
+  return tile_ids;
+}
+
+uint64_t ImageDSTileLayout::cell_num(const std::vector<uint64_t>& subarray) {
+  uint64_t num = 1;
+  for (auto i=0ul; i<subarray.size()/2; i++) {
+    num *= subarray[i*2+1] - subarray[i*2] + 1;
+  }
+  return num;
+}
+
+bool intersect(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, std::vector<uint64_t>& result) {
+  result.resize(a.size());
+  for (auto i=0ul; i<a.size()/2; i++) {
+    result[i*2] = std::max(a[i*2], b[i*2]);
+    result[i*2+1] = std::min(a[i*2+1], b[i*2+1]);
+    if (result[i*2] > result[i*2+1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Calls copy_row with the first cells of every row of region in both boxes and the cells in a row
+template<typename CopyRow>
+static void for_each_row(const void *src, const std::vector<uint64_t>& src_box, size_t src_cell_size,
+                         void *dst, const std::vector<uint64_t>& dst_box, size_t dst_cell_size,
+                         const std::vector<uint64_t>& region, const CopyRow& copy_row) {
+  size_t dim_num = region.size()/2;
+  size_t last = dim_num-1;
+  uint64_t run = region[last*2+1] - region[last*2] + 1;
+
+  // Row strides in cells for both boxes
+  std::vector<uint64_t> src_strides(dim_num, 1), dst_strides(dim_num, 1);
+  for (auto i=last; i-- > 0; ) {
+    src_strides[i] = src_strides[i+1]*(src_box[(i+1)*2+1] - src_box[(i+1)*2] + 1);
+    dst_strides[i] = dst_strides[i+1]*(dst_box[(i+1)*2+1] - dst_box[(i+1)*2] + 1);
+  }
+
+  std::vector<uint64_t> coords(dim_num);
+  for (auto i=0ul; i<dim_num; i++) {
+    coords[i] = region[i*2];
+  }
+
+  const char *src_bytes = reinterpret_cast<const char *>(src);
+  char *dst_bytes = reinterpret_cast<char *>(dst);
+  while (true) {
+    uint64_t src_offset = 0, dst_offset = 0;
+    for (auto i=0ul; i<dim_num; i++) {
+      src_offset += (coords[i] - src_box[i*2])*src_strides[i];
+      dst_offset += (coords[i] - dst_box[i*2])*dst_strides[i];
+    }
+    copy_row(src_bytes + src_offset*src_cell_size, dst_bytes + dst_offset*dst_cell_size, run);
+
+    size_t dim = last;
+    while (dim-- > 0) {
+      if (++coords[dim] <= region[dim*2+1]) break;
+      coords[dim] = region[dim*2];
+    }
+    if (dim == static_cast<size_t>(-1)) break;
+  }
+}
+
+void copy_region(const void *src, const std::vector<uint64_t>& src_box,
+                 void *dst, const std::vector<uint64_t>& dst_box,
+                 const std::vector<uint64_t>& region, size_t cell_size) {
+  for_each_row(src, src_box, cell_size, dst, dst_box, cell_size, region,
+               [cell_size](const char *src_row, char *dst_row, uint64_t cell_num) {
+                 memcpy(dst_row, src_row, cell_num*cell_size);
+               });
+}
+
+void copy_region(const void *src, const std::vector<uint64_t>& src_box, size_t src_cell_size,
+                 void *dst, const std::vector<uint64_t>& dst_box, size_t dst_cell_size,
+                 const std::vector<uint64_t>& region, const copy_row_t& copy_row) {
+  for_each_row(src, src_box, src_cell_size, dst, dst_box, dst_cell_size, region, copy_row);
+}
+
+template<typename T>
+static void copy_plane(const T *src, uint64_t src_row_stride, uint64_t src_col_stride,
+                       T *dst, uint64_t dst_row_stride, uint64_t dst_col_stride, uint64_t rows, uint64_t cols) {
+  for (auto row_block=0ul; row_block<rows; row_block+=IMAGEDS_PLANE_BLOCK) {
+    uint64_t row_end = std::min<uint64_t>(rows, row_block+IMAGEDS_PLANE_BLOCK);
+    for (auto col_block=0ul; col_block<cols; col_block+=IMAGEDS_PLANE_BLOCK) {
+      uint64_t col_end = std::min<uint64_t>(cols, col_block+IMAGEDS_PLANE_BLOCK);
+      for (auto row=row_block; row<row_end; row++) {
+        const T *src_row = src + row*src_row_stride;
+        T *dst_row = dst + row*dst_row_stride;
+        for (auto col=col_block; col<col_end; col++) {
+          dst_row[col*dst_col_stride] = src_row[col*src_col_stride];
+        }
+      }
+    }
+  }
+}
+
+void copy_plane(const void *src, uint64_t src_row_stride, uint64_t src_col_stride,
+                void *dst, uint64_t dst_row_stride, uint64_t dst_col_stride,
+                uint64_t rows, uint64_t cols, size_t cell_size) {
+  const char *src_bytes = reinterpret_cast<const char *>(src);
+  char *dst_bytes = reinterpret_cast<char *>(dst);
+  if (src_col_stride == 1 && dst_col_stride == 1) {
+    for (auto row=0ul; row<rows; row++) {
+      memcpy(dst_bytes + row*dst_row_stride*cell_size, src_bytes + row*src_row_stride*cell_size, cols*cell_size);
+    }
+    return;
+  }
+  switch (cell_size) {
+    case 1:
+      copy_plane(reinterpret_cast<const uint8_t *>(src), src_row_stride, src_col_stride,
+                 reinterpret_cast<uint8_t *>(dst), dst_row_stride, dst_col_stride, rows, cols);
+      break;
+    case 2:
+      copy_plane(reinterpret_cast<const uint16_t *>(src), src_row_stride, src_col_stride,
+                 reinterpret_cast<uint16_t *>(dst), dst_row_stride, dst_col_stride, rows, cols);
+      break;
+    case 4:
+      copy_plane(reinterpret_cast<const uint32_t *>(src), src_row_stride, src_col_stride,
+                 reinterpret_cast<uint32_t *>(dst), dst_row_stride, dst_col_stride, rows, cols);
+      break;
+    case 8:
+      copy_plane(reinterpret_cast<const uint64_t *>(src), src_row_stride, src_col_stride,
+                 reinterpret_cast<uint64_t *>(dst), dst_row_stride, dst_col_stride, rows, cols);
+      break;
+    default:
+      for (auto row=0ul; row<rows; row++) {
+        for (auto col=0ul; col<cols; col++) {
+          memcpy(dst_bytes + (row*dst_row_stride + col*dst_col_stride)*cell_size,
+                 src_bytes + (row*src_row_stride + col*src_col_stride)*cell_size, cell_size);
+        }
+      }
+  }
+}
@@ -0,0 +1,113 @@
+/**
+ * @file tile_layout.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Row-major tile geometry of dense ImageDS arrays
+ *
+ * Subarrays are represented as in TileDB, i.e. [low, high] pairs per dimension
+ * with both bounds inclusive.
+ */
+
+#ifndef __TILE_LAYOUT_H__
+#define __TILE_LAYOUT_H__
+
+#include "imageds.h"
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+size_t attr_type_size(attr_type_t type);
+
+/** Tile extents are limited by ImageDSDimension to less than end-start */
+uint64_t clamp_tile_extent(uint64_t tile_extent, uint64_t length);
+
+class ImageDSTileLayout {
+ public:
+  ImageDSTileLayout(const std::vector<std::unique_ptr<ImageDSDimension>>& dimensions);
+
+  size_t dim_num() const {
+    return m_tile_extents.size();
+  }
+
+  const std::vector<uint64_t>& domain() const {
+    return m_domain;
+  }
+
+  const std::vector<uint64_t>& tile_extents() const {
+    return m_tile_extents;
+  }
+
+  /** Number of tiles along every dimension */
+  const std::vector<uint64_t>& tile_counts() const {
+    return m_tile_counts;
+  }
+
+  uint64_t tile_num() const;
+
+  /** Tile subarray clipped to the array domain, tiles are numbered in row-major order */
+  std::vector<uint64_t> tile_subarray(uint64_t tile_id) const;
+
+  /** Ids of all tiles intersecting the given subarray, in row-major tile order */
+  std::vector<uint64_t> overlapping_tiles(const std::vector<uint64_t>& subarray) const;
+
+  /** Number of tiles intersecting the given subarray without enumerating them */
+  uint64_t overlapping_tile_num(const std::vector<uint64_t>& subarray) const;
+
+  static uint64_t cell_num(const std::vector<uint64_t>& subarray);
+
+ private:
+  std::vector<uint64_t> m_domain;
+  std::vector<uint64_t> m_tile_extents;
+  std::vector<uint64_t> m_tile_counts;
+};
+
+bool intersect(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, std::vector<uint64_t>& result);
+
+/**
+ * Copies the cells of region from a row-major buffer laid out over src_box into a row-major buffer laid
+ * out over dst_box. region has to be contained in both boxes.
+ */
+void copy_region(const void *src, const std::vector<uint64_t>& src_box,
+                 void *dst, const std::vector<uint64_t>& dst_box,
+                 const std::vector<uint64_t>& region, size_t cell_size);
+
+/** Copies every row of cells of region with copy_row instead, for copies that convert the cells */
+typedef std::function<void(const void *src, void *dst, uint64_t cell_num)> copy_row_t;
+void copy_region(const void *src, const std::vector<uint64_t>& src_box, size_t src_cell_size,
+                 void *dst, const std::vector<uint64_t>& dst_box, size_t dst_cell_size,
+                 const std::vector<uint64_t>& region, const copy_row_t& copy_row);
+
+/**
+ * Copies rows x cols cells between buffers addressed with the given strides in cells, e.g. a plane cut across a
+ * tile or a transposed plane. Strided copies go block by block so that the cache lines of a block are reused.
+ */
+void copy_plane(const void *src, uint64_t src_row_stride, uint64_t src_col_stride,
+                void *dst, uint64_t dst_row_stride, uint64_t dst_col_stride,
+                uint64_t rows, uint64_t cols, size_t cell_size);
+
+#endif //__TILE_LAYOUT_H__
@@ -0,0 +1,404 @@
+/**
+ * @file tile_store.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Workspace-level content-addressed store of ImageDS tiles
+ */
+
+#include "tile_store.h"
+#include "trace.h"
+
+#include "tiledb.h"
+#include "tiledb_storage.h"
+
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+#define TILEDB_CTX reinterpret_cast<TileDB_CTX*>(m_tiledb_ctx)
+
+#define TILE_CODEC_RAW  0
+#define TILE_CODEC_ZLIB 1
+
+#define TEMP_SUFFIX ".tmp"
+
+// XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+static const uint64_t PRIME64_3 = 1609587929392839161ULL;
+static const uint64_t PRIME64_4 = 9650029242287828579ULL;
+static const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t value) {
+  acc ^= xxh64_round(0, value);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t xxh64(const void *data, size_t length, uint64_t seed) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  const unsigned char *end = p + length;
+  uint64_t h64;
+
+  if (length >= 32) {
+    const unsigned char *limit = end - 32;
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+    do {
+      v1 = xxh64_round(v1, read64(p)); p += 8;
+      v2 = xxh64_round(v2, read64(p)); p += 8;
+      v3 = xxh64_round(v3, read64(p)); p += 8;
+      v4 = xxh64_round(v4, read64(p)); p += 8;
+    } while (p <= limit);
+    h64 = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h64 = xxh64_merge_round(h64, v1);
+    h64 = xxh64_merge_round(h64, v2);
+    h64 = xxh64_merge_round(h64, v3);
+    h64 = xxh64_merge_round(h64, v4);
+  } else {
+    h64 = seed + PRIME64_5;
+  }
+
+  h64 += static_cast<uint64_t>(length);
+
+  while (p + 8 <= end) {
+    h64 ^= xxh64_round(0, read64(p));
+    h64 = rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h64 ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+    h64 = rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h64 ^= (*p) * PRIME64_5;
+    h64 = rotl64(h64, 11) * PRIME64_1;
+    p++;
+  }
+
+  h64 ^= h64 >> 33;
+  h64 *= PRIME64_2;
+  h64 ^= h64 >> 29;
+  h64 *= PRIME64_3;
+  h64 ^= h64 >> 32;
+  return h64;
+}
+
+// Writers in other stores, threads and processes may write the same path concurrently, each under its own name
+static std::string temp_path(const std::string& path) {
+  std::ostringstream temp;
+  temp << path << "." << getpid() << "-" << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id())
+       << TEMP_SUFFIX;
+  return temp.str();
+}
+
+std::string ImageDSTileStore::key(const void *data, size_t length) {
+  // Two differently seeded 64-bit hashes, collisions between distinct tiles are not expected in practice
+  std::ostringstream key;
+  key << std::hex << std::setfill('0') << std::setw(16) << xxh64(data, length, 0)
+      << std::setw(16) << xxh64(data, length, PRIME64_3);
+  return key.str();
+}
+
+std::string ImageDSTileStore::tile_path(const std::string& key) {
+  return m_path + "/" + key.substr(0, 2) + "/" + key;
+}
+
+int ImageDSTileStore::create_dirs(const std::string& key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!is_dir(TILEDB_CTX, m_path)) {
+    RETURN_EIO_IF_ERROR(create_dir(TILEDB_CTX, m_path));
+  }
+  std::string fanout_dir = m_path + "/" + key.substr(0, 2);
+  if (!is_dir(TILEDB_CTX, fanout_dir)) {
+    RETURN_EIO_IF_ERROR(create_dir(TILEDB_CTX, fanout_dir));
+  }
+  return IMAGEDS_OK;
+}
+
+bool ImageDSTileStore::contains(const std::string& key) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_known_keys.count(key)) return true;
+  }
+  return is_file(TILEDB_CTX, tile_path(key));
+}
+
+ssize_t ImageDSTileStore::stored_size(const std::string& key) {
+  std::string path = tile_path(key);
+  return is_file(TILEDB_CTX, path) ? file_size(TILEDB_CTX, path) : IMAGEDS_ERR;
+}
+
+int ImageDSTileStore::put(const std::string& key, const void *data, size_t length, compression_t compression, int compression_level) {
+  {
+    // Concurrent puts of the same tile wait for the first one, and write the tile themselves if it failed
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_written.wait(lock, [&] { return !m_pending_keys.count(key); });
+    if (m_known_keys.count(key)) return 0;
+    if (is_file(TILEDB_CTX, tile_path(key))) {
+      m_known_keys.insert(key);
+      return 0;
+    }
+    m_pending_keys.insert(key);
+  }
+
+  // Header is the decoded length followed by the codec
+  std::vector<char> encoded(sizeof(uint64_t) + sizeof(uint32_t));
+  uint64_t decoded_length = length;
+  uint32_t codec = compression == NONE ? TILE_CODEC_RAW : TILE_CODEC_ZLIB;
+  memcpy(encoded.data(), &decoded_length, sizeof(uint64_t));
+  memcpy(encoded.data() + sizeof(uint64_t), &codec, sizeof(uint32_t));
+  size_t header_length = encoded.size();
+  int rc = IMAGEDS_OK;
+  if (codec == TILE_CODEC_ZLIB) {
+    IMAGEDS_TRACE_SPAN("tile_store_compress");
+    // All ImageDS compression types are served by zlib in the tile store
+    uLongf compressed_length = compressBound(length);
+    encoded.resize(header_length + compressed_length);
+    int level = (compression_level >= 1 && compression_level <= 9) ? compression_level : Z_DEFAULT_COMPRESSION;
+    if (compress2(reinterpret_cast<Bytef *>(encoded.data() + header_length), &compressed_length,
+                  reinterpret_cast<const Bytef *>(data), length, level) != Z_OK) {
+      errno = EIO;
+      rc = IMAGEDS_ERR;
+    }
+    encoded.resize(header_length + compressed_length);
+  } else {
+    encoded.insert(encoded.end(), reinterpret_cast<const char *>(data), reinterpret_cast<const char *>(data) + length);
+  }
+
+  // Write under a temporary name so readers never observe partial tiles
+  std::string path = tile_path(key);
+  std::string tmp_path = temp_path(path);
+  IMAGEDS_TRACE_SPAN("tile_store_write");
+  if (!rc) rc = create_dirs(key);
+  if (!rc && is_file(TILEDB_CTX, tmp_path)) rc = delete_file(TILEDB_CTX, tmp_path);
+  if (!rc) rc = write_to_file(TILEDB_CTX, tmp_path, encoded.data(), encoded.size());
+  if (!rc) rc = close_file(TILEDB_CTX, tmp_path);
+  if (!rc) rc = move_path(TILEDB_CTX, tmp_path, path);
+  {
+    // Keys are only known once their tile can be read, so that no reference is written to a missing tile
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending_keys.erase(key);
+    if (!rc) m_known_keys.insert(key);
+  }
+  m_written.notify_all();
+  if (rc) {
+    if (!errno) errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  return 1;
+}
+
+int ImageDSTileStore::get(const std::string& key, std::vector<char>& tile, uint64_t *read_bytes,
+                          uint64_t *decompressed_bytes) {
+  std::string path = tile_path(key);
+  ssize_t stored_length = file_size(TILEDB_CTX, path);
+  if (stored_length < static_cast<ssize_t>(sizeof(uint64_t) + sizeof(uint32_t))) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+
+  std::vector<char> encoded(stored_length);
+  {
+    IMAGEDS_TRACE_SPAN("tile_store_read");
+    RETURN_EIO_IF_ERROR(read_from_file(TILEDB_CTX, path, 0, encoded.data(), stored_length));
+  }
+  if (read_bytes) *read_bytes = stored_length;
+  return decode(encoded, tile, decompressed_bytes);
+}
+
+int ImageDSTileStore::decode(const std::vector<char>& encoded, std::vector<char>& tile, uint64_t *decompressed_bytes) {
+  size_t stored_length = encoded.size();
+  size_t header_length = sizeof(uint64_t) + sizeof(uint32_t);
+  if (decompressed_bytes) *decompressed_bytes = 0;
+  if (stored_length < header_length) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+  uint64_t decoded_length;
+  uint32_t codec;
+  memcpy(&decoded_length, encoded.data(), sizeof(uint64_t));
+  memcpy(&codec, encoded.data() + sizeof(uint64_t), sizeof(uint32_t));
+
+  tile.resize(decoded_length);
+  if (codec == TILE_CODEC_RAW) {
+    if (stored_length - header_length != decoded_length) {
+      errno = EIO;
+      return IMAGEDS_ERR;
+    }
+    memcpy(tile.data(), encoded.data() + header_length, decoded_length);
+  } else {
+    IMAGEDS_TRACE_SPAN("tile_store_decompress");
+    uLongf length = decoded_length;
+    if (uncompress(reinterpret_cast<Bytef *>(tile.data()), &length,
+                   reinterpret_cast<const Bytef *>(encoded.data() + header_length), stored_length - header_length) != Z_OK
+        || length != decoded_length) {
+      errno = EIO;
+      return IMAGEDS_ERR;
+    }
+    if (decompressed_bytes) *decompressed_bytes = decoded_length;
+  }
+  return IMAGEDS_OK;
+}
+
+const char *ImageDSTileStore::raw_cells(const char *encoded, size_t length, uint64_t& tile_length) {
+  size_t header_length = sizeof(uint64_t) + sizeof(uint32_t);
+  if (length < header_length) {
+    return NULL;
+  }
+  uint32_t codec;
+  memcpy(&tile_length, encoded, sizeof(uint64_t));
+  memcpy(&codec, encoded + sizeof(uint64_t), sizeof(uint32_t));
+  if (codec != TILE_CODEC_RAW || length - header_length != tile_length) {
+    return NULL;
+  }
+  return encoded + header_length;
+}
+
+int ImageDSTileStore::size(uint64_t& tile_num, uint64_t& stored_bytes) {
+  tile_num = 0;
+  stored_bytes = 0;
+  if (!is_dir(TILEDB_CTX, m_path)) {
+    return IMAGEDS_OK;
+  }
+  for (auto& fanout_dir : get_dirs(TILEDB_CTX, m_path)) {
+    for (auto& file : get_files(TILEDB_CTX, fanout_dir)) {
+      // Temporary files of puts in progress or interrupted, in this or other processes, are not tiles
+      size_t suffix_length = strlen(TEMP_SUFFIX);
+      if (file.size() >= suffix_length && file.compare(file.size()-suffix_length, suffix_length, TEMP_SUFFIX) == 0) {
+        continue;
+      }
+      ssize_t length = file_size(TILEDB_CTX, file);
+      if (length < 0) {
+        errno = EIO;
+        return IMAGEDS_ERR;
+      }
+      tile_num++;
+      stored_bytes += length;
+    }
+  }
+  return IMAGEDS_OK;
+}
+
+bool ImageDSTileStore::has_refs(const std::string& array_path) {
+  return is_file(TILEDB_CTX, append_paths(array_path, IMAGEDS_TILE_REFS));
+}
+
+int ImageDSTileStore::drop_refs(const std::string& array_path) {
+  std::string path = append_paths(array_path, IMAGEDS_TILE_REFS);
+  if (is_file(TILEDB_CTX, path)) {
+    RETURN_EIO_IF_ERROR(delete_file(TILEDB_CTX, path));
+  }
+  return IMAGEDS_OK;
+}
+
+int ImageDSTileStore::write_refs(const std::string& array_path, const ImageDSTileRefs& refs) {
+  std::ostringstream out;
+  out << IMAGEDS_TILE_REFS << " 1\n";
+  out << refs.m_attributes.size() << " " << (refs.m_keys.empty() ? 0 : refs.m_keys[0].size()) << "\n";
+  for (auto i=0ul; i<refs.m_attributes.size(); i++) {
+    out << refs.m_attributes[i] << "\n";
+    for (auto& key : refs.m_keys[i]) {
+      out << key << "\n";
+    }
+  }
+  std::string contents = out.str();
+
+  std::string path = append_paths(array_path, IMAGEDS_TILE_REFS);
+  std::string tmp_path = temp_path(path);
+  if (is_file(TILEDB_CTX, tmp_path)) {
+    RETURN_EIO_IF_ERROR(delete_file(TILEDB_CTX, tmp_path));
+  }
+  RETURN_EIO_IF_ERROR(write_to_file(TILEDB_CTX, tmp_path, contents.data(), contents.size()));
+  RETURN_EIO_IF_ERROR(close_file(TILEDB_CTX, tmp_path));
+  if (is_file(TILEDB_CTX, path)) {
+    RETURN_EIO_IF_ERROR(delete_file(TILEDB_CTX, path));
+  }
+  RETURN_EIO_IF_ERROR(move_path(TILEDB_CTX, tmp_path, path));
+  return IMAGEDS_OK;
+}
+
+int ImageDSTileStore::read_refs(const std::string& array_path, ImageDSTileRefs& refs) {
+  std::string path = append_paths(array_path, IMAGEDS_TILE_REFS);
+  ssize_t length = file_size(TILEDB_CTX, path);
+  if (length <= 0) {
+    errno = ENOENT;
+    return IMAGEDS_ERR;
+  }
+  std::string contents(length, 0);
+  RETURN_EIO_IF_ERROR(read_from_file(TILEDB_CTX, path, 0, &contents[0], length));
+
+  std::istringstream in(contents);
+  std::string magic;
+  int version;
+  size_t attribute_num, tile_num;
+  in >> magic >> version >> attribute_num >> tile_num;
+  if (!in || magic != IMAGEDS_TILE_REFS || version != 1) {
+    errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  refs.m_attributes.resize(attribute_num);
+  refs.m_keys.assign(attribute_num, std::vector<std::string>(tile_num));
+  for (auto i=0ul; i<attribute_num; i++) {
+    in >> refs.m_attributes[i];
+    for (auto j=0ul; j<tile_num; j++) {
+      in >> refs.m_keys[i][j];
+    }
+  }
+  if (!in) {
+    errno = EIO;
+    return IMAGEDS_ERR;
+  }
+  return IMAGEDS_OK;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file tile_store.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Workspace-level content-addressed store of ImageDS tiles
+ */
+
+#ifndef __TILE_STORE_H__
+#define __TILE_STORE_H__
+
+#include "imageds.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#define IMAGEDS_TILE_STORE "__imageds_tile_store"
+#define IMAGEDS_TILE_REFS "__imageds_tile_refs"
+
+/**
+ * Tile references of an array written to the tile store. For every attribute, keys are held in
+ * row-major tile order.
+ */
+class ImageDSTileRefs {
+ public:
+  std::vector<std::string> m_attributes;
+  std::vector<std::vector<std::string>> m_keys;
+
+  int attribute_id(const std::string& name) const {
+    for (auto i=0ul; i<m_attributes.size(); i++) {
+      if (m_attributes[i] == name) return i;
+    }
+    return -1;
+  }
+};
+
+/**
+ * Tiles are keyed by a 128-bit content hash and stored once per workspace, optionally zlib compressed.
+ * All paths are relative to the TileDB working directory, which is expected to be the workspace.
+ */
+class ImageDSTileStore {
+ public:
+  ImageDSTileStore(void *tiledb_ctx, const std::string& path=IMAGEDS_TILE_STORE)
+      : m_tiledb_ctx(tiledb_ctx), m_path(path) {}
+
+  // Delete copy constructor
+  ImageDSTileStore(const ImageDSTileStore& other) = delete;
+
+  static std::string key(const void *data, size_t length);
+
+  /**
+   * Returns 1 if the tile was added, 0 if an identical tile was already stored and IMAGEDS_ERR on error.
+   */
+  int put(const std::string& key, const void *data, size_t length, compression_t compression=NONE, int compression_level=0);
+
+  /** read_bytes is set to the bytes read from the store and decompressed_bytes to the bytes inflated, if any */
+  int get(const std::string& key, std::vector<char>& tile, uint64_t *read_bytes=NULL,
+          uint64_t *decompressed_bytes=NULL);
+
+  /** Decodes a tile as stored, for tiles read from tile_path by other means than get */
+  static int decode(const std::vector<char>& encoded, std::vector<char>& tile, uint64_t *decompressed_bytes=NULL);
+
+  /** Cells of a tile stored without compression within its encoding, NULL for compressed or truncated tiles */
+  static const char *raw_cells(const char *encoded, size_t length, uint64_t& tile_length);
+
+  /** Path of the stored tile relative to the TileDB working directory */
+  std::string tile_path(const std::string& key);
+
+  bool contains(const std::string& key);
+
+  /** Bytes on disk of a stored tile, IMAGEDS_ERR if the tile is not stored */
+  ssize_t stored_size(const std::string& key);
+
+  /** Number of tiles and bytes on disk held by the store */
+  int size(uint64_t& tile_num, uint64_t& stored_bytes);
+
+  int write_refs(const std::string& array_path, const ImageDSTileRefs& refs);
+
+  int read_refs(const std::string& array_path, ImageDSTileRefs& refs);
+
+  bool has_refs(const std::string& array_path);
+
+  /** Removes the tile references of an array, the tiles themselves stay in the store */
+  int drop_refs(const std::string& array_path);
+
+ private:
+  int create_dirs(const std::string& key);
+
+  void *m_tiledb_ctx;
+  std::string m_path;
+  std::unordered_set<std::string> m_known_keys;   // Keys of tiles moved into the store
+  std::unordered_set<std::string> m_pending_keys; // Keys of tiles being written by a put
+  std::mutex m_mutex;
+  std::condition_variable m_written;
+};
+
+#endif //__TILE_STORE_H__
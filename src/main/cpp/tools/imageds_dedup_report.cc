@@ -0,0 +1,124 @@
+/**
+ * @file imageds_dedup_report.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Reports tile dedup ratios of the arrays in an existing ImageDS workspace
+ */
+
+#include "imageds.h"
+#include "tile_layout.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " <workspace>" << std::endl
+            << "Reports logical versus unique tiles for all arrays in the workspace. Arrays written with tile "
+            << "dedup report their references, other arrays are hashed tile by tile to show the achievable ratio."
+            << std::endl;
+}
+
+static double ratio(uint64_t logical, uint64_t unique) {
+  return unique ? static_cast<double>(logical)/unique : 1.0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+    usage(argv[0]);
+    return argc == 2 ? 0 : 1;
+  }
+
+  try {
+    ImageDS imageds(argv[1], false, false, true);
+    std::vector<std::string> array_paths;
+    if (imageds.list_arrays(array_paths)) {
+      std::cerr << "Could not list arrays in workspace " << argv[1] << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    std::unordered_map<std::string, uint64_t> unique_tiles;
+    uint64_t logical_tiles = 0, logical_bytes = 0;
+    std::cout << std::left << std::setw(40) << "array/attribute" << std::right << std::setw(10) << "tiles"
+              << std::setw(10) << "unique" << std::setw(16) << "bytes" << std::setw(8) << "ratio" << "  stored" << std::endl;
+    for (auto& array_path : array_paths) {
+      ImageDSArray array;
+      if (imageds.array_info(array_path, array)) {
+        std::cerr << "Skipping " << array_path << ", could not get array info" << std::endl;
+        continue;
+      }
+      ImageDSTileLayout layout(array.m_dimensions);
+      for (auto& attribute : array.m_attributes) {
+        std::vector<std::string> keys;
+        bool deduped;
+        if (imageds.tile_keys(array_path, attribute->m_name, keys, deduped)) {
+          std::cerr << "Skipping " << array_path << "/" << attribute->m_name << ", could not get tile keys" << std::endl;
+          continue;
+        }
+        size_t cell_size = attr_type_size(attribute->m_type);
+        std::unordered_set<std::string> array_unique;
+        uint64_t array_bytes = 0;
+        for (auto i=0ul; i<keys.size(); i++) {
+          uint64_t tile_bytes = ImageDSTileLayout::cell_num(layout.tile_subarray(i))*cell_size;
+          array_unique.insert(keys[i]);
+          unique_tiles[keys[i]] = tile_bytes;
+          array_bytes += tile_bytes;
+        }
+        logical_tiles += keys.size();
+        logical_bytes += array_bytes;
+        std::cout << std::left << std::setw(40) << (array_path + "/" + attribute->m_name) << std::right
+                  << std::setw(10) << keys.size() << std::setw(10) << array_unique.size()
+                  << std::setw(16) << array_bytes << std::setw(8) << std::fixed << std::setprecision(2)
+                  << ratio(keys.size(), array_unique.size()) << "  " << (deduped ? "tile store" : "tiledb")
+                  << std::endl;
+      }
+    }
+
+    uint64_t unique_bytes = 0;
+    for (auto& tile : unique_tiles) {
+      unique_bytes += tile.second;
+    }
+    uint64_t store_tiles = 0, store_bytes = 0;
+    if (imageds.tile_store_size(store_tiles, store_bytes)) {
+      std::cerr << "Could not get tile store size: " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    std::cout << std::endl
+              << "Arrays                : " << array_paths.size() << std::endl
+              << "Logical tiles         : " << logical_tiles << " (" << logical_bytes << " bytes)" << std::endl
+              << "Unique tiles          : " << unique_tiles.size() << " (" << unique_bytes << " bytes)" << std::endl
+              << "Dedup ratio (tiles)   : " << std::fixed << std::setprecision(2) << ratio(logical_tiles, unique_tiles.size()) << std::endl
+              << "Dedup ratio (bytes)   : " << ratio(logical_bytes, unique_bytes) << std::endl
+              << "Tile store            : " << store_tiles << " tiles (" << store_bytes << " bytes on disk)" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << argv[1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file imageds_dicom_ingest.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Ingests all DICOM series found in a directory into an ImageDS workspace
+ */
+
+#include "dicom.h"
+#include "imageds.h"
+
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <dicom_dir> <workspace>" << std::endl
+            << "Ingests every DICOM series in dicom_dir into a 3D array named <array_prefix>/<series_uid>." << std::endl
+            << "Options:" << std::endl
+            << "  -p, --array-prefix <prefix>  Prefix of the array paths, default dicom" << std::endl
+            << "  -s, --slab-slices <n>        Slices decoded and written per slab and Z tile extent, default 16" << std::endl
+            << "  -t, --tile-extent <n>        Y and X tile extents, default 256" << std::endl
+            << "  -c, --compression <n>        compression_t of the intensity attribute, default 0 (none)" << std::endl
+            << "  -l, --compression-level <n>  Compression level, default 0" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"array-prefix", required_argument, 0, 'p'},
+    {"slab-slices", required_argument, 0, 's'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"compression", required_argument, 0, 'c'},
+    {"compression-level", required_argument, 0, 'l'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  std::string array_prefix = "dicom";
+  uint64_t slab_slices = 16;
+  uint64_t tile_extent = 256;
+  int compression = NONE;
+  int compression_level = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "p:s:t:c:l:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'p':
+        array_prefix = optarg;
+        break;
+      case 's':
+        slab_slices = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        compression = atoi(optarg);
+        break;
+      case 'l':
+        compression_level = atoi(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2 || compression < NONE || compression > BLOSC_RLE) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<ImageDSDicomSeries> series;
+  auto start = std::chrono::steady_clock::now();
+  if (imageds_dicom_scan(argv[optind], series)) {
+    std::cerr << "Could not scan " << argv[optind] << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+  std::cout << "Found " << series.size() << " series in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+
+  int rc = 0;
+  try {
+    ImageDS imageds(argv[optind+1], false, false, true);
+    for (auto& found : series) {
+      std::string array_path = array_prefix + "/" + found.m_series_uid;
+      start = std::chrono::steady_clock::now();
+      if (imageds_dicom_ingest(imageds, found, array_path, slab_slices, tile_extent,
+                               static_cast<compression_t>(compression), compression_level)) {
+        std::cerr << "Could not ingest series " << found.m_series_uid << ": " << strerror(errno) << std::endl;
+        rc = 1;
+        continue;
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      uint64_t bytes = found.m_slices.size()*found.m_slices[0].m_pixel_length;
+      std::cout << array_path << ": " << found.m_slices.size() << " slices, " << bytes << " bytes in " << seconds
+                << "s (" << bytes/seconds/(1024*1024) << " MB/s)" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << argv[optind+1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return rc;
+}
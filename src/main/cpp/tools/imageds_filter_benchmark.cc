@@ -0,0 +1,208 @@
+/**
+ * @file imageds_filter_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Gaussian smoothing of a volume tile by tile with the filter engine and by hand from a full read
+ */
+
+
+#include "imageds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace>" << std::endl
+            << "Writes a deduped ZYX volume and smooths it with a gaussian into new arrays, tile by tile with" << std::endl
+            << "ImageDS::filter and by hand from the whole volume read into memory and written back, and reports" << std::endl
+            << "the throughput of both and the largest difference between their results" << std::endl
+            << "Options:" << std::endl
+            << "  -n, --extent <n>             Extent of the volume along Y and X, default 512" << std::endl
+            << "  -z, --depth <n>              Extent of the volume along Z, default 256" << std::endl
+            << "  -t, --tile-extent <n>        Tile extent along every dimension, default 64" << std::endl
+            << "  -s, --sigma <sigma>          Standard deviation of the gaussian in cells, default 2" << std::endl;
+}
+
+static int generate(ImageDS& imageds, const std::string& array_path, uint64_t depth, uint64_t extent,
+                    uint64_t tile_extent) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Z", 0, depth-1, tile_extent);
+  array.add_dimension("Y", 0, extent-1, tile_extent);
+  array.add_dimension("X", 0, extent-1, tile_extent);
+  array.add_attribute("Intensity", UINT16, GZIP, 1);
+  std::vector<uint16_t> values(depth*extent*extent);
+  std::mt19937 random(0);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i/(extent*extent) + (i/extent)%extent + i%extent + random()%16;
+  }
+  imageds.enable_tile_dedup();
+  return imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)});
+}
+
+// Separable correlation of the whole volume along dimension d, with taps past the edges repeating the edge cells
+static void smooth(const std::vector<float>& in, std::vector<float>& out, const uint64_t extents[3], size_t d,
+                   const std::vector<double>& kernel) {
+  int64_t radius = kernel.size()/2;
+  int64_t length = extents[d];
+  uint64_t inner = 1;
+  for (auto i=d+1; i<3; i++) {
+    inner *= extents[i];
+  }
+  uint64_t outer = in.size()/(length*inner);
+  for (auto o=0ul; o<outer; o++) {
+    for (int64_t x=0; x<length; x++) {
+      float *dst = out.data() + (o*length + x)*inner;
+      std::fill_n(dst, inner, 0.0f);
+      for (int64_t k=0; k<=radius*2; k++) {
+        const float *src = in.data() + (o*length + std::min(std::max(x+k-radius, int64_t(0)), length-1))*inner;
+        float weight = kernel[k];
+        for (auto i=0ul; i<inner; i++) {
+          dst[i] += weight*src[i];
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"extent", required_argument, 0, 'n'},
+    {"depth", required_argument, 0, 'z'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"sigma", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  uint64_t extent = 512;
+  uint64_t depth = 256;
+  uint64_t tile_extent = 64;
+  double sigma = 2;
+  int c;
+  while ((c = getopt_long(argc, argv, "n:z:t:s:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'n':
+        extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'z':
+        depth = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        sigma = atof(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 1 || !tile_extent || tile_extent+1 >= extent || tile_extent+1 >= depth || !(sigma > 0)) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string workspace = argv[optind];
+  std::string array_path = "filter_benchmark";
+  std::string filtered_path = "filter_benchmark_filtered";
+  std::string by_hand_path = "filter_benchmark_by_hand";
+
+  try {
+    ImageDS imageds(workspace, true, false, true);
+    if (generate(imageds, array_path, depth, extent, tile_extent)) {
+      std::cerr << "Could not write " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    ImageDSArray array(array_path);
+    ImageDSFilter filter = ImageDSFilter::gaussian(3, sigma);
+    double megavoxels = depth*extent*extent/1e6;
+
+    imageds.reset_stats();
+    auto start = std::chrono::steady_clock::now();
+    if (imageds.filter(array, filtered_path, filter)) {
+      std::cerr << "Could not filter " << array_path << " into " << filtered_path << ": " << strerror(errno)
+                << std::endl;
+      return 1;
+    }
+    double filter_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ImageDSArrayStats stats = imageds.stats().total();
+    std::cout << "ImageDS::filter: " << filter_seconds << "s " << megavoxels/filter_seconds << " Mvoxels/s, "
+              << stats.m_tiles_touched << " tiles read, "
+              << stats.m_bytes_written/(1024*1024.0) << " MB written" << std::endl;
+
+    // The whole volume is held in memory, twice in single precision while it is smoothed
+    start = std::chrono::steady_clock::now();
+    std::vector<uint16_t> values(depth*extent*extent);
+    if (imageds.from_array(array, {values.data()}, {values.size()*sizeof(uint16_t)})) {
+      std::cerr << "Could not read " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    uint64_t extents[] = {depth, extent, extent};
+    std::vector<float> cells(values.begin(), values.end()), smoothed(cells.size());
+    for (auto d=0ul; d<3; d++) {
+      smooth(cells, smoothed, extents, d, filter.m_kernels[d]);
+      cells.swap(smoothed);
+    }
+    ImageDSArray by_hand(by_hand_path);
+    by_hand.add_dimension("Z", 0, depth-1, tile_extent);
+    by_hand.add_dimension("Y", 0, extent-1, tile_extent);
+    by_hand.add_dimension("X", 0, extent-1, tile_extent);
+    by_hand.add_attribute("Intensity", FLOAT32, GZIP, 1);
+    imageds.enable_tile_dedup(false);
+    if (imageds.to_array(by_hand, {cells.data()}, {cells.size()*sizeof(float)})) {
+      std::cerr << "Could not write " << by_hand_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    double by_hand_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "By hand: " << by_hand_seconds << "s " << megavoxels/by_hand_seconds << " Mvoxels/s, "
+              << cells.size()*sizeof(float)*2/(1024*1024.0) << " MB held" << std::endl;
+
+    std::vector<float> filtered(cells.size());
+    ImageDSArray filtered_array(filtered_path);
+    if (imageds.from_array(filtered_array, {filtered.data()}, {filtered.size()*sizeof(float)})) {
+      std::cerr << "Could not read " << filtered_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    float difference = 0;
+    for (auto i=0ul; i<cells.size(); i++) {
+      difference = std::max(difference, std::abs(filtered[i] - cells[i]));
+    }
+    std::cout << "Largest difference " << difference << ", speedup " << by_hand_seconds/filter_seconds << "x"
+              << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
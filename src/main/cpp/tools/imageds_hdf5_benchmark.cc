@@ -0,0 +1,237 @@
+/**
+ * @file imageds_hdf5_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Compares read throughput of the same volume stored as an HDF5 dataset and as an ImageDS array
+ */
+
+
+#include "hdf5_bridge.h"
+#include "tile_layout.h"
+
+#include <chrono>
+#include <getopt.h>
+#include <hdf5.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace> <hdf5_file> <dataset>" << std::endl
+            << "Imports the HDF5 dataset into the workspace and times full and random ROI reads from both" << std::endl
+            << "Options:" << std::endl
+            << "  -g, --generate <n>           Create a deflated n^3 uint16 dataset in hdf5_file first" << std::endl
+            << "  -c, --chunk <n>              Chunk extent of the generated dataset, default 64" << std::endl
+            << "  -r, --rois <n>               Random ROIs read, default 100" << std::endl
+            << "  -e, --roi-extent <n>         Extent of the ROIs along every dimension, default 32" << std::endl;
+}
+
+static int generate(const std::string& filename, const std::string& dataset, hsize_t extent, hsize_t chunk_extent) {
+  hsize_t dims[] = { extent, extent, extent };
+  hsize_t chunk[] = { std::min(chunk_extent, extent), std::min(chunk_extent, extent), std::min(chunk_extent, extent) };
+  hid_t file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  hid_t space = H5Screate_simple(3, dims, NULL);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, 3, chunk);
+  H5Pset_shuffle(dcpl);
+  H5Pset_deflate(dcpl, 4);
+  hid_t dset = H5Dcreate2(file, dataset.c_str(), H5T_NATIVE_UINT16, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  // Smooth gradient with some noise, so that chunks compress like images rather than like constants
+  std::vector<uint16_t> slice(extent*extent);
+  std::mt19937 random(0);
+  hsize_t start[] = { 0, 0, 0 }, count[] = { 1, extent, extent };
+  hid_t memory_space = H5Screate_simple(3, count, NULL);
+  herr_t status = dset < 0 ? -1 : 0;
+  for (hsize_t z=0; z<extent && status >= 0; z++) {
+    for (hsize_t i=0; i<slice.size(); i++) {
+      slice[i] = z + i/extent + i%extent + random()%16;
+    }
+    start[0] = z;
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, start, NULL, count, NULL);
+    status = H5Dwrite(dset, H5T_NATIVE_UINT16, memory_space, space, H5P_DEFAULT, slice.data());
+  }
+  H5Sclose(memory_space);
+  H5Dclose(dset);
+  H5Pclose(dcpl);
+  H5Sclose(space);
+  H5Fclose(file);
+  return status < 0 ? IMAGEDS_ERR : IMAGEDS_OK;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const std::string& label, size_t bytes, double seconds) {
+  std::cout << label << ": " << seconds << "s " << bytes/seconds/(1024*1024) << " MB/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"generate", required_argument, 0, 'g'},
+    {"chunk", required_argument, 0, 'c'},
+    {"rois", required_argument, 0, 'r'},
+    {"roi-extent", required_argument, 0, 'e'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  uint64_t generate_extent = 0;
+  uint64_t chunk_extent = 64;
+  int roi_num = 100;
+  uint64_t roi_extent = 32;
+  int c;
+  while ((c = getopt_long(argc, argv, "g:c:r:e:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'g':
+        generate_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        chunk_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        roi_num = atoi(optarg);
+        break;
+      case 'e':
+        roi_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 3 || !chunk_extent || !roi_extent) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string filename = argv[optind+1];
+  std::string dataset = argv[optind+2];
+  std::string array_path = "hdf5_benchmark";
+
+  if (generate_extent && generate(filename, dataset, generate_extent, chunk_extent)) {
+    std::cerr << "Could not generate " << dataset << " in " << filename << std::endl;
+    return 1;
+  }
+
+  try {
+    ImageDS imageds(argv[optind], true, false, true);
+    auto start = std::chrono::steady_clock::now();
+    if (imageds_hdf5_import(imageds, filename, dataset, array_path)) {
+      std::cerr << "Could not import " << dataset << " from " << filename << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    std::cout << "Import: " << seconds_since(start) << "s" << std::endl;
+
+    ImageDSArray schema;
+    if (imageds.array_info(array_path, schema)) {
+      std::cerr << "Could not get the schema of " << array_path << std::endl;
+      return 1;
+    }
+    int rank = schema.m_dimensions.size();
+    attr_type_t type = schema.m_attributes[0]->m_type;
+    size_t cell_size = attr_type_size(type);
+    std::vector<hsize_t> dims;
+    size_t cell_num = 1;
+    for (auto& dimension : schema.m_dimensions) {
+      dims.push_back(dimension->m_end - dimension->m_start + 1);
+      cell_num *= dims.back();
+    }
+    std::vector<char> buffer(cell_num*cell_size);
+    ImageDSArray array(array_path);
+    array.add_attribute(schema.m_attributes[0]->m_name, type);
+
+    hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dset = H5Dopen2(file, dataset.c_str(), H5P_DEFAULT);
+    hid_t file_type = H5Dget_type(dset);
+    hid_t memory_type = H5Tget_native_type(file_type, H5T_DIR_DEFAULT);
+    start = std::chrono::steady_clock::now();
+    if (H5Dread(dset, memory_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer.data()) < 0) {
+      std::cerr << "Could not read " << dataset << std::endl;
+      return 1;
+    }
+    report("HDF5 full read", buffer.size(), seconds_since(start));
+    start = std::chrono::steady_clock::now();
+    if (imageds.from_array(array, {buffer.data()}, {buffer.size()})) {
+      std::cerr << "Could not read " << array_path << std::endl;
+      return 1;
+    }
+    report("ImageDS full read", buffer.size(), seconds_since(start));
+
+    // Same ROIs for both, clamped to the volume
+    std::mt19937 random(0);
+    std::vector<std::vector<uint64_t>> rois(roi_num);
+    size_t roi_bytes = 0;
+    for (auto& roi : rois) {
+      size_t roi_cells = 1;
+      for (auto i=0; i<rank; i++) {
+        uint64_t extent = std::min<uint64_t>(roi_extent, dims[i]);
+        uint64_t low = random()%(dims[i]-extent+1);
+        roi.push_back(low);
+        roi.push_back(low+extent-1);
+        roi_cells *= extent;
+      }
+      roi_bytes += roi_cells*cell_size;
+    }
+    hid_t file_space = H5Dget_space(dset);
+    start = std::chrono::steady_clock::now();
+    for (auto& roi : rois) {
+      std::vector<hsize_t> offset, count;
+      for (auto i=0; i<rank; i++) {
+        offset.push_back(roi[i*2]);
+        count.push_back(roi[i*2+1]-roi[i*2]+1);
+      }
+      hid_t memory_space = H5Screate_simple(rank, count.data(), NULL);
+      H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(), NULL, count.data(), NULL);
+      H5Dread(dset, memory_type, memory_space, file_space, H5P_DEFAULT, buffer.data());
+      H5Sclose(memory_space);
+    }
+    report("HDF5 ROI reads", roi_bytes, seconds_since(start));
+    start = std::chrono::steady_clock::now();
+    for (auto& roi : rois) {
+      size_t roi_size = cell_size;
+      for (auto i=0; i<rank; i++) {
+        roi_size *= roi[i*2+1]-roi[i*2]+1;
+      }
+      if (imageds.from_array(array, roi, {buffer.data()}, {roi_size})) {
+        std::cerr << "Could not read a ROI of " << array_path << std::endl;
+        return 1;
+      }
+    }
+    report("ImageDS ROI reads", roi_bytes, seconds_since(start));
+    H5Sclose(file_space);
+    H5Tclose(memory_type);
+    H5Tclose(file_type);
+    H5Dclose(dset);
+    H5Fclose(file);
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << argv[optind] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file imageds_io_uring_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Cold cache random region reads of a deduped array with and without the io_uring backend
+ */
+
+
+#include "imageds.h"
+
+#include <chrono>
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace>" << std::endl
+            << "Writes a deduped 3D array and reads random regions with the tile cache disabled and the tile store" << std::endl
+            << "evicted from the page cache before every read, with and without the io_uring backend" << std::endl
+            << "Options:" << std::endl
+            << "  -r, --reads <n>              Regions read per backend, default 50" << std::endl
+            << "  -n, --extent <n>             Extent of the array along every dimension, default 256" << std::endl
+            << "  -e, --roi-extent <n>         Extent of the regions read along every dimension, default 96" << std::endl
+            << "  -t, --tile-extent <n>        Tile extent along every dimension, default 32" << std::endl;
+}
+
+static int generate(ImageDS& imageds, const std::string& array_path, uint64_t extent, uint64_t tile_extent) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Z", 0, extent-1, tile_extent);
+  array.add_dimension("Y", 0, extent-1, tile_extent);
+  array.add_dimension("X", 0, extent-1, tile_extent);
+  array.add_attribute("Intensity", UINT16, GZIP, 6);
+  // Gradient with noise, so that tiles are distinct and compress like images
+  std::vector<uint16_t> values(extent*extent*extent);
+  std::mt19937 random(0);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i/(extent*extent) + (i/extent)%extent + i%extent + random()%16;
+  }
+  imageds.enable_tile_dedup();
+  return imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)});
+}
+
+// Drops the files under path from the page cache, so that reads go to the device
+static void evict(const std::string& path) {
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+    return;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+      evict(append_paths(path, entry->d_name));
+    }
+  }
+  closedir(dir);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"reads", required_argument, 0, 'r'},
+    {"extent", required_argument, 0, 'n'},
+    {"roi-extent", required_argument, 0, 'e'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int read_num = 50;
+  uint64_t extent = 256;
+  uint64_t roi_extent = 96;
+  uint64_t tile_extent = 32;
+  int c;
+  while ((c = getopt_long(argc, argv, "r:n:e:t:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'r':
+        read_num = atoi(optarg);
+        break;
+      case 'n':
+        extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'e':
+        roi_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 1 || read_num <= 0 || !extent || !roi_extent || roi_extent > extent || !tile_extent
+      || tile_extent > extent) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string workspace = argv[optind];
+  std::string array_path = "io_uring_benchmark";
+
+  try {
+    ImageDS imageds(workspace, true, false, true);
+    if (generate(imageds, array_path, extent, tile_extent)) {
+      std::cerr << "Could not write " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    // Both backends read the same regions
+    std::vector<std::vector<uint64_t>> rois;
+    std::mt19937 random(0);
+    for (int i=0; i<read_num; i++) {
+      std::vector<uint64_t> roi;
+      for (int d=0; d<3; d++) {
+        uint64_t low = random()%(extent-roi_extent+1);
+        roi.push_back(low);
+        roi.push_back(low+roi_extent-1);
+      }
+      rois.push_back(roi);
+    }
+
+    if (!ImageDS::io_uring_available()) {
+      std::cout << "io_uring is not available, reads fall back to the default backend" << std::endl;
+    }
+    size_t roi_bytes = roi_extent*roi_extent*roi_extent*sizeof(uint16_t);
+    std::vector<char> buffer(roi_bytes);
+    imageds.set_tile_cache_capacity(0);
+    ImageDSArray array(array_path);
+    for (auto io_uring : {false, true}) {
+      imageds.enable_io_uring(io_uring);
+      imageds.reset_stats();
+      double seconds = 0;
+      for (auto& roi : rois) {
+        evict(workspace);
+        auto start = std::chrono::steady_clock::now();
+        if (imageds.from_array(array, roi, {buffer.data()}, {roi_bytes})) {
+          std::cerr << "Could not read " << array_path << ": " << strerror(errno) << std::endl;
+          return 1;
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+      ImageDSArrayStats stats = imageds.stats().total();
+      std::cout << (io_uring ? "io_uring" : "Default") << ": " << seconds << "s "
+                << read_num/seconds << " reads/s "
+                << roi_bytes*read_num/seconds/(1024*1024) << " MB/s, "
+                << stats.m_tiles_touched << " tiles read, "
+                << stats.m_bytes_read/(1024*1024.0) << " MB from the tile store, "
+                << "p99 " << stats.m_from_array_latency.percentile(0.99) << "us" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file imageds_nifti_import.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Imports NIfTI files into an ImageDS workspace in parallel
+ */
+
+#include "nifti.h"
+
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace> <nifti_file>..." << std::endl
+            << "Imports .nii and .nii.gz files in parallel into arrays named <array_prefix>/<file name without extension>." << std::endl
+            << "Options:" << std::endl
+            << "  -p, --array-prefix <prefix>  Prefix of the array paths, default nifti" << std::endl
+            << "  -t, --tile-extent <n>        Tile extent of all dimensions and slab extent for .nii.gz files, default 64" << std::endl
+            << "  -c, --compression <n>        compression_t of the intensity attribute, default 0 (none)" << std::endl
+            << "  -l, --compression-level <n>  Compression level, default 0" << std::endl;
+}
+
+static std::string array_name(const std::string& filename) {
+  std::string name = pathname(filename);
+  for (auto extension : {".gz", ".nii"}) {
+    size_t length = strlen(extension);
+    if (name.size() > length && name.compare(name.size()-length, length, extension) == 0) {
+      name = name.substr(0, name.size()-length);
+    }
+  }
+  return name;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"array-prefix", required_argument, 0, 'p'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"compression", required_argument, 0, 'c'},
+    {"compression-level", required_argument, 0, 'l'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  std::string array_prefix = "nifti";
+  uint64_t tile_extent = 64;
+  int compression = NONE;
+  int compression_level = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "p:t:c:l:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'p':
+        array_prefix = optarg;
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        compression = atoi(optarg);
+        break;
+      case 'l':
+        compression_level = atoi(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind < 2 || compression < NONE || compression > BLOSC_RLE) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string workspace = argv[optind];
+  std::vector<std::string> filenames, array_paths;
+  for (auto i=optind+1; i<argc; i++) {
+    filenames.push_back(argv[i]);
+    array_paths.push_back(array_prefix + "/" + array_name(argv[i]));
+  }
+
+  try {
+    // Creates the workspace if necessary before the import threads open it
+    ImageDS imageds(workspace, false, false, true);
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> errnos;
+  int rc = imageds_nifti_import_batch(workspace, filenames, array_paths, errnos, tile_extent,
+                                      static_cast<compression_t>(compression), compression_level);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t imported = 0;
+  for (auto i=0ul; i<filenames.size(); i++) {
+    if (errnos[i]) {
+      std::cerr << "Could not import " << filenames[i] << ": " << strerror(errnos[i]) << std::endl;
+    } else {
+      std::cout << filenames[i] << " -> " << array_paths[i] << std::endl;
+      imported++;
+    }
+  }
+  std::cout << "Imported " << imported << " of " << filenames.size() << " files in " << seconds << "s" << std::endl;
+  return rc ? 1 : 0;
+}
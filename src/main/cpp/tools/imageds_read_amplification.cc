@@ -0,0 +1,195 @@
+/**
+ * @file imageds_read_amplification.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Replays a log of subarray queries against an array and reports the queries with the worst read amplification
+ */
+
+
+#include "imageds.h"
+#include "tile_layout.h"
+
+#include <algorithm>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace> <array_path> <query_log>" << std::endl
+            << "Replays the queries of query_log, one subarray per line given as low and high bounds per dimension,"
+            << std::endl
+            << "e.g. \"0 9 100 163 100 163\", and prints the queries decompressing the most bytes per byte returned"
+            << std::endl
+            << "Options:" << std::endl
+            << "  -n, --worst <n>              Queries reported, default 10" << std::endl
+            << "  -a, --attribute <name>       Attribute read, default all attributes" << std::endl;
+}
+
+static bool parse_query(const std::string& line, size_t dim_num, std::vector<uint64_t>& subarray) {
+  std::string bounds(line);
+  std::replace(bounds.begin(), bounds.end(), ',', ' ');
+  std::istringstream in(bounds);
+  uint64_t bound;
+  subarray.clear();
+  while (in >> bound) {
+    subarray.push_back(bound);
+  }
+  return in.eof() && subarray.size() == dim_num*2;
+}
+
+static std::string format_subarray(const std::vector<uint64_t>& subarray) {
+  std::ostringstream out;
+  for (auto i=0ul; i<subarray.size(); i+=2) {
+    out << (i ? ", " : "") << "[" << subarray[i] << ", " << subarray[i+1] << "]";
+  }
+  return out.str();
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"worst", required_argument, 0, 'n'},
+    {"attribute", required_argument, 0, 'a'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  size_t worst_num = 10;
+  std::string attribute;
+  int c;
+  while ((c = getopt_long(argc, argv, "n:a:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'n':
+        worst_num = strtoull(optarg, NULL, 10);
+        break;
+      case 'a':
+        attribute = optarg;
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string array_path = argv[optind+1];
+  std::ifstream query_log(argv[optind+2]);
+  if (!query_log) {
+    std::cerr << "Could not open query log " << argv[optind+2] << std::endl;
+    return 1;
+  }
+
+  try {
+    ImageDS imageds(argv[optind], false, false, true);
+    ImageDSArray schema;
+    if (imageds.array_info(array_path, schema)) {
+      std::cerr << "Could not get the schema of " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    ImageDSArray array(array_path);
+    std::vector<size_t> cell_sizes;
+    for (auto& schema_attribute : schema.m_attributes) {
+      if (attribute.empty() || schema_attribute->m_name == attribute) {
+        array.add_attribute(schema_attribute->m_name, schema_attribute->m_type);
+        cell_sizes.push_back(attr_type_size(schema_attribute->m_type));
+      }
+    }
+    if (cell_sizes.empty()) {
+      std::cerr << "No attribute " << attribute << " in " << array_path << std::endl;
+      return 1;
+    }
+
+    std::vector<ImageDSQueryProfile> profiles;
+    imageds.set_query_profiler([&profiles](const ImageDSQueryProfile& profile) {
+        profiles.push_back(profile);
+      });
+    std::string line;
+    std::vector<uint64_t> subarray;
+    std::vector<std::vector<char>> buffers(cell_sizes.size());
+    for (auto line_num=1; std::getline(query_log, line); line_num++) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#') {
+        continue;
+      }
+      if (!parse_query(line, schema.m_dimensions.size(), subarray)) {
+        std::cerr << "Skipping line " << line_num << ", expected " << schema.m_dimensions.size()*2 << " bounds"
+                  << std::endl;
+        continue;
+      }
+      std::vector<void *> query_buffers;
+      std::vector<size_t> query_buffer_sizes;
+      for (auto i=0ul; i<cell_sizes.size(); i++) {
+        buffers[i].resize(ImageDSTileLayout::cell_num(subarray)*cell_sizes[i]);
+        query_buffers.push_back(buffers[i].data());
+        query_buffer_sizes.push_back(buffers[i].size());
+      }
+      if (imageds.from_array(array, subarray, query_buffers, query_buffer_sizes)) {
+        std::cerr << "Query on line " << line_num << " failed: " << strerror(errno) << std::endl;
+      }
+    }
+    if (profiles.empty()) {
+      std::cerr << "No queries replayed" << std::endl;
+      return 1;
+    }
+
+    uint64_t bytes_returned = 0, bytes_decompressed = 0;
+    for (auto& profile : profiles) {
+      bytes_returned += profile.m_bytes_returned;
+      bytes_decompressed += profile.m_bytes_decompressed;
+    }
+    std::cout << array_path << ": " << profiles.size() << " queries, tile extents";
+    for (auto& dimension : schema.m_dimensions) {
+      std::cout << " " << dimension->m_name << "=" << dimension->m_tile_extent;
+    }
+    std::cout << std::endl << "Returned " << bytes_returned << " bytes, decompressed " << bytes_decompressed
+              << " bytes, amplification " << std::fixed << std::setprecision(2)
+              << (bytes_returned ? static_cast<double>(bytes_decompressed)/bytes_returned : 0) << std::endl;
+
+    std::stable_sort(profiles.begin(), profiles.end(), [](const ImageDSQueryProfile& a, const ImageDSQueryProfile& b) {
+        return a.amplification() > b.amplification();
+      });
+    std::cout << std::endl << std::setw(14) << "Amplification" << std::setw(8) << "Tiles" << std::setw(11) << "Fragments"
+              << std::setw(14) << "Returned" << std::setw(14) << "Decompressed" << std::setw(12) << "Latency(us)"
+              << "  Subarray" << std::endl;
+    for (auto i=0ul; i<std::min(worst_num, profiles.size()); i++) {
+      const ImageDSQueryProfile& profile = profiles[i];
+      std::cout << std::setw(14) << profile.amplification() << std::setw(8) << profile.m_tiles_touched
+                << std::setw(11) << profile.m_fragments_scanned << std::setw(14) << profile.m_bytes_returned
+                << std::setw(14) << profile.m_bytes_decompressed << std::setw(12) << profile.m_latency_us
+                << "  " << format_subarray(profile.m_subarray) << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << argv[optind] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
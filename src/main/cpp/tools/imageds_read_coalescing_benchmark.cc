@@ -0,0 +1,193 @@
+/**
+ * @file imageds_read_coalescing_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Load test of concurrent readers of the same region with and without read coalescing
+ */
+
+
+#include "imageds.h"
+
+#include <atomic>
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+#include <thread>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace>" << std::endl
+            << "Writes a deduped 2D array and has concurrent readers, each with its own instance, read the same" << std::endl
+            << "region with read coalescing disabled and enabled" << std::endl
+            << "Options:" << std::endl
+            << "  -t, --threads <n>            Concurrent readers, default 8" << std::endl
+            << "  -r, --reads <n>              Reads per reader, default 20" << std::endl
+            << "  -n, --extent <n>             Extent of the array along both dimensions, default 2048" << std::endl
+            << "  -e, --roi-extent <n>         Extent of the region read along both dimensions, default 1024" << std::endl
+            << "  -c, --cache <bytes>          Tile cache capacity of every reader, default 0" << std::endl;
+}
+
+static int generate(ImageDS& imageds, const std::string& array_path, uint64_t extent) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Y", 0, extent-1, 256);
+  array.add_dimension("X", 0, extent-1, 256);
+  array.add_attribute("Intensity", UINT16, GZIP, 6);
+  // Gradient with noise, so that tiles are distinct and compress like images
+  std::vector<uint16_t> values(extent*extent);
+  std::mt19937 random(0);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i/extent + i%extent + random()%16;
+  }
+  imageds.enable_tile_dedup();
+  return imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)});
+}
+
+// Runs the readers and returns the summed statistics of their instances
+static int run_readers(const std::string& workspace, const std::string& array_path, bool coalescing, int thread_num,
+                       int read_num, const std::vector<uint64_t>& roi, size_t cache_capacity,
+                       ImageDSArrayStats& total) {
+  std::atomic<int> ready(0);
+  std::atomic<int> status(IMAGEDS_OK);
+  std::vector<ImageDSArrayStats> thread_stats(thread_num);
+  std::vector<std::thread> threads;
+  size_t roi_size = (roi[1]-roi[0]+1)*(roi[3]-roi[2]+1)*sizeof(uint16_t);
+  for (int t=0; t<thread_num; t++) {
+    threads.push_back(std::thread([&, t]() {
+          std::vector<char> buffer(roi_size);
+          try {
+            ImageDS imageds(workspace, false, false, true);
+            imageds.enable_read_coalescing(coalescing);
+            imageds.set_tile_cache_capacity(cache_capacity);
+            ImageDSArray array(array_path);
+            // Start all readers together, so that their reads overlap
+            ready++;
+            while (ready < thread_num) {
+              std::this_thread::yield();
+            }
+            for (int i=0; i<read_num && !status; i++) {
+              if (imageds.from_array(array, roi, {buffer.data()}, {roi_size})) {
+                status = IMAGEDS_ERR;
+              }
+            }
+            thread_stats[t] = imageds.stats().total();
+          } catch (const std::exception& e) {
+            ready++;
+            status = IMAGEDS_ERR;
+          }
+        }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  total = ImageDSArrayStats();
+  for (auto& stats : thread_stats) {
+    total.merge(stats);
+  }
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"threads", required_argument, 0, 't'},
+    {"reads", required_argument, 0, 'r'},
+    {"extent", required_argument, 0, 'n'},
+    {"roi-extent", required_argument, 0, 'e'},
+    {"cache", required_argument, 0, 'c'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int thread_num = 8;
+  int read_num = 20;
+  uint64_t extent = 2048;
+  uint64_t roi_extent = 1024;
+  size_t cache_capacity = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "t:r:n:e:c:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 't':
+        thread_num = atoi(optarg);
+        break;
+      case 'r':
+        read_num = atoi(optarg);
+        break;
+      case 'n':
+        extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'e':
+        roi_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        cache_capacity = strtoull(optarg, NULL, 10);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 1 || thread_num <= 0 || read_num <= 0 || !extent || !roi_extent || roi_extent > extent) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string workspace = argv[optind];
+  std::string array_path = "coalescing_benchmark";
+
+  try {
+    ImageDS imageds(workspace, true, false, true);
+    if (generate(imageds, array_path, extent)) {
+      std::cerr << "Could not write " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  // Centered region, so that every reader decodes the same tiles
+  uint64_t low = (extent-roi_extent)/2;
+  std::vector<uint64_t> roi = { low, low+roi_extent-1, low, low+roi_extent-1 };
+  size_t roi_bytes = roi_extent*roi_extent*sizeof(uint16_t);
+  for (auto coalescing : {false, true}) {
+    ImageDSArrayStats total;
+    auto start = std::chrono::steady_clock::now();
+    if (run_readers(workspace, array_path, coalescing, thread_num, read_num, roi, cache_capacity, total)) {
+      std::cerr << "Could not read " << array_path << std::endl;
+      return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t decoded = total.m_tiles_touched - total.m_cache_hits - total.m_coalesced_reads;
+    std::cout << (coalescing ? "Coalescing enabled" : "Coalescing disabled") << ": " << seconds << "s "
+              << total.m_from_array_calls/seconds << " reads/s "
+              << roi_bytes*total.m_from_array_calls/seconds/(1024*1024) << " MB/s, "
+              << decoded << " tiles decoded, " << total.m_coalesced_reads << " coalesced, "
+              << "p99 " << total.m_from_array_latency.percentile(0.99) << "us" << std::endl;
+  }
+  return 0;
+}
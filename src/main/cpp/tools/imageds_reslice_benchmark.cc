@@ -0,0 +1,269 @@
+/**
+ * @file imageds_reslice_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Latency of axial, coronal, sagittal and oblique plane reads and projections of a volume
+ */
+
+
+#include "imageds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace>" << std::endl
+            << "Writes a deduped ZYX volume and reads random axial, coronal and sagittal planes with the tile cache" << std::endl
+            << "disabled, through reslice and through from_array of the plane. Exits with 2 if the p99 latency of" << std::endl
+            << "reslice misses the SLA for any plane. Oblique planes through the center are sampled as well, and the" << std::endl
+            << "axial MIP is projected natively and from a full read" << std::endl
+            << "Options:" << std::endl
+            << "  -r, --reads <n>              Planes read per orientation and method, default 20" << std::endl
+            << "  -n, --extent <n>             Extent of the volume along Y and X, default 512" << std::endl
+            << "  -z, --depth <n>              Extent of the volume along Z, default 1000" << std::endl
+            << "  -t, --tile-extent <n>        Tile extent along every dimension, default 64" << std::endl
+            << "  -l, --sla <ms>               p99 latency of plane reads, default 100" << std::endl
+            << "  -c, --cold                   Evict the workspace from the page cache before every read" << std::endl;
+}
+
+static int generate(ImageDS& imageds, const std::string& array_path, uint64_t depth, uint64_t extent,
+                    uint64_t tile_extent) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Z", 0, depth-1, tile_extent);
+  array.add_dimension("Y", 0, extent-1, tile_extent);
+  array.add_dimension("X", 0, extent-1, tile_extent);
+  array.add_attribute("Intensity", UINT16, GZIP, 1);
+  std::vector<uint16_t> values(depth*extent*extent);
+  std::mt19937 random(0);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i/(extent*extent) + (i/extent)%extent + i%extent + random()%16;
+  }
+  imageds.enable_tile_dedup();
+  return imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)});
+}
+
+// Drops the files under path from the page cache, so that reads go to the device
+static void evict(const std::string& path) {
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+    return;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+      evict(append_paths(path, entry->d_name));
+    }
+  }
+  closedir(dir);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"reads", required_argument, 0, 'r'},
+    {"extent", required_argument, 0, 'n'},
+    {"depth", required_argument, 0, 'z'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"sla", required_argument, 0, 'l'},
+    {"cold", no_argument, 0, 'c'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int read_num = 20;
+  uint64_t extent = 512;
+  uint64_t depth = 1000;
+  uint64_t tile_extent = 64;
+  double sla_ms = 100;
+  bool cold = false;
+  int c;
+  while ((c = getopt_long(argc, argv, "r:n:z:t:l:ch", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'r':
+        read_num = atoi(optarg);
+        break;
+      case 'n':
+        extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'z':
+        depth = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'l':
+        sla_ms = atof(optarg);
+        break;
+      case 'c':
+        cold = true;
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 1 || read_num <= 0 || !tile_extent || tile_extent+1 >= extent || tile_extent+1 >= depth
+      || sla_ms <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string workspace = argv[optind];
+  std::string array_path = "reslice_benchmark";
+
+  try {
+    ImageDS imageds(workspace, true, false, true);
+    if (generate(imageds, array_path, depth, extent, tile_extent)) {
+      std::cerr << "Could not write " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    ImageDSArray array(array_path);
+    imageds.set_tile_cache_capacity(0);
+    uint64_t extents[] = {depth, extent, extent};
+    const char *planes[] = {"Axial", "Coronal", "Sagittal"};
+    std::vector<char> buffer(std::max(extent, depth)*extent*sizeof(uint16_t));
+    bool sla_met = true;
+    for (auto axis=0ul; axis<3; axis++) {
+      // Both methods read the same planes
+      std::vector<uint64_t> indices;
+      std::mt19937 random(axis);
+      for (int i=0; i<read_num; i++) {
+        indices.push_back(random()%extents[axis]);
+      }
+      size_t plane_bytes = depth*extent*extent/extents[axis]*sizeof(uint16_t);
+      for (auto resliced : {false, true}) {
+        std::vector<double> latencies;
+        for (auto index : indices) {
+          if (cold) {
+            evict(workspace);
+          }
+          std::vector<uint64_t> plane = {0, depth-1, 0, extent-1, 0, extent-1};
+          plane[axis*2] = plane[axis*2+1] = index;
+          auto start = std::chrono::steady_clock::now();
+          if (resliced ? imageds.reslice(array, axis, index, {buffer.data()}, {plane_bytes})
+              : imageds.from_array(array, plane, {buffer.data()}, {plane_bytes})) {
+            std::cerr << "Could not read " << array_path << ": " << strerror(errno) << std::endl;
+            return 1;
+          }
+          latencies.push_back(std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        double p99 = latencies[std::min(latencies.size()-1, latencies.size()*99/100)];
+        std::cout << planes[axis] << " " << (resliced ? "reslice" : "from_array") << ": p50 "
+                  << latencies[latencies.size()/2] << "ms p99 " << p99 << "ms";
+        if (resliced) {
+          std::cout << (p99 <= sla_ms ? ", meets" : ", misses") << " the " << sla_ms << "ms SLA";
+          sla_met = sla_met && p99 <= sla_ms;
+        }
+        std::cout << std::endl;
+      }
+    }
+
+    // Planes tilted about random axes through the center, sampled at the cell spacing
+    std::vector<double> latencies;
+    std::mt19937 random(3);
+    std::normal_distribution<double> normal;
+    for (int i=0; i<read_num; i++) {
+      std::vector<double> row(3), column(3), axis(3);
+      for (auto d=0; d<3; d++) {
+        row[d] = normal(random);
+        axis[d] = normal(random);
+      }
+      // Column direction orthogonal to the row direction
+      for (auto d=0; d<3; d++) {
+        column[d] = row[(d+1)%3]*axis[(d+2)%3] - row[(d+2)%3]*axis[(d+1)%3];
+      }
+      std::vector<double> center = {depth/2.0, extent/2.0, extent/2.0};
+      double row_norm = std::sqrt(row[0]*row[0] + row[1]*row[1] + row[2]*row[2]);
+      double column_norm = std::sqrt(column[0]*column[0] + column[1]*column[1] + column[2]*column[2]);
+      std::vector<double> origin(3);
+      for (auto d=0; d<3; d++) {
+        origin[d] = center[d] - (row[d]/row_norm + column[d]/column_norm)*extent/2.0;
+      }
+      if (cold) {
+        evict(workspace);
+      }
+      auto start = std::chrono::steady_clock::now();
+      if (imageds.oblique_slice(array, ImageDSObliquePlane(origin, row, column, extent, extent), {buffer.data()},
+                                {extent*extent*sizeof(uint16_t)})) {
+        std::cerr << "Could not sample " << array_path << ": " << strerror(errno) << std::endl;
+        return 1;
+      }
+      latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Oblique: p50 " << latencies[latencies.size()/2] << "ms p99 "
+              << latencies[std::min(latencies.size()-1, latencies.size()*99/100)] << "ms, "
+              << 1000/latencies[latencies.size()/2] << " frames/s" << std::endl;
+
+    // MIP along Z, natively and from the whole volume read into memory
+    std::vector<uint16_t> mip(extent*extent);
+    auto start = std::chrono::steady_clock::now();
+    if (imageds.project(array, {}, 0, PROJECTION_MAX, {mip.data()}, {mip.size()*sizeof(uint16_t)})) {
+      std::cerr << "Could not project " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    double project_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    std::vector<uint16_t> volume(depth*extent*extent);
+    if (imageds.from_array(array, {volume.data()}, {volume.size()*sizeof(uint16_t)})) {
+      std::cerr << "Could not read " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    std::fill(mip.begin(), mip.end(), 0);
+    for (auto z=0ul; z<depth; z++) {
+      for (auto i=0ul; i<mip.size(); i++) {
+        mip[i] = std::max(mip[i], volume[z*mip.size()+i]);
+      }
+    }
+    double read_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Axial MIP: project " << project_ms << "ms, from_array and reduce " << read_ms << "ms" << std::endl;
+
+    if (!sla_met) {
+      return 2;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file imageds_scan_benchmark.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Latency of interactive region reads interleaved with full array scans, with and without scan mode
+ */
+
+
+#include "imageds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace>" << std::endl
+            << "Writes a small hot and a large cold deduped 3D array, then scans the cold array slab by slab" << std::endl
+            << "with random region reads of the hot array after every slab, with and without scan mode" << std::endl
+            << "Options:" << std::endl
+            << "  -s, --scans <n>              Full scans of the cold array per setting, default 2" << std::endl
+            << "  -r, --reads <n>              Region reads of the hot array after every slab, default 4" << std::endl
+            << "  -n, --extent <n>             Extent of the cold array along every dimension, default 256" << std::endl
+            << "  -m, --hot-extent <n>         Extent of the hot array along every dimension, default 128" << std::endl
+            << "  -e, --roi-extent <n>         Extent of the regions read along every dimension, default 32" << std::endl
+            << "  -t, --tile-extent <n>        Tile extent along every dimension, default 32" << std::endl
+            << "  -c, --cache <MB>             Tile cache capacity, default 16" << std::endl;
+}
+
+static int generate(ImageDS& imageds, const std::string& array_path, uint64_t extent, uint64_t tile_extent) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Z", 0, extent-1, tile_extent);
+  array.add_dimension("Y", 0, extent-1, tile_extent);
+  array.add_dimension("X", 0, extent-1, tile_extent);
+  array.add_attribute("Intensity", UINT16, GZIP, 1);
+  std::vector<uint16_t> values(extent*extent*extent);
+  std::mt19937 random(0);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i/(extent*extent) + (i/extent)%extent + i%extent + random()%16;
+  }
+  return imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)});
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"scans", required_argument, 0, 's'},
+    {"reads", required_argument, 0, 'r'},
+    {"extent", required_argument, 0, 'n'},
+    {"hot-extent", required_argument, 0, 'm'},
+    {"roi-extent", required_argument, 0, 'e'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"cache", required_argument, 0, 'c'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int scan_num = 2;
+  int read_num = 4;
+  uint64_t extent = 256;
+  uint64_t hot_extent = 128;
+  uint64_t roi_extent = 32;
+  uint64_t tile_extent = 32;
+  size_t cache_mb = 16;
+  int c;
+  while ((c = getopt_long(argc, argv, "s:r:n:m:e:t:c:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 's':
+        scan_num = atoi(optarg);
+        break;
+      case 'r':
+        read_num = atoi(optarg);
+        break;
+      case 'n':
+        extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'm':
+        hot_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'e':
+        roi_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        cache_mb = strtoull(optarg, NULL, 10);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 1 || scan_num <= 0 || read_num <= 0 || !extent || !hot_extent || !roi_extent
+      || roi_extent > hot_extent || !tile_extent || tile_extent > extent || tile_extent > hot_extent) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string workspace = argv[optind];
+  std::string hot_path = "scan_benchmark_hot";
+  std::string cold_path = "scan_benchmark_cold";
+
+  try {
+    ImageDS imageds(workspace, true, false, true);
+    imageds.enable_tile_dedup();
+    if (generate(imageds, hot_path, hot_extent, tile_extent) || generate(imageds, cold_path, extent, tile_extent)) {
+      std::cerr << "Could not write the benchmark arrays: " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    ImageDSArray hot(hot_path);
+    ImageDSArray cold(cold_path);
+    size_t roi_bytes = roi_extent*roi_extent*roi_extent*sizeof(uint16_t);
+    size_t slab_bytes = tile_extent*extent*extent*sizeof(uint16_t);
+    std::vector<char> roi_buffer(roi_bytes);
+    std::vector<char> slab_buffer(slab_bytes);
+    std::vector<char> hot_buffer(hot_extent*hot_extent*hot_extent*sizeof(uint16_t));
+    for (auto scan_mode : {false, true}) {
+      // Warm an empty tile cache with the whole hot array, as an interactive session would
+      imageds.set_tile_cache_capacity(0);
+      imageds.set_tile_cache_capacity(cache_mb*1024*1024);
+      imageds.enable_scan_mode(false);
+      if (imageds.from_array(hot, {hot_buffer.data()}, {hot_buffer.size()})) {
+        std::cerr << "Could not read " << hot_path << ": " << strerror(errno) << std::endl;
+        return 1;
+      }
+
+      std::mt19937 random(0);
+      std::vector<double> latencies;
+      double scan_seconds = 0;
+      for (int i=0; i<scan_num; i++) {
+        for (uint64_t z=0; z<extent; z+=tile_extent) {
+          imageds.enable_scan_mode(scan_mode);
+          auto start = std::chrono::steady_clock::now();
+          uint64_t z_end = std::min(z+tile_extent, extent)-1;
+          if (imageds.from_array(cold, {z, z_end, 0, extent-1, 0, extent-1}, {slab_buffer.data()},
+                                 {(z_end-z+1)*extent*extent*sizeof(uint16_t)})) {
+            std::cerr << "Could not read " << cold_path << ": " << strerror(errno) << std::endl;
+            return 1;
+          }
+          scan_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+          imageds.enable_scan_mode(false);
+          for (int j=0; j<read_num; j++) {
+            std::vector<uint64_t> roi;
+            for (int d=0; d<3; d++) {
+              uint64_t low = random()%(hot_extent-roi_extent+1);
+              roi.push_back(low);
+              roi.push_back(low+roi_extent-1);
+            }
+            start = std::chrono::steady_clock::now();
+            if (imageds.from_array(hot, roi, {roi_buffer.data()}, {roi_bytes})) {
+              std::cerr << "Could not read " << hot_path << ": " << strerror(errno) << std::endl;
+              return 1;
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count());
+          }
+        }
+      }
+      std::sort(latencies.begin(), latencies.end());
+      std::cout << (scan_mode ? "Scan mode" : "Default") << ": region reads p50 "
+                << latencies[latencies.size()/2] << "us p99 "
+                << latencies[std::min(latencies.size()-1, latencies.size()*99/100)] << "us, scans "
+                << scan_num*extent*extent*extent*sizeof(uint16_t)/scan_seconds/(1024*1024) << " MB/s" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << workspace << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
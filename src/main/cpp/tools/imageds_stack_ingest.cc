@@ -0,0 +1,124 @@
+/**
+ * @file imageds_stack_ingest.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Ingests TIFF/PNG image stacks or single, possibly pyramidal, TIFF images into an ImageDS workspace
+ */
+
+
+#include "image_stack.h"
+
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <string.h>
+
+static void usage(const char *name) {
+  std::cerr << "Usage: " << name << " [options] <workspace> <array_path> <image_file>..." << std::endl
+            << "Ingests a stack of TIFF/PNG slices into a 3D array, or a single TIFF image file directory into a 2D array"
+            << std::endl
+            << "Options:" << std::endl
+            << "  -d, --directory <n>          Ingest TIFF image file directory n, e.g. a pyramid level, into a 2D array"
+            << std::endl
+            << "  -s, --slab-slices <n>        Slices decoded and written per slab and Z tile extent, default 16" << std::endl
+            << "  -t, --tile-extent <n>        Y and X tile extents, default 256 or the TIFF tile size" << std::endl
+            << "  -c, --compression <n>        compression_t of the intensity attributes, default 0 (none)" << std::endl
+            << "  -l, --compression-level <n>  Compression level, default 0" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"directory", required_argument, 0, 'd'},
+    {"slab-slices", required_argument, 0, 's'},
+    {"tile-extent", required_argument, 0, 't'},
+    {"compression", required_argument, 0, 'c'},
+    {"compression-level", required_argument, 0, 'l'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  int directory = -1;
+  uint64_t slab_slices = 16;
+  uint64_t tile_extent = 0;
+  int compression = NONE;
+  int compression_level = 0;
+  int c;
+  while ((c = getopt_long(argc, argv, "d:s:t:c:l:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'd':
+        directory = atoi(optarg);
+        break;
+      case 's':
+        slab_slices = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        tile_extent = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        compression = atoi(optarg);
+        break;
+      case 'l':
+        compression_level = atoi(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  int file_num = argc - optind - 2;
+  if (file_num < 1 || (directory >= 0 && file_num != 1) || compression < NONE || compression > BLOSC_RLE) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string array_path = argv[optind+1];
+  std::vector<std::string> filenames(argv+optind+2, argv+argc);
+
+  try {
+    ImageDS imageds(argv[optind], false, false, true);
+    auto start = std::chrono::steady_clock::now();
+    int status;
+    if (directory >= 0) {
+      status = imageds_tiff_ingest(imageds, filenames[0], array_path, directory, tile_extent,
+                                   static_cast<compression_t>(compression), compression_level);
+    } else {
+      status = imageds_stack_ingest(imageds, filenames, array_path, slab_slices, tile_extent ? tile_extent : 256,
+                                    static_cast<compression_t>(compression), compression_level);
+    }
+    if (status) {
+      std::cerr << "Could not ingest into " << array_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    std::cout << array_path << ": " << filenames.size() << " file(s) in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Could not open workspace " << argv[optind] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file trace.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Per-thread recording of trace spans and their Chrome trace-event export
+ */
+
+
+
+#include "trace.h"
+#include "json.h"
+
+#include "tiledb_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+// Spans kept per thread, older spans are overwritten
+#define IMAGEDS_TRACE_BUFFER_CAPACITY 64*1024
+
+static bool trace_enabled_at_startup() {
+#ifdef IMAGEDS_TRACE
+  return true;
+#else
+  const char *env = getenv("IMAGEDS_TRACE");
+  return env && atoi(env);
+#endif
+}
+
+std::atomic<bool> imageds_trace_on(trace_enabled_at_startup());
+
+struct TraceEvent {
+  const char *m_name;
+  uint64_t m_start;
+  uint64_t m_duration;
+  std::string m_detail;
+};
+
+// Ring of the spans of one thread. The lock is only contended while a dump or clear is in progress.
+class TraceBuffer {
+ public:
+  TraceBuffer(uint64_t thread_id) : m_thread_id(thread_id) {}
+
+  void add(TraceEvent&& event) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_events.size() < IMAGEDS_TRACE_BUFFER_CAPACITY) {
+      m_events.push_back(std::move(event));
+    } else {
+      m_events[m_next] = std::move(event);
+      m_next = (m_next+1)%IMAGEDS_TRACE_BUFFER_CAPACITY;
+    }
+  }
+
+  const uint64_t m_thread_id;
+  std::mutex m_mutex;
+  std::vector<TraceEvent> m_events;
+  size_t m_next = 0;
+};
+
+// Buffers outlive their threads so that spans of finished worker threads can still be dumped
+static std::mutex& buffers_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::vector<std::shared_ptr<TraceBuffer>>& buffers() {
+  static std::vector<std::shared_ptr<TraceBuffer>> trace_buffers;
+  return trace_buffers;
+}
+
+static TraceBuffer& thread_buffer() {
+  thread_local std::shared_ptr<TraceBuffer> buffer;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(buffers_mutex());
+    buffer = std::make_shared<TraceBuffer>(buffers().size()+1);
+    buffers().push_back(buffer);
+  }
+  return *buffer;
+}
+
+void imageds_trace_enable(bool enable) {
+  imageds_trace_on = enable;
+}
+
+bool imageds_trace_enabled() {
+  return imageds_trace_on;
+}
+
+uint64_t imageds_trace_now() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void imageds_trace_clear() {
+  std::lock_guard<std::mutex> lock(buffers_mutex());
+  for (auto& buffer : buffers()) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->m_mutex);
+    buffer->m_events.clear();
+    buffer->m_next = 0;
+  }
+}
+
+void ImageDSTraceSpan::record() {
+  uint64_t end = imageds_trace_now();
+  thread_buffer().add(TraceEvent{m_name, m_start, end-m_start, std::move(m_detail)});
+}
+
+std::string imageds_trace_json(uint64_t start_us, uint64_t end_us) {
+  std::ostringstream json;
+  json << "{\"traceEvents\": [";
+  bool first = true;
+  int pid = getpid();
+  std::lock_guard<std::mutex> lock(buffers_mutex());
+  for (auto& buffer : buffers()) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->m_mutex);
+    for (auto& event : buffer->m_events) {
+      if (event.m_start > end_us || event.m_start+event.m_duration < start_us) {
+        continue;
+      }
+      json << (first ? "\n  " : ",\n  ")
+           << "{\"name\": " << json_string(event.m_name) << ", \"cat\": \"imageds\", \"ph\": \"X\""
+           << ", \"ts\": " << event.m_start << ", \"dur\": " << event.m_duration
+           << ", \"pid\": " << pid << ", \"tid\": " << buffer->m_thread_id;
+      if (!event.m_detail.empty()) {
+        json << ", \"args\": {\"detail\": " << json_string(event.m_detail) << "}";
+      }
+      json << "}";
+      first = false;
+    }
+  }
+  json << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  return json.str();
+}
+
+int imageds_trace_dump(const std::string& filename, uint64_t start_us, uint64_t end_us) {
+  std::string json = imageds_trace_json(start_us, end_us);
+  RETURN_EIO_IF_ERROR(TileDBUtils::write_file(filename, json.data(), json.size(), true));
+  return IMAGEDS_OK;
+}
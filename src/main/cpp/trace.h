@@ -0,0 +1,102 @@
+/**
+ * @file trace.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Scoped trace spans of ImageDS operations with Chrome trace-event export
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "imageds.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Spans are recorded into per-thread ring buffers only while tracing is enabled, a disabled span costs a relaxed
+ * atomic load. Tracing is enabled at startup when built with -DIMAGEDS_TRACE or when the IMAGEDS_TRACE environment
+ * variable is set to a non-zero value.
+ */
+IMAGEDS_PUBLIC void imageds_trace_enable(bool enable=true);
+
+IMAGEDS_PUBLIC bool imageds_trace_enabled();
+
+/** Microseconds on the steady clock used for span timestamps */
+IMAGEDS_PUBLIC uint64_t imageds_trace_now();
+
+/** Drops all recorded spans */
+IMAGEDS_PUBLIC void imageds_trace_clear();
+
+/**
+ * Chrome trace-event JSON, loadable in chrome://tracing or Perfetto, of the recorded spans overlapping
+ * [start_us, end_us] of imageds_trace_now() time.
+ */
+IMAGEDS_PUBLIC std::string imageds_trace_json(uint64_t start_us=0, uint64_t end_us=UINT64_MAX);
+
+IMAGEDS_PUBLIC int imageds_trace_dump(const std::string& filename, uint64_t start_us=0, uint64_t end_us=UINT64_MAX);
+
+extern IMAGEDS_PUBLIC std::atomic<bool> imageds_trace_on;
+
+/** Records the time from construction to destruction as a complete event, name must be a string literal */
+class IMAGEDS_PUBLIC ImageDSTraceSpan {
+ public:
+  ImageDSTraceSpan(const char *name) : m_name(name), m_recording(imageds_trace_on.load(std::memory_order_relaxed)) {
+    if (m_recording) {
+      m_start = imageds_trace_now();
+    }
+  }
+
+  /** detail, e.g. the array path, is shown with the span arguments */
+  ImageDSTraceSpan(const char *name, const std::string& detail) : ImageDSTraceSpan(name) {
+    if (m_recording) {
+      m_detail = detail;
+    }
+  }
+
+  ImageDSTraceSpan(const ImageDSTraceSpan& other) = delete;
+
+  ~ImageDSTraceSpan() {
+    if (m_recording) {
+      record();
+    }
+  }
+
+ private:
+  void record();
+
+  const char *m_name;
+  bool m_recording;
+  uint64_t m_start = 0;
+  std::string m_detail;
+};
+
+#define IMAGEDS_TRACE_CONCAT_(X, Y) X##Y
+#define IMAGEDS_TRACE_CONCAT(X, Y) IMAGEDS_TRACE_CONCAT_(X, Y)
+#define IMAGEDS_TRACE_SPAN(...) ImageDSTraceSpan IMAGEDS_TRACE_CONCAT(imageds_trace_span_, __LINE__)(__VA_ARGS__)
+
+#endif //__TRACE_H__
@@ -0,0 +1,313 @@
+/**
+ * @file typed_view.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Header-only typed views of ImageDS cells and readers checked against the array schema
+ */
+
+#ifndef __TYPED_VIEW_H__
+#define __TYPED_VIEW_H__
+
+#include "imageds.h"
+
+#include <array>
+#include <type_traits>
+#include <utility>
+
+/** attr_type_t of cells of type T, only defined for the types ImageDS attributes can hold */
+template<typename T> struct imageds_attr_type;
+template<typename T> struct imageds_attr_type<const T> : imageds_attr_type<T> {};
+template<> struct imageds_attr_type<char> : std::integral_constant<attr_type_t, CHAR> {};
+template<> struct imageds_attr_type<int8_t> : std::integral_constant<attr_type_t, INT8> {};
+template<> struct imageds_attr_type<uint8_t> : std::integral_constant<attr_type_t, UINT8> {};
+template<> struct imageds_attr_type<int16_t> : std::integral_constant<attr_type_t, INT16> {};
+template<> struct imageds_attr_type<uint16_t> : std::integral_constant<attr_type_t, UINT16> {};
+template<> struct imageds_attr_type<int32_t> : std::integral_constant<attr_type_t, INT32> {};
+template<> struct imageds_attr_type<uint32_t> : std::integral_constant<attr_type_t, UINT32> {};
+template<> struct imageds_attr_type<int64_t> : std::integral_constant<attr_type_t, INT64> {};
+template<> struct imageds_attr_type<uint64_t> : std::integral_constant<attr_type_t, UINT64> {};
+template<> struct imageds_attr_type<float> : std::integral_constant<attr_type_t, FLOAT32> {};
+template<> struct imageds_attr_type<double> : std::integral_constant<attr_type_t, FLOAT64> {};
+
+/**
+ * Runs Kernel<T>::run(args...) with T the C++ type of type, so that kernels switch on the attribute type once per
+ * call and their loops over cells are compiled for every type. Fails with EINVAL for unknown types.
+ */
+template<template<typename> class Kernel, typename... Args>
+int imageds_dispatch(attr_type_t type, Args&&... args) {
+  switch (type) {
+    case CHAR:
+      return Kernel<char>::run(std::forward<Args>(args)...);
+    case INT8:
+      return Kernel<int8_t>::run(std::forward<Args>(args)...);
+    case UINT8:
+      return Kernel<uint8_t>::run(std::forward<Args>(args)...);
+    case INT16:
+      return Kernel<int16_t>::run(std::forward<Args>(args)...);
+    case UINT16:
+      return Kernel<uint16_t>::run(std::forward<Args>(args)...);
+    case INT32:
+      return Kernel<int32_t>::run(std::forward<Args>(args)...);
+    case UINT32:
+      return Kernel<uint32_t>::run(std::forward<Args>(args)...);
+    case INT64:
+      return Kernel<int64_t>::run(std::forward<Args>(args)...);
+    case UINT64:
+      return Kernel<uint64_t>::run(std::forward<Args>(args)...);
+    case FLOAT32:
+      return Kernel<float>::run(std::forward<Args>(args)...);
+    case FLOAT64:
+      return Kernel<double>::run(std::forward<Args>(args)...);
+  }
+  errno = EINVAL;
+  return IMAGEDS_ERR;
+}
+
+/**
+ * Cells of type T of an N-dimensional box, the first dimension varying slowest as in from_array buffers. Strides
+ * are in cells and may be negative or describe a box within a larger buffer, index arithmetic is unrolled for N at
+ * compile time. Views do not own their cells.
+ */
+template<typename T, size_t N>
+class ImageDSView {
+  static_assert(N > 0, "Views have at least one dimension");
+
+ public:
+  typedef T value_type;
+  typedef std::array<uint64_t, N> index_t;
+  typedef std::array<int64_t, N> strides_t;
+
+  ImageDSView() : m_data(NULL) {
+    m_extents.fill(0);
+    m_strides.fill(0);
+  }
+
+  /** Row-major cells of the given extents */
+  ImageDSView(T *data, const index_t& extents) : m_data(data), m_extents(extents) {
+    int64_t stride = 1;
+    for (size_t d=N; d-- > 0; ) {
+      m_strides[d] = stride;
+      stride *= m_extents[d];
+    }
+  }
+
+  ImageDSView(T *data, const index_t& extents, const strides_t& strides)
+      : m_data(data), m_extents(extents), m_strides(strides) {}
+
+  /** Views of cells convert to views of const cells */
+  template<typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+  ImageDSView(const ImageDSView<U, N>& other) : m_data(other.data()), m_extents(other.extents()),
+                                                m_strides(other.strides()) {}
+
+  template<typename... I>
+  T& operator()(I... index) const {
+    static_assert(sizeof...(I) == N, "One index per dimension");
+    return m_data[offset<0>(static_cast<uint64_t>(index)...)];
+  }
+
+  T& operator[](const index_t& index) const {
+    int64_t cell = 0;
+    for (size_t d=0; d<N; d++) {
+      cell += index[d]*m_strides[d];
+    }
+    return m_data[cell];
+  }
+
+  T *data() const {
+    return m_data;
+  }
+
+  const index_t& extents() const {
+    return m_extents;
+  }
+
+  uint64_t extent(size_t d) const {
+    return m_extents[d];
+  }
+
+  const strides_t& strides() const {
+    return m_strides;
+  }
+
+  int64_t stride(size_t d) const {
+    return m_strides[d];
+  }
+
+  /** Number of cells */
+  uint64_t size() const {
+    uint64_t size = 1;
+    for (size_t d=0; d<N; d++) {
+      size *= m_extents[d];
+    }
+    return size;
+  }
+
+  /** Whether the cells are row-major without gaps, as read by from_array */
+  bool contiguous() const {
+    int64_t stride = 1;
+    for (size_t d=N; d-- > 0; ) {
+      if (m_extents[d] > 1 && m_strides[d] != stride) {
+        return false;
+      }
+      stride *= m_extents[d];
+    }
+    return true;
+  }
+
+  /** Cells of the box [low, high] per dimension, sharing the cells of this view */
+  ImageDSView box(const index_t& low, const index_t& high) const {
+    index_t extents;
+    for (size_t d=0; d<N; d++) {
+      extents[d] = high[d]-low[d]+1;
+    }
+    return ImageDSView(&(*this)[low], extents, m_strides);
+  }
+
+  /** Cells with the given index along dimension D, with one dimension less */
+  template<size_t D>
+  ImageDSView<T, N-1> slice(uint64_t index) const {
+    static_assert(N > 1 && D < N, "Slices keep at least one dimension");
+    std::array<uint64_t, N-1> extents;
+    std::array<int64_t, N-1> strides;
+    for (size_t d=0, k=0; d<N; d++) {
+      if (d != D) {
+        extents[k] = m_extents[d];
+        strides[k++] = m_strides[d];
+      }
+    }
+    return ImageDSView<T, N-1>(m_data + index*m_strides[D], extents, strides);
+  }
+
+  /** Cells in reverse order along dimension D */
+  template<size_t D>
+  ImageDSView flip() const {
+    static_assert(D < N, "No such dimension");
+    strides_t strides = m_strides;
+    strides[D] = -strides[D];
+    return ImageDSView(m_extents[D] ? m_data + (m_extents[D]-1)*m_strides[D] : m_data, m_extents, strides);
+  }
+
+ private:
+  template<size_t D>
+  int64_t offset() const {
+    return 0;
+  }
+
+  template<size_t D, typename... I>
+  int64_t offset(uint64_t index, I... rest) const {
+    return index*m_strides[D] + offset<D+1>(rest...);
+  }
+
+  T *m_data;
+  index_t m_extents;
+  strides_t m_strides;
+};
+
+/**
+ * Reads an attribute of type T of an N-dimensional array. The schema is checked once on construction, which throws
+ * ImageDSException if the array does not exist, does not have N dimensions or the attribute is not of type T.
+ * An empty attribute selects the only attribute of the array. Instances use imageds for their reads and share its
+ * thread-safety.
+ */
+template<typename T, size_t N>
+class ImageDSReader {
+  static_assert(!std::is_const<T>::value, "Cells are read into writable buffers");
+
+ public:
+  typedef std::array<uint64_t, 2*N> subarray_t;
+
+  ImageDSReader(ImageDS& imageds, const std::string& array_path, const std::string& attribute="")
+      : m_imageds(imageds), m_array(array_path) {
+    ImageDSArray schema;
+    if (imageds.array_info(array_path, schema)) {
+      throw ImageDSException("Could not get the schema of " + array_path);
+    }
+    if (schema.m_dimensions.size() != N) {
+      throw ImageDSException(array_path + " does not have " + std::to_string(N) + " dimensions");
+    }
+    for (size_t d=0; d<N; d++) {
+      m_domain[2*d] = schema.m_dimensions[d]->m_start;
+      m_domain[2*d+1] = schema.m_dimensions[d]->m_end;
+    }
+    for (auto& schema_attribute : schema.m_attributes) {
+      if (attribute.empty() ? schema.m_attributes.size() == 1 : schema_attribute->m_name == attribute) {
+        if (schema_attribute->m_type != imageds_attr_type<T>::value) {
+          throw ImageDSException("Attribute " + schema_attribute->m_name + " of " + array_path
+                                 + " does not hold cells of the requested type");
+        }
+        m_array.add_attribute(schema_attribute->m_name, schema_attribute->m_type);
+      }
+    }
+    if (m_array.m_attributes.empty()) {
+      throw ImageDSException("No attribute " + attribute + " in " + array_path);
+    }
+  }
+
+  // Delete copy constructor
+  ImageDSReader(const ImageDSReader& other) = delete;
+
+  const subarray_t& domain() const {
+    return m_domain;
+  }
+
+  const std::string& attribute() const {
+    return m_array.m_attributes[0]->m_name;
+  }
+
+  /** Extents of the cells of subarray */
+  static typename ImageDSView<T, N>::index_t extents(const subarray_t& subarray) {
+    typename ImageDSView<T, N>::index_t extents;
+    for (size_t d=0; d<N; d++) {
+      extents[d] = subarray[2*d+1]-subarray[2*d]+1;
+    }
+    return extents;
+  }
+
+  /** Reads subarray into view, which has to be contiguous with the extents of subarray, see ImageDS::from_array */
+  int read(const subarray_t& subarray, const ImageDSView<T, N>& view) {
+    if (view.extents() != extents(subarray) || !view.contiguous()) {
+      errno = EINVAL;
+      return IMAGEDS_ERR;
+    }
+    return m_imageds.from_array(m_array, std::vector<uint64_t>(subarray.begin(), subarray.end()), {view.data()},
+                                {view.size()*sizeof(T)});
+  }
+
+  /** Reads subarray into cells, resized to fit, and points view at them */
+  int read(const subarray_t& subarray, std::vector<T>& cells, ImageDSView<T, N>& view) {
+    cells.resize(ImageDSView<T, N>(NULL, extents(subarray)).size());
+    RETURN_EIO_IF_ERROR(read(subarray, ImageDSView<T, N>(cells.data(), extents(subarray))));
+    view = ImageDSView<T, N>(cells.data(), extents(subarray));
+    return IMAGEDS_OK;
+  }
+
+ private:
+  ImageDS& m_imageds;
+  ImageDSArray m_array;
+  subarray_t m_domain;
+};
+
+#endif //__TYPED_VIEW_H__
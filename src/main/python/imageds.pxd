@@ -1,6 +1,8 @@
 # distutils: language = c++
 # cython: language_level=3
 
+from libcpp cimport bool
+from libcpp.map cimport map
 from libcpp.memory cimport unique_ptr
 from libcpp.string cimport string
 from libcpp.vector cimport vector
@@ -74,6 +76,88 @@ cdef extern from "imageds.h":
     vector[size_t] get_sizes()
     pass
 
+  cdef cppclass ImageDSLatencyHistogram:
+    uint64_t m_count
+    uint64_t m_total_us
+    uint64_t m_max_us
+    vector[uint64_t] m_buckets
+    uint64_t percentile(double)
+
+  cdef cppclass ImageDSArrayStats:
+    uint64_t m_to_array_calls
+    uint64_t m_from_array_calls
+    uint64_t m_errors
+    uint64_t m_bytes_written
+    uint64_t m_bytes_requested
+    uint64_t m_bytes_read
+    uint64_t m_bytes_decompressed
+    uint64_t m_tiles_touched
+    uint64_t m_cache_hits
+    uint64_t m_coalesced_reads
+    ImageDSLatencyHistogram m_to_array_latency
+    ImageDSLatencyHistogram m_from_array_latency
+
+  cdef cppclass ImageDSStats:
+    map[string, ImageDSArrayStats] m_arrays
+
+  cdef cppclass ImageDSMemoryUsage:
+    size_t m_budget
+    size_t m_tile_cache
+    size_t m_in_flight
+    size_t m_peak
+    uint64_t m_queued
+    uint64_t m_split
+
+  cdef cppclass ImageDSMappedTile:
+    uint64_t m_tile_id
+    vector[uint64_t] m_box
+    const void *m_data
+
+  cdef cppclass ImageDSMappedView:
+    string m_attribute
+    attr_type_t m_type
+    vector[uint64_t] m_subarray
+    vector[ImageDSMappedTile] m_tiles
+    const void *m_data
+    vector[uint64_t] m_strides
+
+  ctypedef enum voi_function_t:
+    VOI_LINEAR=0
+    VOI_LINEAR_EXACT=1
+    VOI_SIGMOID=2
+
+  cdef cppclass ImageDSConversion:
+    ImageDSConversion(attr_type_t, double, double)
+    ImageDSConversion& clip(double, double)
+    ImageDSConversion& window(double, double, voi_function_t)
+    ImageDSConversion& lut(vector[double], double)
+
+  ctypedef enum projection_t:
+    PROJECTION_MAX=0
+    PROJECTION_MIN=1
+    PROJECTION_MEAN=2
+
+  ctypedef enum filter_operation_t:
+    FILTER_CORRELATE=0
+    FILTER_ERODE=1
+    FILTER_DILATE=2
+
+  cdef cppclass ImageDSFilter:
+    ImageDSFilter(vector[vector[double]], filter_operation_t, attr_type_t)
+
+  cdef cppclass ImageDSObliquePlane:
+    ImageDSObliquePlane(vector[double], vector[double], vector[double], uint64_t, uint64_t, double, double)
+    double m_fill
+
+  cdef cppclass completion_t:
+    pass
+
+  cdef cppclass ImageDSRequest:
+    ImageDSRequest()
+    bool cancel()
+    bool done()
+    int error()
+
   cdef cppclass ImageDS:
     ImageDS(string, bool, bool) except +
     ImageDS(string, bool) except +
@@ -82,4 +166,54 @@ cdef extern from "imageds.h":
     int to_array(ImageDSArray, vector[void *], vector[size_t])
     ImageDSBuffers create_read_buffers(ImageDSArray)
     int from_array(ImageDSArray, vector[void *], vector[size_t])
+    int from_array(ImageDSArray, vector[uint64_t], vector[void *], vector[size_t], vector[ImageDSConversion])
+    int map(ImageDSArray, vector[uint64_t], vector[ImageDSMappedView]&)
+    int reslice(ImageDSArray, size_t, uint64_t, vector[void *], vector[size_t], bool)
+    int oblique_slice(ImageDSArray, ImageDSObliquePlane, vector[void *], vector[size_t])
+    int project(ImageDSArray, vector[uint64_t], size_t, projection_t, vector[void *], vector[size_t])
+    int filter(ImageDSArray, string, ImageDSFilter)
+    void enable_tile_dedup(bool)
+    void enable_read_coalescing(bool)
+    void enable_scan_mode(bool)
+    void set_tile_cache_capacity(size_t)
+    void set_memory_budget(size_t)
+    ImageDSMemoryUsage memory_usage()
+    ImageDSStats stats()
+    void reset_stats()
+    int set_io_pool(size_t, size_t)
+    ImageDSRequest read_async(ImageDSArray, vector[uint64_t], vector[void *], vector[size_t], completion_t)
+    ImageDSRequest write_async(ImageDSArray, vector[uint64_t], vector[void *], vector[size_t], completion_t)
     pass
+
+cdef extern from *:
+  """
+  #include "imageds.h"
+  // Calls resolve(status, error) with the GIL held from whichever thread completes the request
+  static completion_t imageds_python_completion(PyObject *resolve) {
+    Py_INCREF(resolve);
+    return [resolve](int status, int error) {
+      PyGILState_STATE gil = PyGILState_Ensure();
+      PyObject *result = PyObject_CallFunction(resolve, "ii", status, error);
+      if (!result) PyErr_Print();
+      Py_XDECREF(result);
+      Py_DECREF(resolve);
+      PyGILState_Release(gil);
+    };
+  }
+  """
+  completion_t imageds_python_completion(object)
+
+cdef extern from "nifti.h":
+  int imageds_nifti_import(ImageDS&, string, string, uint64_t, compression_t, int)
+  int imageds_nifti_import_batch(string, vector[string], vector[string], vector[int]&, uint64_t, compression_t, int)
+  int imageds_nifti_export(ImageDS&, string, string, string)
+
+cdef extern from "array_export.h":
+  int imageds_zarr_export(ImageDS&, string, string, string, vector[uint64_t], int)
+  int imageds_npy_export(ImageDS&, string, string, string)
+
+cdef extern from "trace.h":
+  void imageds_trace_enable(bool)
+  void imageds_trace_clear()
+  uint64_t imageds_trace_now()
+  int imageds_trace_dump(string, uint64_t, uint64_t)
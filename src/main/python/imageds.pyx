@@ -4,8 +4,11 @@
 from __future__ import absolute_import, print_function
 from enum import IntEnum
 
+import asyncio
 import numpy as np
+import os
 
+from libc.errno cimport errno
 from libcpp.vector cimport vector
 from cython.operator cimport dereference as deref, preincrement as inc
 from cython.operator cimport dereference
@@ -25,6 +28,21 @@ class compression_type(IntEnum):
     BLOSC_ZSTD=compression_t.ZSTD
     BLOSC_RLE=compression_t.BLOSC_RLE
 
+class voi_function(IntEnum):
+    LINEAR=voi_function_t.VOI_LINEAR
+    LINEAR_EXACT=voi_function_t.VOI_LINEAR_EXACT
+    SIGMOID=voi_function_t.VOI_SIGMOID
+
+class projection_type(IntEnum):
+    MAX=projection_t.PROJECTION_MAX
+    MIN=projection_t.PROJECTION_MIN
+    MEAN=projection_t.PROJECTION_MEAN
+
+class filter_operation(IntEnum):
+    CORRELATE=filter_operation_t.FILTER_CORRELATE
+    ERODE=filter_operation_t.FILTER_ERODE
+    DILATE=filter_operation_t.FILTER_DILATE
+
 cdef attr_type_t to_attr_type(dtype):
     if dtype == np.char:
         return CHAR
@@ -75,6 +93,14 @@ cdef np.dtype to_dtype(attr_type_t attr_type):
         return np.dtype(np.float64)
     raise TypeError("Unsupported attribute data type {0}".format(attr_type))
 
+cdef dict latency_dict(const ImageDSLatencyHistogram& histogram):
+    return {"count": histogram.m_count,
+            "total_us": histogram.m_total_us,
+            "max_us": histogram.m_max_us,
+            "p50_us": histogram.percentile(0.5),
+            "p99_us": histogram.percentile(0.99),
+            "buckets": list(histogram.m_buckets)}
+
 def version():
     version_string = imageds_version()
     return version_string
@@ -100,16 +126,296 @@ cdef class _ImageDS:
         if self._imageds.array_info(as_string(path), array) != 0:
             raise RuntimeError("Could not get array_info for "+path)
 
+    def enable_tile_dedup(self, enable = True):
+        self._imageds.enable_tile_dedup(enable)
+
+    def enable_read_coalescing(self, enable = True):
+        self._imageds.enable_read_coalescing(enable)
+
+    def enable_scan_mode(self, enable = True):
+        self._imageds.enable_scan_mode(enable)
+
+    def set_tile_cache_capacity(self, capacity):
+        self._imageds.set_tile_cache_capacity(capacity)
+
+    def set_memory_budget(self, budget):
+        """Bytes held by the tile cache and the reads and writes in flight, 0 for no limit"""
+        self._imageds.set_memory_budget(budget)
+
+    def memory_usage(self):
+        """Current and peak memory since creation or reset_stats"""
+        cdef ImageDSMemoryUsage usage = self._imageds.memory_usage()
+        return {
+            "budget": usage.m_budget,
+            "tile_cache": usage.m_tile_cache,
+            "in_flight": usage.m_in_flight,
+            "peak": usage.m_peak,
+            "queued": usage.m_queued,
+            "split": usage.m_split}
+
+    def stats(self):
+        """Counters and latency histograms of to_array/from_array per array path since creation or reset_stats"""
+        cdef ImageDSStats snapshot = self._imageds.stats()
+        stats = {}
+        for entry in snapshot.m_arrays:
+            stats[entry.first.decode("utf-8")] = {
+                "to_array_calls": entry.second.m_to_array_calls,
+                "from_array_calls": entry.second.m_from_array_calls,
+                "errors": entry.second.m_errors,
+                "bytes_written": entry.second.m_bytes_written,
+                "bytes_requested": entry.second.m_bytes_requested,
+                "bytes_read": entry.second.m_bytes_read,
+                "bytes_decompressed": entry.second.m_bytes_decompressed,
+                "tiles_touched": entry.second.m_tiles_touched,
+                "cache_hits": entry.second.m_cache_hits,
+                "coalesced_reads": entry.second.m_coalesced_reads,
+                "to_array_latency": latency_dict(entry.second.m_to_array_latency),
+                "from_array_latency": latency_dict(entry.second.m_from_array_latency)}
+        return stats
+
+    def reset_stats(self):
+        self._imageds.reset_stats()
+
+    def nifti_import(self, filename, array_path, tile_extent = 64, compression_t compression = NONE, compression_level = 0):
+        if imageds_nifti_import(self._imageds[0], as_string(filename), as_string(array_path),
+                                tile_extent, compression, compression_level) != 0:
+            raise RuntimeError("Could not import NIfTI file "+filename)
+
+    def nifti_export(self, array_path, filename, attribute = ""):
+        if imageds_nifti_export(self._imageds[0], as_string(array_path), as_string(filename), as_string(attribute)) != 0:
+            raise RuntimeError("Could not export "+array_path+" to NIfTI file "+filename)
+
+    def zarr_export(self, array_path, directory, attribute = "", chunk_shape = None, zlib_level = 0):
+        cdef vector[uint64_t] chunks = chunk_shape if chunk_shape else []
+        if imageds_zarr_export(self._imageds[0], as_string(array_path), as_string(directory), as_string(attribute),
+                               chunks, zlib_level) != 0:
+            raise RuntimeError("Could not export "+array_path+" to Zarr store "+directory)
+
+    def npy_export(self, array_path, filename, attribute = ""):
+        if imageds_npy_export(self._imageds[0], as_string(array_path), as_string(filename), as_string(attribute)) != 0:
+            raise RuntimeError("Could not export "+array_path+" to NPY file "+filename)
+
+    def set_io_pool(self, threads, queue_depth):
+        if self._imageds.set_io_pool(threads, queue_depth) != 0:
+            raise RuntimeError("Could not set up an I/O pool with "+str(threads)+" threads")
+
+    cdef _ImageDSRequest submit_async(self, _ImageDSArray array, np.ndarray value, bint write, loop, future):
+        cdef vector[uint64_t] subarray
+        cdef vector[void *] buffers
+        cdef vector[size_t] sizes
+        buffers.push_back(np.PyArray_DATA(value))
+        sizes.push_back(value.nbytes)
+        request = _ImageDSRequest()
+        resolve = _asyncio_resolver(loop, future, value)
+        if write:
+            request._request = self._imageds.write_async(array.get()[0], subarray, buffers, sizes,
+                                                         imageds_python_completion(resolve))
+        else:
+            request._request = self._imageds.read_async(array.get()[0], subarray, buffers, sizes,
+                                                        imageds_python_completion(resolve))
+        return request
+
+    cdef map(self, _ImageDSArray array, vector[uint64_t] subarray):
+        cdef vector[ImageDSMappedView] views
+        if self._imageds.map(array.get()[0], subarray, views) != 0:
+            raise OSError(errno, os.strerror(errno))
+        cdef _ImageDSMapping mapping = _ImageDSMapping()
+        mapping._view = views[0]
+        cdef ImageDSMappedView* view = &mapping._view
+        cdef size_t dim_num = view.m_subarray.size()//2
+        if view.m_data != NULL:
+            shape = [view.m_subarray[2*d+1]-view.m_subarray[2*d]+1 for d in range(dim_num)]
+            return mapping.array(view.m_data, shape, view.m_strides)
+        # Every tile is strided on its own
+        cdef size_t cell_size = to_dtype(view.m_type).itemsize
+        cdef vector[uint64_t] strides
+        cdef uint64_t low, high, offset
+        tiles = []
+        for tile in view.m_tiles:
+            region = []
+            shape = []
+            strides.assign(dim_num, cell_size)
+            offset = 0
+            for d in reversed(range(dim_num)):
+                if d+1 < dim_num:
+                    strides[d] = strides[d+1]*(tile.m_box[2*d+3]-tile.m_box[2*d+2]+1)
+                low = max(tile.m_box[2*d], view.m_subarray[2*d])
+                high = min(tile.m_box[2*d+1], view.m_subarray[2*d+1])
+                region = [low, high] + region
+                shape.insert(0, high-low+1)
+                offset += (low-tile.m_box[2*d])*strides[d]
+            tiles.append((region, mapping.array(<const char*>tile.m_data + offset, shape, strides)))
+        return tiles
+
+    cdef reslice(self, _ImageDSArray array, size_t axis, uint64_t index, np.ndarray plane, bint transpose):
+        cdef vector[void *] buffers
+        cdef vector[size_t] sizes
+        buffers.push_back(np.PyArray_DATA(plane))
+        sizes.push_back(plane.nbytes)
+        if self._imageds.reslice(array.get()[0], axis, index, buffers, sizes, transpose) != 0:
+            raise OSError(errno, os.strerror(errno))
+        return plane
+
+    cdef oblique_slice(self, _ImageDSArray array, origin, row_direction, column_direction, np.ndarray plane,
+                       spacing, double fill):
+        cdef vector[void *] buffers
+        cdef vector[size_t] sizes
+        buffers.push_back(np.PyArray_DATA(plane))
+        sizes.push_back(plane.nbytes)
+        cdef ImageDSObliquePlane *oblique = new ImageDSObliquePlane(origin, row_direction, column_direction,
+                                                                    plane.shape[0], plane.shape[1], spacing[0],
+                                                                    spacing[1])
+        oblique.m_fill = fill
+        cdef int rc = self._imageds.oblique_slice(array.get()[0], oblique[0], buffers, sizes)
+        del oblique
+        if rc != 0:
+            raise OSError(errno, os.strerror(errno))
+        return plane
+
+    cdef project(self, _ImageDSArray array, vector[uint64_t] subarray, size_t axis, projection_t projection,
+                 np.ndarray result):
+        cdef vector[void *] buffers
+        cdef vector[size_t] sizes
+        buffers.push_back(np.PyArray_DATA(result))
+        sizes.push_back(result.nbytes)
+        if self._imageds.project(array.get()[0], subarray, axis, projection, buffers, sizes) != 0:
+            raise OSError(errno, os.strerror(errno))
+        return result
+
+    cdef filter(self, _ImageDSArray array, _ImageDSArray result, kernels, filter_operation_t operation):
+        cdef vector[vector[double]] filter_kernels = [kernel if kernel is not None else [] for kernel in kernels]
+        cdef ImageDSFilter *imageds_filter = new ImageDSFilter(filter_kernels, operation,
+                                                               deref(result.get().attributes().data()[0]).type())
+        cdef int rc = self._imageds.filter(array.get()[0], result.get().path(), imageds_filter[0])
+        del imageds_filter
+        if rc != 0:
+            raise OSError(errno, os.strerror(errno))
+        return result
+
     cdef to_image(self, _ImageDSArray array, vector[void *]buffers, vector[size_t] sizes):
         return self._imageds.to_array(array.get()[0], buffers, sizes)
 
     cdef from_image(self, _ImageDSArray array, vector[void *]buffers, vector[size_t] sizes):
         return self._imageds.from_array(array.get()[0], buffers, sizes)
 
+    cdef from_image_as(self, _ImageDSArray array, vector[void *]buffers, vector[size_t] sizes, attr_type_t attr_type,
+                       double slope, double intercept, clip, window, voi, lut, double lut_first):
+        cdef vector[uint64_t] subarray
+        cdef vector[ImageDSConversion] conversions
+        conversions.push_back(ImageDSConversion(attr_type, slope, intercept))
+        if clip is not None:
+            conversions.back().clip(clip[0], clip[1])
+        if window is not None:
+            conversions.back().window(window[0], window[1], voi)
+        if lut is not None:
+            conversions.back().lut(lut, lut_first)
+        return self._imageds.from_array(array.get()[0], subarray, buffers, sizes, conversions)
+
+cdef class _ImageDSRequest:
+    cdef ImageDSRequest _request
+
+    def cancel(self):
+        return self._request.cancel()
+
+    def done(self):
+        return self._request.done()
+
+cdef class _ImageDSMapping:
+    """Keeps the files of a mapped view mapped for as long as any array created from it is alive"""
+    cdef ImageDSMappedView _view
+
+    cdef array(self, const void *data, shape, strides):
+        mapped = _ImageDSMappedArray()
+        mapped._mapping = self
+        mapped._interface = {"version": 3,
+                             "shape": tuple(shape),
+                             "strides": tuple(strides),
+                             "typestr": to_dtype(self._view.m_type).str,
+                             "data": (<uintptr_t>data, True)}
+        return np.asarray(mapped)
+
+cdef class _ImageDSMappedArray:
+    cdef object _mapping
+    cdef dict _interface
+
+    @property
+    def __array_interface__(self):
+        return self._interface
+
+def _resolve_future(future, status, error, result):
+    if future.done():
+        return # The awaiting task was cancelled
+    if status == 0:
+        future.set_result(result)
+    else:
+        future.set_exception(OSError(error, os.strerror(error)))
+
+def _asyncio_resolver(loop, future, result):
+    # Called on an I/O pool thread, result keeps the buffer alive until the request completes
+    return lambda status, error: loop.call_soon_threadsafe(_resolve_future, future, status, error, result)
+
+async def _await_request(_ImageDSRequest request, future):
+    try:
+        return await future
+    except asyncio.CancelledError:
+        request.cancel()
+        raise
+
 cdef _ImageDS _imageds
-def setup(workspace):
+def setup(workspace, tile_dedup = False):
     global _imageds # necessary
     _imageds = _ImageDS(workspace)
+    _imageds.enable_tile_dedup(tile_dedup)
+
+def stats():
+    return _imageds.stats()
+
+def set_io_pool(threads, queue_depth):
+    """Threads and queue depth serving read_async/write_async, requests fail with EAGAIN when the queue is full"""
+    _imageds.set_io_pool(threads, queue_depth)
+
+def reset_stats():
+    _imageds.reset_stats()
+
+def nifti_import(filename, array_path, tile_extent = 64, compression_t compression = NONE, compression_level = 0):
+    _imageds.nifti_import(filename, array_path, tile_extent, compression, compression_level)
+
+def nifti_export(array_path, filename, attribute = ""):
+    _imageds.nifti_export(array_path, filename, attribute)
+
+def zarr_export(array_path, directory, attribute = "", chunk_shape = None, zlib_level = 0):
+    """Streams array_path chunk by chunk into a Zarr v2 directory store without materializing the array"""
+    _imageds.zarr_export(array_path, directory, attribute, chunk_shape, zlib_level)
+
+def npy_export(array_path, filename, attribute = ""):
+    """Streams array_path into a memory mapped .npy file, load it lazily with np.load(filename, mmap_mode='r')"""
+    _imageds.npy_export(array_path, filename, attribute)
+
+def nifti_import_batch(workspace, filenames, array_paths, tile_extent = 64, compression_t compression = NONE,
+                       compression_level = 0):
+    """Imports NIfTI files into arrays of workspace in parallel, raises with the files that failed"""
+    cdef vector[string] nifti_files = [as_string(filename) for filename in filenames]
+    cdef vector[string] nifti_array_paths = [as_string(array_path) for array_path in array_paths]
+    cdef vector[int] errnos
+    if imageds_nifti_import_batch(as_string(workspace), nifti_files, nifti_array_paths, errnos,
+                                  tile_extent, compression, compression_level) != 0:
+        failed = [filename for filename, error in zip(filenames, errnos) if error != 0]
+        raise RuntimeError("Could not import NIfTI files "+", ".join(failed if failed else filenames))
+
+def trace_enable(enable = True):
+    imageds_trace_enable(enable)
+
+def trace_clear():
+    imageds_trace_clear()
+
+def trace_now():
+    """Microseconds on the clock of the trace spans, to select the time window of trace_dump"""
+    return imageds_trace_now()
+
+def trace_dump(filename, start_us = 0, end_us = 2**64-1):
+    """Writes the recorded spans as Chrome trace-event JSON, open it in chrome://tracing or Perfetto"""
+    if imageds_trace_dump(as_string(filename), start_us, end_us) != 0:
+        raise RuntimeError("Could not write trace to "+filename)
 
 class Py_ImageDSDimension:
     def __init__(self, name, start, end, tile_extent):
@@ -153,10 +459,7 @@ cdef class _ImageDSArray(object):
         assert(rc == 0)
 
     def __array__(self, dtype=None):
-        a = self[...]
-        if dtype and a.dtype != dtype:
-            a = a.astype(dtype)
-        return a
+        return self.read(dtype)
 
     def __repr__(self):
         return self.__array__().__repr__()
@@ -168,12 +471,7 @@ cdef class _ImageDSArray(object):
             raise TypeError("Unsupported subscriptable key type '{0}'".format(type(key)))
         if key.start != None or key.stop != None or key.step != None:
             raise RuntimeError("Only reading the entire array with all dimensions/attributes supported for now")
-        nbytes = 0
-        dim_list = []
-        for i in range(self._array.dimensions().size()):
-            dim_list.append(deref(self._array.dimensions().data()[i]).end()
-                            -deref(self._array.dimensions().data()[i]).start() + 1)
-        np_array = np.empty(tuple(dim_list), dtype=to_dtype(deref(self._array.attributes().data()[0]).type()), order='C')
+        np_array = self.empty()
         cdef vector[void *] buffers
         cdef vector[size_t] buffer_sizes
         buffers.push_back(np.PyArray_DATA(np_array))
@@ -182,9 +480,128 @@ cdef class _ImageDSArray(object):
         assert(rc == 0)
         return np_array
 
+    def read(self, dtype=None, slope=1.0, intercept=0.0, clip=None, window=None, voi=voi_function.LINEAR, lut=None,
+             lut_first=0):
+        """Reads the entire array as dtype, the stored type by default, with every cell x stored as slope*x+intercept
+        and clipped to the (min, max) pair clip if given. Cells are converted while they are copied out of the tiles,
+        integer dtypes round to nearest and saturate instead of wrapping around as with astype.
+
+        For display, the rescaled cells can be mapped through a DICOM VOI window, given as a (center, width) pair,
+        onto the range of dtype, e.g. read(np.uint8, window=(40, 400)), or through the lookup table lut whose first
+        entry is the result of lut_first."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        np_array = self.empty(dtype)
+        cdef vector[void *] buffers
+        cdef vector[size_t] buffer_sizes
+        buffers.push_back(np.PyArray_DATA(np_array))
+        buffer_sizes.push_back(np_array.nbytes)
+        if _imageds.from_image_as(self, buffers, buffer_sizes, to_attr_type(np_array.dtype), slope, intercept,
+                                  clip, window, voi, lut, lut_first) != 0:
+            raise OSError(errno, os.strerror(errno))
+        return np_array
+
     cdef ImageDSArray *get(self):
         return self._array
 
+    cdef shape(self):
+        dim_list = []
+        for i in range(self._array.dimensions().size()):
+            dim_list.append(deref(self._array.dimensions().data()[i]).end()
+                            -deref(self._array.dimensions().data()[i]).start() + 1)
+        return dim_list
+
+    cdef empty(self, dtype=None):
+        if dtype is None:
+            dtype = to_dtype(deref(self._array.attributes().data()[0]).type())
+        return np.empty(tuple(self.shape()), dtype=dtype, order='C')
+
+    def map(self, subarray = None):
+        """Read-only view of the cells of subarray, given as [start, end] pairs per dimension, backed by memory
+        mappings of the array files instead of copies. Subarrays addressable with strides map to a numpy array, others
+        to a list of (tile region, numpy array) pairs for the tiles they overlap. Only arrays written without
+        compression can be mapped."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        return _imageds.map(self, subarray if subarray else [])
+
+    def reslice(self, axis, index, transpose = False):
+        """Plane where dimension axis is index, e.g. reslice(2, x) is the sagittal plane at x of a ZYX volume, read
+        from the tiles the plane cuts only. transpose swaps the two dimensions of the plane of a 3D array."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        shape = self.shape()
+        if axis < 0 or axis >= len(shape):
+            raise IndexError("Axis "+str(axis)+" is out of range")
+        del shape[axis]
+        if transpose:
+            shape.reverse()
+        plane = np.empty(tuple(shape), dtype=to_dtype(deref(self._array.attributes().data()[0]).type()))
+        return _imageds.reslice(self, axis, index, plane, transpose)
+
+    def oblique_slice(self, origin, row_direction, column_direction, shape, spacing = (1, 1), fill = 0):
+        """Plane of the given (rows, cols) shape through a 3D array, sampled with trilinear interpolation at
+        origin + col*spacing[1]*row_direction + row*spacing[0]*column_direction in cell coordinates, with unit
+        directions. Samples outside of the array are fill."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        plane = np.empty(tuple(shape), dtype=to_dtype(deref(self._array.attributes().data()[0]).type()))
+        return _imageds.oblique_slice(self, origin, row_direction, column_direction, plane, spacing, fill)
+
+    def project(self, axis, projection = projection_type.MAX, subarray = None):
+        """Maximum, minimum or mean intensity projection along axis of subarray, given as [start, end] pairs per
+        dimension, or of the entire array. Tiles are reduced natively as they are decoded, only the projection is
+        returned, of the stored dtype or float64 for means."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        shape = self.shape()
+        if axis < 0 or axis >= len(shape):
+            raise IndexError("Axis "+str(axis)+" is out of range")
+        if subarray:
+            shape = [subarray[2*d+1]-subarray[2*d]+1 for d in range(len(shape))]
+        del shape[axis]
+        dtype = np.float64 if projection == projection_type.MEAN \
+            else to_dtype(deref(self._array.attributes().data()[0]).type())
+        result = np.empty(tuple(shape), dtype=dtype)
+        return _imageds.project(self, subarray if subarray else [], axis, projection, result)
+
+    def filter(self, result_path, kernels, operation = filter_operation.CORRELATE, dtype = np.float32):
+        """Filters the array tile by tile into a new array at result_path with cells of dtype and returns it. kernels
+        holds a kernel of odd length centered on the filtered cell per dimension, or None for dimensions left alone.
+        Correlations sum the weighted cells under the kernels, erosions and dilations take their minimum or maximum.
+        Cells past the edges of the array repeat the edge cells."""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        cdef _ImageDSArray result = _ImageDSArray(result_path)
+        cdef ImageDSDimension *dimension
+        for i in range(self._array.dimensions().size()):
+            dimension = self._array.dimensions().data()[i].get()
+            result.get().add_dimension(dimension.name(), dimension.start(), dimension.end(), dimension.tile_extent())
+        cdef ImageDSAttribute *attribute = self._array.attributes().data()[0].get()
+        result.get().add_attribute(attribute.name(), to_attr_type(np.dtype(dtype)), attribute.compression(),
+                                   attribute.compression_level())
+        return _imageds.filter(self, result, kernels, operation)
+
+    def read_async(self):
+        """Awaitable read of the entire array on the I/O pool, cancelling the awaiting task cancels a queued read"""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        loop = asyncio.get_event_loop()
+        future = loop.create_future()
+        request = _imageds.submit_async(self, self.empty(), False, loop, future)
+        return _await_request(request, future)
+
+    def write_async(self, value):
+        """Awaitable write of the entire array on the I/O pool, value must not be modified until it completes"""
+        if self._array.attributes().size() != 1:
+            raise RuntimeError("Only ImageDS arrays with 1 attribute is supported for now")
+        if not isinstance(value, np.ndarray) or not value.flags.c_contiguous:
+            raise TypeError("Only C contiguous numpy arrays can be written")
+        loop = asyncio.get_event_loop()
+        future = loop.create_future()
+        request = _imageds.submit_async(self, value, True, loop, future)
+        return _await_request(request, future)
+
     def add_dimension(self, dimension):
         if type(dimension) is Py_ImageDSDimension:
             self._array.add_dimension(as_string(dimension._name),
@@ -1,4 +1,5 @@
 import array
+import asyncio
 import os
 import shutil
 import sys
@@ -45,6 +46,17 @@ def run_test():
     print("\tRead 2D array")
     data = arr[:]
     print(data)
+    print("\tRead 2D array converted")
+    normalized = arr.read(np.float32, slope=1/16.0)
+    assert normalized.dtype == np.float32 and np.allclose(normalized, data/16.0)
+    assert np.array_equal(np.asarray(arr, dtype=np.float64), data)
+    assert np.array_equal(arr.read(np.uint8, clip=(4, 12)), np.clip(data, 4, 12))
+    window = arr.read(np.uint8, window=(9, 10))
+    assert np.array_equal(window, np.clip(((data - 8.5)/9 + 0.5)*255, 0, 255).round())
+    assert np.array_equal(arr.read(np.uint8, lut=[0, 100, 200], lut_first=7), np.clip(data.astype(np.int32)-7, 0, 2)*100)
+
+    assert np.array_equal(arr.reslice(0, 2), data[2])
+    assert np.array_equal(arr.reslice(1, 1), data[:, 1])
 
     try:
         data = arr[1:3]
@@ -57,6 +69,62 @@ def run_test():
     except Exception as e:
         print("Expected exception: " + str(e))
 
+    # Oblique planes sampled with trilinear interpolation
+    print("Test oblique 3D array")
+    z_dim = imageds.array_dimension("Z", 0, 3, 2)
+    volume = imageds.define_array("PET_3D", [z_dim, y_dim, x_dim], [red])
+    cells = np.arange(64, dtype=np.uint16).reshape(4, 4, 4)*2
+    volume[:] = cells
+    assert np.array_equal(volume.reslice(2, 1), cells[:, :, 1])
+    assert np.array_equal(volume.oblique_slice([0, 1, 0], [0, 0, 1], [1, 0, 0], (4, 4)), cells[:, 1, :])
+    between = volume.oblique_slice([0, 1.5, 0], [0, 0, 1], [1, 0, 0], (4, 4))
+    assert np.array_equal(between, (cells[:, 1, :] + cells[:, 2, :])//2)
+    diagonal = volume.oblique_slice([0, 0, 0], [0, 0, 1], [1, 1, 0], (5, 4), spacing=(2**0.5, 1), fill=1)
+    assert np.array_equal(diagonal[:, 0], [0, 40, 80, 120, 1])
+
+    # Intensity projections reduced natively
+    print("Test projections of 3D array")
+    assert np.array_equal(volume.project(0), cells.max(axis=0))
+    assert np.array_equal(volume.project(2, imageds.projection_type.MIN), cells.min(axis=2))
+    assert np.allclose(volume.project(1, imageds.projection_type.MEAN, [1, 2, 0, 3, 1, 3]),
+                       cells[1:3, :, 1:4].mean(axis=1))
+
+    # Filters applied tile by tile into new arrays
+    print("Test filters of 3D array")
+    smoothed = volume.filter("PET_3D_SMOOTHED", [None, [0.25, 0.5, 0.25], None])
+    padded = np.pad(cells.astype(np.float32), ((0, 0), (1, 1), (0, 0)), mode='edge')
+    assert np.allclose(smoothed.read(), 0.25*padded[:, :-2, :] + 0.5*padded[:, 1:-1, :] + 0.25*padded[:, 2:, :])
+    dilated = volume.filter("PET_3D_DILATED", [[1]*3]*3, imageds.filter_operation.DILATE, np.uint16)
+    padded = np.pad(cells, 1, mode='edge')
+    assert np.array_equal(dilated.read(), np.max([padded[z:z+4, y:y+4, x:x+4] for z in range(3) for y in range(3)
+                                                  for x in range(3)], axis=0))
+
+    # Uncompressed arrays mapped without copying
+    print("Test mapped 2D array")
+    mapped = imageds.define_array("PET_MAPPED", [x_dim, y_dim], [red])
+    mapped[:] = np.arange(16, dtype=np.uint16).reshape(4, 4)
+    tile = mapped.map([0, 1, 2, 3])
+    assert not tile.flags.writeable
+    assert np.array_equal(tile, [[2, 3], [6, 7]])
+    tiles = mapped.map([1, 2, 1, 3])
+    assert len(tiles) == 4
+    assembled = np.zeros((4, 4), dtype=np.uint16)
+    for region, cells in tiles:
+        assembled[region[0]:region[1]+1, region[2]:region[3]+1] = cells
+    assert np.array_equal(assembled[1:3, 1:4], [[5, 6, 7], [9, 10, 11]])
+    print("\tMapped " + str(len(tiles)) + " tiles")
+
+    # Asynchronous reads and writes on the I/O pool
+    print("Test async 2D array")
+    async def read_write_async():
+        written = np.arange(data.size, dtype=data.dtype).reshape(data.shape)
+        await arr.write_async(written)
+        results = await asyncio.gather(*[arr.read_async() for i in range(4)])
+        for result in results:
+            assert np.array_equal(result, written)
+        print("\tRead " + str(len(results)) + " arrays concurrently")
+    asyncio.get_event_loop().run_until_complete(read_write_async())
+
     
 tmp_dir = tempfile.TemporaryDirectory().name
 
@@ -0,0 +1,150 @@
+/**
+ * @file test_array_export.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for Zarr and NPY export
+ */
+
+
+#include "array_export.h"
+#include "catch.h"
+#include "imageds.h"
+#include "test_base.h"
+
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <zlib.h>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+// 5x7x9 volume with 2x3x4 tiles, none of the dimensions is a multiple of its tile extent
+static std::vector<uint16_t> write_volume(ImageDS& imageds, const std::string& array_path) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Z", 0, 4, 2);
+  array.add_dimension("Y", 0, 6, 3);
+  array.add_dimension("X", 0, 8, 4);
+  array.add_attribute("Intensity", UINT16);
+  array.add_attribute("Mask", UINT8);
+  std::vector<uint16_t> intensities(5*7*9);
+  std::vector<uint8_t> mask(intensities.size());
+  for (auto i=0ul; i<intensities.size(); i++) {
+    intensities[i] = i*3 + 1;
+    mask[i] = i%2;
+  }
+  REQUIRE(!imageds.to_array(array, {intensities.data(), mask.data()},
+                            {intensities.size()*sizeof(uint16_t), mask.size()}));
+  std::map<std::string, std::string> metadata;
+  metadata["spacing"] = "2\\0.5\\0.5";
+  metadata["description"] = "a \"quoted\" value";
+  REQUIRE(!imageds.write_metadata(array_path, metadata));
+  return intensities;
+}
+
+static std::string read_file(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST_CASE_METHOD(TempDir, "Test Zarr export", "[zarr_export]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> volume = write_volume(imageds, "volume");
+  std::string store = append_paths(get_temp_dir(), "volume.zarr");
+
+  // Attribute required for arrays with multiple attributes
+  CHECK(imageds_zarr_export(imageds, "volume", store));
+  CHECK(imageds_zarr_export(imageds, "volume", store, "NonExistent"));
+  CHECK(imageds_zarr_export(imageds, "volume", store, "Intensity", {2, 3}));
+
+  CHECK(!imageds_zarr_export(imageds, "volume", store, "Intensity"));
+  std::string zarray = read_file(append_paths(store, ".zarray"));
+  CHECK(zarray.find("\"chunks\": [2, 3, 4]") != std::string::npos);
+  CHECK(zarray.find("\"shape\": [5, 7, 9]") != std::string::npos);
+  CHECK(zarray.find("\"dtype\": \"<u2\"") != std::string::npos);
+  CHECK(zarray.find("\"compressor\": null") != std::string::npos);
+  std::string zattrs = read_file(append_paths(store, ".zattrs"));
+  CHECK(zattrs.find("\"_ARRAY_DIMENSIONS\": [\"Z\", \"Y\", \"X\"]") != std::string::npos);
+  CHECK(zattrs.find("\"spacing\": \"2\\\\0.5\\\\0.5\"") != std::string::npos);
+  CHECK(zattrs.find("\"description\": \"a \\\"quoted\\\" value\"") != std::string::npos);
+
+  // 3x3x3 chunks, edge chunks are padded with zeros
+  for (auto z=0; z<3; z++) {
+    for (auto y=0; y<3; y++) {
+      for (auto x=0; x<3; x++) {
+        std::string chunk = read_file(append_paths(store, std::to_string(z)+"."+std::to_string(y)+"."+std::to_string(x)));
+        REQUIRE(chunk.size() == 2*3*4*sizeof(uint16_t));
+        const uint16_t *cells = reinterpret_cast<const uint16_t *>(chunk.data());
+        bool matches = true;
+        for (auto i=0; i<2; i++) {
+          for (auto j=0; j<3; j++) {
+            for (auto k=0; k<4; k++) {
+              uint64_t zz = z*2+i, yy = y*3+j, xx = x*4+k;
+              uint16_t expected = zz < 5 && yy < 7 && xx < 9 ? volume[(zz*7 + yy)*9 + xx] : 0;
+              matches = matches && cells[(i*3 + j)*4 + k] == expected;
+            }
+          }
+        }
+        CHECK(matches);
+      }
+    }
+  }
+
+  // Compressed chunks of a custom shape
+  std::string compressed_store = append_paths(get_temp_dir(), "compressed.zarr");
+  CHECK(!imageds_zarr_export(imageds, "volume", compressed_store, "Intensity", {5, 7, 9}, 6));
+  zarray = read_file(append_paths(compressed_store, ".zarray"));
+  CHECK(zarray.find("\"compressor\": {\"id\": \"zlib\", \"level\": 6}") != std::string::npos);
+  std::string chunk = read_file(append_paths(compressed_store, "0.0.0"));
+  std::vector<uint16_t> decompressed(volume.size());
+  uLongf length = decompressed.size()*sizeof(uint16_t);
+  CHECK(uncompress(reinterpret_cast<Bytef *>(decompressed.data()), &length,
+                   reinterpret_cast<const Bytef *>(chunk.data()), chunk.size()) == Z_OK);
+  CHECK(decompressed == volume);
+}
+
+TEST_CASE_METHOD(TempDir, "Test NPY export", "[npy_export]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> volume = write_volume(imageds, "volume");
+  std::string filename = append_paths(get_temp_dir(), "volume.npy");
+
+  CHECK(imageds_npy_export(imageds, "volume", filename));
+  CHECK(!imageds_npy_export(imageds, "volume", filename, "Intensity"));
+  std::string npy = read_file(filename);
+  REQUIRE(npy.size() == 128 + volume.size()*sizeof(uint16_t));
+  CHECK(npy.substr(0, 8) == std::string("\x93NUMPY\x01\x00", 8));
+  CHECK(static_cast<uint8_t>(npy[8]) + 256*static_cast<uint8_t>(npy[9]) == 118);
+  CHECK(npy.substr(10, 64) == "{'descr': '<u2', 'fortran_order': False, 'shape': (5, 7, 9), }  ");
+  CHECK(npy[127] == '\n');
+  CHECK(!memcmp(npy.data()+128, volume.data(), volume.size()*sizeof(uint16_t)));
+
+  CHECK(!imageds_npy_export(imageds, "volume", filename, "Mask"));
+  npy = read_file(filename);
+  CHECK(npy.find("'descr': '|u1'") != std::string::npos);
+  CHECK(npy.size() == 128 + volume.size());
+  CHECK(npy[129] == 1);
+}
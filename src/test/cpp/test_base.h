@@ -28,6 +28,17 @@
  * @section DESCRIPTION Base class for imageds tests
  */
 
+#ifndef __TEST_BASE_H__
+#define __TEST_BASE_H__
+
+#include "imageds.h"
+#include "tiledb_utils.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 class TempDir {
  public:
   TempDir() {
@@ -41,6 +52,10 @@ class TempDir {
   const std::string& get_temp_dir() {
     return tmp_dirname_;
   }
+
+  void make_temp_cwd() {
+    chdir(get_temp_dir().c_str());
+  }
   
  private:
   std::string tmp_dirname_;
@@ -52,6 +67,8 @@ class TempDir {
       tmp_dir = P_tmpdir; // defined in stdio
     }
     assert(tmp_dir != NULL);
-    tmp_dirname_ = mkdtemp(const_cast<char *>((append_slash(tmp_dir)+dirname_pattern).c_str()));
+    tmp_dirname_ = mkdtemp(const_cast<char *>(append_paths(tmp_dir, dirname_pattern).c_str()));
   }
 };
+
+#endif // __TEST_BASE_H__
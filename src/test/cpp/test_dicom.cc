@@ -0,0 +1,245 @@
+/**
+ * @file test_dicom.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Omics Data Automation, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for DICOM series ingestion
+ */
+
+#include "catch.h"
+#include "dicom.h"
+#include "imageds.h"
+#include "test_base.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string.h>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+class DicomWriter {
+ public:
+  DicomWriter(bool explicit_vr) : m_explicit(explicit_vr) {
+    m_data.assign(128, 0);
+    m_data.insert(m_data.end(), {'D', 'I', 'C', 'M'});
+    std::string transfer_syntax = explicit_vr ? DICOM_EXPLICIT_VR_LITTLE_ENDIAN : DICOM_IMPLICIT_VR_LITTLE_ENDIAN;
+    element(0x0002, 0x0010, "UI", transfer_syntax, true);
+  }
+
+  void string(uint16_t group, uint16_t element_id, const char *vr, const std::string& value) {
+    element(group, element_id, vr, value, m_explicit);
+  }
+
+  void us(uint16_t group, uint16_t element_id, uint16_t value) {
+    element(group, element_id, "US", std::string(reinterpret_cast<char *>(&value), 2), m_explicit);
+  }
+
+  // Sequence of undefined length with one item of undefined length
+  void sequence(uint16_t group, uint16_t element_id) {
+    tag(group, element_id);
+    if (m_explicit) {
+      m_data.insert(m_data.end(), {'S', 'Q', 0, 0});
+    }
+    u32(0xFFFFFFFF);
+    tag(0xFFFE, 0xE000);
+    u32(0xFFFFFFFF);
+    string(0x0008, 0x0100, "SH", "CODE");
+    tag(0xFFFE, 0xE00D);
+    u32(0);
+    tag(0xFFFE, 0xE0DD);
+    u32(0);
+  }
+
+  void pixels(const std::vector<uint16_t>& pixels) {
+    element(0x7FE0, 0x0010, "OW", std::string(reinterpret_cast<const char *>(pixels.data()), pixels.size()*2), m_explicit);
+  }
+
+  void write(const std::string& filename) {
+    CHECK(!TileDBUtils::write_file(filename, m_data.data(), m_data.size()));
+  }
+
+ private:
+  void tag(uint16_t group, uint16_t element_id) {
+    m_data.insert(m_data.end(), {static_cast<char>(group & 0xFF), static_cast<char>(group >> 8),
+                                 static_cast<char>(element_id & 0xFF), static_cast<char>(element_id >> 8)});
+  }
+
+  void u32(uint32_t value) {
+    m_data.insert(m_data.end(), reinterpret_cast<char *>(&value), reinterpret_cast<char *>(&value)+4);
+  }
+
+  void element(uint16_t group, uint16_t element_id, const char *vr, std::string value, bool explicit_vr) {
+    if (value.size() % 2) value.push_back(' ');
+    tag(group, element_id);
+    if (explicit_vr) {
+      m_data.insert(m_data.end(), vr, vr+2);
+      if (!strcmp(vr, "OW") || !strcmp(vr, "OB")) {
+        m_data.insert(m_data.end(), {0, 0});
+        u32(value.size());
+      } else {
+        uint16_t length = value.size();
+        m_data.insert(m_data.end(), reinterpret_cast<char *>(&length), reinterpret_cast<char *>(&length)+2);
+      }
+    } else {
+      u32(value.size());
+    }
+    m_data.insert(m_data.end(), value.begin(), value.end());
+  }
+
+  bool m_explicit;
+  std::vector<char> m_data;
+};
+
+static void write_slice(const std::string& filename, const std::string& series_uid, int slice, bool explicit_vr,
+                        double slope=1.0) {
+  DicomWriter writer(explicit_vr);
+  writer.string(0x0008, 0x0060, "CS", "CT");
+  writer.sequence(0x0008, 0x1140);
+  writer.string(0x0020, 0x000E, "UI", series_uid);
+  writer.string(0x0020, 0x0013, "IS", std::to_string(10-slice));
+  std::ostringstream position;
+  position << "-10\\-20\\" << (slice*2.5 - 100);
+  writer.string(0x0020, 0x0032, "DS", position.str());
+  writer.string(0x0020, 0x0037, "DS", "1\\0\\0\\0\\1\\0");
+  writer.us(0x0028, 0x0002, 1);
+  writer.us(0x0028, 0x0010, 4);
+  writer.us(0x0028, 0x0011, 6);
+  writer.string(0x0028, 0x0030, "DS", "0.5\\0.75");
+  writer.us(0x0028, 0x0100, 16);
+  writer.us(0x0028, 0x0103, 0);
+  writer.string(0x0028, 0x1050, "DS", "-700\\40");
+  writer.string(0x0028, 0x1051, "DS", "400\\80");
+  writer.string(0x0028, 0x1052, "DS", "-1024");
+  std::ostringstream rescale_slope;
+  rescale_slope << slope;
+  writer.string(0x0028, 0x1053, "DS", rescale_slope.str());
+  std::vector<uint16_t> pixels(24);
+  for (auto i=0; i<24; i++) {
+    pixels[i] = slice*100 + i;
+  }
+  writer.pixels(pixels);
+  writer.write(filename);
+}
+
+TEST_CASE_METHOD(TempDir, "Test DICOM header", "[dicom_header]") {
+  std::string filename = append_paths(get_temp_dir(), "slice.dcm");
+  for (auto explicit_vr : {true, false}) {
+    TileDBUtils::delete_file(filename);
+    write_slice(filename, "1.2.3", 3, explicit_vr);
+    ImageDSDicomSlice slice;
+    CHECK(!imageds_dicom_read_header(filename, slice));
+    CHECK(slice.m_series_uid == "1.2.3");
+    CHECK(slice.m_modality == "CT");
+    CHECK(slice.m_instance_number == 7);
+    CHECK(slice.m_rows == 4);
+    CHECK(slice.m_columns == 6);
+    CHECK(slice.m_bits_allocated == 16);
+    CHECK(slice.m_has_position);
+    CHECK(slice.m_position[2] == -92.5);
+    CHECK(slice.m_pixel_spacing[1] == 0.75);
+    CHECK(slice.m_rescale_intercept == -1024);
+    CHECK(slice.m_has_window);
+    CHECK(slice.m_window_center == -700);
+    CHECK(slice.m_window_width == 400);
+    CHECK(slice.m_voi_lut_function == "LINEAR");
+    CHECK(slice.m_pixel_length == 48);
+    CHECK(!slice.m_encapsulated);
+  }
+
+  std::string not_dicom = append_paths(get_temp_dir(), "not_dicom.txt");
+  CHECK(!TileDBUtils::write_file(not_dicom, "Hello", 5));
+  ImageDSDicomSlice slice;
+  CHECK(imageds_dicom_read_header(not_dicom, slice));
+}
+
+TEST_CASE_METHOD(TempDir, "Test DICOM ingest", "[dicom_ingest]") {
+  std::string dicom_dir = append_paths(get_temp_dir(), "dicom");
+  CHECK(!TileDBUtils::create_dir(dicom_dir));
+  CHECK(!TileDBUtils::create_dir(append_paths(dicom_dir, "nested")));
+  // Slices are written out of order, some in a nested dir, alongside a second series
+  std::vector<int> order = {4, 0, 7, 2, 6, 1, 5, 3};
+  for (auto slice : order) {
+    std::string dir = slice % 2 ? append_paths(dicom_dir, "nested") : dicom_dir;
+    write_slice(append_paths(dir, "ct_" + std::to_string(slice) + ".dcm"), "1.2.3", slice, slice % 3);
+  }
+  for (auto slice=0; slice<3; slice++) {
+    write_slice(append_paths(dicom_dir, "other_" + std::to_string(slice) + ".dcm"), "1.2.4", slice, true, 2.0);
+  }
+  CHECK(!TileDBUtils::write_file(append_paths(dicom_dir, "README"), "Hello", 5));
+
+  std::vector<ImageDSDicomSeries> series;
+  CHECK(!imageds_dicom_scan(dicom_dir, series));
+  REQUIRE(series.size() == 2);
+  auto ct = std::find_if(series.begin(), series.end(), [](ImageDSDicomSeries& s) { return s.m_series_uid == "1.2.3"; });
+  REQUIRE(ct != series.end());
+  CHECK(ct->m_slices.size() == 8);
+  CHECK(ct->m_spacing[0] == 2.5);
+  CHECK(ct->m_spacing[1] == 0.5);
+  CHECK(ct->m_spacing[2] == 0.75);
+  CHECK(ct->type() == UINT16);
+
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  CHECK(!imageds_dicom_ingest(imageds, *ct, "ct", 3, 2));
+
+  ImageDSArray info;
+  CHECK(!imageds.array_info("ct", info));
+  REQUIRE(info.m_dimensions.size() == 3);
+  CHECK(info.m_dimensions[0]->m_end == 7);
+  CHECK(info.m_dimensions[0]->m_tile_extent == 3);
+  CHECK(info.m_dimensions[1]->m_end == 3);
+  CHECK(info.m_dimensions[2]->m_end == 5);
+
+  ImageDSArray array("ct");
+  std::vector<uint16_t> volume(8*24);
+  CHECK(!imageds.from_array(array, {volume.data()}, {volume.size()*sizeof(uint16_t)}));
+  for (auto slice=0; slice<8; slice++) {
+    for (auto i=0; i<24; i++) {
+      CHECK(volume[slice*24+i] == slice*100+i);
+    }
+  }
+
+  std::map<std::string, std::string> metadata;
+  CHECK(!imageds.read_metadata("ct", metadata));
+  CHECK(metadata["rescale_slope"] == "1");
+  CHECK(metadata["rescale_intercept"] == "-1024");
+  CHECK(metadata["spacing"] == "2.5\\0.5\\0.75");
+  CHECK(metadata["origin"] == "-10\\-20\\-100");
+  CHECK(metadata["dicom_series_uid"] == "1.2.3");
+  CHECK(metadata.count("rescale_slopes") == 0);
+  CHECK(metadata["window_center"] == "-700");
+  CHECK(metadata["window_width"] == "400");
+
+  // Display reads return 8 bit cells of the window of the series
+  ImageDSConversion display(UINT8);
+  CHECK(!imageds_dicom_display_conversion(imageds, "ct", display));
+  std::vector<uint8_t> pixels(8*24);
+  CHECK(!imageds.from_array(array, {}, {pixels.data()}, {pixels.size()}, {display}));
+  for (auto i=0ul; i<pixels.size(); i++) {
+    double value = volume[i] - 1024.0;
+    double expected = value <= -900 ? 0 : value > -500 ? 255 : ((value + 700.5)/399 + 0.5)*255;
+    CHECK(std::abs(pixels[i] - expected) <= 0.51);
+  }
+}
@@ -0,0 +1,188 @@
+/**
+ * @file test_hdf5.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for HDF5 import and export
+ */
+
+
+#include "catch.h"
+#include "hdf5_bridge.h"
+#include "imageds.h"
+#include "test_base.h"
+
+#include <hdf5.h>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+// Writes a 2D or 3D dataset of the given file type with an optional chunked layout and filters
+static void write_dataset(const std::string& filename, const std::string& dataset, std::vector<hsize_t> dims,
+                          hid_t file_type, const std::vector<uint16_t>& values, std::vector<hsize_t> chunk = {},
+                          bool shuffle = false, int deflate_level = 0, bool fletcher32 = false) {
+  hid_t file = TileDBUtils::is_file(filename) ? H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT)
+      : H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  REQUIRE(file >= 0);
+  hid_t space = H5Screate_simple(dims.size(), dims.data(), NULL);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  if (!chunk.empty()) {
+    H5Pset_chunk(dcpl, chunk.size(), chunk.data());
+    if (fletcher32) H5Pset_fletcher32(dcpl);
+    if (shuffle) H5Pset_shuffle(dcpl);
+    if (deflate_level) H5Pset_deflate(dcpl, deflate_level);
+  }
+  hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(lcpl, 1);
+  hid_t dset = H5Dcreate2(file, dataset.c_str(), file_type, space, lcpl, dcpl, H5P_DEFAULT);
+  REQUIRE(dset >= 0);
+  CHECK(H5Dwrite(dset, H5T_NATIVE_UINT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()) >= 0);
+
+  hid_t scalar = H5Screate(H5S_SCALAR);
+  double spacing[] = { 2, 0.5, 0.5 };
+  hsize_t spacing_num = 3;
+  hid_t vector_space = H5Screate_simple(1, &spacing_num, NULL);
+  hid_t attribute = H5Acreate2(dset, "spacing", H5T_IEEE_F64LE, vector_space, H5P_DEFAULT, H5P_DEFAULT);
+  H5Awrite(attribute, H5T_NATIVE_DOUBLE, spacing);
+  H5Aclose(attribute);
+  hid_t string_type = H5Tcopy(H5T_C_S1);
+  H5Tset_size(string_type, H5T_VARIABLE);
+  const char *modality = "MR";
+  attribute = H5Acreate2(dset, "modality", string_type, scalar, H5P_DEFAULT, H5P_DEFAULT);
+  H5Awrite(attribute, string_type, &modality);
+  H5Aclose(attribute);
+  H5Tclose(string_type);
+  H5Sclose(vector_space);
+  H5Sclose(scalar);
+
+  H5Dclose(dset);
+  H5Pclose(lcpl);
+  H5Pclose(dcpl);
+  H5Sclose(space);
+  H5Fclose(file);
+}
+
+static std::vector<uint16_t> volume(size_t cell_num) {
+  std::vector<uint16_t> values(cell_num);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i*7 + 3;
+  }
+  return values;
+}
+
+static std::vector<uint16_t> read_array(ImageDS& imageds, const std::string& array_path, size_t cell_num) {
+  ImageDSArray array(array_path);
+  array.add_attribute("Intensity", UINT16);
+  std::vector<uint16_t> values(cell_num);
+  CHECK(!imageds.from_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  return values;
+}
+
+TEST_CASE_METHOD(TempDir, "Test HDF5 import", "[hdf5_import]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::string filename = append_paths(get_temp_dir(), "volume.h5");
+  std::vector<uint16_t> values = volume(5*7*9);
+
+  // Chunks do not divide the dataset, the last chunk row is partially filled
+  write_dataset(filename, "/images/deflated", {5, 7, 9}, H5T_STD_U16LE, values, {2, 3, 4}, true, 4, true);
+  write_dataset(filename, "big_endian", {5, 7, 9}, H5T_STD_U16BE, values, {3, 7, 9});
+  write_dataset(filename, "contiguous", {5, 7, 9}, H5T_STD_U16LE, values);
+
+  CHECK(imageds_hdf5_import(imageds, append_paths(get_temp_dir(), "non_existent.h5"), "contiguous", "missing"));
+  CHECK(imageds_hdf5_import(imageds, filename, "non_existent", "missing"));
+
+  CHECK(!imageds_hdf5_import(imageds, filename, "/images/deflated", "deflated"));
+  ImageDSArray schema;
+  REQUIRE(!imageds.array_info("deflated", schema));
+  REQUIRE(schema.m_dimensions.size() == 3);
+  CHECK(schema.m_dimensions[0]->m_name == "Z");
+  CHECK(schema.m_dimensions[2]->m_name == "X");
+  CHECK(schema.m_dimensions[0]->m_end == 4);
+  CHECK(schema.m_dimensions[1]->m_tile_extent == 3);
+  CHECK(schema.m_dimensions[2]->m_tile_extent == 4);
+  CHECK(schema.m_attributes[0]->m_compression == GZIP);
+  CHECK(schema.m_attributes[0]->m_compression_level == 4);
+  CHECK(read_array(imageds, "deflated", values.size()) == values);
+  std::map<std::string, std::string> metadata;
+  CHECK(!imageds.read_metadata("deflated", metadata));
+  CHECK(metadata["spacing"] == "2\\0.5\\0.5");
+  CHECK(metadata["modality"] == "MR");
+
+  CHECK(!imageds_hdf5_import(imageds, filename, "big_endian", "big_endian"));
+  CHECK(read_array(imageds, "big_endian", values.size()) == values);
+
+  CHECK(!imageds_hdf5_import(imageds, filename, "contiguous", "contiguous", "Intensity", 3));
+  ImageDSArray contiguous_schema;
+  REQUIRE(!imageds.array_info("contiguous", contiguous_schema));
+  CHECK(contiguous_schema.m_dimensions[0]->m_tile_extent == 3);
+  CHECK(contiguous_schema.m_attributes[0]->m_compression == NONE);
+  CHECK(read_array(imageds, "contiguous", values.size()) == values);
+}
+
+TEST_CASE_METHOD(TempDir, "Test HDF5 export", "[hdf5_export]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> values = volume(5*7*9);
+  ImageDSArray array("volume");
+  array.add_dimension("Z", 0, 4, 2);
+  array.add_dimension("Y", 0, 6, 3);
+  array.add_dimension("X", 0, 8, 4);
+  array.add_attribute("Intensity", UINT16, GZIP, 5);
+  REQUIRE(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  std::map<std::string, std::string> metadata;
+  metadata["spacing"] = "2\\0.5\\0.5";
+  REQUIRE(!imageds.write_metadata("volume", metadata));
+
+  std::string filename = append_paths(get_temp_dir(), "exported.h5");
+  CHECK(imageds_hdf5_export(imageds, "volume", filename, "/exported/volume", "NonExistent"));
+  CHECK(!imageds_hdf5_export(imageds, "volume", filename, "/exported/volume"));
+  // Existing datasets are replaced
+  CHECK(!imageds_hdf5_export(imageds, "volume", filename, "/exported/volume"));
+
+  hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  REQUIRE(file >= 0);
+  hid_t dset = H5Dopen2(file, "/exported/volume", H5P_DEFAULT);
+  REQUIRE(dset >= 0);
+  hid_t dcpl = H5Dget_create_plist(dset);
+  hsize_t chunk[3];
+  CHECK(H5Pget_chunk(dcpl, 3, chunk) == 3);
+  CHECK(chunk[0] == 2);
+  CHECK(chunk[1] == 3);
+  CHECK(chunk[2] == 4);
+  CHECK(H5Pget_nfilters(dcpl) == 1);
+  CHECK(H5Pget_filter2(dcpl, 0, NULL, NULL, NULL, 0, NULL, NULL) == H5Z_FILTER_DEFLATE);
+  std::vector<uint16_t> exported(values.size());
+  CHECK(H5Dread(dset, H5T_NATIVE_UINT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, exported.data()) >= 0);
+  CHECK(exported == values);
+  CHECK(H5Aexists(dset, "spacing") > 0);
+  H5Pclose(dcpl);
+  H5Dclose(dset);
+  H5Fclose(file);
+
+  // Round trip through the raw chunk path
+  CHECK(!imageds_hdf5_import(imageds, filename, "/exported/volume", "reimported"));
+  CHECK(read_array(imageds, "reimported", values.size()) == values);
+  metadata.clear();
+  CHECK(!imageds.read_metadata("reimported", metadata));
+  CHECK(metadata["spacing"] == "2\\0.5\\0.5");
+}
@@ -0,0 +1,522 @@
+/**
+ * @file test_image_stack.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for TIFF and PNG image and image stack ingestion
+ */
+
+#include "catch.h"
+#include "image_stack.h"
+#include "imageds.h"
+#include "test_base.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <map>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef IMAGEDS_PNG
+#include <png.h>
+#endif
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+// Minimal TIFF encoder, every added image becomes an image file directory of the file
+class TiffWriter {
+ public:
+  TiffWriter(bool big_endian=false, bool big_tiff=false) : m_big_endian(big_endian), m_big_tiff(big_tiff) {
+    m_bytes.push_back(big_endian ? 'M' : 'I');
+    m_bytes.push_back(big_endian ? 'M' : 'I');
+    put(big_tiff ? 43 : 42, 2);
+    if (big_tiff) {
+      put(8, 2);
+      put(0, 2);
+    }
+    m_next_ifd = m_bytes.size();
+    put(0, offset_size());
+  }
+
+  // Chunks are tiles if tile_width is set, strips of rows_per_strip rows otherwise
+  void add_image(const void *pixels, uint32_t width, uint32_t height, int samples, int bits, int sample_format=1,
+                 int compression=1, int predictor=1, uint32_t tile_width=0, uint32_t tile_height=0,
+                 uint32_t rows_per_strip=0) {
+    size_t sample_size = bits/8;
+    size_t pixel_size = samples*sample_size;
+    uint32_t chunk_width = tile_width ? tile_width : width;
+    uint32_t chunk_height = tile_width ? tile_height : rows_per_strip ? rows_per_strip : height;
+    uint32_t across = (width+chunk_width-1)/chunk_width;
+    uint32_t down = (height+chunk_height-1)/chunk_height;
+
+    std::vector<uint64_t> offsets, byte_counts;
+    for (uint32_t chunk=0; chunk<across*down; chunk++) {
+      uint32_t y0 = (chunk/across)*chunk_height;
+      uint32_t x0 = (chunk%across)*chunk_width;
+      uint32_t rows = tile_width ? chunk_height : std::min(chunk_height, height-y0);
+      std::vector<char> data(rows*chunk_width*pixel_size, 0);
+      for (uint32_t y=y0; y<std::min(y0+rows, height); y++) {
+        for (uint32_t x=x0; x<std::min(x0+chunk_width, width); x++) {
+          memcpy(data.data()+((y-y0)*chunk_width + x-x0)*pixel_size,
+                 reinterpret_cast<const char *>(pixels)+(y*width + x)*pixel_size, pixel_size);
+        }
+      }
+      if (predictor == 2) {
+        difference(data, rows, chunk_width*samples, samples, sample_size);
+      }
+      if (m_big_endian) {
+        for (size_t i=0; i<data.size(); i+=sample_size) {
+          std::reverse(data.begin()+i, data.begin()+i+sample_size);
+        }
+      }
+      std::vector<char> encoded = encode(data, compression);
+      offsets.push_back(m_bytes.size());
+      byte_counts.push_back(encoded.size());
+      m_bytes.insert(m_bytes.end(), encoded.begin(), encoded.end());
+    }
+
+    std::map<int, std::pair<int, std::vector<uint64_t>>> tags;
+    int long_type = m_big_tiff ? 16 : 4;
+    tags[256] = {4, {width}};
+    tags[257] = {4, {height}};
+    tags[258] = {3, std::vector<uint64_t>(samples, bits)};
+    tags[259] = {3, {static_cast<uint64_t>(compression)}};
+    tags[262] = {3, {samples >= 3 ? 2ul : 1ul}};
+    tags[277] = {3, {static_cast<uint64_t>(samples)}};
+    tags[284] = {3, {1}};
+    tags[339] = {3, std::vector<uint64_t>(samples, sample_format)};
+    if (predictor != 1) {
+      tags[317] = {3, {static_cast<uint64_t>(predictor)}};
+    }
+    if (tile_width) {
+      tags[322] = {4, {tile_width}};
+      tags[323] = {4, {tile_height}};
+      tags[324] = {long_type, offsets};
+      tags[325] = {long_type, byte_counts};
+    } else {
+      tags[273] = {long_type, offsets};
+      tags[278] = {4, {chunk_height}};
+      tags[279] = {long_type, byte_counts};
+    }
+
+    // Values that do not fit into the entries precede the directory
+    std::map<int, uint64_t> value_offsets;
+    for (auto& tag : tags) {
+      size_t type_size = tag.second.first == 3 ? 2 : tag.second.first == 4 ? 4 : 8;
+      if (tag.second.second.size()*type_size > offset_size()) {
+        value_offsets[tag.first] = m_bytes.size();
+        for (auto value : tag.second.second) {
+          put(value, type_size);
+        }
+      }
+    }
+    if (m_bytes.size()%2) {
+      m_bytes.push_back(0);
+    }
+    patch(m_next_ifd, m_bytes.size(), offset_size());
+    put(tags.size(), m_big_tiff ? 8 : 2);
+    for (auto& tag : tags) {
+      size_t type_size = tag.second.first == 3 ? 2 : tag.second.first == 4 ? 4 : 8;
+      put(tag.first, 2);
+      put(tag.second.first, 2);
+      put(tag.second.second.size(), offset_size());
+      size_t value_start = m_bytes.size();
+      if (value_offsets.count(tag.first)) {
+        put(value_offsets[tag.first], offset_size());
+      } else {
+        for (auto value : tag.second.second) {
+          put(value, type_size);
+        }
+        m_bytes.resize(value_start+offset_size(), 0);
+      }
+    }
+    m_next_ifd = m_bytes.size();
+    put(0, offset_size());
+  }
+
+  void write(const std::string& filename) {
+    CHECK(!TileDBUtils::write_file(filename, m_bytes.data(), m_bytes.size(), true));
+  }
+
+ private:
+  bool m_big_endian;
+  bool m_big_tiff;
+  std::vector<char> m_bytes;
+  size_t m_next_ifd;
+
+  size_t offset_size() const {
+    return m_big_tiff ? 8 : 4;
+  }
+
+  void patch(size_t offset, uint64_t value, size_t size) {
+    for (size_t i=0; i<size; i++) {
+      size_t shift = m_big_endian ? (size-1-i)*8 : i*8;
+      m_bytes[offset+i] = (value >> shift) & 0xFF;
+    }
+  }
+
+  void put(uint64_t value, size_t size) {
+    m_bytes.resize(m_bytes.size()+size);
+    patch(m_bytes.size()-size, value, size);
+  }
+
+  static void difference(std::vector<char>& data, uint32_t rows, uint32_t row_samples, int samples,
+                         size_t sample_size) {
+    for (uint32_t row=0; row<rows; row++) {
+      for (uint32_t i=row_samples; i-- > static_cast<uint32_t>(samples); ) {
+        uint64_t value = 0, previous = 0;
+        char *current = data.data() + (row*row_samples + i)*sample_size;
+        memcpy(&value, current, sample_size);
+        memcpy(&previous, current-samples*sample_size, sample_size);
+        value -= previous;
+        memcpy(current, &value, sample_size);
+      }
+    }
+  }
+
+  static std::vector<char> encode(const std::vector<char>& data, int compression) {
+    std::vector<char> encoded;
+    switch (compression) {
+      case 5:
+        return lzw(data);
+      case 8: {
+        uLongf length = compressBound(data.size());
+        encoded.resize(length);
+        CHECK(compress(reinterpret_cast<Bytef *>(encoded.data()), &length,
+                       reinterpret_cast<const Bytef *>(data.data()), data.size()) == Z_OK);
+        encoded.resize(length);
+        return encoded;
+      }
+      case 32773:
+        // Repeat runs of identical bytes, literal runs otherwise
+        for (size_t i=0; i<data.size(); ) {
+          size_t run = 1;
+          while (i+run < data.size() && run < 128 && data[i+run] == data[i]) run++;
+          if (run > 2) {
+            encoded.push_back(static_cast<char>(1-static_cast<int>(run)));
+            encoded.push_back(data[i]);
+          } else {
+            run = std::min<size_t>(data.size()-i, 128);
+            encoded.push_back(run-1);
+            encoded.insert(encoded.end(), data.begin()+i, data.begin()+i+run);
+          }
+          i += run;
+        }
+        return encoded;
+      default:
+        return data;
+    }
+  }
+
+  static std::vector<char> lzw(const std::vector<char>& data) {
+    std::vector<char> encoded;
+    uint64_t bits = 0;
+    int bit_count = 0;
+    int width = 9;
+    auto emit = [&](int code) {
+      bits = (bits << width) | code;
+      bit_count += width;
+      while (bit_count >= 8) {
+        encoded.push_back((bits >> (bit_count-8)) & 0xFF);
+        bit_count -= 8;
+      }
+    };
+    std::map<std::string, int> table;
+    int next = 258;
+    emit(256);
+    std::string current;
+    for (auto c : data) {
+      std::string extended = current + c;
+      if (current.empty() || table.count(extended)) {
+        current = extended;
+        continue;
+      }
+      emit(current.size() == 1 ? static_cast<unsigned char>(current[0]) : table[current]);
+      if (next == 4093) {
+        emit(256);
+        table.clear();
+        next = 258;
+        width = 9;
+      } else {
+        table[extended] = next++;
+        if (next > (1 << width) - 1) width++;
+      }
+      current = std::string(1, c);
+    }
+    if (!current.empty()) {
+      emit(current.size() == 1 ? static_cast<unsigned char>(current[0]) : table[current]);
+      if (++next > (1 << width) - 1) width++;
+    }
+    emit(257);
+    if (bit_count) {
+      encoded.push_back((bits << (8-bit_count)) & 0xFF);
+    }
+    return encoded;
+  }
+};
+
+template<typename T>
+static std::vector<T> image(size_t width, size_t height, int samples=1, int seed=0) {
+  std::vector<T> data(width*height*samples);
+  for (auto i=0ul; i<data.size(); i++) {
+    data[i] = static_cast<T>((i*7 + seed*13) % 251 + (i/97)*3);
+  }
+  return data;
+}
+
+template<typename T>
+static void check_array(ImageDS& imageds, const std::string& array_path, const std::vector<uint64_t>& shape,
+                        const std::vector<T>& expected, int samples=1) {
+  ImageDSArray array;
+  REQUIRE(!imageds.array_info(array_path, array));
+  REQUIRE(array.m_dimensions.size() == shape.size());
+  for (auto i=0ul; i<shape.size(); i++) {
+    CHECK(array.m_dimensions[i]->m_end == shape[i]-1);
+  }
+  REQUIRE(array.m_attributes.size() == static_cast<size_t>(samples));
+
+  size_t cell_num = expected.size()/samples;
+  std::vector<std::vector<T>> channels(samples, std::vector<T>(cell_num));
+  std::vector<void *> buffers;
+  std::vector<size_t> sizes;
+  for (auto& channel : channels) {
+    buffers.push_back(channel.data());
+    sizes.push_back(channel.size()*sizeof(T));
+  }
+  ImageDSArray read_array(array_path);
+  CHECK(!imageds.from_array(read_array, buffers, sizes));
+  for (auto i=0; i<samples; i++) {
+    CHECK(array.m_attributes[i]->m_name == (samples == 1 ? "Intensity" : "Intensity_" + std::to_string(i)));
+    bool matches = true;
+    for (auto j=0ul; j<cell_num; j++) {
+      matches = matches && channels[i][j] == expected[j*samples+i];
+    }
+    CHECK(matches);
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test TIFF decoding", "[tiff_decode]") {
+  std::string filename = append_paths(get_temp_dir(), "image.tif");
+  std::vector<uint16_t> gray = image<uint16_t>(37, 29);
+
+  for (auto big_endian : {false, true}) {
+    for (auto compression : {1, 5, 8, 32773}) {
+      for (auto predictor : {1, 2}) {
+        for (auto tiled : {false, true}) {
+          TiffWriter writer(big_endian);
+          writer.add_image(gray.data(), 37, 29, 1, 16, 1, compression, predictor, tiled ? 16 : 0, tiled ? 8 : 0, 5);
+          writer.write(filename);
+
+          ImageDSImageFile file;
+          REQUIRE(!imageds_image_read_header(filename, file));
+          CHECK(file.m_format == TIFF_IMAGE);
+          CHECK(file.m_width == 37);
+          CHECK(file.m_height == 29);
+          CHECK(file.m_samples == 1);
+          CHECK(file.m_type == UINT16);
+          CHECK(file.m_tiled == tiled);
+          CHECK(file.m_tile_width == (tiled ? 16u : 0u));
+          std::vector<uint16_t> decoded(gray.size());
+          CHECK(!imageds_image_read(file, decoded.data()));
+          CHECK(decoded == gray);
+        }
+      }
+    }
+  }
+
+  // RGB, signed and floating point samples in a BigTIFF with two pages
+  std::vector<uint8_t> rgb = image<uint8_t>(37, 29, 3);
+  std::vector<float> floats(37*29);
+  std::transform(gray.begin(), gray.end(), floats.begin(), [](uint16_t v) { return v*0.25f - 8; });
+  TiffWriter writer(false, true);
+  writer.add_image(rgb.data(), 37, 29, 3, 8, 1, 5, 2, 16, 16);
+  writer.add_image(floats.data(), 37, 29, 1, 32, 3, 8);
+  writer.write(filename);
+  ImageDSImageFile file;
+  REQUIRE(!imageds_image_read_header(filename, file));
+  CHECK(file.m_directory_num == 2);
+  CHECK(file.m_samples == 3);
+  CHECK(file.pixel_size() == 3);
+  std::vector<uint8_t> decoded_rgb(rgb.size());
+  CHECK(!imageds_image_read(file, decoded_rgb.data()));
+  CHECK(decoded_rgb == rgb);
+  REQUIRE(!imageds_image_read_header(filename, file, 1));
+  CHECK(file.m_type == FLOAT32);
+  std::vector<float> decoded_floats(floats.size());
+  CHECK(!imageds_image_read(file, decoded_floats.data()));
+  CHECK(decoded_floats == floats);
+  CHECK(imageds_image_read_header(filename, file, 2));
+
+  // JPEG compression is not supported
+  TiffWriter jpeg;
+  jpeg.add_image(gray.data(), 37, 29, 1, 16, 1, 7);
+  jpeg.write(filename);
+  CHECK(imageds_image_read_header(filename, file));
+  CHECK(errno == ENOTSUP);
+
+  CHECK(imageds_image_read_header(append_paths(get_temp_dir(), "non-existent.tif"), file));
+  CHECK(!TileDBUtils::write_file(filename, "not an image file", 17, true));
+  CHECK(imageds_image_read_header(filename, file));
+}
+
+TEST_CASE_METHOD(TempDir, "Test image stack ingest", "[stack_ingest]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+
+  std::vector<std::string> filenames;
+  std::vector<uint16_t> stack;
+  for (auto i=0; i<5; i++) {
+    std::vector<uint16_t> slice = image<uint16_t>(37, 29, 1, i);
+    stack.insert(stack.end(), slice.begin(), slice.end());
+    filenames.push_back(append_paths(get_temp_dir(), "slice" + std::to_string(i) + ".tif"));
+    TiffWriter writer(i%2);
+    writer.add_image(slice.data(), 37, 29, 1, 16, 1, i%2 ? 8 : 5, 2);
+    writer.write(filenames[i]);
+  }
+  // Slabs of 2 slices
+  CHECK(!imageds_stack_ingest(imageds, filenames, "stack/gray", 2, 8));
+  check_array(imageds, "stack/gray", {5, 29, 37}, stack);
+  ImageDSArray info;
+  REQUIRE(!imageds.array_info("stack/gray", info));
+  CHECK(info.m_dimensions[0]->m_name == "Z");
+  CHECK(info.m_dimensions[0]->m_tile_extent == 2);
+  CHECK(info.m_dimensions[2]->m_tile_extent == 8);
+
+  std::vector<std::string> rgb_filenames;
+  std::vector<uint8_t> rgb_stack;
+  for (auto i=0; i<3; i++) {
+    std::vector<uint8_t> slice = image<uint8_t>(37, 29, 3, i);
+    rgb_stack.insert(rgb_stack.end(), slice.begin(), slice.end());
+    rgb_filenames.push_back(append_paths(get_temp_dir(), "rgb" + std::to_string(i) + ".tif"));
+    TiffWriter writer;
+    writer.add_image(slice.data(), 37, 29, 3, 8, 1, 32773, 1, 0, 0, 4);
+    writer.write(rgb_filenames[i]);
+  }
+  CHECK(!imageds_stack_ingest(imageds, rgb_filenames, "stack/rgb"));
+  check_array(imageds, "stack/rgb", {3, 29, 37}, rgb_stack, 3);
+
+  // Slices have to agree in size and type
+  filenames[3] = rgb_filenames[0];
+  CHECK(imageds_stack_ingest(imageds, filenames, "stack/mixed"));
+  CHECK(errno == EINVAL);
+  filenames[3] = append_paths(get_temp_dir(), "non-existent.tif");
+  CHECK(imageds_stack_ingest(imageds, filenames, "stack/missing"));
+  CHECK(imageds_stack_ingest(imageds, {}, "stack/empty"));
+}
+
+TEST_CASE_METHOD(TempDir, "Test tiled TIFF ingest", "[tiff_ingest]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::string filename = append_paths(get_temp_dir(), "pyramid.tif");
+
+  // Two level pyramid with 16x16 tiles
+  std::vector<uint16_t> level0 = image<uint16_t>(53, 41);
+  std::vector<uint16_t> level1 = image<uint16_t>(27, 21, 1, 1);
+  TiffWriter writer;
+  writer.add_image(level0.data(), 53, 41, 1, 16, 1, 8, 2, 16, 16);
+  writer.add_image(level1.data(), 27, 21, 1, 16, 1, 5, 1, 16, 16);
+  writer.write(filename);
+
+  CHECK(!imageds_tiff_ingest(imageds, filename, "pyramid/level0"));
+  check_array(imageds, "pyramid/level0", {41, 53}, level0);
+  ImageDSArray info;
+  REQUIRE(!imageds.array_info("pyramid/level0", info));
+  CHECK(info.m_dimensions[0]->m_name == "Y");
+  CHECK(info.m_dimensions[0]->m_tile_extent == 16);
+  CHECK(info.m_dimensions[1]->m_tile_extent == 16);
+  CHECK(!imageds_tiff_ingest(imageds, filename, "pyramid/level1", 1));
+  check_array(imageds, "pyramid/level1", {21, 27}, level1);
+  // Bands not aligned to the TIFF tiles still decode each of the 3x4 tiles once
+  imageds_trace_clear();
+  imageds_trace_enable();
+  CHECK(!imageds_tiff_ingest(imageds, filename, "pyramid/unaligned", 0, 12));
+  imageds_trace_enable(false);
+  std::string json = imageds_trace_json();
+  size_t decodes = 0;
+  for (auto pos=json.find("\"name\": \"tiff_read_chunk\""); pos!=std::string::npos;
+       pos=json.find("\"name\": \"tiff_read_chunk\"", pos+1)) {
+    decodes++;
+  }
+  CHECK(decodes == 12);
+  check_array(imageds, "pyramid/unaligned", {41, 53}, level0);
+  CHECK(imageds_tiff_ingest(imageds, filename, "pyramid/level2", 2));
+
+  // Stripped RGBA
+  std::vector<uint8_t> rgba = image<uint8_t>(53, 41, 4);
+  TiffWriter stripped(true);
+  stripped.add_image(rgba.data(), 53, 41, 4, 8, 1, 5, 2, 0, 0, 3);
+  stripped.write(filename);
+  CHECK(!imageds_tiff_ingest(imageds, filename, "stripped/rgba", 0, 8));
+  check_array(imageds, "stripped/rgba", {41, 53}, rgba, 4);
+}
+
+#ifdef IMAGEDS_PNG
+static void write_png(const std::string& filename, const void *pixels, uint32_t width, uint32_t height,
+                      int color_type, int bit_depth) {
+  FILE *fp = fopen(filename.c_str(), "wb");
+  REQUIRE(fp);
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png_create_info_struct(png);
+  png_init_io(png, fp);
+  png_set_IHDR(png, info, width, height, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  if (bit_depth == 16) {
+    png_set_swap(png);
+  }
+  size_t row_size = png_get_rowbytes(png, info);
+  for (uint32_t i=0; i<height; i++) {
+    png_write_row(png, reinterpret_cast<png_const_bytep>(pixels) + i*row_size);
+  }
+  png_write_end(png, NULL);
+  png_destroy_write_struct(&png, &info);
+  fclose(fp);
+}
+
+TEST_CASE_METHOD(TempDir, "Test PNG stack ingest", "[png_ingest]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+
+  std::vector<std::string> filenames;
+  std::vector<uint16_t> stack;
+  for (auto i=0; i<3; i++) {
+    std::vector<uint16_t> slice = image<uint16_t>(37, 29, 1, i);
+    stack.insert(stack.end(), slice.begin(), slice.end());
+    filenames.push_back(append_paths(get_temp_dir(), "slice" + std::to_string(i) + ".png"));
+    write_png(filenames[i], slice.data(), 37, 29, PNG_COLOR_TYPE_GRAY, 16);
+  }
+  ImageDSImageFile file;
+  REQUIRE(!imageds_image_read_header(filenames[0], file));
+  CHECK(file.m_format == PNG_IMAGE);
+  CHECK(file.m_type == UINT16);
+  CHECK(!imageds_stack_ingest(imageds, filenames, "png/gray"));
+  check_array(imageds, "png/gray", {3, 29, 37}, stack);
+
+  std::vector<uint8_t> rgb = image<uint8_t>(37, 29, 3);
+  write_png(filenames[0], rgb.data(), 37, 29, PNG_COLOR_TYPE_RGB, 8);
+  REQUIRE(!imageds_image_read_header(filenames[0], file));
+  CHECK(file.m_samples == 3);
+  std::vector<uint8_t> decoded(rgb.size());
+  CHECK(!imageds_image_read(file, decoded.data()));
+  CHECK(decoded == rgb);
+}
+#endif
@@ -29,11 +29,17 @@
  */
 
 #include "catch.h"
+#include "convert.h"
 #include "error.h"
 #include "imageds.h"
 #include "tiledb_utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fcntl.h>
+#include <numeric>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -350,6 +356,1085 @@ TEST_CASE_METHOD(TempDir, "Test to and from array 2D", "[to_from_array_2D]") {
 
   std::string expected("ABCEFGIJK");
   CHECK(expected.compare(bytes) == 0);
+
+  // Subarrays narrower than a dimension cannot be described by ImageDSDimension
+  ImageDSArray row(ARRAY);
+  memset(bytes, 0, 10);
+  buf_size[0] = 4;
+  CHECK(!imageds.from_array(row, {1, 1, 0, 3}, buf, buf_size));
+  CHECK(std::string("EFGH").compare(bytes) == 0);
+  CHECK(!imageds.from_array(row, {0, 3, 2, 2}, buf, buf_size));
+  CHECK(std::string("CGKO").compare(bytes) == 0);
+  delete [] bytes;
+}
+
+
+
+TEST_CASE_METHOD(TempDir, "Test stats", "[stats]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  ImageDSArray array("stats");
+  array.add_dimension("Y", 0, 7, 4);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  std::vector<uint16_t> values(64, 1);
+  CHECK(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  CHECK(!imageds.from_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  ImageDSArray read_array("stats");
+  read_array.add_attribute("Intensity", UINT16);
+  CHECK(!imageds.from_array(read_array, {1, 2, 1, 2}, {values.data()}, {4*sizeof(uint16_t)}));
+  CHECK(imageds.from_array(read_array, {0, 8, 0, 0}, {values.data()}, {9*sizeof(uint16_t)}));
+
+  ImageDSStats stats = imageds.stats();
+  REQUIRE(stats.m_arrays.count("stats") == 1);
+  ImageDSArrayStats& array_stats = stats.m_arrays["stats"];
+  CHECK(array_stats.m_to_array_calls == 1);
+  CHECK(array_stats.m_from_array_calls == 3);
+  CHECK(array_stats.m_errors == 1);
+  CHECK(array_stats.m_bytes_written == 128);
+  CHECK(array_stats.m_bytes_requested == 128 + 8);
+  CHECK(array_stats.m_tiles_touched == 4 + 1);
+  CHECK(array_stats.m_to_array_latency.m_count == 1);
+  CHECK(array_stats.m_from_array_latency.m_count == 3);
+  CHECK(array_stats.m_from_array_latency.percentile(1) == array_stats.m_from_array_latency.m_max_us);
+  CHECK(stats.total().m_from_array_calls == 3);
+
+  // Tile store reads count cache hits and decompressed bytes
+  imageds.reset_stats();
+  CHECK(imageds.stats().m_arrays.empty());
+  imageds.enable_tile_dedup();
+  ImageDSArray deduped("deduped");
+  deduped.add_dimension("Y", 0, 7, 4);
+  deduped.add_dimension("X", 0, 7, 4);
+  deduped.add_attribute("Intensity", UINT16, GZIP, 1);
+  CHECK(!imageds.to_array(deduped, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  CHECK(!imageds.from_array(deduped, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  CHECK(!imageds.from_array(deduped, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  array_stats = imageds.stats().m_arrays["deduped"];
+  CHECK(array_stats.m_tiles_touched == 8);
+  // Four identical tiles, only the first read of the first call misses the cache
+  CHECK(array_stats.m_cache_hits >= 6);
+  CHECK(array_stats.m_bytes_decompressed == (8 - array_stats.m_cache_hits)*16*sizeof(uint16_t));
+  CHECK(array_stats.m_bytes_read > 0);
+}
+
+TEST_CASE("Test ImageDSLatencyHistogram", "[stats]") {
+  ImageDSLatencyHistogram histogram;
+  CHECK(histogram.percentile(0.5) == 0);
+  for (auto latency : {0, 1, 3, 100, 5000}) {
+    histogram.add(latency);
+  }
+  CHECK(histogram.m_count == 5);
+  CHECK(histogram.m_total_us == 5104);
+  CHECK(histogram.m_max_us == 5000);
+  CHECK(histogram.m_buckets[0] == 1);
+  CHECK(histogram.m_buckets[1] == 1);
+  CHECK(histogram.m_buckets[2] == 1);
+  CHECK(histogram.percentile(0.5) == 3);
+  CHECK(histogram.percentile(0.8) == 127);
+  CHECK(histogram.percentile(1) == 5000);
+  ImageDSLatencyHistogram other;
+  other.add(1000000);
+  histogram.merge(other);
+  CHECK(histogram.m_count == 6);
+  CHECK(histogram.m_max_us == 1000000);
+}
+
+TEST_CASE_METHOD(TempDir, "Test query profiler", "[query_profile]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  ImageDSArray array("profiled");
+  array.add_dimension("Y", 0, 7, 4);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  array.add_attribute("Mask", UINT8);
+  std::vector<uint16_t> values(64, 1);
+  std::vector<uint8_t> mask(64, 1);
+  CHECK(!imageds.to_array(array, {values.data(), mask.data()}, {values.size()*sizeof(uint16_t), mask.size()}));
+
+  std::vector<ImageDSQueryProfile> profiles;
+  imageds.set_query_profiler([&profiles](const ImageDSQueryProfile& profile) {
+      profiles.push_back(profile);
+    });
+  ImageDSArray read_array("profiled");
+  read_array.add_attribute("Intensity", UINT16);
+  // A single cell of one tile and a 2x2 region across all four tiles
+  CHECK(!imageds.from_array(read_array, {1, 1, 1, 1}, {values.data()}, {sizeof(uint16_t)}));
+  CHECK(!imageds.from_array(read_array, {3, 4, 3, 4}, {values.data()}, {4*sizeof(uint16_t)}));
+  CHECK(imageds.from_array(read_array, {0, 8, 0, 0}, {values.data()}, {9*sizeof(uint16_t)}));
+  REQUIRE(profiles.size() == 2);
+  CHECK(profiles[0].m_array_path == "profiled");
+  CHECK(profiles[0].m_subarray == std::vector<uint64_t>({1, 1, 1, 1}));
+  CHECK(profiles[0].m_tiles_touched == 1);
+  CHECK(profiles[0].m_bytes_returned == 2);
+  CHECK(profiles[0].m_bytes_decompressed == 16*sizeof(uint16_t));
+  CHECK(profiles[0].amplification() == 16);
+  CHECK(profiles[0].m_fragments_scanned >= 1);
+  CHECK(profiles[1].m_tiles_touched == 4);
+  CHECK(profiles[1].amplification() == 16);
+
+  imageds.set_query_profiler(NULL);
+  CHECK(!imageds.from_array(read_array, {1, 1, 1, 1}, {values.data()}, {sizeof(uint16_t)}));
+  CHECK(profiles.size() == 2);
+}
+
+TEST_CASE_METHOD(TempDir, "Test estimate", "[estimate]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  ImageDSArray array("estimated");
+  array.add_dimension("Y", 0, 7, 4);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  array.add_attribute("Mask", UINT8);
+  std::vector<uint16_t> values(64, 1);
+  std::vector<uint8_t> mask(64, 1);
+  ImageDSQueryEstimate estimate;
+  CHECK(imageds.estimate(array, {}, estimate));
+  CHECK(!imageds.to_array(array, {values.data(), mask.data()}, {values.size()*sizeof(uint16_t), mask.size()}));
+
+  ImageDSArray read_array("estimated");
+  CHECK(!imageds.estimate(read_array, {}, estimate));
+  CHECK(estimate.m_tiles_touched == 8);
+  CHECK(estimate.m_decompressed_bytes == 64*3);
+  CHECK(estimate.m_result_bytes == 64*3);
+  CHECK(estimate.m_result_sizes == std::vector<uint64_t>({128, 64}));
+  uint64_t domain_compressed_bytes = estimate.m_compressed_bytes;
+  CHECK(domain_compressed_bytes > 0);
+
+  read_array.add_attribute("Mask", UINT8);
+  CHECK(!imageds.estimate(read_array, {1, 1, 1, 1}, estimate));
+  CHECK(estimate.m_tiles_touched == 1);
+  CHECK(estimate.m_decompressed_bytes == 16);
+  CHECK(estimate.m_result_sizes == std::vector<uint64_t>({1}));
+  CHECK(estimate.m_compressed_bytes <= domain_compressed_bytes);
+  CHECK(imageds.estimate(read_array, {0, 8, 0, 0}, estimate));
+  CHECK(imageds.estimate(read_array, {0, 0}, estimate));
+
+  ImageDSBuffers buffers = imageds.create_read_buffers(read_array, {3, 4, 3, 5});
+  REQUIRE(buffers.get_sizes() == std::vector<size_t>({6}));
+  CHECK(!imageds.from_array(read_array, {3, 4, 3, 5}, buffers.get(), buffers.get_sizes()));
+  free(buffers.get()[0]);
+  ImageDSArray unknown_attribute("estimated");
+  unknown_attribute.add_attribute("Unknown", UINT8);
+  CHECK_THROWS(imageds.create_read_buffers(unknown_attribute, {}));
+
+  imageds.enable_tile_dedup();
+  ImageDSArray deduped("deduped");
+  deduped.add_dimension("Y", 0, 7, 4);
+  deduped.add_dimension("X", 0, 7, 4);
+  deduped.add_attribute("Intensity", UINT16, GZIP, 1);
+  CHECK(!imageds.to_array(deduped, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  CHECK(!imageds.estimate(deduped, {}, estimate));
+  CHECK(estimate.m_tiles_touched == 4);
+  CHECK(estimate.m_result_bytes == 128);
+  CHECK(estimate.m_compressed_bytes > 0);
+  uint64_t deduped_compressed_bytes = estimate.m_compressed_bytes;
+  CHECK(!imageds.estimate(deduped, {0, 3, 0, 3}, estimate));
+  CHECK(estimate.m_tiles_touched == 1);
+  CHECK(estimate.m_compressed_bytes*4 == deduped_compressed_bytes);
+}
+
+TEST_CASE_METHOD(TempDir, "Test gather", "[gather]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> values(64);
+  std::vector<uint8_t> mask(64);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i;
+    mask[i] = 64-i;
+  }
+  // Overlapping ROIs, an ROI spanning all tiles and a repeated ROI
+  std::vector<std::vector<uint64_t>> rois = {{1, 2, 1, 2}, {3, 4, 3, 4}, {0, 7, 6, 7}, {1, 2, 1, 2}, {5, 5, 0, 7}};
+
+  // Arrays read through TileDB and through the tile store
+  for (auto dedup : {false, true}) {
+    std::string array_path = dedup ? "gathered_deduped" : "gathered";
+    imageds.enable_tile_dedup(dedup);
+    ImageDSArray array(array_path);
+    array.add_dimension("Y", 0, 7, 4);
+    array.add_dimension("X", 0, 7, 4);
+    array.add_attribute("Intensity", UINT16);
+    array.add_attribute("Mask", UINT8);
+    CHECK(!imageds.to_array(array, {values.data(), mask.data()}, {values.size()*sizeof(uint16_t), mask.size()}));
+
+    ImageDSArray read_array(array_path);
+    ImageDSBuffers buffers = imageds.create_gather_buffers(read_array, rois);
+    REQUIRE(buffers.get_sizes() == std::vector<size_t>({2*(4+4+16+4+8), 4+4+16+4+8}));
+    std::vector<uint64_t> cell_offsets;
+    CHECK(!imageds.gather(read_array, rois, buffers.get(), buffers.get_sizes(), cell_offsets));
+    CHECK(cell_offsets == std::vector<uint64_t>({0, 4, 8, 24, 28}));
+    for (auto k=0ul; k<rois.size(); k++) {
+      uint64_t cell_num = (rois[k][1]-rois[k][0]+1)*(rois[k][3]-rois[k][2]+1);
+      std::vector<uint16_t> roi_values(cell_num);
+      std::vector<uint8_t> roi_mask(cell_num);
+      CHECK(!imageds.from_array(read_array, rois[k], {roi_values.data(), roi_mask.data()},
+                                {cell_num*sizeof(uint16_t), cell_num}));
+      CHECK(!memcmp(static_cast<uint16_t *>(buffers.get()[0]) + cell_offsets[k], roi_values.data(),
+                    cell_num*sizeof(uint16_t)));
+      CHECK(!memcmp(static_cast<uint8_t *>(buffers.get()[1]) + cell_offsets[k], roi_mask.data(), cell_num));
+    }
+
+    CHECK(imageds.gather(read_array, {{0, 8, 0, 0}}, buffers.get(), buffers.get_sizes(), cell_offsets));
+    CHECK(imageds.gather(read_array, rois, {buffers.get()[0]}, {buffers.get_sizes()[0]}, cell_offsets));
+    CHECK_THROWS(imageds.gather(read_array, rois, buffers.get(), {buffers.get_sizes()[0], 1}, cell_offsets));
+    std::vector<uint64_t> empty_offsets;
+    CHECK(!imageds.gather(read_array, {}, buffers.get(), buffers.get_sizes(), empty_offsets));
+    CHECK(empty_offsets.empty());
+    for (auto buffer : buffers.get()) {
+      free(buffer);
+    }
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test reslice", "[reslice]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  // Extents that are not multiples of the tile extents
+  uint64_t extents[] = {6, 5, 7};
+  std::vector<uint16_t> values(6*5*7);
+  std::vector<uint8_t> mask(values.size());
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i;
+    mask[i] = 255-i;
+  }
+  auto value = [&](uint64_t z, uint64_t y, uint64_t x) {
+    return values[(z*5 + y)*7 + x];
+  };
+
+  for (auto dedup : {false, true}) {
+    std::string array_path = dedup ? "resliced_deduped" : "resliced";
+    imageds.enable_tile_dedup(dedup);
+    ImageDSArray array(array_path);
+    array.add_dimension("Z", 0, 5, 4);
+    array.add_dimension("Y", 0, 4, 2);
+    array.add_dimension("X", 0, 6, 3);
+    array.add_attribute("Intensity", UINT16);
+    array.add_attribute("Mask", UINT8);
+    CHECK(!imageds.to_array(array, {values.data(), mask.data()}, {values.size()*sizeof(uint16_t), mask.size()}));
+
+    ImageDSArray read_array(array_path);
+    for (auto axis=0ul; axis<3; axis++) {
+      for (auto transpose : {false, true}) {
+        uint64_t rows = extents[axis == 0 ? 1 : 0], cols = extents[axis == 2 ? 1 : 2];
+        for (auto index=0ul; index<extents[axis]; index++) {
+          std::vector<uint16_t> plane(rows*cols);
+          std::vector<uint8_t> plane_mask(rows*cols);
+          REQUIRE(!imageds.reslice(read_array, axis, index, {plane.data(), plane_mask.data()},
+                                   {plane.size()*sizeof(uint16_t), plane_mask.size()}, transpose));
+          bool matches = true;
+          for (auto row=0ul; row<rows; row++) {
+            for (auto col=0ul; col<cols; col++) {
+              uint64_t coords[3];
+              coords[axis] = index;
+              coords[axis == 0 ? 1 : 0] = row;
+              coords[axis == 2 ? 1 : 2] = col;
+              uint64_t offset = transpose ? col*rows + row : row*cols + col;
+              uint16_t expected = value(coords[0], coords[1], coords[2]);
+              matches = matches && plane[offset] == expected && plane_mask[offset] == uint8_t(255-expected);
+            }
+          }
+          CHECK(matches);
+        }
+      }
+    }
+
+    // Attributes are selected as with from_array
+    ImageDSArray mask_array(array_path);
+    mask_array.add_attribute("Mask", UINT8);
+    std::vector<uint8_t> sagittal(6*5);
+    CHECK(!imageds.reslice(mask_array, 2, 3, {sagittal.data()}, {sagittal.size()}));
+    CHECK(sagittal[5*1+2] == uint8_t(255-value(1, 2, 3)));
+
+    std::vector<uint16_t> plane(6*7);
+    std::vector<uint8_t> plane_mask(6*7);
+    CHECK(imageds.reslice(read_array, 3, 0, {plane.data(), plane_mask.data()}, {6*7*2, 6*7}));
+    CHECK(imageds.reslice(read_array, 1, 5, {plane.data(), plane_mask.data()}, {6*7*2, 6*7}));
+    CHECK(imageds.reslice(read_array, 1, 0, {plane.data()}, {6*7*2}));
+    CHECK_THROWS(imageds.reslice(read_array, 1, 0, {plane.data(), plane_mask.data()}, {6*7*2, 6*7-1}));
+  }
+
+  // Lines of 2D arrays and planes of 4D arrays
+  ImageDSArray image("resliced_image");
+  image.add_dimension("Y", 0, 4, 2);
+  image.add_dimension("X", 0, 6, 3);
+  image.add_attribute("Intensity", UINT16);
+  CHECK(!imageds.to_array(image, {values.data()}, {5*7*sizeof(uint16_t)}));
+  std::vector<uint16_t> column(5);
+  CHECK(!imageds.reslice(image, 1, 4, {column.data()}, {column.size()*sizeof(uint16_t)}));
+  CHECK(column == std::vector<uint16_t>({4, 11, 18, 25, 32}));
+  CHECK(imageds.reslice(image, 1, 4, {column.data()}, {column.size()*sizeof(uint16_t)}, true));
+
+  ImageDSArray series("resliced_series");
+  series.add_dimension("T", 0, 2, 1);
+  series.add_dimension("Z", 0, 2, 1);
+  series.add_dimension("Y", 0, 4, 2);
+  series.add_dimension("X", 0, 6, 3);
+  series.add_attribute("Intensity", UINT16);
+  std::vector<uint16_t> series_values(3*3*5*7);
+  for (auto i=0ul; i<series_values.size(); i++) {
+    series_values[i] = i;
+  }
+  CHECK(!imageds.to_array(series, {series_values.data()}, {series_values.size()*sizeof(uint16_t)}));
+  std::vector<uint16_t> volume(3*3*5);
+  CHECK(!imageds.reslice(series, 3, 6, {volume.data()}, {volume.size()*sizeof(uint16_t)}));
+  bool matches = true;
+  for (auto i=0ul; i<volume.size(); i++) {
+    matches = matches && volume[i] == series_values[i*7+6];
+  }
+  CHECK(matches);
+}
+
+TEST_CASE_METHOD(TempDir, "Test oblique slices", "[oblique_slice]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  // Trilinear interpolation reproduces linear functions of the coordinates
+  auto linear = [](double z, double y, double x) {
+    return 100*z + 10*y + x;
+  };
+  std::vector<float> values(8*6*7);
+  std::vector<uint16_t> intensities(values.size());
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = linear(i/42, (i/7)%6, i%7);
+    intensities[i] = values[i];
+  }
+
+  for (auto dedup : {false, true}) {
+    std::string array_path = dedup ? "oblique_deduped" : "oblique";
+    imageds.enable_tile_dedup(dedup);
+    ImageDSArray array(array_path);
+    array.add_dimension("Z", 0, 7, 4);
+    array.add_dimension("Y", 0, 5, 2);
+    array.add_dimension("X", 0, 6, 3);
+    array.add_attribute("Value", FLOAT32);
+    array.add_attribute("Intensity", UINT16);
+    CHECK(!imageds.to_array(array, {values.data(), intensities.data()},
+                            {values.size()*sizeof(float), intensities.size()*sizeof(uint16_t)}));
+
+    // Plane tilted about X, rows run along X and columns down the Y-Z diagonal from outside of the volume
+    ImageDSArray read_array(array_path);
+    ImageDSObliquePlane plane({0.5, 0.25, 1.5}, {0, 0, 2}, {1, 1, 0}, 12, 4, std::sqrt(2)/2, 0.75);
+    plane.m_fill = 7;
+    std::vector<float> slice(12*4);
+    std::vector<uint16_t> intensity_slice(12*4);
+    imageds.reset_stats();
+    REQUIRE(!imageds.oblique_slice(read_array, plane, {slice.data(), intensity_slice.data()},
+                                   {slice.size()*sizeof(float), intensity_slice.size()*sizeof(uint16_t)}));
+    bool matches = true;
+    for (auto row=0ul; row<12; row++) {
+      for (auto col=0ul; col<4; col++) {
+        double z = 0.5 + row*0.5, y = 0.25 + row*0.5, x = 1.5 + col*0.75;
+        bool inside = z <= 7 && y <= 5;
+        double expected = inside ? linear(z, y, x) : 7;
+        matches = matches && std::abs(slice[row*4+col] - expected) < 1e-3
+            && intensity_slice[row*4+col] == std::floor(expected + 0.5);
+      }
+    }
+    CHECK(matches);
+    // Only 5 of the 6 ZY tiles along the diagonal and 2 of the 3 X tiles are read for both attributes
+    CHECK(imageds.stats().m_arrays[array_path].m_tiles_touched == 2*5*2);
+
+    // Fills that are not finite leave the samples inside of the volume alone
+    ImageDSArray value_array(array_path);
+    value_array.add_attribute("Value", FLOAT32);
+    plane.m_fill = NAN;
+    REQUIRE(!imageds.oblique_slice(value_array, plane, {slice.data()}, {slice.size()*sizeof(float)}));
+    matches = true;
+    for (auto row=0ul; row<12; row++) {
+      for (auto col=0ul; col<4; col++) {
+        double z = 0.5 + row*0.5, y = 0.25 + row*0.5, x = 1.5 + col*0.75;
+        bool inside = z <= 7 && y <= 5;
+        matches = matches && (inside ? std::abs(slice[row*4+col] - linear(z, y, x)) < 1e-3
+                              : std::isnan(slice[row*4+col]));
+      }
+    }
+    CHECK(matches);
+
+    // Planes through cells sample them exactly
+    ImageDSObliquePlane coronal({0, 2, 0}, {0, 0, 1}, {1, 0, 0}, 8, 7);
+    std::vector<uint16_t> resliced(8*7), sampled(8*7);
+    ImageDSArray intensity_array(array_path);
+    intensity_array.add_attribute("Intensity", UINT16);
+    CHECK(!imageds.reslice(intensity_array, 1, 2, {resliced.data()}, {resliced.size()*sizeof(uint16_t)}));
+    CHECK(!imageds.oblique_slice(intensity_array, coronal, {sampled.data()}, {sampled.size()*sizeof(uint16_t)}));
+    CHECK(sampled == resliced);
+
+    ImageDSObliquePlane invalid = coronal;
+    invalid.m_row_direction = {0, 0, 0};
+    CHECK(imageds.oblique_slice(intensity_array, invalid, {sampled.data()}, {sampled.size()*sizeof(uint16_t)}));
+    invalid = coronal;
+    invalid.m_column_direction = {1, 0};
+    CHECK(imageds.oblique_slice(intensity_array, invalid, {sampled.data()}, {sampled.size()*sizeof(uint16_t)}));
+    invalid = coronal;
+    invalid.m_rows = 0;
+    CHECK(imageds.oblique_slice(intensity_array, invalid, {sampled.data()}, {sampled.size()*sizeof(uint16_t)}));
+    CHECK_THROWS(imageds.oblique_slice(intensity_array, coronal, {sampled.data()}, {sampled.size()}));
+  }
+
+  ImageDSArray image("oblique_image");
+  image.add_dimension("Y", 0, 7, 4);
+  image.add_dimension("X", 0, 6, 3);
+  image.add_attribute("Intensity", UINT16);
+  CHECK(!imageds.to_array(image, {intensities.data()}, {8*7*sizeof(uint16_t)}));
+  std::vector<uint16_t> line(4);
+  CHECK(imageds.oblique_slice(image, ImageDSObliquePlane({0, 0, 0}, {0, 0, 1}, {0, 1, 0}, 2, 2), {line.data()},
+                              {line.size()*sizeof(uint16_t)}));
+}
+
+TEST_CASE_METHOD(TempDir, "Test intensity projections", "[project]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<int16_t> values(9*6*7);
+  std::vector<float> doses(values.size());
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = (i*7919)%1000 - 500;
+    doses[i] = values[i]/8.0f;
+  }
+
+  // Dense reference of the projection of box along axis
+  auto reference = [&](const std::vector<float>& cells, const std::vector<uint64_t>& box, size_t axis,
+                       projection_t projection) {
+    std::vector<double> result;
+    uint64_t coords[3];
+    for (coords[0]=box[0]; coords[0]<=box[1]; coords[0]++) {
+      for (coords[1]=box[2]; coords[1]<=box[3]; coords[1]++) {
+        for (coords[2]=box[4]; coords[2]<=box[5]; coords[2]++) {
+          if (coords[axis] != box[axis*2]) continue;
+          std::vector<double> column;
+          uint64_t cell[3] = {coords[0], coords[1], coords[2]};
+          for (cell[axis]=box[axis*2]; cell[axis]<=box[axis*2+1]; cell[axis]++) {
+            column.push_back(cells[(cell[0]*6 + cell[1])*7 + cell[2]]);
+          }
+          if (projection == PROJECTION_MAX) {
+            result.push_back(*std::max_element(column.begin(), column.end()));
+          } else if (projection == PROJECTION_MIN) {
+            result.push_back(*std::min_element(column.begin(), column.end()));
+          } else {
+            result.push_back(std::accumulate(column.begin(), column.end(), 0.0)/column.size());
+          }
+        }
+      }
+    }
+    return result;
+  };
+  std::vector<float> value_cells(values.begin(), values.end());
+
+  for (auto dedup : {false, true}) {
+    std::string array_path = dedup ? "projected_deduped" : "projected";
+    imageds.enable_tile_dedup(dedup);
+    ImageDSArray array(array_path);
+    array.add_dimension("Z", 0, 8, 4);
+    array.add_dimension("Y", 0, 5, 2);
+    array.add_dimension("X", 0, 6, 3);
+    array.add_attribute("Intensity", INT16);
+    array.add_attribute("Dose", FLOAT32);
+    CHECK(!imageds.to_array(array, {values.data(), doses.data()},
+                            {values.size()*sizeof(int16_t), doses.size()*sizeof(float)}));
+
+    ImageDSArray read_array(array_path);
+    // A budget of a few tiles without a tile cache streams the tiles in many batches
+    for (auto budget : {0ul, 3*4*2*3*(sizeof(int16_t)+sizeof(float))}) {
+      imageds.set_tile_cache_capacity(budget ? 0 : 1024*1024);
+      imageds.set_memory_budget(budget);
+      imageds.reset_stats();
+      for (auto box : {std::vector<uint64_t>({0, 8, 0, 5, 0, 6}), std::vector<uint64_t>({1, 6, 1, 4, 2, 6})}) {
+        for (auto axis=0ul; axis<3; axis++) {
+          uint64_t cell_num = 1;
+          for (auto d=0ul; d<3; d++) {
+            cell_num *= d == axis ? 1 : box[d*2+1] - box[d*2] + 1;
+          }
+          for (auto projection : {PROJECTION_MAX, PROJECTION_MIN, PROJECTION_MEAN}) {
+            std::vector<double> expected = reference(value_cells, box, axis, projection);
+            std::vector<double> expected_doses = reference(doses, box, axis, projection);
+            bool matches = true;
+            if (projection == PROJECTION_MEAN) {
+              std::vector<double> means(cell_num), dose_means(cell_num);
+              REQUIRE(!imageds.project(read_array, box, axis, projection, {means.data(), dose_means.data()},
+                                       {cell_num*sizeof(double), cell_num*sizeof(double)}));
+              for (auto i=0ul; i<cell_num; i++) {
+                matches = matches && std::abs(means[i] - expected[i]) < 1e-9
+                    && std::abs(dose_means[i] - expected_doses[i]) < 1e-6;
+              }
+            } else {
+              std::vector<int16_t> intensities(cell_num);
+              std::vector<float> projected_doses(cell_num);
+              REQUIRE(!imageds.project(read_array, box, axis, projection,
+                                       {intensities.data(), projected_doses.data()},
+                                       {cell_num*sizeof(int16_t), cell_num*sizeof(float)}));
+              for (auto i=0ul; i<cell_num; i++) {
+                matches = matches && intensities[i] == expected[i] && projected_doses[i] == expected_doses[i];
+              }
+            }
+            CHECK(matches);
+          }
+        }
+      }
+      CHECK((!budget || imageds.memory_usage().m_peak <= budget));
+    }
+    imageds.set_memory_budget(0);
+
+    // Empty subarrays are the entire domain
+    std::vector<int16_t> mip(6*7);
+    ImageDSArray intensity_array(array_path);
+    intensity_array.add_attribute("Intensity", INT16);
+    CHECK(!imageds.project(intensity_array, {}, 0, PROJECTION_MAX, {mip.data()}, {mip.size()*sizeof(int16_t)}));
+    std::vector<double> expected = reference(value_cells, {0, 8, 0, 5, 0, 6}, 0, PROJECTION_MAX);
+    CHECK(std::vector<double>(mip.begin(), mip.end()) == expected);
+
+    CHECK(imageds.project(intensity_array, {}, 3, PROJECTION_MAX, {mip.data()}, {mip.size()*sizeof(int16_t)}));
+    CHECK(imageds.project(intensity_array, {0, 9, 0, 5, 0, 6}, 0, PROJECTION_MAX, {mip.data()},
+                          {mip.size()*sizeof(int16_t)}));
+    CHECK(imageds.project(intensity_array, {}, 0, static_cast<projection_t>(3), {mip.data()},
+                          {mip.size()*sizeof(int16_t)}));
+    CHECK_THROWS(imageds.project(intensity_array, {}, 0, PROJECTION_MEAN, {mip.data()},
+                                 {mip.size()*sizeof(int16_t)}));
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test filters", "[filter]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<int16_t> values(9*6*11);
+  std::vector<float> doses(values.size());
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = (i*7919)%1000 - 500;
+    doses[i] = values[i]/8.0f;
+  }
+
+  // Dense reference, with taps past the edges of the domain repeating the edge cells
+  auto reference = [&](const std::vector<float>& cells, const ImageDSFilter& filter) {
+    const int64_t extents[3] = {9, 6, 11};
+    std::vector<std::vector<double>> kernels(filter.m_kernels);
+    for (auto& kernel : kernels) {
+      if (kernel.empty()) {
+        kernel = {1};
+      }
+    }
+    auto clamp = [](int64_t index, int64_t extent) {
+      return std::min(std::max(index, static_cast<int64_t>(0)), extent-1);
+    };
+    int64_t radii[3] = {int64_t(kernels[0].size()/2), int64_t(kernels[1].size()/2), int64_t(kernels[2].size()/2)};
+    std::vector<double> result;
+    for (int64_t z=0; z<extents[0]; z++) {
+      for (int64_t y=0; y<extents[1]; y++) {
+        for (int64_t x=0; x<extents[2]; x++) {
+          double value = filter.m_operation == FILTER_ERODE ? INFINITY
+              : filter.m_operation == FILTER_DILATE ? -INFINITY : 0;
+          for (int64_t i=0; i<=radii[0]*2; i++) {
+            for (int64_t j=0; j<=radii[1]*2; j++) {
+              for (int64_t k=0; k<=radii[2]*2; k++) {
+                double cell = cells[(clamp(z+i-radii[0], extents[0])*extents[1] + clamp(y+j-radii[1], extents[1]))
+                                    *extents[2] + clamp(x+k-radii[2], extents[2])];
+                if (filter.m_operation == FILTER_ERODE) {
+                  value = std::min(value, cell);
+                } else if (filter.m_operation == FILTER_DILATE) {
+                  value = std::max(value, cell);
+                } else {
+                  value += kernels[0][i]*kernels[1][j]*kernels[2][k]*cell;
+                }
+              }
+            }
+          }
+          result.push_back(value);
+        }
+      }
+    }
+    return result;
+  };
+  std::vector<float> value_cells(values.begin(), values.end());
+
+  // Kernels reaching past the neighboring tiles, dimensions left alone and integer results
+  std::vector<ImageDSFilter> filters = {
+    ImageDSFilter::gaussian(3, 1),
+    ImageDSFilter::gradient(3, 0),
+    ImageDSFilter::gradient(3, 2),
+    ImageDSFilter::morphology(3, 1, FILTER_ERODE, INT16),
+    ImageDSFilter::morphology(3, 5, FILTER_DILATE, INT16),
+    ImageDSFilter({{}, {1}, {0.25, 0.5, 0.25}}, FILTER_CORRELATE, INT16),
+    ImageDSFilter({{0.5, 1, -2, 1, 0.5}, {}, {}}, FILTER_CORRELATE, FLOAT64)
+  };
+  for (auto dedup : {false, true}) {
+    std::string array_path = dedup ? "filtered_deduped" : "filtered";
+    imageds.enable_tile_dedup(dedup);
+    ImageDSArray array(array_path);
+    array.add_dimension("Z", 0, 8, 4);
+    array.add_dimension("Y", 0, 5, 2);
+    array.add_dimension("X", 0, 10, 4);
+    array.add_attribute("Intensity", INT16, GZIP, 6);
+    array.add_attribute("Dose", FLOAT32);
+    CHECK(!imageds.to_array(array, {values.data(), doses.data()},
+                            {values.size()*sizeof(int16_t), doses.size()*sizeof(float)}));
+
+    ImageDSArray read_array(array_path);
+    for (auto f=0ul; f<filters.size(); f++) {
+      const ImageDSFilter& filter = filters[f];
+      std::string result_path = array_path + "_" + std::to_string(f);
+      REQUIRE(!imageds.filter(read_array, result_path, filter));
+
+      ImageDSArray schema;
+      REQUIRE(!imageds.array_info(result_path, schema));
+      REQUIRE(schema.m_attributes.size() == 2);
+      CHECK(schema.m_attributes[0]->m_name == "Intensity");
+      CHECK(schema.m_attributes[0]->m_type == filter.m_type);
+      CHECK(schema.m_attributes[0]->m_compression == GZIP);
+      CHECK(schema.m_attributes[1]->m_type == filter.m_type);
+      CHECK(schema.m_dimensions[2]->m_tile_extent == 4);
+
+      std::vector<double> expected = reference(value_cells, filter);
+      std::vector<double> expected_doses = reference(doses, filter);
+      size_t cell_size = filter.m_type == INT16 ? sizeof(int16_t)
+          : filter.m_type == FLOAT32 ? sizeof(float) : sizeof(double);
+      std::vector<char> intensities(values.size()*cell_size), filtered_doses(values.size()*cell_size);
+      ImageDSArray result_array(result_path);
+      REQUIRE(!imageds.from_array(result_array, {intensities.data(), filtered_doses.data()},
+                                  {intensities.size(), filtered_doses.size()}));
+      auto cell = [&](const std::vector<char>& cells, size_t i) {
+        if (filter.m_type == INT16) {
+          return static_cast<double>(reinterpret_cast<const int16_t *>(cells.data())[i]);
+        } else if (filter.m_type == FLOAT32) {
+          return static_cast<double>(reinterpret_cast<const float *>(cells.data())[i]);
+        }
+        return reinterpret_cast<const double *>(cells.data())[i];
+      };
+      bool matches = true;
+      for (auto i=0ul; i<values.size(); i++) {
+        if (filter.m_type == INT16) {
+          matches = matches && cell(intensities, i) == std::round(expected[i])
+              && cell(filtered_doses, i) == std::round(expected_doses[i]);
+        } else {
+          matches = matches && std::abs(cell(intensities, i) - expected[i]) < 1e-3
+              && std::abs(cell(filtered_doses, i) - expected_doses[i]) < 1e-4;
+        }
+      }
+      CHECK(matches);
+    }
+
+    // Filtering leaves tile dedup of the instance as it was
+    CHECK(!imageds.to_array(array, {values.data(), doses.data()},
+                            {values.size()*sizeof(int16_t), doses.size()*sizeof(float)}));
+    std::vector<std::string> keys;
+    bool deduped;
+    CHECK(!imageds.tile_keys(array_path, "Dose", keys, deduped));
+    CHECK(deduped == dedup);
+
+    // Only the attributes of the array are filtered
+    ImageDSArray dose_array(array_path);
+    dose_array.add_attribute("Dose", FLOAT32);
+    std::string dose_path = array_path + "_doses";
+    CHECK(!imageds.filter(dose_array, dose_path, ImageDSFilter::morphology(3, 2, FILTER_ERODE, FLOAT32)));
+    std::vector<float> eroded(doses.size());
+    ImageDSArray eroded_array(dose_path);
+    CHECK(!imageds.from_array(eroded_array, {eroded.data()}, {eroded.size()*sizeof(float)}));
+    std::vector<double> expected = reference(doses, ImageDSFilter::morphology(3, 2, FILTER_ERODE));
+    CHECK(std::vector<double>(eroded.begin(), eroded.end()) == expected);
+
+    errno = 0;
+    CHECK(imageds.filter(read_array, dose_path, ImageDSFilter::gaussian(3, 1)));
+    CHECK(errno == EEXIST);
+    errno = 0;
+    std::vector<std::vector<double>> even_kernels = {{0.5, 0.5}, {}, {}};
+    CHECK(imageds.filter(read_array, array_path + "_even", ImageDSFilter(even_kernels)));
+    CHECK(errno == EINVAL);
+    errno = 0;
+    CHECK(imageds.filter(read_array, array_path + "_2d", ImageDSFilter::gaussian(2, 1)));
+    CHECK(errno == EINVAL);
+    CHECK(imageds.filter(read_array, array_path + "_axis", ImageDSFilter::gradient(3, 3)));
+    std::vector<std::vector<double>> nan_kernels = {{NAN}, {}, {}};
+    CHECK(imageds.filter(read_array, array_path + "_nan", ImageDSFilter(nan_kernels)));
+    CHECK(imageds.filter(read_array, array_path + "_operation",
+                         ImageDSFilter({{1}, {}, {}}, static_cast<filter_operation_t>(3))));
+    ImageDSArray missing_array("not_an_array");
+    CHECK(imageds.filter(missing_array, array_path + "_missing", ImageDSFilter::gaussian(3, 1)));
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test async reads and writes", "[async]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  ImageDSArray array("async");
+  array.add_dimension("Y", 0, 7, 4);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  std::vector<uint16_t> values(64);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i;
+  }
+  ImageDSRequest write = imageds.write_async(array, {}, {values.data()}, {values.size()*sizeof(uint16_t)});
+  CHECK(!write.wait());
+  CHECK(write.done());
+  CHECK(!write.error());
+
+  // Futures and completion callbacks
+  std::vector<uint16_t> first(16), second(16);
+  ImageDSRequest read = imageds.read_async(array, {0, 3, 0, 3}, {first.data()}, {first.size()*sizeof(uint16_t)});
+  std::promise<int> completed;
+  imageds.read_async(array, {4, 7, 4, 7}, {second.data()}, {second.size()*sizeof(uint16_t)},
+                     [&completed](int status, int) {
+                       completed.set_value(status);
+                     });
+  CHECK(read.future().get() == IMAGEDS_OK);
+  CHECK(completed.get_future().get() == IMAGEDS_OK);
+  CHECK(first[5] == 9);
+  CHECK(second[0] == 36);
+  CHECK(imageds.stats().m_arrays["async"].m_from_array_calls == 2);
+
+  std::vector<uint16_t> too_small(1);
+  read = imageds.read_async(array, {0, 8, 0, 0}, {too_small.data()}, {sizeof(uint16_t)});
+  CHECK(read.wait());
+  CHECK(read.error());
+
+  // A single thread held by a completion callback, one queued request and a full queue
+  REQUIRE(!imageds.set_io_pool(1, 1));
+  std::promise<void> started, release;
+  std::shared_future<void> released = release.get_future().share();
+  ImageDSRequest blocking = imageds.read_async(array, {0, 0, 0, 0}, {first.data()}, {sizeof(uint16_t)},
+                                               [&started, released](int, int) {
+                                                 started.set_value();
+                                                 released.wait();
+                                               });
+  started.get_future().wait();
+  std::atomic<int> cancelled_error(0);
+  ImageDSRequest queued = imageds.read_async(array, {}, {values.data()}, {values.size()*sizeof(uint16_t)},
+                                             [&cancelled_error](int, int error) {
+                                               cancelled_error = error;
+                                             });
+  ImageDSRequest rejected = imageds.read_async(array, {}, {values.data()}, {values.size()*sizeof(uint16_t)});
+  CHECK(rejected.done());
+  CHECK(rejected.error() == EAGAIN);
+  CHECK(!blocking.cancel());
+  CHECK(queued.cancel());
+  CHECK(!queued.cancel());
+  CHECK(queued.wait() == IMAGEDS_ERR);
+  CHECK(errno == ECANCELED);
+  CHECK(cancelled_error == ECANCELED);
+  // Cancelled requests leave the queue
+  std::vector<uint16_t> requeued_values(values.size());
+  ImageDSRequest requeued = imageds.read_async(array, {}, {requeued_values.data()},
+                                               {requeued_values.size()*sizeof(uint16_t)});
+  CHECK(!requeued.done());
+  release.set_value();
+  CHECK(!blocking.wait());
+  CHECK(!requeued.wait());
+  CHECK(requeued_values == values);
+  CHECK(imageds.set_io_pool(0, 1));
+  CHECK(ImageDSRequest().wait());
+}
+
+TEST_CASE_METHOD(TempDir, "Test memory budget", "[memory_budget]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> values(16*16*16);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = i;
+  }
+  for (auto tile_dedup : {false, true}) {
+    std::string path = tile_dedup ? "budget_deduped" : "budget";
+    ImageDSArray array(path);
+    array.add_dimension("Z", 0, 15, 4);
+    array.add_dimension("Y", 0, 15, 4);
+    array.add_dimension("X", 0, 15, 4);
+    array.add_attribute("Intensity", UINT16);
+    imageds.enable_tile_dedup(tile_dedup);
+    imageds.set_memory_budget(0);
+    imageds.set_tile_cache_capacity(1024*1024);
+    CHECK(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+    CHECK(imageds.memory_usage().m_in_flight == 0);
+
+    // The tile cache gets half of the budget, the rest holds one row of tiles
+    imageds.set_memory_budget(4096);
+    imageds.reset_stats();
+    ImageDSMemoryUsage usage = imageds.memory_usage();
+    CHECK(usage.m_budget == 4096);
+    CHECK(usage.m_tile_cache <= 2048);
+    imageds.set_tile_cache_capacity(1024*1024);
+    CHECK(imageds.memory_usage().m_tile_cache <= 2048);
+
+    std::vector<uint16_t> read_values(values.size());
+    std::vector<size_t> read_sizes = {read_values.size()*sizeof(uint16_t)};
+    CHECK(!imageds.from_array(array, {read_values.data()}, read_sizes));
+    CHECK(read_values == values);
+    // Subarrays whose tiles fit are read whole
+    std::vector<uint16_t> roi(14*8*1);
+    CHECK(!imageds.from_array(array, {1, 14, 2, 9, 3, 3}, {roi.data()}, {roi.size()*sizeof(uint16_t)}));
+    for (auto z=0; z<14; z++) {
+      for (auto y=0; y<8; y++) {
+        CHECK(roi[z*8+y] == ((z+1)*16+y+2)*16+3);
+      }
+    }
+    CHECK(!imageds.from_array(array, {4, 7, 0, 15, 0, 15}, {read_values.data()}, {2048}));
+    CHECK(read_values[0] == 4*16*16);
+    usage = imageds.memory_usage();
+    CHECK(usage.m_split == 1);
+    CHECK(usage.m_in_flight == 0);
+    CHECK(usage.m_peak <= 4096);
+    CHECK(imageds.stats().m_arrays[path].m_from_array_calls == 3);
+
+    // Requests in flight together stay within the budget, gathers are queued
+    std::vector<std::vector<uint16_t>> results(8, std::vector<uint16_t>(values.size()));
+    std::vector<ImageDSRequest> requests;
+    for (auto& result : results) {
+      requests.push_back(imageds.read_async(array, {}, {result.data()}, {result.size()*sizeof(uint16_t)}));
+    }
+    std::vector<uint64_t> cell_offsets;
+    CHECK(!imageds.gather(array, {{0, 3, 0, 3, 0, 3}, {12, 15, 12, 15, 12, 15}}, {read_values.data()},
+                          {2*64*sizeof(uint16_t)}, cell_offsets));
+    CHECK(read_values[64] == (12*16+12)*16+12);
+    for (auto i=0ul; i<requests.size(); i++) {
+      CHECK(!requests[i].wait());
+      CHECK(results[i] == values);
+    }
+    CHECK(imageds.memory_usage().m_peak <= 4096);
+    CHECK(imageds.memory_usage().m_split == 9);
+
+    // Reads larger than the budget still complete alone
+    imageds.set_memory_budget(16);
+    CHECK(!imageds.from_array(array, {read_values.data()}, read_sizes));
+    CHECK(read_values == values);
+  }
+}
+
+// Checks that every mapped tile holds the cells of a Z/Y/X array of the given extents filled with its cell indices
+static void check_mapped_tiles(const ImageDSMappedView& view, uint64_t y_num, uint64_t x_num) {
+  for (auto& tile : view.m_tiles) {
+    const std::vector<uint64_t>& box = tile.m_box;
+    const uint16_t *cells = static_cast<const uint16_t *>(tile.m_data);
+    for (auto z=box[0]; z<=box[1]; z++) {
+      for (auto y=box[2]; y<=std::min(box[3], y_num-1); y++) {
+        for (auto x=box[4]; x<=std::min(box[5], x_num-1); x++) {
+          uint16_t cell = cells[((z-box[0])*(box[3]-box[2]+1) + y-box[2])*(box[5]-box[4]+1) + x-box[4]];
+          CHECK(cell == (z*y_num+y)*x_num+x);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Test imageds_convert", "[convert]") {
+  std::vector<float> floats = {-1.5f, -0.4f, 0.5f, 2.5f, 1e9f, NAN};
+  std::vector<int16_t> rounded(floats.size());
+  CHECK(!imageds_convert(floats.data(), FLOAT32, rounded.data(), ImageDSConversion(INT16), floats.size()));
+  CHECK(rounded == std::vector<int16_t>({-2, 0, 1, 3, 32767, -32768}));
+
+  std::vector<uint16_t> intensities = {0, 1000, 4095, 65535};
+  std::vector<float> normalized(intensities.size());
+  CHECK(!imageds_convert(intensities.data(), UINT16, normalized.data(), ImageDSConversion(FLOAT32, 1/4095.0),
+                         intensities.size()));
+  CHECK(normalized[0] == 0);
+  CHECK(std::abs(normalized[1] - 1000/4095.0) < 1e-6);
+  CHECK(std::abs(normalized[2] - 1) < 1e-6);
+  std::vector<uint32_t> scaled(intensities.size());
+  CHECK(!imageds_convert(intensities.data(), UINT16, scaled.data(), ImageDSConversion(UINT32, 70000, -1e6),
+                         intensities.size()));
+  CHECK(scaled == std::vector<uint32_t>({0, 69000000, 285650000, 4294967295u}));
+  std::vector<double> clipped(intensities.size());
+  CHECK(!imageds_convert(intensities.data(), UINT16, clipped.data(), ImageDSConversion(FLOAT64).clip(100, 4095),
+                         intensities.size()));
+  CHECK(clipped == std::vector<double>({100, 1000, 4095, 4095}));
+
+  CHECK(imageds_convert(intensities.data(), UINT16, clipped.data(), ImageDSConversion(static_cast<attr_type_t>(42)),
+                        intensities.size()));
+  CHECK(errno == EINVAL);
+}
+
+TEST_CASE("Test windows and lookup tables", "[convert]") {
+  // 16 bit cells go through tables, 32 bit cells are mapped one by one and linear windows are rescales
+  std::vector<uint16_t> cells(4096);
+  std::vector<int32_t> wide_cells(cells.size());
+  for (auto i=0ul; i<cells.size(); i++) {
+    cells[i] = wide_cells[i] = i;
+  }
+  std::vector<uint8_t> pixels(cells.size()), wide_pixels(cells.size());
+  for (auto function : {VOI_LINEAR, VOI_LINEAR_EXACT, VOI_SIGMOID}) {
+    ImageDSConversion conversion = ImageDSConversion(UINT8, 2, -1024).window(1000, 2000, function);
+    CHECK(!imageds_convert(cells.data(), UINT16, pixels.data(), conversion, cells.size()));
+    CHECK(!imageds_convert(wide_cells.data(), INT32, wide_pixels.data(), conversion, cells.size()));
+    for (auto i=0ul; i<cells.size(); i++) {
+      double value = 2.0*i - 1024;
+      double expected;
+      if (function == VOI_LINEAR) {
+        expected = value <= 0 ? 0 : value > 1999 ? 255 : ((value - 999.5)/1999 + 0.5)*255;
+      } else if (function == VOI_LINEAR_EXACT) {
+        expected = std::min(std::max(((value - 1000)/2000 + 0.5)*255, 0.0), 255.0);
+      } else {
+        expected = 255/(1 + std::exp(-4*(value - 1000)/2000));
+      }
+      CHECK(std::abs(pixels[i] - expected) <= 0.51);
+      CHECK(std::abs(wide_pixels[i] - expected) <= 0.51);
+    }
+    if (function != VOI_SIGMOID) {
+      CHECK(pixels.front() == 0);
+      CHECK(pixels.back() == 255);
+    }
+  }
+
+  // Windows of floating point results span [0, 1], clipping applies after the window
+  std::vector<float> normalized(cells.size());
+  CHECK(!imageds_convert(cells.data(), UINT16, normalized.data(),
+                         ImageDSConversion(FLOAT32).window(2048, 1025).clip(0, 0.75), cells.size()));
+  CHECK(normalized[1000] == 0);
+  CHECK(std::abs(normalized[2048] - 0.5) < 1e-3);
+  CHECK(normalized[3000] == 0.75f);
+
+  // Cells outside of lookup tables take their first or last entry
+  std::vector<int16_t> small_cells = {4, 5, 6, 7, 100, -100};
+  std::vector<float> float_cells(small_cells.begin(), small_cells.end());
+  ImageDSConversion lut = ImageDSConversion(UINT8).lut({10, 20, 30}, 5);
+  CHECK(!imageds_convert(small_cells.data(), INT16, pixels.data(), lut, small_cells.size()));
+  CHECK(std::vector<uint8_t>(pixels.begin(), pixels.begin()+6) == std::vector<uint8_t>({10, 10, 20, 30, 30, 10}));
+  CHECK(!imageds_convert(float_cells.data(), FLOAT32, pixels.data(), lut, float_cells.size()));
+  CHECK(std::vector<uint8_t>(pixels.begin(), pixels.begin()+6) == std::vector<uint8_t>({10, 10, 20, 30, 30, 10}));
+
+  CHECK(imageds_convert(cells.data(), UINT16, pixels.data(), ImageDSConversion(UINT8).window(100, 0.5), 1));
+  CHECK(errno == EINVAL);
+  CHECK(!imageds_convert(cells.data(), UINT16, pixels.data(), ImageDSConversion(UINT8).window(100, 0.5, VOI_SIGMOID),
+                         1));
+}
+
+TEST_CASE_METHOD(TempDir, "Test conversions", "[convert]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<int16_t> values(8*8*8);
+  for (auto i=0ul; i<values.size(); i++) {
+    values[i] = static_cast<int16_t>(i) - 256;
+  }
+  for (auto tile_dedup : {false, true}) {
+    std::string path = tile_dedup ? "convert_deduped" : "convert";
+    ImageDSArray array(path);
+    array.add_dimension("Z", 0, 7, 4);
+    array.add_dimension("Y", 0, 7, 4);
+    array.add_dimension("X", 0, 7, 4);
+    array.add_attribute("Intensity", INT16);
+    imageds.enable_tile_dedup(tile_dedup);
+    imageds.set_memory_budget(0);
+    CHECK(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(int16_t)}));
+
+    std::vector<float> floats(values.size());
+    std::vector<size_t> sizes = {floats.size()*sizeof(float)};
+    CHECK(!imageds.from_array(array, {}, {floats.data()}, sizes, {ImageDSConversion(FLOAT32, 0.5, 1)}));
+    for (auto i=0ul; i<values.size(); i++) {
+      CHECK(floats[i] == values[i]*0.5f + 1);
+    }
+    CHECK(imageds.stats().m_arrays[path].m_bytes_requested == values.size()*sizeof(float));
+
+    // Integer results saturate at the limits of their type unless clipped further
+    std::vector<uint8_t> bytes(values.size());
+    CHECK(!imageds.from_array(array, {}, {bytes.data()}, {bytes.size()}, {ImageDSConversion(UINT8)}));
+    CHECK(bytes[0] == 0);
+    CHECK(bytes[256+200] == 200);
+    CHECK(bytes[511] == 255);
+    CHECK(!imageds.from_array(array, {}, {bytes.data()}, {bytes.size()}, {ImageDSConversion(UINT8).clip(10, 100)}));
+    CHECK(bytes[0] == 10);
+    CHECK(bytes[256+50] == 50);
+    CHECK(bytes[511] == 100);
+
+    // Subarrays crossing tiles
+    std::vector<double> roi(3*5*2);
+    CHECK(!imageds.from_array(array, {2, 4, 1, 5, 3, 4}, {roi.data()}, {roi.size()*sizeof(double)},
+                              {ImageDSConversion(FLOAT64)}));
+    for (auto z=0; z<3; z++) {
+      for (auto y=0; y<5; y++) {
+        for (auto x=0; x<2; x++) {
+          CHECK(roi[(z*5+y)*2+x] == values[((z+2)*8+y+1)*8+x+3]);
+        }
+      }
+    }
+    // Display reads return one byte per cell
+    CHECK(!imageds.from_array(array, {}, {bytes.data()}, {bytes.size()}, {ImageDSConversion(UINT8).window(0, 256)}));
+    for (auto i=0ul; i<values.size(); i++) {
+      double expected = std::min(std::max(((values[i] + 0.5)/255 + 0.5)*255, 0.0), 255.0);
+      CHECK(std::abs(bytes[i] - expected) <= 0.51);
+    }
+    std::vector<int16_t> same(values.size());
+    CHECK(!imageds.from_array(array, {}, {same.data()}, {same.size()*sizeof(int16_t)}, {ImageDSConversion(INT16)}));
+    CHECK(same == values);
+
+    // Converted reads are split into slabs that fit in the memory budget
+    imageds.set_memory_budget(4096);
+    imageds.reset_stats();
+    std::fill(floats.begin(), floats.end(), 0);
+    sizes = {floats.size()*sizeof(float)};
+    CHECK(!imageds.from_array(array, {}, {floats.data()}, sizes, {ImageDSConversion(FLOAT32, 0.5, 1)}));
+    CHECK(sizes[0] == values.size()*sizeof(float));
+    for (auto i=0ul; i<values.size(); i++) {
+      CHECK(floats[i] == values[i]*0.5f + 1);
+    }
+    CHECK(imageds.memory_usage().m_peak <= 4096);
+
+    // One conversion per attribute read, buffers are sized for the converted type
+    CHECK(imageds.from_array(array, {}, {floats.data()}, {sizes[0]}, {ImageDSConversion(FLOAT32),
+                                                                       ImageDSConversion(FLOAT32)}));
+    CHECK(errno == EINVAL);
+    CHECK_THROWS(imageds.from_array(array, {}, {floats.data()}, {values.size()*sizeof(int16_t)},
+                                    {ImageDSConversion(FLOAT32)}));
+  }
 }
 
+TEST_CASE_METHOD(TempDir, "Test map", "[map]") {
+  ImageDSMappedView view;
+  {
+    ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+    ImageDSArray array("mapped");
+    array.add_dimension("Z", 0, 5, 1);
+    array.add_dimension("Y", 0, 7, 4);
+    array.add_dimension("X", 0, 6, 3);
+    array.add_attribute("Intensity", UINT16);
+    std::vector<uint16_t> values(6*8*7);
+    for (auto i=0ul; i<values.size(); i++) {
+      values[i] = i;
+    }
+    std::vector<ImageDSMappedView> views;
+    CHECK(imageds.map(array, {}, views));
+    REQUIRE(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
 
+    // Edge tiles of the fragment are padded along X
+    CHECK(!imageds.map(array, {}, views));
+    REQUIRE(views.size() == 1);
+    CHECK(views[0].m_attribute == "Intensity");
+    CHECK(views[0].m_type == UINT16);
+    REQUIRE(views[0].m_tiles.size() == 6*2*3);
+    CHECK(views[0].m_tiles.back().m_tile_id == 35);
+    CHECK(views[0].m_tiles.back().m_box == std::vector<uint64_t>({5, 5, 4, 7, 6, 8}));
+    CHECK(views[0].m_data == NULL);
+    check_mapped_tiles(views[0], 8, 7);
+
+    // Subarrays within a tile are addressable through strides
+    CHECK(!imageds.map(array, {2, 2, 5, 7, 3, 4}, views));
+    REQUIRE(views.size() == 1);
+    CHECK(views[0].m_tiles.size() == 1);
+    REQUIRE(views[0].m_data != NULL);
+    CHECK(views[0].m_strides == std::vector<uint64_t>({24, 6, 2}));
+    view = views[0];
+    CHECK(imageds.map(array, {2, 2, 5, 8, 3, 4}, views));
+    CHECK(errno == EINVAL);
+
+    ImageDSArray compressed("compressed");
+    compressed.add_dimension("Y", 0, 7, 4);
+    compressed.add_dimension("X", 0, 7, 4);
+    compressed.add_attribute("Intensity", UINT16, GZIP, 1);
+    REQUIRE(!imageds.to_array(compressed, {values.data()}, {64*sizeof(uint16_t)}));
+    CHECK(imageds.map(compressed, {}, views));
+    CHECK(errno == ENOTSUP);
+
+    // Identical tiles of the tile store are mapped once
+    imageds.enable_tile_dedup();
+    ImageDSArray deduped("deduped");
+    deduped.add_dimension("Z", 0, 5, 1);
+    deduped.add_dimension("Y", 0, 7, 4);
+    deduped.add_dimension("X", 0, 6, 3);
+    deduped.add_attribute("Intensity", UINT16);
+    REQUIRE(!imageds.to_array(deduped, {values.data()}, {values.size()*sizeof(uint16_t)}));
+    CHECK(!imageds.map(deduped, {}, views));
+    REQUIRE(views.size() == 1);
+    CHECK(views[0].m_tiles.size() == 36);
+    CHECK(views[0].m_mappings.size() == 36);
+    CHECK(views[0].m_tiles.back().m_box == std::vector<uint64_t>({5, 5, 4, 7, 6, 6}));
+    check_mapped_tiles(views[0], 8, 7);
+    std::vector<uint16_t> constant(values.size(), 7);
+    ImageDSArray constant_array("constant");
+    constant_array.add_dimension("Z", 0, 5, 1);
+    constant_array.add_dimension("Y", 0, 7, 4);
+    constant_array.add_dimension("X", 0, 5, 3);
+    constant_array.add_attribute("Intensity", UINT16);
+    REQUIRE(!imageds.to_array(constant_array, {constant.data()}, {6*8*6*sizeof(uint16_t)}));
+    CHECK(!imageds.map(constant_array, {}, views));
+    CHECK(views[0].m_tiles.size() == 24);
+    CHECK(views[0].m_mappings.size() == 1);
+  }
+
+  // Views outlive the instance that mapped them
+  const char *data = static_cast<const char *>(view.m_data);
+  for (auto y=5; y<=7; y++) {
+    for (auto x=3; x<=4; x++) {
+      uint16_t cell = *reinterpret_cast<const uint16_t *>(data + (y-5)*view.m_strides[1] + (x-3)*view.m_strides[2]);
+      CHECK(cell == (2*8+y)*7+x);
+    }
+  }
+}
@@ -0,0 +1,180 @@
+/**
+ * @file test_itk_imageio.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Omics Data Automation, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for the ITK ImageIO plugin
+ */
+
+#include "catch.h"
+#include "itk_imageds_image_io.h"
+#include "test_base.h"
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkVectorImage.h"
+
+using ImageType = itk::Image<uint16_t, 3>;
+
+static ImageType::Pointer create_image() {
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size = {{10, 8, 6}};
+  image->SetRegions(ImageType::RegionType(size));
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.5;
+  spacing[1] = 0.75;
+  spacing[2] = 2.5;
+  image->SetSpacing(spacing);
+  ImageType::PointType origin;
+  origin[0] = -10;
+  origin[1] = 20;
+  origin[2] = 5;
+  image->SetOrigin(origin);
+  image->Allocate();
+  for (itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetLargestPossibleRegion()); !it.IsAtEnd(); ++it) {
+    it.Set(it.GetIndex()[2]*100 + it.GetIndex()[1]*10 + it.GetIndex()[0]);
+  }
+  return image;
+}
+
+TEST_CASE_METHOD(TempDir, "Test ITK ImageDSImageIO", "[itk_imageio]") {
+  itk::ImageDSImageIOFactory::RegisterOneFactory();
+  std::string workspace = append_paths(get_temp_dir(), "ws");
+  {
+    ImageDS imageds(workspace);
+  }
+  std::string filename = append_paths(workspace, "itk/volume");
+
+  itk::ImageDSImageIO::Pointer io = itk::ImageDSImageIO::New();
+  CHECK(!io->CanReadFile(filename.c_str()));
+  CHECK(io->CanWriteFile(filename.c_str()));
+  CHECK(!io->CanWriteFile(append_paths(get_temp_dir(), "volume").c_str()));
+
+  // Streamed writes go straight to subarrays of the array
+  ImageType::Pointer image = create_image();
+  using WriterType = itk::ImageFileWriter<ImageType>;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput(image);
+  writer->SetFileName(filename);
+  writer->SetNumberOfStreamDivisions(3);
+  writer->Update();
+  CHECK(io->CanReadFile(filename.c_str()));
+
+  ImageDS imageds(workspace, false, false, true);
+  ImageDSArray array;
+  CHECK(!imageds.array_info("itk/volume", array));
+  REQUIRE(array.m_dimensions.size() == 3);
+  CHECK(array.m_dimensions[0]->m_name == "Z");
+  CHECK(array.m_dimensions[0]->m_end == 5);
+  CHECK(array.m_dimensions[2]->m_name == "X");
+  CHECK(array.m_dimensions[2]->m_end == 9);
+  REQUIRE(array.m_attributes.size() == 1);
+  CHECK(array.m_attributes[0]->m_type == UINT16);
+
+  using ReaderType = itk::ImageFileReader<ImageType>;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  ImageType::Pointer read = reader->GetOutput();
+  CHECK(dynamic_cast<itk::ImageDSImageIO *>(reader->GetImageIO()) != NULL);
+  CHECK(read->GetLargestPossibleRegion() == image->GetLargestPossibleRegion());
+  CHECK(read->GetSpacing() == image->GetSpacing());
+  CHECK(read->GetOrigin() == image->GetOrigin());
+  for (itk::ImageRegionConstIteratorWithIndex<ImageType> it(read, read->GetLargestPossibleRegion()); !it.IsAtEnd(); ++it) {
+    CHECK(it.Get() == image->GetPixel(it.GetIndex()));
+  }
+
+  // Requested regions are streamed from the array without reading the entire image
+  ReaderType::Pointer region_reader = ReaderType::New();
+  region_reader->SetFileName(filename);
+  region_reader->UpdateOutputInformation();
+  ImageType::IndexType index = {{2, 3, 4}};
+  ImageType::SizeType size = {{5, 2, 1}};
+  ImageType::RegionType region(index, size);
+  region_reader->GetOutput()->SetRequestedRegion(region);
+  region_reader->Update();
+  CHECK(region_reader->GetOutput()->GetBufferedRegion() == region);
+  for (itk::ImageRegionConstIteratorWithIndex<ImageType> it(region_reader->GetOutput(), region); !it.IsAtEnd(); ++it) {
+    CHECK(it.Get() == image->GetPixel(it.GetIndex()));
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test ITK ImageDSImageIO vector pixels", "[itk_imageio_vector]") {
+  std::string workspace = append_paths(get_temp_dir(), "ws");
+  {
+    ImageDS imageds(workspace);
+  }
+  std::string filename = append_paths(workspace, "rgb");
+
+  using VectorImageType = itk::VectorImage<uint8_t, 2>;
+  VectorImageType::Pointer image = VectorImageType::New();
+  VectorImageType::SizeType size = {{4, 3}};
+  image->SetRegions(VectorImageType::RegionType(size));
+  image->SetNumberOfComponentsPerPixel(3);
+  image->Allocate();
+  for (auto i=0ul; i<4*3*3; i++) {
+    image->GetBufferPointer()[i] = i;
+  }
+
+  itk::ImageDSImageIO::Pointer io = itk::ImageDSImageIO::New();
+  using WriterType = itk::ImageFileWriter<VectorImageType>;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput(image);
+  writer->SetImageIO(io);
+  writer->SetFileName(filename);
+  writer->Update();
+
+  ImageDS imageds(workspace, false, false, true);
+  ImageDSArray array;
+  CHECK(!imageds.array_info("rgb", array));
+  REQUIRE(array.m_attributes.size() == 3);
+  CHECK(array.m_attributes[1]->m_name == "Intensity_1");
+
+  using ReaderType = itk::ImageFileReader<VectorImageType>;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetImageIO(itk::ImageDSImageIO::New());
+  reader->SetFileName(filename);
+  reader->Update();
+  CHECK(reader->GetOutput()->GetNumberOfComponentsPerPixel() == 3);
+  for (auto i=0ul; i<4*3*3; i++) {
+    CHECK(reader->GetOutput()->GetBufferPointer()[i] == i);
+  }
+
+  // A single attribute is read as a scalar image
+  using ScalarImageType = itk::Image<uint8_t, 2>;
+  itk::ImageDSImageIO::Pointer green = itk::ImageDSImageIO::New();
+  green->SetAttribute("Intensity_1");
+  using ScalarReaderType = itk::ImageFileReader<ScalarImageType>;
+  ScalarReaderType::Pointer scalar_reader = ScalarReaderType::New();
+  scalar_reader->SetImageIO(green);
+  scalar_reader->SetFileName(filename);
+  scalar_reader->Update();
+  for (auto i=0ul; i<4*3; i++) {
+    CHECK(scalar_reader->GetOutput()->GetBufferPointer()[i] == i*3+1);
+  }
+}
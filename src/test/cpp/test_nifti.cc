@@ -0,0 +1,302 @@
+/**
+ * @file test_nifti.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Omics Data Automation, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for NIfTI import and export
+ */
+
+#include "catch.h"
+#include "imageds.h"
+#include "nifti.h"
+#include "test_base.h"
+
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+// Single file NIfTI-1 image with an sform, optionally big endian or gzip compressed
+class NiftiWriter {
+ public:
+  NiftiWriter(const std::vector<int16_t>& dims, int16_t datatype, int16_t bitpix) : m_header(352, 0) {
+    set<int32_t>(0, 348);
+    set<int16_t>(40, dims.size());
+    for (auto i=0ul; i<dims.size(); i++) {
+      set<int16_t>(42+i*2, dims[i]);
+    }
+    for (auto i=dims.size(); i<7; i++) {
+      set<int16_t>(42+i*2, 1);
+    }
+    set<int16_t>(70, datatype);
+    set<int16_t>(72, bitpix);
+    float pixdim[4] = {1, 0.5, 0.75, 2};
+    for (auto i=0; i<4; i++) {
+      set<float>(76+i*4, pixdim[i]);
+    }
+    set<float>(108, 352);
+    set<float>(112, 2);
+    set<float>(116, -1024);
+    set<int16_t>(254, 1);
+    // Axial LAS, i.e. x flipped
+    float srow[12] = {-0.5, 0, 0, 90, 0, 0.75, 0, -126, 0, 0, 2, -72};
+    for (auto i=0; i<12; i++) {
+      set<float>(280+i*4, srow[i]);
+    }
+    memcpy(m_header.data()+344, "n+1", 4);
+  }
+
+  template<typename T>
+  void set(size_t offset, T value) {
+    memcpy(m_header.data()+offset, &value, sizeof(T));
+  }
+
+  void write(const std::string& filename, const void *data, size_t size, size_t cell_size=2,
+             bool big_endian=false, bool gzip=false) {
+    std::vector<char> bytes(m_header);
+    bytes.insert(bytes.end(), reinterpret_cast<const char *>(data), reinterpret_cast<const char *>(data)+size);
+    if (big_endian) {
+      swap(bytes, 0, 4);
+      for (auto offset=40; offset<56; offset+=2) {
+        swap(bytes, offset, 2);
+      }
+      for (auto offset=68; offset<76; offset+=2) {
+        swap(bytes, offset, 2);
+      }
+      for (auto offset=76; offset<120; offset+=4) {
+        swap(bytes, offset, 4);
+      }
+      swap(bytes, 252, 2);
+      swap(bytes, 254, 2);
+      for (auto offset=256; offset<328; offset+=4) {
+        swap(bytes, offset, 4);
+      }
+      for (auto offset=352ul; offset<bytes.size(); offset+=cell_size) {
+        swap(bytes, offset, cell_size);
+      }
+    }
+    if (gzip) {
+      gzFile file = gzopen(filename.c_str(), "wb");
+      REQUIRE(file);
+      CHECK(gzwrite(file, bytes.data(), bytes.size()) == static_cast<int>(bytes.size()));
+      gzclose(file);
+    } else {
+      CHECK(!TileDBUtils::write_file(filename, bytes.data(), bytes.size(), true));
+    }
+  }
+
+ private:
+  std::vector<char> m_header;
+
+  static void swap(std::vector<char>& bytes, size_t offset, size_t size) {
+    std::reverse(bytes.begin()+offset, bytes.begin()+offset+size);
+  }
+};
+
+static std::vector<uint16_t> volume(size_t x, size_t y, size_t z) {
+  std::vector<uint16_t> data(x*y*z);
+  for (auto i=0ul; i<data.size(); i++) {
+    data[i] = i*7 + 3;
+  }
+  return data;
+}
+
+static void check_array(ImageDS& imageds, const std::string& array_path, const std::vector<uint16_t>& expected) {
+  ImageDSArray array;
+  REQUIRE(!imageds.array_info(array_path, array));
+  REQUIRE(array.m_dimensions.size() == 3);
+  CHECK(array.m_dimensions[0]->m_name == "Z");
+  CHECK(array.m_dimensions[0]->m_end == 4);
+  CHECK(array.m_dimensions[1]->m_name == "Y");
+  CHECK(array.m_dimensions[1]->m_end == 5);
+  CHECK(array.m_dimensions[2]->m_name == "X");
+  CHECK(array.m_dimensions[2]->m_end == 6);
+  REQUIRE(array.m_attributes.size() == 1);
+  CHECK(array.m_attributes[0]->m_type == UINT16);
+
+  std::vector<uint16_t> read(expected.size());
+  ImageDSArray read_array(array_path);
+  CHECK(!imageds.from_array(read_array, {read.data()}, {read.size()*sizeof(uint16_t)}));
+  CHECK(read == expected);
+}
+
+TEST_CASE_METHOD(TempDir, "Test NIfTI header", "[nifti_header]") {
+  std::vector<uint16_t> data = volume(7, 6, 5);
+  NiftiWriter writer({7, 6, 5}, 512, 16);
+  std::string filename = append_paths(get_temp_dir(), "image.nii");
+  writer.write(filename, data.data(), data.size()*2);
+
+  ImageDSNiftiHeader header;
+  REQUIRE(!imageds_nifti_read_header(filename, header));
+  CHECK(header.m_version == 1);
+  CHECK(!header.m_gzip);
+  CHECK(!header.m_swapped);
+  CHECK(header.m_dim[0] == 3);
+  CHECK(header.m_dim[3] == 5);
+  CHECK(header.m_vox_offset == 352);
+  CHECK(header.data_size() == data.size()*2);
+  attr_type_t type;
+  CHECK(!header.type(type));
+  CHECK(type == UINT16);
+  std::vector<double> affine = header.affine();
+  CHECK(affine[0] == -0.5);
+  CHECK(affine[3] == 90);
+  CHECK(affine[15] == 1);
+
+  // Without sform the qform or pixdim are used
+  writer.set<int16_t>(254, 0);
+  writer.write(filename, data.data(), data.size()*2, 2, true, true);
+  REQUIRE(!imageds_nifti_read_header(filename, header));
+  CHECK(header.m_gzip);
+  CHECK(header.m_swapped);
+  CHECK(header.m_dim[1] == 7);
+  CHECK(header.m_pixdim[3] == 2);
+  affine = header.affine();
+  CHECK(affine[0] == 0.5);
+  CHECK(affine[5] == 0.75);
+  CHECK(affine[10] == 2);
+  CHECK(affine[3] == 0);
+
+  writer.set<int16_t>(252, 1);
+  writer.set<float>(256, 0);
+  writer.set<float>(260, 0);
+  writer.set<float>(264, 1); // 180 degrees around z
+  writer.set<float>(268, 10);
+  writer.write(filename, data.data(), data.size()*2);
+  REQUIRE(!imageds_nifti_read_header(filename, header));
+  affine = header.affine();
+  CHECK(affine[0] == -0.5);
+  CHECK(affine[5] == -0.75);
+  CHECK(affine[10] == 2);
+  CHECK(affine[3] == 10);
+
+  // RGB and dimensions too small to be tiled are not supported
+  NiftiWriter rgb({7, 6, 5}, 128, 24);
+  rgb.write(filename, data.data(), data.size()*2);
+  REQUIRE(!imageds_nifti_read_header(filename, header));
+  CHECK(header.type(type));
+  CHECK(errno == ENOTSUP);
+  NiftiWriter thin({7, 2, 5}, 512, 16);
+  thin.write(filename, data.data(), data.size()*2);
+  REQUIRE(!imageds_nifti_read_header(filename, header));
+  CHECK(header.type(type));
+  CHECK(errno == ENOTSUP);
+
+  CHECK(imageds_nifti_read_header(append_paths(get_temp_dir(), "non-existent.nii"), header));
+  CHECK(!TileDBUtils::write_file(filename, "not a nifti file", 16, true));
+  CHECK(imageds_nifti_read_header(filename, header));
+}
+
+TEST_CASE_METHOD(TempDir, "Test NIfTI import and export", "[nifti_import]") {
+  std::vector<uint16_t> data = volume(7, 6, 5);
+  NiftiWriter writer({7, 6, 5, 1}, 512, 16);
+  std::string nii = append_paths(get_temp_dir(), "image.nii");
+  std::string nii_gz = append_paths(get_temp_dir(), "image.nii.gz");
+  std::string nii_be = append_paths(get_temp_dir(), "image_be.nii");
+  writer.write(nii, data.data(), data.size()*2);
+  writer.write(nii_gz, data.data(), data.size()*2, 2, false, true);
+  writer.write(nii_be, data.data(), data.size()*2, 2, true);
+
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  CHECK(!imageds_nifti_import(imageds, nii, "nifti/mapped", 3));
+  check_array(imageds, "nifti/mapped", data);
+  // Slabs of 2 slices
+  CHECK(!imageds_nifti_import(imageds, nii_gz, "nifti/gzip", 2));
+  check_array(imageds, "nifti/gzip", data);
+  CHECK(!imageds_nifti_import(imageds, nii_be, "nifti/swapped", 2));
+  check_array(imageds, "nifti/swapped", data);
+
+  std::map<std::string, std::string> metadata;
+  CHECK(!imageds.read_metadata("nifti/gzip", metadata));
+  CHECK(metadata["spacing"] == "2\\0.75\\0.5");
+  CHECK(metadata["rescale_slope"] == "2");
+  CHECK(metadata["rescale_intercept"] == "-1024");
+  CHECK(metadata["nifti_sform_code"] == "1");
+  CHECK(metadata["affine"] == "-0.5\\0\\0\\90\\0\\0.75\\0\\-126\\0\\0\\2\\-72\\0\\0\\0\\1");
+  CHECK(metadata["origin"] == "-90\\126\\-72");
+  CHECK(metadata["orientation"] == "1\\0\\0\\0\\-1\\0");
+
+  CHECK(imageds_nifti_import(imageds, append_paths(get_temp_dir(), "non-existent.nii"), "nifti/missing"));
+
+  // Export both uncompressed and compressed, the gzip export streams slabs of 2 slices
+  std::string exported = append_paths(get_temp_dir(), "exported.nii");
+  std::string exported_gz = append_paths(get_temp_dir(), "exported.nii.gz");
+  CHECK(!imageds_nifti_export(imageds, "nifti/mapped", exported));
+  CHECK(!imageds_nifti_export(imageds, "nifti/gzip", exported_gz));
+  CHECK(imageds_nifti_export(imageds, "nifti/gzip", exported_gz, "NonExistent"));
+  for (auto& filename : {exported, exported_gz}) {
+    ImageDSNiftiHeader header;
+    REQUIRE(!imageds_nifti_read_header(filename, header));
+    CHECK(header.m_dim[0] == 3);
+    CHECK(header.m_dim[1] == 7);
+    CHECK(header.m_dim[3] == 5);
+    CHECK(header.m_datatype == 512);
+    CHECK(header.m_pixdim[1] == 0.5);
+    CHECK(header.m_scl_slope == 2);
+    CHECK(header.m_sform_code == 1);
+    CHECK(header.affine()[3] == 90);
+
+    CHECK(!imageds_nifti_import(imageds, filename, "nifti/reimported"));
+    check_array(imageds, "nifti/reimported", data);
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test NIfTI batch import", "[nifti_batch]") {
+  std::string workspace = append_paths(get_temp_dir(), WORKSPACE);
+  {
+    ImageDS imageds(workspace);
+  }
+
+  std::vector<std::string> filenames, array_paths;
+  std::vector<std::vector<uint16_t>> volumes;
+  for (auto i=0; i<6; i++) {
+    volumes.push_back(volume(7, 6, 5));
+    std::transform(volumes[i].begin(), volumes[i].end(), volumes[i].begin(), [i](uint16_t v) { return v+i; });
+    filenames.push_back(append_paths(get_temp_dir(), "image" + std::to_string(i) + ".nii" + (i%2 ? ".gz" : "")));
+    array_paths.push_back("batch/image" + std::to_string(i));
+    NiftiWriter({7, 6, 5}, 512, 16).write(filenames[i], volumes[i].data(), volumes[i].size()*2, 2, false, i%2);
+  }
+
+  std::vector<int> errnos;
+  CHECK(!imageds_nifti_import_batch(workspace, filenames, array_paths, errnos));
+  CHECK(errnos == std::vector<int>(6, 0));
+  ImageDS imageds(workspace, false, false, true);
+  for (auto i=0; i<6; i++) {
+    check_array(imageds, array_paths[i], volumes[i]);
+  }
+
+  // Failures are reported per file without stopping the batch
+  filenames[2] = append_paths(get_temp_dir(), "non-existent.nii");
+  for (auto& array_path : array_paths) {
+    array_path += "_again";
+  }
+  CHECK(imageds_nifti_import_batch(workspace, filenames, array_paths, errnos));
+  CHECK(errnos[2] != 0);
+  CHECK(std::count(errnos.begin(), errnos.end(), 0) == 5);
+  check_array(imageds, array_paths[5], volumes[5]);
+
+  CHECK(imageds_nifti_import_batch(workspace, filenames, {"batch/one"}, errnos));
+}
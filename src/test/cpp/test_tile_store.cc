@@ -0,0 +1,433 @@
+/**
+ * @file test_tile_store.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Omics Data Automation, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for the tile layout, tile cache and tile store
+ */
+
+#include "batch_reader.h"
+#include "catch.h"
+#include "imageds.h"
+#include "page_cache.h"
+#include "single_flight.h"
+#include "test_base.h"
+#include "tile_cache.h"
+#include "tile_layout.h"
+#include "tile_store.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+static ImageDSArray *define_2D_array(const std::string& path, compression_t compression=NONE) {
+  ImageDSArray *array = new ImageDSArray(path);
+  array->add_dimension("X", 0, 7, 4);
+  array->add_dimension("Y", 0, 7, 4);
+  array->add_attribute("Intensity", UINT16, compression);
+  return array;
+}
+
+// Four identical 4x4 tiles
+static std::vector<uint16_t> repeating_tiles() {
+  std::vector<uint16_t> buffer(64);
+  for (auto i=0; i<8; i++) {
+    for (auto j=0; j<8; j++) {
+      buffer[i*8+j] = (i%4)*4 + j%4;
+    }
+  }
+  return buffer;
+}
+
+TEST_CASE("Test ImageDSTileLayout", "[tile_layout]") {
+  std::vector<std::unique_ptr<ImageDSDimension>> dimensions;
+  dimensions.push_back(std::unique_ptr<ImageDSDimension>(new ImageDSDimension("X", 0, 9, 4)));
+  dimensions.push_back(std::unique_ptr<ImageDSDimension>(new ImageDSDimension("Y", 0, 9, 4)));
+  ImageDSTileLayout layout(dimensions);
+
+  CHECK(layout.dim_num() == 2);
+  CHECK(layout.tile_num() == 9);
+  CHECK(layout.tile_subarray(0) == std::vector<uint64_t>({0, 3, 0, 3}));
+  CHECK(layout.tile_subarray(5) == std::vector<uint64_t>({4, 7, 8, 9}));
+  CHECK(layout.tile_subarray(8) == std::vector<uint64_t>({8, 9, 8, 9}));
+  CHECK(layout.overlapping_tiles({3, 4, 0, 0}) == std::vector<uint64_t>({0, 3}));
+  CHECK(layout.overlapping_tiles({0, 9, 0, 9}).size() == 9);
+  CHECK(layout.overlapping_tiles({10, 12, 0, 9}).empty());
+  CHECK(layout.overlapping_tile_num({3, 4, 0, 0}) == 2);
+  CHECK(layout.overlapping_tile_num({0, 9, 0, 9}) == 9);
+  CHECK(layout.overlapping_tile_num({10, 12, 0, 9}) == 0);
+  CHECK(ImageDSTileLayout::cell_num({4, 7, 8, 9}) == 8);
+
+  std::vector<uint64_t> region;
+  CHECK(intersect({0, 3, 0, 3}, {2, 5, 3, 9}, region));
+  CHECK(region == std::vector<uint64_t>({2, 3, 3, 3}));
+  CHECK(!intersect({0, 3, 0, 3}, {4, 5, 0, 9}, region));
+
+  std::vector<int> src(100);
+  for (auto i=0; i<100; i++) {
+    src[i] = i;
+  }
+  std::vector<int> dst(6);
+  copy_region(src.data(), layout.domain(), dst.data(), {1, 2, 3, 5}, {1, 2, 3, 5}, sizeof(int));
+  CHECK(dst == std::vector<int>({13, 14, 15, 23, 24, 25}));
+
+  CHECK(attr_type_size(UINT16) == 2);
+  CHECK(attr_type_size(FLOAT64) == 8);
+}
+
+TEST_CASE("Test ImageDSTileCache", "[tile_cache]") {
+  ImageDSTileCache cache(10);
+  cache.put("a", tile_buffer_t(new std::vector<char>(4, 'a')));
+  cache.put("b", tile_buffer_t(new std::vector<char>(4, 'b')));
+  CHECK(cache.size() == 8);
+  CHECK(cache.get("a"));
+
+  // "b" is the least recently used tile
+  cache.put("c", tile_buffer_t(new std::vector<char>(4, 'c')));
+  CHECK(cache.get("a"));
+  CHECK(!cache.get("b"));
+  CHECK(cache.get("c"));
+  CHECK(cache.size() == 8);
+
+  cache.put("d", tile_buffer_t(new std::vector<char>(11, 'd')));
+  CHECK(!cache.get("d"));
+
+  cache.set_capacity(4);
+  CHECK(cache.size() == 4);
+  cache.clear();
+  CHECK(cache.size() == 0);
+  CHECK(!cache.get("a"));
+}
+
+TEST_CASE("Test ImageDSSingleFlight", "[single_flight]") {
+  ImageDSSingleFlight<tile_buffer_t> flights;
+  const int follower_num = 4;
+  std::atomic<int> loads(0);
+  std::atomic<int> followers_started(0);
+  auto load = [&]() {
+    loads++;
+    // Keep the load in flight until all followers are about to join it
+    while (followers_started < follower_num) {
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return tile_buffer_t(new std::vector<char>(4, 'a'));
+  };
+
+  std::vector<tile_buffer_t> tiles(follower_num+1);
+  std::vector<bool> coalesced(follower_num+1);
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread([&]() {
+        bool shared;
+        tiles[0] = flights.run("a", load, &shared);
+        coalesced[0] = shared;
+      }));
+  while (!loads) {
+    std::this_thread::yield();
+  }
+  for (int i=1; i<=follower_num; i++) {
+    threads.push_back(std::thread([&, i]() {
+          followers_started++;
+          bool shared;
+          tiles[i] = flights.run("a", load, &shared);
+          coalesced[i] = shared;
+        }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(loads == 1);
+  CHECK(!coalesced[0]);
+  for (int i=1; i<=follower_num; i++) {
+    CHECK(coalesced[i]);
+    CHECK(tiles[i] == tiles[0]);
+  }
+  CHECK(flights.size() == 0);
+
+  // Results are not kept once the load is done and failures propagate
+  bool shared = true;
+  CHECK(flights.run("a", []() { return tile_buffer_t(new std::vector<char>(1)); }, &shared)->size() == 1);
+  CHECK(!shared);
+  CHECK_THROWS(flights.run("b", []() -> tile_buffer_t { throw std::runtime_error("load failed"); }));
+  CHECK(flights.size() == 0);
+}
+
+TEST_CASE("Test ImageDSTileStore keys", "[tile_store_keys]") {
+  std::string tile1("0123456789abcdef0123456789abcdef0123");
+  std::string tile2("0123456789abcdef0123456789abcdef0124");
+  CHECK(ImageDSTileStore::key(tile1.data(), tile1.size()).size() == 32);
+  CHECK(ImageDSTileStore::key(tile1.data(), tile1.size()) == ImageDSTileStore::key(tile1.data(), tile1.size()));
+  CHECK(ImageDSTileStore::key(tile1.data(), tile1.size()) != ImageDSTileStore::key(tile2.data(), tile2.size()));
+  CHECK(ImageDSTileStore::key(tile1.data(), 3) != ImageDSTileStore::key(tile1.data(), 4));
+}
+
+TEST_CASE_METHOD(TempDir, "Test tile dedup", "[tile_dedup]") {
+  std::string workspace = append_paths(get_temp_dir(), WORKSPACE);
+  std::vector<uint16_t> buffer = repeating_tiles();
+
+  {
+    ImageDS imageds(workspace);
+    imageds.enable_tile_dedup();
+
+    std::unique_ptr<ImageDSArray> array(define_2D_array("study/original"));
+    CHECK(!imageds.to_array(*array, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+
+    uint64_t tile_num, stored_bytes;
+    CHECK(!imageds.tile_store_size(tile_num, stored_bytes));
+    CHECK(tile_num == 1);
+
+    std::unique_ptr<ImageDSArray> copy(define_2D_array("study/copy", GZIP));
+    CHECK(!imageds.to_array(*copy, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+    CHECK(!imageds.tile_store_size(tile_num, stored_bytes));
+    CHECK(tile_num == 1); // Tiles are keyed by content irrespective of compression
+
+    std::vector<uint16_t> read_buffer(64);
+    std::vector<size_t> read_sizes = {read_buffer.size()*sizeof(uint16_t)};
+    CHECK(!imageds.from_array(*copy, {read_buffer.data()}, read_sizes));
+    CHECK(read_buffer == buffer);
+
+    // Subarray spanning all four tiles
+    ImageDSArray subarray("study/original");
+    subarray.add_dimension("X", 3, 5, 1);
+    subarray.add_dimension("Y", 2, 4, 1);
+    subarray.add_attribute("Intensity", UINT16);
+    std::vector<uint16_t> sub_buffer(9);
+    CHECK(!imageds.from_array(subarray, {sub_buffer.data()}, {sub_buffer.size()*sizeof(uint16_t)}));
+    for (auto i=0; i<3; i++) {
+      for (auto j=0; j<3; j++) {
+        CHECK(sub_buffer[i*3+j] == buffer[(i+3)*8+j+2]);
+      }
+    }
+
+    // Slabs written by subarray, as the ingesters do, fall back to TileDB fragments
+    std::unique_ptr<ImageDSArray> slabs(define_2D_array("slabs"));
+    CHECK(!imageds.to_array(*slabs, {0, 3, 0, 7}, {buffer.data()}, {32*sizeof(uint16_t)}));
+    CHECK(!imageds.to_array(*slabs, {4, 7, 0, 7}, {buffer.data()+32}, {32*sizeof(uint16_t)}));
+    CHECK(!imageds.from_array(*slabs, {read_buffer.data()}, read_sizes));
+    CHECK(read_buffer == buffer);
+
+    // Arrays written without dedup produce the same tile keys
+    imageds.enable_tile_dedup(false);
+    std::unique_ptr<ImageDSArray> plain(define_2D_array("plain"));
+    CHECK(!imageds.to_array(*plain, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+    std::vector<std::string> keys, plain_keys;
+    bool deduped;
+    CHECK(!imageds.tile_keys("study/original", "Intensity", keys, deduped));
+    CHECK(deduped);
+    CHECK(keys.size() == 4);
+    CHECK(std::count(keys.begin(), keys.end(), keys[0]) == 4);
+    CHECK(!imageds.tile_keys("plain", "Intensity", plain_keys, deduped));
+    CHECK(!deduped);
+    CHECK(plain_keys == keys);
+    CHECK(imageds.tile_keys("plain", "NoSuchAttribute", keys, deduped));
+
+    // Rewrites without dedup replace the tile references of deduped arrays
+    std::vector<uint16_t> rewritten(buffer.rbegin(), buffer.rend());
+    CHECK(!imageds.to_array(*copy, {rewritten.data()}, {rewritten.size()*sizeof(uint16_t)}));
+    CHECK(!imageds.from_array(*copy, {read_buffer.data()}, read_sizes));
+    CHECK(read_buffer == rewritten);
+    std::vector<std::string> copy_keys;
+    CHECK(!imageds.tile_keys("study/copy", "Intensity", copy_keys, deduped));
+    CHECK(!deduped);
+    errno = 0;
+    CHECK(imageds.to_array(*array, {0, 0, 0, 0}, {buffer.data()}, {sizeof(uint16_t)}));
+    CHECK(errno == ENOTSUP);
+    CHECK(!imageds.from_array(*array, {read_buffer.data()}, read_sizes));
+    CHECK(read_buffer == buffer);
+
+    // Temporary files left by interrupted puts are not counted as tiles
+    std::ofstream(append_paths(workspace, std::string(IMAGEDS_TILE_STORE) + "/" + keys[0].substr(0, 2) + "/"
+                               + keys[0] + ".4242-1a2b.tmp")) << "partial";
+    CHECK(!imageds.tile_store_size(tile_num, stored_bytes));
+    CHECK(tile_num == 1);
+
+    std::vector<std::string> array_paths;
+    CHECK(!imageds.list_arrays(array_paths));
+    std::sort(array_paths.begin(), array_paths.end());
+    CHECK(array_paths == std::vector<std::string>({"plain", "slabs", "study/copy", "study/original"}));
+  }
+
+  // Reopen the workspace, tile references are resolved without dedup being enabled
+  try {
+    ImageDS imageds(workspace);
+    FAIL();
+  } catch (const ImageDSException& e) {
+    // Expected exception
+  }
+  ImageDS imageds(workspace, false, false, true);
+  ImageDSArray array("study/original");
+  std::vector<uint16_t> read_buffer(64);
+  CHECK(!imageds.from_array(array, {read_buffer.data()}, {read_buffer.size()*sizeof(uint16_t)}));
+  CHECK(read_buffer == buffer);
+}
+
+TEST_CASE_METHOD(TempDir, "Test ImageDSBatchReader", "[batch_reader]") {
+  std::vector<std::string> paths;
+  std::vector<std::string> contents;
+  for (auto i=0; i<100; i++) {
+    paths.push_back(append_paths(get_temp_dir(), "file" + std::to_string(i)));
+    contents.push_back(std::string(i*97, 'a' + i%26));
+    std::ofstream(paths.back()) << contents.back();
+  }
+  paths.insert(paths.begin()+50, append_paths(get_temp_dir(), "missing"));
+  contents.insert(contents.begin()+50, "");
+
+  // Queue depth below the batch size, so that reads are refilled as others complete
+  for (auto uring : {true, false}) {
+    ImageDSBatchReader reader(uring ? 8 : 0);
+    CHECK(reader.uses_uring() == (uring && ImageDSBatchReader::uring_available()));
+    std::vector<int> reads(paths.size());
+    std::vector<std::string> read_contents(paths.size());
+    errno = 0;
+    CHECK(reader.read(paths, [&](size_t index, std::vector<char>& data) {
+          reads[index]++;
+          read_contents[index].assign(data.begin(), data.end());
+        }) == IMAGEDS_ERR);
+    CHECK(errno == ENOENT);
+    CHECK(reads[50] == 0);
+    reads.erase(reads.begin()+50);
+    CHECK(std::count(reads.begin(), reads.end(), 1) == 100);
+    CHECK(read_contents == contents);
+  }
+}
+
+TEST_CASE_METHOD(TempDir, "Test direct reads", "[batch_reader_direct]") {
+  // Sizes around the alignment of direct reads
+  std::vector<std::string> paths;
+  std::vector<std::string> contents;
+  for (auto size : {0, 1, 4095, 4096, 4097, 3*4096+5}) {
+    paths.push_back(append_paths(get_temp_dir(), "file" + std::to_string(size)));
+    contents.push_back(std::string(size, 'a' + size%26));
+    std::ofstream(paths.back()) << contents.back();
+  }
+  for (auto uring : {true, false}) {
+    ImageDSBatchReader reader(uring ? 2 : 0, true);
+    CHECK(reader.direct());
+    std::vector<std::string> read_contents(paths.size());
+    // Pooled buffers are reused by the second batch
+    for (auto batch=0; batch<2; batch++) {
+      CHECK(!reader.read(paths, [&](size_t index, std::vector<char>& data) {
+            read_contents[index].assign(data.begin(), data.end());
+          }));
+      CHECK(read_contents == contents);
+    }
+  }
+
+  // Pages cached before the guard was created stay cached
+  ImageDSBatchReader reader(0);
+  CHECK(!reader.read(paths, [](size_t, std::vector<char>&) {}));
+  {
+    ImageDSPageCacheGuard guard(paths.back());
+    CHECK(guard.resident_pages() == 4);
+  }
+  ImageDSPageCacheGuard guard(paths.back());
+  CHECK(guard.resident_pages() == 4);
+  ImageDSPageCacheGuard missing(append_paths(get_temp_dir(), "missing"));
+  CHECK(missing.resident_pages() == 0);
+}
+
+TEST_CASE_METHOD(TempDir, "Test scan mode", "[scan_mode]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  std::vector<uint16_t> buffer = repeating_tiles();
+  std::unique_ptr<ImageDSArray> plain(define_2D_array("plain"));
+  CHECK(!imageds.to_array(*plain, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+  imageds.enable_tile_dedup();
+  std::unique_ptr<ImageDSArray> deduped(define_2D_array("deduped", GZIP));
+  CHECK(!imageds.to_array(*deduped, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+
+  // Scans read the same cells without populating the tile cache
+  imageds.enable_scan_mode();
+  for (auto io_uring : {false, true}) {
+    imageds.enable_io_uring(io_uring);
+    for (auto i=0; i<2; i++) {
+      imageds.reset_stats();
+      std::vector<uint16_t> read_buffer(buffer.size());
+      CHECK(!imageds.from_array(*deduped, {read_buffer.data()}, {read_buffer.size()*sizeof(uint16_t)}));
+      CHECK(read_buffer == buffer);
+      std::vector<uint16_t> roi(9);
+      CHECK(!imageds.from_array(*plain, {3, 5, 2, 4}, {roi.data()}, {roi.size()*sizeof(uint16_t)}));
+      CHECK(roi[4] == buffer[4*8+3]);
+      CHECK(imageds.stats().total().m_cache_hits == 0);
+    }
+  }
+
+  // Tiles cached by interactive reads are still served to scans
+  imageds.enable_scan_mode(false);
+  std::vector<uint16_t> read_buffer(buffer.size());
+  CHECK(!imageds.from_array(*deduped, {read_buffer.data()}, {read_buffer.size()*sizeof(uint16_t)}));
+  imageds.enable_scan_mode();
+  imageds.reset_stats();
+  CHECK(!imageds.from_array(*deduped, {read_buffer.data()}, {read_buffer.size()*sizeof(uint16_t)}));
+  CHECK(read_buffer == buffer);
+  CHECK(imageds.stats().total().m_cache_hits > 0);
+}
+
+TEST_CASE_METHOD(TempDir, "Test io_uring tile reads", "[io_uring]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  imageds.enable_tile_dedup();
+  ImageDSArray array("volume");
+  array.add_dimension("Z", 0, 15, 4);
+  array.add_dimension("Y", 0, 15, 4);
+  array.add_dimension("X", 0, 15, 4);
+  array.add_attribute("Intensity", UINT16, GZIP, 1);
+  std::vector<uint16_t> buffer(16*16*16);
+  std::mt19937 random(0);
+  for (auto& value : buffer) {
+    value = random();
+  }
+  CHECK(!imageds.to_array(array, {buffer.data()}, {buffer.size()*sizeof(uint16_t)}));
+
+  // Results match the default read path whether or not io_uring is available
+  imageds.set_tile_cache_capacity(0);
+  imageds.enable_io_uring();
+  imageds.reset_stats();
+  std::vector<uint16_t> read_buffer(buffer.size());
+  CHECK(!imageds.from_array(array, {read_buffer.data()}, {read_buffer.size()*sizeof(uint16_t)}));
+  CHECK(read_buffer == buffer);
+  ImageDSArrayStats stats = imageds.stats().m_arrays["volume"];
+  CHECK(stats.m_tiles_touched == 64);
+  CHECK(stats.m_bytes_decompressed == buffer.size()*sizeof(uint16_t));
+  CHECK(stats.m_bytes_read > 0);
+
+  std::vector<uint16_t> roi(3*5*7);
+  CHECK(!imageds.from_array(array, {2, 4, 3, 7, 1, 7}, {roi.data()}, {roi.size()*sizeof(uint16_t)}));
+  for (auto z=0; z<3; z++) {
+    for (auto y=0; y<5; y++) {
+      for (auto x=0; x<7; x++) {
+        CHECK(roi[(z*5+y)*7+x] == buffer[((z+2)*16+y+3)*16+x+1]);
+      }
+    }
+  }
+  std::vector<uint64_t> cell_offsets;
+  CHECK(!imageds.gather(array, {{2, 4, 3, 7, 1, 7}}, {read_buffer.data()}, {roi.size()*sizeof(uint16_t)},
+                        cell_offsets));
+  CHECK(std::equal(roi.begin(), roi.end(), read_buffer.begin()));
+}
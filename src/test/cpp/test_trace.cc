@@ -0,0 +1,129 @@
+/**
+ * @file test_trace.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for trace spans and their Chrome trace export
+ */
+
+
+#include "catch.h"
+#include "imageds.h"
+#include "test_base.h"
+#include "trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+static void write_and_read(ImageDS& imageds, const std::string& array_path) {
+  ImageDSArray array(array_path);
+  array.add_dimension("Y", 0, 7, 4);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  std::vector<uint16_t> values(64, 5);
+  REQUIRE(!imageds.to_array(array, {values.data()}, {values.size()*sizeof(uint16_t)}));
+  ImageDSArray schema;
+  REQUIRE(!imageds.array_info(array_path, schema));
+  std::vector<uint16_t> read(values.size());
+  REQUIRE(!imageds.from_array(array, {read.data()}, {read.size()*sizeof(uint16_t)}));
+}
+
+static size_t count(const std::string& json, const std::string& text) {
+  size_t found = 0;
+  for (auto pos = json.find(text); pos != std::string::npos; pos = json.find(text, pos+1)) {
+    found++;
+  }
+  return found;
+}
+
+TEST_CASE_METHOD(TempDir, "Test trace spans", "[trace]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  imageds_trace_enable(false);
+  imageds_trace_clear();
+  write_and_read(imageds, "untraced");
+  CHECK(count(imageds_trace_json(), "\"ph\": \"X\"") == 0);
+
+  imageds_trace_enable();
+  CHECK(imageds_trace_enabled());
+  uint64_t start = imageds_trace_now();
+  write_and_read(imageds, "traced");
+  uint64_t end = imageds_trace_now();
+  std::string json = imageds_trace_json();
+  CHECK(json.find("{\"traceEvents\": [") == 0);
+  CHECK(count(json, "\"name\": \"to_array\"") == 1);
+  CHECK(count(json, "\"name\": \"setup_tiledb_schema\"") == 1);
+  CHECK(count(json, "\"name\": \"array_info\"") == 1);
+  CHECK(count(json, "\"name\": \"from_array\"") == 1);
+  CHECK(count(json, "\"name\": \"tiledb_array_read\"") == 1);
+  CHECK(count(json, "\"name\": \"tiledb_array_write\"") == 1);
+  CHECK(count(json, "\"args\": {\"detail\": \"traced\"}") == 4);
+
+  // Spans of other threads are kept after the threads exit
+  std::thread worker([]() {
+      IMAGEDS_TRACE_SPAN("worker", "quoted \"detail\"");
+    });
+  worker.join();
+  json = imageds_trace_json();
+  CHECK(count(json, "\"name\": \"worker\"") == 1);
+  CHECK(count(json, "\"detail\": \"quoted \\\"detail\\\"\"") == 1);
+
+  // Time windows
+  CHECK(count(imageds_trace_json(start, end), "\"name\": \"to_array\"") == 1);
+  CHECK(count(imageds_trace_json(end+1000000), "\"ph\": \"X\"") == 0);
+  // The trace clock starts at its first use, spans may start in the same microsecond
+  if (start > 0) {
+    CHECK(count(imageds_trace_json(0, start-1), "\"name\": \"to_array\"") == 0);
+  }
+
+  std::string filename = append_paths(get_temp_dir(), "trace.json");
+  CHECK(!imageds_trace_dump(filename, start, end));
+  std::ifstream file(filename);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  CHECK(contents.str() == imageds_trace_json(start, end));
+
+  imageds_trace_clear();
+  CHECK(count(imageds_trace_json(), "\"ph\": \"X\"") == 0);
+  imageds_trace_enable(false);
+  CHECK(!imageds_trace_enabled());
+}
+
+TEST_CASE_METHOD(TempDir, "Test trace spans of tile store reads", "[trace]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  imageds.enable_tile_dedup();
+  imageds_trace_enable();
+  imageds_trace_clear();
+  write_and_read(imageds, "deduped");
+  std::string json = imageds_trace_json();
+  CHECK(count(json, "\"name\": \"to_tile_store\"") == 1);
+  CHECK(count(json, "\"name\": \"from_tile_store\"") == 1);
+  // Four 4x4 tiles of the same content, stored and read from the store once
+  CHECK(count(json, "\"name\": \"tile_store_write\"") == 1);
+  CHECK(count(json, "\"name\": \"copy_region\"") == 4);
+  imageds_trace_enable(false);
+}
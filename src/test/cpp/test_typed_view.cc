@@ -0,0 +1,157 @@
+/**
+ * @file test_typed_view.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2019 Nalini Ganapati
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION Tests for typed_view.h
+ */
+
+
+#include "catch.h"
+#include "imageds.h"
+#include "test_base.h"
+#include "typed_view.h"
+
+const std::string WORKSPACE = "imageds_test_ws";
+
+TEST_CASE("Test ImageDSView", "[typed_view]") {
+  std::vector<uint16_t> cells(2*3*4);
+  for (auto i=0ul; i<cells.size(); i++) {
+    cells[i] = i;
+  }
+  ImageDSView<uint16_t, 3> view(cells.data(), {{2, 3, 4}});
+  CHECK(view.size() == 24);
+  CHECK(view.contiguous());
+  CHECK(view.stride(0) == 12);
+  CHECK(view.stride(1) == 4);
+  CHECK(view.stride(2) == 1);
+  CHECK(view(1, 2, 3) == 23);
+  CHECK(view[{{1, 0, 2}}] == 14);
+  view(0, 1, 1) = 100;
+  CHECK(cells[5] == 100);
+
+  ImageDSView<const uint16_t, 3> const_view = view;
+  CHECK(const_view(0, 1, 1) == 100);
+
+  ImageDSView<uint16_t, 3> box = view.box({{1, 1, 1}}, {{1, 2, 2}});
+  CHECK(box.extents() == std::array<uint64_t, 3>({{1, 2, 2}}));
+  CHECK(!box.contiguous());
+  CHECK(box(0, 0, 0) == 17);
+  CHECK(box(0, 1, 1) == 22);
+
+  ImageDSView<uint16_t, 2> slice = view.slice<1>(2);
+  CHECK(slice.extents() == std::array<uint64_t, 2>({{2, 4}}));
+  CHECK(slice(0, 0) == 8);
+  CHECK(slice(1, 3) == 23);
+  ImageDSView<uint16_t, 1> row = view.slice<0>(1).slice<0>(1);
+  CHECK(row.contiguous());
+  CHECK(row(2) == 18);
+
+  ImageDSView<uint16_t, 3> flipped = view.flip<2>();
+  CHECK(flipped(0, 0, 0) == 3);
+  CHECK(flipped(1, 2, 3) == 20);
+  CHECK(flipped.flip<2>()(1, 2, 3) == 23);
+}
+
+template<typename T>
+struct SumKernel {
+  static int run(const void *data, size_t n, double& sum) {
+    const T *cells = static_cast<const T *>(data);
+    sum = 0;
+    for (auto i=0ul; i<n; i++) {
+      sum += cells[i];
+    }
+    return IMAGEDS_OK;
+  }
+};
+
+TEST_CASE("Test imageds_dispatch", "[typed_view]") {
+  CHECK(imageds_attr_type<uint16_t>::value == UINT16);
+  CHECK(imageds_attr_type<const float>::value == FLOAT32);
+  CHECK(imageds_attr_type<int8_t>::value == INT8);
+  CHECK(imageds_attr_type<char>::value == CHAR);
+
+  double sum = 0;
+  std::vector<int16_t> shorts = {-1, 2, -3};
+  CHECK(!imageds_dispatch<SumKernel>(INT16, shorts.data(), shorts.size(), sum));
+  CHECK(sum == -2);
+  std::vector<double> doubles = {0.5, 0.25};
+  CHECK(!imageds_dispatch<SumKernel>(FLOAT64, doubles.data(), doubles.size(), sum));
+  CHECK(sum == 0.75);
+  CHECK(imageds_dispatch<SumKernel>(static_cast<attr_type_t>(100), doubles.data(), doubles.size(), sum));
+  CHECK(errno == EINVAL);
+}
+
+TEST_CASE_METHOD(TempDir, "Test ImageDSReader", "[typed_reader]") {
+  ImageDS imageds(append_paths(get_temp_dir(), WORKSPACE));
+  ImageDSArray array("volume");
+  array.add_dimension("Z", 0, 5, 2);
+  array.add_dimension("Y", 0, 6, 3);
+  array.add_dimension("X", 0, 7, 4);
+  array.add_attribute("Intensity", UINT16);
+  array.add_attribute("Density", FLOAT32);
+  std::vector<uint16_t> intensities(6*7*8);
+  std::vector<float> densities(intensities.size());
+  for (auto i=0ul; i<intensities.size(); i++) {
+    intensities[i] = i;
+    densities[i] = i*0.5f;
+  }
+  REQUIRE(!imageds.to_array(array, {intensities.data(), densities.data()},
+                            {intensities.size()*sizeof(uint16_t), densities.size()*sizeof(float)}));
+
+  ImageDSReader<uint16_t, 3> reader(imageds, "volume", "Intensity");
+  CHECK(reader.attribute() == "Intensity");
+  CHECK(reader.domain() == std::array<uint64_t, 6>({{0, 5, 0, 6, 0, 7}}));
+  std::vector<uint16_t> cells;
+  ImageDSView<uint16_t, 3> view;
+  CHECK(!reader.read({{1, 4, 2, 5, 3, 3}}, cells, view));
+  CHECK(cells.size() == 16);
+  CHECK(view.extents() == std::array<uint64_t, 3>({{4, 4, 1}}));
+  for (uint64_t z=0; z<4; z++) {
+    for (uint64_t y=0; y<4; y++) {
+      CHECK(view(z, y, 0) == ((z+1)*7+y+2)*8+3);
+    }
+  }
+  CHECK(!reader.read(reader.domain(), cells, view));
+  CHECK(cells == intensities);
+
+  // Views have to match the subarray and be contiguous
+  CHECK(reader.read({{0, 1, 0, 0, 0, 0}}, view.box({{0, 0, 0}}, {{0, 1, 0}})) == IMAGEDS_ERR);
+  CHECK(errno == EINVAL);
+  CHECK(reader.read({{0, 0, 0, 1, 0, 7}}, view.box({{0, 0, 0}}, {{0, 1, 7}})) == IMAGEDS_OK);
+
+  ImageDSReader<float, 3> density_reader(imageds, "volume", "Density");
+  std::vector<float> density_cells;
+  ImageDSView<float, 3> density_view;
+  CHECK(!density_reader.read({{5, 5, 6, 6, 7, 7}}, density_cells, density_view));
+  CHECK(density_view(0, 0, 0) == 167.5f);
+
+  // Types and dimensions are checked against the schema
+  CHECK_THROWS_AS((ImageDSReader<uint8_t, 3>(imageds, "volume", "Intensity")), ImageDSException);
+  CHECK_THROWS_AS((ImageDSReader<uint16_t, 2>(imageds, "volume", "Intensity")), ImageDSException);
+  CHECK_THROWS_AS((ImageDSReader<uint16_t, 3>(imageds, "volume")), ImageDSException);
+  CHECK_THROWS_AS((ImageDSReader<uint16_t, 3>(imageds, "volume", "Missing")), ImageDSException);
+  CHECK_THROWS_AS((ImageDSReader<uint16_t, 3>(imageds, "missing")), ImageDSException);
+}